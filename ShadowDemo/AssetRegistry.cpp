@@ -0,0 +1,15 @@
+#include "AssetRegistry.h"
+#include <algorithm>
+#include <cctype>
+#include "ModelCache.h"
+
+std::string CanonicalAssetPath(const std::string& path)
+{
+	std::string canonical = ModelCache::FullPath(path);
+#ifdef _WIN32
+	std::replace(canonical.begin(), canonical.end(), '/', '\\');
+	std::transform(canonical.begin(), canonical.end(), canonical.begin(),
+		[](char c) { return (char)std::tolower((unsigned char)c); });
+#endif
+	return canonical;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+//Key of an asset: its full path, with the separators and, on Windows, the case made the
+//same, so that every spelling of one file gives one key.
+std::string CanonicalAssetPath(const std::string& path);
+
+//Keeps one copy of every asset still referenced, keyed by canonical path.  Acquire()
+//hands out shared handles: the first Acquire() of a path loads it, the others share
+//that copy, and the last handle to go frees it.  Memory and load time follow the assets
+//in use rather than the references to them.
+//Acquire() may be called from any thread; an Acquire() of a path being loaded waits for
+//that load instead of starting its own.
+template<class T>
+class AssetRegistry
+{
+public:
+	typedef std::shared_ptr<T> Handle;
+	//Loads the asset at a canonical path; a null handle means the load failed.
+	typedef std::function<Handle(const std::string& canonicalPath)> LoadFunc;
+
+	AssetRegistry() = default;
+	AssetRegistry(const AssetRegistry& rhs) = delete;
+	AssetRegistry& operator=(const AssetRegistry& rhs) = delete;
+
+	//Handle to the asset at path, loaded by load when nobody holds it.  A failed load is
+	//not kept, so the next Acquire() tries again.
+	Handle Acquire(const std::string& path, const LoadFunc& load)
+	{
+		const std::string key = CanonicalAssetPath(path);
+		std::promise<Handle> loaded;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			auto found = m_assets.find(key);
+			if (found != m_assets.end())
+			{
+				if (Handle asset = found->second.lock())
+				{
+					++m_shareCount;
+					return asset;
+				}
+			}
+
+			auto loading = m_loading.find(key);
+			if (loading != m_loading.end())
+			{
+				std::shared_future<Handle> pending = loading->second;
+				lock.unlock();
+				Handle asset = pending.get();
+				if (asset)
+				{
+					std::lock_guard<std::mutex> relock(m_lock);
+					++m_shareCount;
+				}
+				return asset;
+			}
+			m_loading.emplace(key, loaded.get_future().share());
+		}
+
+		//loaded outside of the lock, so that other paths load meanwhile
+		Handle asset;
+		try
+		{
+			asset = load(key);
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_loading.erase(key);
+			}
+			loaded.set_exception(std::current_exception());
+			throw;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_loading.erase(key);
+			if (asset)
+			{
+				m_assets[key] = asset;
+				++m_loadCount;
+			}
+			else
+				m_assets.erase(key);
+		}
+		loaded.set_value(asset);
+		return asset;
+	}
+
+	//Handle to the asset at path if somebody holds it, or null.
+	Handle Find(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		auto found = m_assets.find(CanonicalAssetPath(path));
+		return found != m_assets.end() ? found->second.lock() : nullptr;
+	}
+
+	//Assets held by at least one handle.
+	int Count()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		int count = 0;
+		for (auto it = m_assets.begin(); it != m_assets.end();)
+		{
+			if (it->second.expired())
+				it = m_assets.erase(it);
+			else
+			{
+				++count;
+				++it;
+			}
+		}
+		return count;
+	}
+
+	//Totals since construction: Acquire() calls that loaded, and that shared a copy.
+	int LoadCount()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_loadCount;
+	}
+
+	int ShareCount()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_shareCount;
+	}
+
+private:
+	std::mutex m_lock;
+	std::unordered_map<std::string, std::weak_ptr<T>> m_assets;		//freed ones are dropped by Count()
+	std::unordered_map<std::string, std::shared_future<Handle>> m_loading;
+	int m_loadCount = 0;
+	int m_shareCount = 0;
+};
@@ -0,0 +1,907 @@
+//***************************************************************************************
+// ModelBenchmark.cpp
+//
+// Headless benchmark and check for the model loading path.  Like TerrainBenchmark it
+// does not touch D3D12 or Assimp and builds on Linux as well as Windows, e.g.
+//
+//   g++ -std=c++14 -O2 -march=native -I<DirectXMath>/Inc -I.. ModelBenchmark.cpp
+//       ../ModelCache.cpp ../MappedFile.cpp ../ModelVertexStreams.cpp ../MeshSimplifier.cpp
+//       -o ModelBenchmark
+//
+// Usage: ModelBenchmark [options]
+//   -vertices a,b,...  vertices per model or mesh       (10000,100000,1000000)
+//   -meshes N          meshes per model                 (4)
+//   -seed N            seed of the meshes               (1)
+//   -temp path         scratch file for the cache runs  (ModelBenchmark.tmp)
+//
+// The cache runs bake a random model of every size with ModelCache, in the layout of
+// ModelImporter::ModelVertex, then time what a cache hit costs ModelImporter: hashing
+// the source file, mapping and fixing up the cache, and copying the arrays into its
+// meshes.  The source stands in as a file the size of the vertices.  Everything read
+// back must equal what was baked.  Then every part of the key, a wrong version, a
+// truncated file and a reference out of its array must each make Open fail.
+//
+// The conversion runs turn models of Assimp-like meshes, one array per attribute and
+// a heap array of indices per face, into ModelImporter's meshes twice: the way
+// ProcessMesh used to, a push_back at a time with every face copied and the result
+// copied on into the importer and the model, and through InterleaveModelVertices and
+// CopyFaceIndices with the buffers moved along.  Both must give the same meshes, and
+// the second must stay within a fixed number of allocations per mesh, whatever its size.
+// Allocations are counted by replacing the global operator new.
+//
+// The LOD runs build chains with BuildMeshLods for a UV sphere, with a texture seam and
+// its poles, and for a wavy open grid, in the layout of ModelImporter::ModelVertex.  Every
+// level must index the shared vertices, have no degenerate triangle, fewer triangles than
+// the level before and an error within its target.  Every vertex of the full mesh must be
+// within the level's target of the level's triangles, measured by brute force, and within
+// the error the level reports.  The sphere must stay closed, without a crack along the
+// seam; the grid must keep its outline.
+// SelectMeshLod must go coarser with the distance, never finer.
+//***************************************************************************************
+
+#include "../ModelCache.h"
+#include "../ModelVertexStreams.h"
+#include "../MeshSimplifier.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+// Counts every allocation of the program; only read around the conversion runs.
+static size_t g_allocations = 0;
+
+void* operator new(size_t size)
+{
+	++g_allocations;
+	if(void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+namespace
+{
+	// The layout of ModelImporter::ModelVertex, which needs Assimp and D3D12 headers.
+	struct BakeVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT3 Normal;
+		XMFLOAT2 TexC;
+		XMFLOAT3 TangentU;
+	};
+
+	struct Options
+	{
+		std::vector<int> Vertices = { 10000, 100000, 1000000 };
+		int Meshes = 4;
+		unsigned Seed = 1;
+		std::string Temp = "ModelBenchmark.tmp";
+	};
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		const char* p = text;
+		while(*p)
+		{
+			char* end = nullptr;
+			long value = strtol(p, &end, 10);
+			if(end == p)
+				break;
+
+			values.push_back((int)value);
+			p = *end == ',' ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options& options)
+	{
+		if(argc % 2 == 0)
+			return false;
+
+		for(int i = 1; i + 1 < argc; i += 2)
+		{
+			if(strcmp(argv[i], "-vertices") == 0)
+				options.Vertices = ParseList(argv[i + 1]);
+			else if(strcmp(argv[i], "-meshes") == 0)
+				options.Meshes = atoi(argv[i + 1]);
+			else if(strcmp(argv[i], "-seed") == 0)
+				options.Seed = (unsigned)strtoul(argv[i + 1], nullptr, 10);
+			else if(strcmp(argv[i], "-temp") == 0)
+				options.Temp = argv[i + 1];
+			else
+				return false;
+		}
+
+		for(int vertices : options.Vertices)
+		{
+			if(vertices < 3)
+				return false;
+		}
+		return options.Meshes >= 1;
+	}
+
+	// A model as ModelImporter holds it: vertices, triangle indices and a material per mesh.
+	struct TestMesh
+	{
+		std::vector<BakeVertex> Vertices;
+		std::vector<std::uint32_t> Indices;
+		std::string DiffuseMapName;
+		std::string NormalMapName;
+		float Roughness;
+	};
+
+	std::vector<TestMesh> MakeModel(int vertexCount, int meshCount, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<TestMesh> model(meshCount);
+		for(int m = 0; m < meshCount; ++m)
+		{
+			TestMesh& mesh = model[m];
+			int vertices = std::max(3, vertexCount / meshCount);
+			mesh.Vertices.resize(vertices);
+			for(BakeVertex& v : mesh.Vertices)
+			{
+				v.Pos = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+				v.Normal = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+				v.TexC = XMFLOAT2(unit(rng), unit(rng));
+				v.TangentU = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+			}
+			std::uniform_int_distribution<std::uint32_t> index(0, vertices - 1);
+			mesh.Indices.resize((size_t)vertices * 2 * 3);
+			for(std::uint32_t& i : mesh.Indices)
+				i = index(rng);
+			mesh.DiffuseMapName = "Tex_" + std::to_string(m) + ".dds";
+			// every other mesh without a normal map, like the demo's models
+			if(m % 2)
+				mesh.NormalMapName = "Tex_" + std::to_string(m) + "_nrm.dds";
+			mesh.Roughness = 0.25f * (m % 4);
+		}
+		return model;
+	}
+
+	std::vector<ModelCache::MeshData> MeshData(const std::vector<TestMesh>& model)
+	{
+		std::vector<ModelCache::MeshData> meshes(model.size());
+		for(size_t m = 0; m < model.size(); ++m)
+		{
+			meshes[m].Vertices = model[m].Vertices.data();
+			meshes[m].VertexCount = (std::uint32_t)model[m].Vertices.size();
+			meshes[m].Indices = model[m].Indices.data();
+			meshes[m].IndexCount = (std::uint32_t)model[m].Indices.size();
+			meshes[m].DiffuseMapName = model[m].DiffuseMapName;
+			meshes[m].NormalMapName = model[m].NormalMapName;
+			meshes[m].Roughness = model[m].Roughness;
+		}
+		return meshes;
+	}
+
+	bool WriteFile(const std::string& path, const std::vector<unsigned char>& bytes)
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write((const char*)bytes.data(), bytes.size());
+		return file.good();
+	}
+
+	std::vector<unsigned char> ReadFile(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	// What ModelImporter does on a hit: the arrays are copied into its meshes whole.
+	void CopyMeshes(const ModelCache& cache, std::vector<TestMesh>& model)
+	{
+		model.resize(cache.MeshCount());
+		for(int m = 0; m < cache.MeshCount(); ++m)
+		{
+			const ModelCache::Mesh& mesh = cache.GetMesh(m);
+			const BakeVertex* vertices = static_cast<const BakeVertex*>(mesh.Vertices.Pointer);
+			model[m].Vertices.assign(vertices, vertices + mesh.VertexCount);
+			model[m].Indices.assign(mesh.Indices.Pointer, mesh.Indices.Pointer + mesh.IndexCount);
+			model[m].DiffuseMapName = mesh.DiffuseMapName.Pointer;
+			model[m].NormalMapName = mesh.NormalMapName.Pointer;
+			model[m].Roughness = mesh.Roughness;
+		}
+	}
+
+	bool SameModel(const std::vector<TestMesh>& a, const std::vector<TestMesh>& b)
+	{
+		if(a.size() != b.size())
+			return false;
+		for(size_t m = 0; m < a.size(); ++m)
+		{
+			if(a[m].Vertices.size() != b[m].Vertices.size() || a[m].Indices != b[m].Indices ||
+				a[m].DiffuseMapName != b[m].DiffuseMapName || a[m].NormalMapName != b[m].NormalMapName ||
+				a[m].Roughness != b[m].Roughness ||
+				memcmp(a[m].Vertices.data(), b[m].Vertices.data(), a[m].Vertices.size()*sizeof(BakeVertex)) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	// aiVector3D and aiFace as Assimp keeps them: a face owns its index array and
+	// copying it copies the array.
+	struct SourceVector
+	{
+		float x, y, z;
+	};
+
+	struct SourceFace
+	{
+		unsigned int mNumIndices = 0;
+		unsigned int* mIndices = nullptr;
+
+		SourceFace() = default;
+		SourceFace(const SourceFace& rhs) : mNumIndices(rhs.mNumIndices), mIndices(new unsigned int[rhs.mNumIndices])
+		{
+			memcpy(mIndices, rhs.mIndices, mNumIndices * sizeof(unsigned int));
+		}
+		SourceFace& operator=(const SourceFace& rhs) = delete;
+		~SourceFace()
+		{
+			delete[] mIndices;
+		}
+	};
+
+	struct SourceMesh
+	{
+		std::vector<SourceVector> Positions;
+		std::vector<SourceVector> Normals;
+		std::vector<SourceVector> TexCoords;
+		std::vector<SourceVector> Tangents;
+		std::vector<SourceFace> Faces;
+	};
+
+	// ModelImporter::ModelMaterial and ModelMesh.
+	struct Material
+	{
+		std::string Name;
+		std::string DiffuseMapName;
+	};
+
+	struct Mesh
+	{
+		std::vector<BakeVertex> Vertices;
+		std::vector<std::uint32_t> Indices;
+		Material Mat;
+
+		Mesh() = default;
+		// the old ModelMesh constructor: arguments by value, then copied again
+		Mesh(std::vector<BakeVertex> vertices, std::vector<std::uint32_t> indices, Material material, bool)
+		{
+			Vertices = vertices;
+			Indices = indices;
+			Mat = material;
+		}
+	};
+
+	std::vector<SourceMesh> MakeSourceModel(int vertexCount, int meshCount, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<SourceMesh> model(meshCount);
+		for(SourceMesh& mesh : model)
+		{
+			for(std::vector<SourceVector>* stream : { &mesh.Positions, &mesh.Normals, &mesh.TexCoords, &mesh.Tangents })
+			{
+				stream->resize(vertexCount);
+				for(SourceVector& v : *stream)
+					v = SourceVector{ unit(rng), unit(rng), unit(rng) };
+			}
+			std::uniform_int_distribution<unsigned int> index(0, vertexCount - 1);
+			mesh.Faces.resize(vertexCount * 2);
+			for(SourceFace& face : mesh.Faces)
+			{
+				face.mNumIndices = 3;
+				face.mIndices = new unsigned int[3];
+				for(unsigned int j = 0; j < 3; ++j)
+					face.mIndices[j] = index(rng);
+			}
+		}
+		return model;
+	}
+
+	Material MeshMaterial(size_t m)
+	{
+		return Material{ "model" + std::to_string(m), "..\\Models\\model\\Tex_Model_" + std::to_string(m) + ".dds" };
+	}
+
+	// ProcessNode, ProcessMesh and Model as they were.
+	std::vector<Mesh> ConvertOld(const std::vector<SourceMesh>& model)
+	{
+		std::vector<Mesh> importerMeshes;
+		for(size_t m = 0; m < model.size(); ++m)
+		{
+			const SourceMesh& source = model[m];
+			std::vector<BakeVertex> vertices;
+			std::vector<std::uint32_t> indices;
+			for(size_t i = 0; i < source.Positions.size(); ++i)
+			{
+				BakeVertex vertex;
+				vertex.Pos = XMFLOAT3(source.Positions[i].x, source.Positions[i].y, source.Positions[i].z);
+				vertex.Normal = XMFLOAT3(source.Normals[i].x, source.Normals[i].y, source.Normals[i].z);
+				vertex.TexC = XMFLOAT2(source.TexCoords[i].x, source.TexCoords[i].y);
+				vertex.TangentU = XMFLOAT3(source.Tangents[i].x, source.Tangents[i].y, source.Tangents[i].z);
+				vertices.push_back(vertex);
+			}
+			for(size_t i = 0; i < source.Faces.size(); ++i)
+			{
+				SourceFace face = source.Faces[i];
+				for(unsigned int j = 0; j < face.mNumIndices; ++j)
+					indices.push_back(face.mIndices[j]);
+			}
+			importerMeshes.push_back(Mesh(vertices, indices, MeshMaterial(m), true));
+		}
+		std::vector<Mesh> modelMeshes = importerMeshes;
+		return modelMeshes;
+	}
+
+	// ProcessNode, ProcessMesh and Model now.
+	std::vector<Mesh> ConvertNew(const std::vector<SourceMesh>& model)
+	{
+		std::vector<Mesh> importerMeshes;
+		importerMeshes.reserve(model.size());
+		for(size_t m = 0; m < model.size(); ++m)
+		{
+			const SourceMesh& source = model[m];
+			Mesh mesh;
+			mesh.Vertices.resize(source.Positions.size());
+			InterleaveModelVertices(&source.Positions[0].x, &source.Normals[0].x, &source.TexCoords[0].x,
+				&source.Tangents[0].x, source.Positions.size(), &mesh.Vertices[0].Pos.x);
+			mesh.Indices.resize(CountFaceIndices(source.Faces.data(), source.Faces.size()));
+			CopyFaceIndices(source.Faces.data(), source.Faces.size(), mesh.Indices.data());
+			mesh.Mat = MeshMaterial(m);
+			importerMeshes.push_back(std::move(mesh));
+		}
+		std::vector<Mesh> modelMeshes = std::move(importerMeshes);
+		return modelMeshes;
+	}
+
+	bool SameMeshes(const std::vector<Mesh>& a, const std::vector<Mesh>& b)
+	{
+		if(a.size() != b.size())
+			return false;
+		for(size_t m = 0; m < a.size(); ++m)
+		{
+			if(a[m].Vertices.size() != b[m].Vertices.size() || a[m].Indices != b[m].Indices ||
+				a[m].Mat.Name != b[m].Mat.Name || a[m].Mat.DiffuseMapName != b[m].Mat.DiffuseMapName ||
+				memcmp(a[m].Vertices.data(), b[m].Vertices.data(), a[m].Vertices.size()*sizeof(BakeVertex)) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	// Missing streams must come out as zeros, and the scalar tail must agree with the
+	// vector loop, for every count around the tail.
+	bool CheckMissingStreams()
+	{
+		for(size_t count = 1; count <= 6; ++count)
+		{
+			std::vector<float> positions(count * 3);
+			for(size_t i = 0; i < positions.size(); ++i)
+				positions[i] = (float)i + 1.0f;
+			std::vector<float> vertices(count * 11, -1.0f);
+			InterleaveModelVertices(positions.data(), nullptr, nullptr, nullptr, count, vertices.data());
+			for(size_t i = 0; i < count; ++i)
+			{
+				for(int k = 0; k < 11; ++k)
+				{
+					float expected = k < 3 ? positions[i * 3 + k] : 0.0f;
+					if(vertices[i * 11 + k] != expected)
+						return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// A mesh to build LODs of, and the properties its levels must keep.
+	struct LodMesh
+	{
+		const char* Name;
+		std::vector<BakeVertex> Vertices;
+		std::vector<std::uint32_t> Indices;
+		float Radius;
+		bool Closed;
+	};
+
+	// A UV sphere of unit radius as GeometryGenerator builds one: a column of vertices
+	// twice over at the seam and a vertex per column at the poles, so seam and pole
+	// vertices share positions with different texture coordinates.
+	LodMesh MakeSphere(int rings, int segments)
+	{
+		// half the diagonal of its bounds, the radius BuildMeshLods measures errors by
+		LodMesh mesh = { "sphere", {}, {}, sqrtf(3.0f), true };
+		for(int r = 0; r <= rings; ++r)
+		{
+			float phi = XM_PI * r / rings;
+			for(int c = 0; c <= segments; ++c)
+			{
+				// the seam column repeats the first one exactly, as do the pole rows
+				float theta = c == segments ? 0.0f : XM_2PI * c / segments;
+				BakeVertex v = {};
+				v.Pos = r == 0 ? XMFLOAT3(0.0f, 1.0f, 0.0f) : r == rings ? XMFLOAT3(0.0f, -1.0f, 0.0f) :
+					XMFLOAT3(sinf(phi) * cosf(theta), cosf(phi), sinf(phi) * sinf(theta));
+				v.Normal = v.Pos;
+				v.TexC = XMFLOAT2((float)c / segments, (float)r / rings);
+				mesh.Vertices.push_back(v);
+			}
+		}
+		const std::uint32_t row = segments + 1;
+		for(int r = 0; r < rings; ++r)
+		{
+			for(int c = 0; c < segments; ++c)
+			{
+				std::uint32_t a = r * row + c, b = a + 1, d = a + row, e = d + 1;
+				if(r != 0)
+					mesh.Indices.insert(mesh.Indices.end(), { a, b, d });
+				if(r != rings - 1)
+					mesh.Indices.insert(mesh.Indices.end(), { b, e, d });
+			}
+		}
+		return mesh;
+	}
+
+	// An n by n grid over the unit square with gentle waves, open at its four borders.
+	LodMesh MakeGrid(int n)
+	{
+		LodMesh mesh = { "grid", {}, {}, 0.0f, false };
+		for(int y = 0; y < n; ++y)
+		{
+			for(int x = 0; x < n; ++x)
+			{
+				float u = (float)x / (n - 1), v = (float)y / (n - 1);
+				BakeVertex vertex = {};
+				vertex.Pos = XMFLOAT3(u, 0.02f * sinf(3.0f * XM_PI * u) * sinf(2.0f * XM_PI * v), v);
+				vertex.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+				vertex.TexC = XMFLOAT2(u, v);
+				mesh.Vertices.push_back(vertex);
+			}
+		}
+		for(int y = 0; y + 1 < n; ++y)
+		{
+			for(int x = 0; x + 1 < n; ++x)
+			{
+				std::uint32_t a = y * n + x, b = a + 1, d = a + n, e = d + 1;
+				mesh.Indices.insert(mesh.Indices.end(), { a, d, b, b, d, e });
+			}
+		}
+		mesh.Radius = 0.5f * sqrtf(2.0f + 0.04f * 0.04f);
+		return mesh;
+	}
+
+	// Undirected edges between positions, with the triangles on each.
+	typedef std::map<std::pair<std::vector<float>, std::vector<float>>, int> EdgeCounts;
+
+	EdgeCounts CountEdges(const LodMesh& mesh, const MeshLod& lod)
+	{
+		EdgeCounts edges;
+		auto position = [&](std::uint32_t i)
+		{
+			const XMFLOAT3& p = mesh.Vertices[i].Pos;
+			return std::vector<float>{ p.x, p.y, p.z };
+		};
+		for(std::uint32_t t = lod.StartIndex; t < lod.StartIndex + lod.IndexCount; t += 3)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				std::vector<float> a = position(mesh.Indices[t + k]), b = position(mesh.Indices[t + (k + 1) % 3]);
+				++edges[a < b ? std::make_pair(a, b) : std::make_pair(b, a)];
+			}
+		}
+		return edges;
+	}
+
+	// Length of the edges on a single triangle.
+	float BorderLength(const EdgeCounts& edges)
+	{
+		float length = 0.0f;
+		for(const auto& edge : edges)
+		{
+			if(edge.second == 1)
+			{
+				const std::vector<float>& a = edge.first.first;
+				const std::vector<float>& b = edge.first.second;
+				length += sqrtf((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+			}
+		}
+		return length;
+	}
+
+	// Squared distance of p from the triangle abc, after Ericson, "Real-Time Collision
+	// Detection", 5.1.5; written out again so the check does not share the simplifier's.
+	double TriangleDistanceSq(const XMFLOAT3& pf, const XMFLOAT3& af, const XMFLOAT3& bf, const XMFLOAT3& cf)
+	{
+		const double p[3] = { pf.x, pf.y, pf.z }, a[3] = { af.x, af.y, af.z };
+		const double b[3] = { bf.x, bf.y, bf.z }, c[3] = { cf.x, cf.y, cf.z };
+		auto dot = [](const double* u, const double* v) { return u[0] * v[0] + u[1] * v[1] + u[2] * v[2]; };
+		double ab[3], ac[3], ap[3], bp[3], cp[3];
+		for(int k = 0; k < 3; ++k)
+		{
+			ab[k] = b[k] - a[k];
+			ac[k] = c[k] - a[k];
+			ap[k] = p[k] - a[k];
+			bp[k] = p[k] - b[k];
+			cp[k] = p[k] - c[k];
+		}
+		const double d1 = dot(ab, ap), d2 = dot(ac, ap), d3 = dot(ab, bp), d4 = dot(ac, bp);
+		const double d5 = dot(ab, cp), d6 = dot(ac, cp);
+		const double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+		// the closest point as a + v ab + w ac
+		double v, w;
+		if(d1 <= 0.0 && d2 <= 0.0)
+			v = 0.0, w = 0.0;
+		else if(d3 >= 0.0 && d4 <= d3)
+			v = 1.0, w = 0.0;
+		else if(d6 >= 0.0 && d5 <= d6)
+			v = 0.0, w = 1.0;
+		else if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+			v = d1 / (d1 - d3), w = 0.0;
+		else if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+			v = 0.0, w = d2 / (d2 - d6);
+		else if(va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+			w = (d4 - d3) / ((d4 - d3) + (d5 - d6)), v = 1.0 - w;
+		else
+			v = vb / (va + vb + vc), w = vc / (va + vb + vc);
+		double d[3];
+		for(int k = 0; k < 3; ++k)
+			d[k] = ap[k] - v * ab[k] - w * ac[k];
+		return dot(d, d);
+	}
+
+	// Largest distance of a vertex of the full mesh from the level's triangles, by brute
+	// force over all of them.
+	float LevelDeviation(const LodMesh& mesh, const MeshLod& lod)
+	{
+		double deviation = 0.0;
+		for(const BakeVertex& vertex : mesh.Vertices)
+		{
+			double nearest = 1e30;
+			for(std::uint32_t t = lod.StartIndex; t < lod.StartIndex + lod.IndexCount && nearest > deviation; t += 3)
+			{
+				nearest = std::min(nearest, TriangleDistanceSq(vertex.Pos, mesh.Vertices[mesh.Indices[t]].Pos,
+					mesh.Vertices[mesh.Indices[t + 1]].Pos, mesh.Vertices[mesh.Indices[t + 2]].Pos));
+			}
+			deviation = std::max(deviation, nearest);
+		}
+		return (float)sqrt(deviation);
+	}
+
+	// Every level in range, without degenerate triangles, coarser than the one before and
+	// within the error target it was built for.
+	bool CheckLevels(const LodMesh& mesh, const std::vector<MeshLod>& lods, const MeshLodDesc& desc,
+		size_t originalIndices)
+	{
+		if(lods.empty() || lods[0].StartIndex != 0 || lods[0].IndexCount != originalIndices || lods[0].Target != -1)
+			return false;
+		for(size_t l = 0; l < lods.size(); ++l)
+		{
+			const MeshLod& lod = lods[l];
+			if(lod.IndexCount == 0 || lod.IndexCount % 3 != 0 || lod.StartIndex + lod.IndexCount > mesh.Indices.size())
+				return false;
+			// the targets of the kept levels grow, a dropped one is skipped; the slack covers
+			// BuildMeshLods measuring the radius in double
+			if(l > 0 && (lod.Target <= lods[l - 1].Target || lod.Target >= (int)desc.Errors.size() ||
+				lod.IndexCount > lods[l - 1].IndexCount * desc.MaxTriangleRatio || lod.Error < lods[l - 1].Error ||
+				lod.Error > desc.Errors[lod.Target] * mesh.Radius * 1.00001f))
+				return false;
+
+			for(std::uint32_t t = lod.StartIndex; t < lod.StartIndex + lod.IndexCount; t += 3)
+			{
+				const std::uint32_t* tri = &mesh.Indices[t];
+				if(tri[0] >= mesh.Vertices.size() || tri[1] >= mesh.Vertices.size() || tri[2] >= mesh.Vertices.size())
+					return false;
+				const XMFLOAT3& a = mesh.Vertices[tri[0]].Pos;
+				const XMFLOAT3& b = mesh.Vertices[tri[1]].Pos;
+				const XMFLOAT3& c = mesh.Vertices[tri[2]].Pos;
+				float u[3] = { b.x - a.x, b.y - a.y, b.z - a.z }, v[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+				float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+				if(n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	double Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: ModelBenchmark [-vertices a,b,..] [-meshes N] [-seed N] [-temp path]\n");
+		return 1;
+	}
+
+	bool passed = true;
+	const std::string cachePath = options.Temp;
+	const std::string sourcePath = options.Temp + ".source";
+
+	//
+	// Cache hits: bake once, then time a hit the way ModelImporter takes it.
+	//
+	printf("Model cache, %d meshes per model, seed %u\n", options.Meshes, options.Seed);
+	printf("%10s %10s %10s %10s %10s %10s %10s %10s\n", "vertices", "MB", "bake (ms)", "hash (ms)",
+		"open (ms)", "copy (ms)", "hit (ms)", "match");
+
+	for(int vertexCount : options.Vertices)
+	{
+		std::vector<TestMesh> model = MakeModel(vertexCount, options.Meshes, options.Seed + vertexCount);
+
+		std::vector<unsigned char> source((size_t)vertexCount * sizeof(BakeVertex));
+		for(size_t i = 0; i < source.size(); ++i)
+			source[i] = (unsigned char)(i * 2654435761u >> 13);
+		if(!WriteFile(sourcePath, source))
+		{
+			printf("cannot write %s\n", sourcePath.c_str());
+			return 1;
+		}
+
+		ModelCache::Key key;
+		key.SourcePath = ModelCache::FullPath(sourcePath);
+		key.PostProcessFlags = 0x1234;
+		key.VertexStride = sizeof(BakeVertex);
+
+		auto start = std::chrono::steady_clock::now();
+		bool baked = ModelCache::HashFile(sourcePath, key.SourceHash) &&
+			ModelCache::Write(cachePath, key, MeshData(model));
+		double bakeMs = Milliseconds(start);
+		if(!baked)
+		{
+			printf("cannot write %s\n", cachePath.c_str());
+			return 1;
+		}
+
+		// the best of a few runs, with the files in the page cache as on a warm start
+		const int runs = 5;
+		double hashMs = 1e30, openMs = 1e30, copyMs = 1e30, hitMs = 1e30;
+		bool match = true;
+		size_t bytes = 0;
+		for(int r = 0; r < runs; ++r)
+		{
+			ModelCache::Key hitKey = key;
+			start = std::chrono::steady_clock::now();
+			bool hashed = ModelCache::HashFile(sourcePath, hitKey.SourceHash);
+			double hash = Milliseconds(start);
+
+			ModelCache cache;
+			auto openStart = std::chrono::steady_clock::now();
+			bool opened = hashed && cache.Open(cachePath, hitKey);
+			double open = Milliseconds(openStart);
+
+			std::vector<TestMesh> loaded;
+			auto copyStart = std::chrono::steady_clock::now();
+			if(opened)
+				CopyMeshes(cache, loaded);
+			double copy = Milliseconds(copyStart);
+			double hit = Milliseconds(start);
+
+			bytes = cache.Size();
+			match = match && opened && SameModel(model, loaded);
+			hashMs = std::min(hashMs, hash);
+			openMs = std::min(openMs, open);
+			copyMs = std::min(copyMs, copy);
+			hitMs = std::min(hitMs, hit);
+		}
+
+		printf("%10d %10.2f %10.2f %10.3f %10.3f %10.3f %10.3f %10s\n", vertexCount, bytes / 1048576.0, bakeMs,
+			hashMs, openMs, copyMs, hitMs, match ? "yes" : "NO");
+		passed = passed && match;
+	}
+
+	//
+	// Misses: the same file under every other key, or damaged, must not open.
+	//
+	{
+		std::vector<TestMesh> model = MakeModel(1000, options.Meshes, options.Seed);
+		ModelCache::Key key;
+		key.SourcePath = ModelCache::FullPath(sourcePath);
+		key.SourceHash = 0x0123456789abcdefull;
+		key.PostProcessFlags = 0x1234;
+		key.VertexStride = sizeof(BakeVertex);
+		if(!ModelCache::Write(cachePath, key, MeshData(model)))
+		{
+			printf("cannot write %s\n", cachePath.c_str());
+			return 1;
+		}
+		const std::vector<unsigned char> good = ReadFile(cachePath);
+
+		printf("\nModel cache misses\n");
+		auto check = [&](const char* name, bool opens, bool expected)
+		{
+			printf("%-28s %10s\n", name, opens == expected ? "ok" : "FAILED");
+			passed = passed && opens == expected;
+		};
+		auto opens = [&](const ModelCache::Key& k)
+		{
+			ModelCache cache;
+			return cache.Open(cachePath, k);
+		};
+		auto damaged = [&](std::function<void(std::vector<unsigned char>&)> damage)
+		{
+			std::vector<unsigned char> bytes = good;
+			damage(bytes);
+			WriteFile(cachePath, bytes);
+			bool result = opens(key);
+			WriteFile(cachePath, good);
+			return result;
+		};
+
+		check("same key", opens(key), true);
+		ModelCache::Key other = key;
+		other.SourcePath += "x";
+		check("other source path", opens(other), false);
+		other = key;
+		other.SourceHash ^= 1;
+		check("other source hash", opens(other), false);
+		other = key;
+		other.PostProcessFlags ^= 1;
+		check("other post-processing", opens(other), false);
+		other = key;
+		other.VertexStride += 4;
+		check("other vertex layout", opens(other), false);
+
+		// the header starts with the magic and the version
+		check("other version", damaged([](std::vector<unsigned char>& b) { b[4] ^= 0x80; }), false);
+		check("truncated", damaged([](std::vector<unsigned char>& b) { b.resize(b.size() - 1); }), false);
+		check("reference out of its array", damaged([](std::vector<unsigned char>& b)
+		{
+			// the first mesh's vertices, the first word of the mesh table
+			std::uint64_t meshes;
+			memcpy(&meshes, b.data() + 40, sizeof(meshes));
+			std::uint64_t offset = b.size();
+			memcpy(b.data() + meshes, &offset, sizeof(offset));
+		}), false);
+		check("missing file", [&] { ModelCache cache; return cache.Open(cachePath + ".missing", key); }(), false);
+	}
+
+	remove(cachePath.c_str());
+	remove(sourcePath.c_str());
+
+	//
+	// Mesh conversion: the old ProcessMesh path against the new one, allocations per mesh
+	// counted over a whole model.
+	//
+	printf("\nMesh conversion, %d meshes per model, vertices per mesh\n", options.Meshes);
+	printf("%10s %12s %12s %12s %12s %10s %10s\n", "vertices", "old allocs", "new allocs", "old (ms)",
+		"new (ms)", "speedup", "match");
+
+	// the two arrays, the material's strings and a share of the importer's mesh list
+	const double maxAllocationsPerMesh = 6.0;
+	for(int vertexCount : options.Vertices)
+	{
+		std::vector<SourceMesh> model = MakeSourceModel(vertexCount, options.Meshes, options.Seed + vertexCount);
+
+		size_t allocations = g_allocations;
+		auto start = std::chrono::steady_clock::now();
+		std::vector<Mesh> oldMeshes = ConvertOld(model);
+		double oldMs = Milliseconds(start);
+		double oldAllocations = double(g_allocations - allocations) / options.Meshes;
+
+		allocations = g_allocations;
+		start = std::chrono::steady_clock::now();
+		std::vector<Mesh> newMeshes = ConvertNew(model);
+		double newMs = Milliseconds(start);
+		double newAllocations = double(g_allocations - allocations) / options.Meshes;
+
+		bool match = SameMeshes(oldMeshes, newMeshes);
+		printf("%10d %12.1f %12.1f %12.2f %12.2f %10.2f %10s\n", vertexCount, oldAllocations, newAllocations,
+			oldMs, newMs, oldMs / newMs, match ? "yes" : "NO");
+		passed = passed && match && newAllocations <= maxAllocationsPerMesh;
+	}
+
+	bool zeros = CheckMissingStreams();
+	printf("%-28s %10s\n", "missing streams", zeros ? "ok" : "FAILED");
+	passed = passed && zeros;
+
+	//
+	// LOD chains: levels of a seamed sphere and an open grid.
+	//
+	MeshLodDesc lodDesc;
+	printf("\nLOD chains, error targets");
+	for(float target : lodDesc.Errors)
+		printf(" %g", target);
+	printf(" of the radius\n");
+	printf("%10s %10s %10s %12s %12s %12s %10s %10s\n", "mesh", "level", "triangles", "target", "error",
+		"deviation", "ms", "ok");
+
+	for(int m = 0; m < 2; ++m)
+	{
+		LodMesh mesh = m == 0 ? MakeSphere(96, 192) : MakeGrid(192);
+		const size_t originalIndices = mesh.Indices.size();
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<MeshLod> lods = BuildMeshLods(&mesh.Vertices[0].Pos.x, &mesh.Vertices[0].Normal.x, 5,
+			sizeof(BakeVertex), mesh.Vertices.size(), mesh.Indices, lodDesc);
+		double ms = Milliseconds(start);
+
+		bool ok = lods.size() > 2 && CheckLevels(mesh, lods, lodDesc, originalIndices);
+		const float originalBorder = BorderLength(CountEdges(mesh, lods[0]));
+		for(size_t l = 0; l < lods.size(); ++l)
+		{
+			EdgeCounts edges = CountEdges(mesh, lods[l]);
+			bool levelOk = ok;
+			if(mesh.Closed)
+			{
+				// closed: every edge between two triangles, the seam included
+				for(const auto& edge : edges)
+					levelOk = levelOk && edge.second == 2;
+			}
+			else
+			{
+				// open: the outline kept, with its length
+				levelOk = levelOk && fabsf(BorderLength(edges) - originalBorder) <= 1e-4f * originalBorder;
+			}
+
+			// every vertex of the full mesh within the level's target of its surface, and
+			// within the error it reports, which SelectMeshLod takes for a bound; level 0
+			// is the full mesh
+			float target = lods[l].Target < 0 ? 0.0f : lodDesc.Errors[lods[l].Target] * mesh.Radius;
+			float deviation = l == 0 ? 0.0f : LevelDeviation(mesh, lods[l]);
+			levelOk = levelOk && deviation <= target * 1.0001f && deviation <= lods[l].Error * 1.0001f + 1e-6f;
+
+			printf("%10s %10zu %10u %12.6f %12.6f %12.6f %10.2f %10s\n", mesh.Name, l, lods[l].IndexCount / 3, target,
+				lods[l].Error, deviation, l == 0 ? ms : 0.0, levelOk ? "yes" : "NO");
+			passed = passed && levelOk;
+		}
+
+		// coarser with the distance, from the full level close up to the coarsest far away
+		bool monotonic = SelectMeshLod(lods.data(), (int)lods.size(), 0.0f, 1000.0f, 1.0f) == 0 &&
+			SelectMeshLod(lods.data(), (int)lods.size(), 1e9f, 1000.0f, 1.0f) == (int)lods.size() - 1;
+		int previous = 0;
+		for(float distance = 0.01f; distance < 1e4f; distance *= 1.5f)
+		{
+			int lod = SelectMeshLod(lods.data(), (int)lods.size(), distance, 1000.0f, 1.0f);
+			monotonic = monotonic && lod >= previous;
+			previous = lod;
+		}
+		printf("%-28s %10s\n", "selection by distance", monotonic ? "ok" : "FAILED");
+		passed = passed && monotonic;
+	}
+
+	printf("\n%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,397 @@
+//***************************************************************************************
+// ModelLoaderBenchmark.cpp
+//
+// Benchmark and check for ModelLoader.  Unlike the other benchmarks it imports real
+// models, so it builds against the same Assimp as the demo, e.g.
+//
+//   cl /EHsc /O2 /I.. /I..\..\Assimp-3.1.1\include ModelLoaderBenchmark.cpp ..\ModelLoader.cpp
+//      ..\Model.cpp ..\AssetRegistry.cpp ..\ModelImporter.cpp ..\ModelCache.cpp ..\MappedFile.cpp
+//      ..\ModelVertexStreams.cpp ..\MeshSimplifier.cpp ..\Common\TaskScheduler.cpp assimp.lib user32.lib
+//
+// Usage: ModelLoaderBenchmark [options] [<model file> ...]
+//   -threads a,b,...   loader threads to sweep                  (1,2,4)
+//   -inflight N        imports in flight, 0 for one per thread  (0)
+//   -runs N            runs per measurement, the best is kept   (3)
+//   -cache 0|1         take the baked caches where there are    (0)
+//   -references N      references per model in the shared runs  (8)
+//
+// The models default to the demo's, ..\Models\fox\file.fbx and ..\Models\magician\file.fbx,
+// with ..\Models\railing\file.FBX as a larger third.  Every model is first imported on
+// its own, one after the other as LoadModels used to; then the whole set goes through a
+// ModelLoader for every thread count.  The set should take about as long as the slowest
+// model once there is a thread per model, rather than the sum of them.  The loader must
+// hand the models over in the order they were queued, with the same meshes as the
+// imports on their own.
+//
+// The shared runs queue every model several times, as a scene placing many copies of
+// it would.  Through Model::Assets() each file must be imported once and every reference
+// must get the same copy, so the time and the memory stay those of the unique models;
+// the copies must be freed with the last handle.  Last, many threads acquire one key of
+// an AssetRegistry at once and exactly one of them must load it.
+//
+// The loader runs leave the LOD chains out, so they do the same work as the imports on
+// their own.  The LOD runs time BuildMeshLods over every mesh of every model and list the
+// triangles left at each level; the full level must stay as imported.
+//***************************************************************************************
+
+#include "../ModelLoader.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		std::vector<int> Threads = { 1, 2, 4 };
+		int InFlight = 0;
+		int Runs = 3;
+		bool Cache = false;
+		int References = 8;
+		std::vector<std::string> Models;
+	};
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		const char* p = text;
+		while(*p)
+		{
+			char* end = nullptr;
+			long value = strtol(p, &end, 10);
+			if(end == p)
+				break;
+
+			values.push_back((int)value);
+			p = *end == ',' ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options& options)
+	{
+		int i = 1;
+		for(; i < argc && argv[i][0] == '-'; i += 2)
+		{
+			if(i + 1 >= argc)
+				return false;
+			if(strcmp(argv[i], "-threads") == 0)
+				options.Threads = ParseList(argv[i + 1]);
+			else if(strcmp(argv[i], "-inflight") == 0)
+				options.InFlight = atoi(argv[i + 1]);
+			else if(strcmp(argv[i], "-runs") == 0)
+				options.Runs = atoi(argv[i + 1]);
+			else if(strcmp(argv[i], "-cache") == 0)
+				options.Cache = atoi(argv[i + 1]) != 0;
+			else if(strcmp(argv[i], "-references") == 0)
+				options.References = atoi(argv[i + 1]);
+			else
+				return false;
+		}
+		for(; i < argc; ++i)
+			options.Models.push_back(argv[i]);
+
+		if(options.Models.empty())
+		{
+			options.Models = { "..\\Models\\fox\\file.fbx", "..\\Models\\magician\\file.fbx",
+				"..\\Models\\railing\\file.FBX" };
+		}
+		for(int threads : options.Threads)
+		{
+			if(threads < 1)
+				return false;
+		}
+		return !options.Threads.empty() && options.InFlight >= 0 && options.Runs >= 1 && options.References >= 1;
+	}
+
+	typedef std::vector<ModelImporter::ModelMesh> Meshes;
+
+	bool SameMeshes(const Meshes& a, const Meshes& b)
+	{
+		if(a.size() != b.size())
+			return false;
+		for(size_t m = 0; m < a.size(); ++m)
+		{
+			if(a[m].vertices.size() != b[m].vertices.size() || a[m].indices != b[m].indices ||
+				a[m].material.Name != b[m].material.Name ||
+				a[m].material.DiffuseMapName != b[m].material.DiffuseMapName ||
+				memcmp(a[m].vertices.data(), b[m].vertices.data(),
+					a[m].vertices.size()*sizeof(ModelImporter::ModelVertex)) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	std::string ModelName(size_t i)
+	{
+		return "model" + std::to_string(i);
+	}
+
+	double Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: ModelLoaderBenchmark [-threads a,b,..] [-inflight N] [-runs N] [-cache 0|1] [-references N]"
+			" [<model file> ...]\n");
+		return 1;
+	}
+
+	bool passed = true;
+
+	//
+	// One after the other: every model on its own, the best of the runs.
+	//
+	printf("Models on their own, %s\n", options.Cache ? "baked caches" : "imported");
+	printf("%-40s %10s %10s %10s\n", "model", "meshes", "vertices", "ms");
+
+	std::vector<Meshes> expected(options.Models.size());
+	double sumMs = 0.0, slowestMs = 0.0;
+	for(size_t i = 0; i < options.Models.size(); ++i)
+	{
+		double best = 1e30;
+		for(int r = 0; r < options.Runs; ++r)
+		{
+			auto start = std::chrono::steady_clock::now();
+			ModelImporter importer(ModelName(i));
+			if(!importer.LoadModel(options.Models[i], options.Cache))
+			{
+				printf("cannot load %s\n", options.Models[i].c_str());
+				return 1;
+			}
+			best = std::min(best, Milliseconds(start));
+			expected[i] = std::move(importer.m_meshes);
+		}
+
+		size_t vertices = 0;
+		for(const auto& mesh : expected[i])
+			vertices += mesh.vertices.size();
+		printf("%-40s %10zu %10zu %10.2f\n", options.Models[i].c_str(), expected[i].size(), vertices, best);
+		sumMs += best;
+		slowestMs = std::max(slowestMs, best);
+	}
+	printf("%-40s %10s %10s %10.2f\n", "sum", "", "", sumMs);
+	printf("%-40s %10s %10s %10.2f\n", "slowest", "", "", slowestMs);
+
+	//
+	// The whole set through a ModelLoader.
+	//
+	printf("\nModelLoader, %zu models\n", options.Models.size());
+	printf("%10s %10s %10s %10s %10s %10s\n", "threads", "in flight", "ms", "vs sum", "vs slowest", "match");
+
+	for(int threads : options.Threads)
+	{
+		ModelLoader::Desc desc;
+		desc.LoaderThreads = threads;
+		desc.MaxImportsInFlight = options.InFlight ? options.InFlight : threads;
+		desc.UseCache = options.Cache;
+		desc.Lods.Errors.clear();
+
+		double best = 1e30;
+		bool match = true;
+		for(int r = 0; r < options.Runs; ++r)
+		{
+			// the threads are started outside of the timing, as the demo starts them early
+			ModelLoader loader(desc);
+			std::vector<int> order;
+			std::vector<Model::AssetHandle> loaded(options.Models.size());
+
+			auto start = std::chrono::steady_clock::now();
+			for(size_t i = 0; i < options.Models.size(); ++i)
+			{
+				int id = loader.Load(ModelName(i), options.Models[i], [&](ModelLoader::Result& result)
+				{
+					order.push_back(result.Id);
+					loaded[result.Id] = result.Asset;
+				});
+				match = match && id == (int)i;
+			}
+			loader.Finish();
+			best = std::min(best, Milliseconds(start));
+
+			match = match && loader.Pending() == 0 && order.size() == options.Models.size() &&
+				std::is_sorted(order.begin(), order.end());
+			for(size_t i = 0; i < options.Models.size(); ++i)
+				match = match && loaded[i] && SameMeshes(loaded[i]->Meshes, expected[i]);
+		}
+
+		printf("%10d %10d %10.2f %10.2f %10.2f %10s\n", threads, desc.MaxImportsInFlight, best,
+			sumMs / best, slowestMs / best, match ? "yes" : "NO");
+		passed = passed && match;
+	}
+
+	//
+	// Shared: every model queued several times, on a thread per model.
+	//
+	printf("\nShared, %d references per model\n", options.References);
+	printf("%10s %10s %10s %10s %10s %10s\n", "references", "imports", "held", "ms", "vs unique", "match");
+	{
+		const int threads = (int)options.Models.size();
+		ModelLoader::Desc desc;
+		desc.LoaderThreads = threads;
+		desc.MaxImportsInFlight = options.InFlight ? options.InFlight : threads;
+		desc.UseCache = options.Cache;
+		desc.Lods.Errors.clear();
+
+		AssetRegistry<const ModelAsset>* assets = Model::Assets();
+		double uniqueMs = 0.0;
+		for(int references : { 1, options.References })
+		{
+			int loads = assets->LoadCount();
+			bool match = true;
+			int held = 0;
+			double ms = 0.0;
+			{
+				std::vector<Model> models;
+				ModelLoader loader(desc);
+				auto start = std::chrono::steady_clock::now();
+				for(int r = 0; r < references; ++r)
+				{
+					for(size_t i = 0; i < options.Models.size(); ++i)
+					{
+						loader.Load(ModelName(i), options.Models[i], [&](ModelLoader::Result& result)
+						{
+							models.push_back(Model(result.Name, result.Asset));
+						});
+					}
+				}
+				loader.Finish();
+				ms = Milliseconds(start);
+				held = assets->Count();
+
+				for(size_t m = 0; m < models.size(); ++m)
+				{
+					size_t i = m % options.Models.size();
+					match = match && models[m].m_asset == models[i].m_asset &&
+						SameMeshes(models[m].Meshes(), expected[i]);
+				}
+			}
+			int imports = assets->LoadCount() - loads;
+			if(references == 1)
+				uniqueMs = ms;
+
+			// one import and one copy per file, none left once the models are gone
+			match = match && imports == (int)options.Models.size() && held == imports && assets->Count() == 0;
+			printf("%10d %10d %10d %10.2f %10.2f %10s\n", references, imports, held, ms, ms / uniqueMs,
+				match ? "yes" : "NO");
+			passed = passed && match;
+		}
+	}
+
+	//
+	// LOD chains of every model, as ModelLoader builds them by default.
+	//
+	printf("\nLOD chains, error targets");
+	const MeshLodDesc lodDesc;
+	for(float target : lodDesc.Errors)
+		printf(" %g", target);
+	printf(" of the radius\n");
+	printf("%-40s %10s %10s %10s %10s\n", "model", "level", "triangles", "ratio", "ms");
+	for(size_t i = 0; i < options.Models.size(); ++i)
+	{
+		Meshes meshes = expected[i];
+		auto start = std::chrono::steady_clock::now();
+		for(auto& mesh : meshes)
+		{
+			if(mesh.vertices.empty())
+				continue;
+			mesh.lods = BuildMeshLods(&mesh.vertices.data()->Pos.x, &mesh.vertices.data()->Normal.x, 5,
+				sizeof(ModelImporter::ModelVertex), mesh.vertices.size(), mesh.indices, lodDesc);
+		}
+		double ms = Milliseconds(start);
+
+		// a mesh with fewer levels takes its coarsest one in the levels after
+		size_t levels = 0;
+		bool same = true;
+		for(size_t m = 0; m < meshes.size(); ++m)
+		{
+			const auto& lods = meshes[m].lods;
+			levels = std::max(levels, lods.size());
+			if(meshes[m].vertices.empty())
+				continue;
+			same = same && !lods.empty() && lods[0].StartIndex == 0 &&
+				lods[0].IndexCount == expected[i][m].indices.size() &&
+				std::equal(expected[i][m].indices.begin(), expected[i][m].indices.end(), meshes[m].indices.begin());
+		}
+		size_t fullTriangles = 0;
+		for(size_t level = 0; level < levels; ++level)
+		{
+			size_t triangles = 0;
+			for(const auto& mesh : meshes)
+			{
+				if(!mesh.lods.empty())
+					triangles += mesh.lods[std::min(level, mesh.lods.size() - 1)].IndexCount / 3;
+			}
+			if(level == 0)
+				fullTriangles = triangles;
+			printf("%-40s %10zu %10zu %10.3f %10.2f\n", level == 0 ? options.Models[i].c_str() : "", level, triangles,
+				(double)triangles / fullTriangles, level == 0 ? ms : 0.0);
+		}
+		if(!same)
+			printf("%-40s %10s\n", "full level changed", "FAILED");
+		passed = passed && same;
+	}
+
+	//
+	// Racing: threads acquiring one key at once share a single load.
+	//
+	{
+		const int threads = 8;
+		AssetRegistry<int> registry;
+		std::atomic<int> loads(0);
+		std::vector<AssetRegistry<int>::Handle> handles(threads * 4);
+		{
+			TaskScheduler scheduler(threads);
+			scheduler.ParallelFor(0, (int)handles.size(), 1, [&](int i)
+			{
+				handles[i] = registry.Acquire(options.Models[0], [&](const std::string&)
+				{
+					++loads;
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+					return std::make_shared<int>(42);
+				});
+			});
+		}
+		bool shared = loads == 1 && registry.LoadCount() == 1 &&
+			registry.ShareCount() == (int)handles.size() - 1 && registry.Count() == 1;
+		for(const auto& handle : handles)
+			shared = shared && handle == handles[0];
+		handles.clear();
+		shared = shared && registry.Count() == 0 && !registry.Find(options.Models[0]);
+		printf("\n%-28s %10s\n", "racing acquires", shared ? "ok" : "FAILED");
+		passed = passed && shared;
+	}
+
+	//
+	// Dropped early: a loader destroyed with models queued must not call back.
+	//
+	{
+		ModelLoader::Desc desc;
+		desc.LoaderThreads = 1;
+		desc.MaxImportsInFlight = 1;
+		desc.UseCache = options.Cache;
+		bool called = false;
+		{
+			ModelLoader loader(desc);
+			for(size_t i = 0; i < options.Models.size(); ++i)
+				loader.Load(ModelName(i), options.Models[i], [&](ModelLoader::Result&) { called = true; });
+		}
+		printf("%-28s %10s\n", "destroyed while loading", called ? "FAILED" : "ok");
+		passed = passed && !called;
+	}
+
+	printf("\n%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,974 @@
+//***************************************************************************************
+// TerrainBenchmark.cpp
+//
+// Headless benchmark and check for the terrain kernels.  Like WavesBenchmark it does
+// not touch D3D12 and builds on Linux as well as Windows, e.g.
+//
+//   g++ -std=c++14 -O2 -march=native -pthread -I<DirectXMath>/Inc -I..
+//       TerrainBenchmark.cpp ../HeightfieldNormals.cpp ../HeightmapSource.cpp ../MappedFile.cpp
+//       ../TerrainQuadtree.cpp
+//       ../TerrainIndexTemplates.cpp ../TerrainVertex.cpp ../TerrainHeightfield.cpp
+//       ../TerrainTileStreamer.cpp ../NoiseHeightSource.cpp ../Common/TaskScheduler.cpp
+//       -o TerrainBenchmark
+//
+// Usage: TerrainBenchmark [options]
+//   -sizes a,b,...     square heightmap sizes to sweep  (512,1024,2048,4096)
+//   -threads a,b,...   thread counts to sweep           (1, 2, 4, ... hardware threads)
+//   -seed N            seed of the heightmaps           (1)
+//   -temp path         scratch file for the loader runs (TerrainBenchmark.tmp)
+//
+// Normals are checked against the per-triangle accumulation through the index
+// buffer that Terrain used before; the program fails when they differ by more
+// than the tolerance.  The reference builds its edges from absolute float
+// positions, which costs it a few 1e-4 on the large grids.  Tangents are compared
+// scaled by the horizontal length of their normal, i.e. as N x up: near vertical
+// normals the direction of the tangent is arbitrary.
+//
+// The loader runs write the largest heightmap in every HeightmapSource format,
+// map it and decode it back; it must come back unchanged.
+//
+// The chunked LOD runs build a TerrainQuadtree over every grid and select it from
+// a 1080p, 45 degree camera at growing distances, reporting the triangles drawn
+// against the full grid.  These grids leave out the per-texel noise, which no
+// level of detail can remove.  Every selection must cover each cell exactly once,
+// and every chunk's index template, stitched or not, must tile its chunk.  Index
+// memory is the shared templates against a 32-bit index list per node.
+//
+// The compact vertex runs encode every grid as TerrainVertex and decode it back.
+// Grid positions and texture coordinates must return exactly, heights within half
+// a quantization step, and normals within the octahedral error, which is also
+// measured over a million random directions.
+//
+// The height query runs check TerrainHeightfield on the largest grid: heights at grid
+// points are the heights, the batched kernel matches SampleHeight, normals match finite
+// differences, and rays agree with marching each ray in small steps.  The march
+// must never find the ground before the ray does, every hit must lie on the surface
+// and every ray the march hits must hit.  Then the throughput of each query.
+//
+// The noise runs generate every size with NoiseHeightSource.  The same seed must give
+// the same heights whether they are read row by row, over the pool, in an odd window
+// or one sample at a time.
+//
+// The streaming runs write the largest heightmap as a tiled file, and set up a far
+// larger noise world, and fly a camera across each with TerrainTileStreamer.  Resident
+// memory must stay within the budget, the callbacks must account for every tile, and
+// neighbouring tiles must agree on their shared border, normals included.
+//***************************************************************************************
+
+#include "../HeightfieldNormals.h"
+#include "../HeightmapSource.h"
+#include "../NoiseHeightSource.h"
+#include "../TerrainIndexTemplates.h"
+#include "../TerrainHeightfield.h"
+#include "../TerrainQuadtree.h"
+#include "../TerrainTileStreamer.h"
+#include "../TerrainVertex.h"
+#include "../Common/TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct Options
+	{
+		std::vector<int> Sizes = { 512, 1024, 2048, 4096 };
+		std::vector<int> Threads;
+		unsigned Seed = 1;
+		std::string Temp = "TerrainBenchmark.tmp";
+	};
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		const char* p = text;
+		while(*p)
+		{
+			char* end = nullptr;
+			long value = strtol(p, &end, 10);
+			if(end == p)
+				break;
+
+			values.push_back((int)value);
+			p = *end == ',' ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options& options)
+	{
+		if(argc % 2 == 0)
+			return false;
+
+		for(int i = 1; i + 1 < argc; i += 2)
+		{
+			if(strcmp(argv[i], "-sizes") == 0)
+				options.Sizes = ParseList(argv[i + 1]);
+			else if(strcmp(argv[i], "-threads") == 0)
+				options.Threads = ParseList(argv[i + 1]);
+			else if(strcmp(argv[i], "-seed") == 0)
+				options.Seed = (unsigned)strtoul(argv[i + 1], nullptr, 10);
+			else if(strcmp(argv[i], "-temp") == 0)
+				options.Temp = argv[i + 1];
+			else
+				return false;
+		}
+
+		if(options.Threads.empty())
+		{
+			int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+			for(int threads = 1; threads < hardware; threads *= 2)
+				options.Threads.push_back(threads);
+			options.Threads.push_back(hardware);
+		}
+
+		for(int size : options.Sizes)
+		{
+			if(size < 2)
+				return false;
+		}
+		for(int threads : options.Threads)
+		{
+			if(threads < 1)
+				return false;
+		}
+
+		return !options.Sizes.empty();
+	}
+
+	// An 8-bit heightmap like terrain_ps2.raw: a few smooth hills plus per-texel
+	// noise, so both gentle and rough slopes are covered.
+	std::vector<float> MakeHeightmap(int size, unsigned seed, int noiseAmplitude = 8)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> phase(0.0f, 6.2831853f);
+		std::uniform_int_distribution<int> noise(-noiseAmplitude, noiseAmplitude);
+
+		float p0 = phase(rng), p1 = phase(rng), p2 = phase(rng);
+		std::vector<float> heights((size_t)size*size);
+		for(int i = 0; i < size; ++i)
+		{
+			for(int j = 0; j < size; ++j)
+			{
+				float u = float(j) / size * 6.2831853f;
+				float v = float(i) / size * 6.2831853f;
+				float h = 128.0f + 60.0f*sinf(2.0f*u + p0)*cosf(3.0f*v + p1) + 30.0f*sinf(7.0f*(u + v) + p2);
+				heights[(size_t)i*size + j] = (float)std::min(255, std::max(0, (int)h + noise(rng)));
+			}
+		}
+		return heights;
+	}
+
+	// The grid as Terrain lays it out: x to the right, z decreasing down the rows.
+	void BuildPositions(const std::vector<float>& heights, int size, float dx, float dz, std::vector<Vertex>& vertices)
+	{
+		float oX = -0.5f*dx*(size - 1);
+		float oZ = 0.5f*dz*(size - 1);
+		vertices.resize(heights.size());
+		for(int i = 0; i < size; ++i)
+		{
+			for(int j = 0; j < size; ++j)
+			{
+				Vertex& v = vertices[(size_t)i*size + j];
+				v.Pos = XMFLOAT3(oX + dx*j, heights[(size_t)i*size + j], oZ - dz*i);
+				v.TexC = XMFLOAT2(dx*i, dx*j);
+			}
+		}
+	}
+
+	// Reference: unit face normals accumulated through the index buffer, then
+	// normalized, and tangent = normalize(N x up) or (1,0,0).
+	void AccumulateNormals(std::vector<Vertex>& vertices, int size)
+	{
+		for(auto& v : vertices)
+			v.Normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+		std::vector<unsigned> indices;
+		indices.reserve((size_t)6*(size - 1)*(size - 1));
+		for(int i = 0; i + 1 < size; ++i)
+		{
+			for(int j = 0; j + 1 < size; ++j)
+			{
+				unsigned top = i*size + j;
+				unsigned bottom = top + size;
+				unsigned quad[6] = { top, top + 1, bottom, top + 1, bottom + 1, bottom };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+
+		for(size_t t = 0; t < indices.size(); t += 3)
+		{
+			Vertex& v1 = vertices[indices[t]];
+			Vertex& v2 = vertices[indices[t + 1]];
+			Vertex& v3 = vertices[indices[t + 2]];
+			XMVECTOR p1 = XMLoadFloat3(&v1.Pos);
+			XMVECTOR n = XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&v2.Pos) - p1, XMLoadFloat3(&v3.Pos) - p1));
+			XMStoreFloat3(&v1.Normal, XMLoadFloat3(&v1.Normal) + n);
+			XMStoreFloat3(&v2.Normal, XMLoadFloat3(&v2.Normal) + n);
+			XMStoreFloat3(&v3.Normal, XMLoadFloat3(&v3.Normal) + n);
+		}
+
+		XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		for(auto& v : vertices)
+		{
+			XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&v.Normal));
+			XMStoreFloat3(&v.Normal, n);
+			XMStoreFloat3(&v.TangentU, XMVector3Normalize(XMVector3Cross(n, up)));
+			if(v.TangentU.x == 0.0f && v.TangentU.y == 0.0f && v.TangentU.z == 0.0f)
+				v.TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		}
+	}
+
+	XMFLOAT3 ScaleByTilt(const XMFLOAT3& tangent, const XMFLOAT3& normal)
+	{
+		float tilt = sqrtf(normal.x*normal.x + normal.z*normal.z);
+		return XMFLOAT3(tangent.x*tilt, tangent.y*tilt, tangent.z*tilt);
+	}
+
+	// Writes heights (integers in 0..255) as a heightmap file in the given format.
+	// tileSize 0 writes a headerless RAW file, anything else a tiled one.
+	bool WriteHeightmap(const std::string& path, const std::vector<float>& heights, int size,
+		HeightmapSource::Format format, HeightmapSource::Endian byteOrder, int tileSize)
+	{
+		const int sampleBytes = format == HeightmapSource::Format::R8 ? 1 : format == HeightmapSource::Format::R16 ? 2 : 4;
+		const bool big = byteOrder == HeightmapSource::Endian::Big;
+
+		std::vector<unsigned char> bytes;
+		auto put = [&](float h)
+		{
+			std::uint32_t bits;
+			if(format == HeightmapSource::Format::R32F)
+				memcpy(&bits, &h, sizeof(bits));
+			else
+				bits = (std::uint32_t)h;
+			for(int b = 0; b < sampleBytes; ++b)
+				bytes.push_back((unsigned char)(bits >> 8*(big ? sampleBytes - 1 - b : b)));
+		};
+
+		if(tileSize == 0)
+		{
+			for(float h : heights)
+				put(h);
+		}
+		else
+		{
+			HeightmapSource::TiledHeader header = {};
+			memcpy(header.Magic, "HMTL", 4);
+			header.Version = HeightmapSource::TiledVersion;
+			header.Width = size;
+			header.Height = size;
+			header.TileSize = tileSize;
+			header.SampleFormat = (std::uint32_t)format;
+			header.ByteOrder = (std::uint32_t)byteOrder;
+			bytes.insert(bytes.end(), (const unsigned char*)&header, (const unsigned char*)(&header + 1));
+
+			int tiles = (size + tileSize - 1) / tileSize;
+			for(int ti = 0; ti < tiles; ++ti)
+				for(int tj = 0; tj < tiles; ++tj)
+					for(int r = 0; r < tileSize; ++r)
+						for(int c = 0; c < tileSize; ++c)
+						{
+							int i = ti*tileSize + r;
+							int j = tj*tileSize + c;
+							put(i < size && j < size ? heights[(size_t)i*size + j] : 0.0f);
+						}
+		}
+
+		std::ofstream file(path, std::ios::binary);
+		file.write((const char*)bytes.data(), bytes.size());
+		return file.good();
+	}
+
+	float MaxDifference(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return std::max(fabsf(a.x - b.x), std::max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+	}
+
+	// Opens a streamer with open, then flies the eye corner to corner across a square of
+	// width world units in 600 frames of about 2 ms, waiting for the tile under the eye on
+	// the first one.  Resident memory must stay within the budget, the callbacks must
+	// account for every tile and neighbouring tiles must agree on their shared border.
+	bool FlyOver(const char* name, const std::function<bool(TerrainTileStreamer&)>& open,
+		const TerrainTileStreamer::Desc& desc, float width)
+	{
+		int ready = 0;
+		int evicted = 0;
+		TerrainTileStreamer streamer;
+		streamer.SetReadyCallback([&](const TerrainTileStreamer::Tile&) { ++ready; });
+		streamer.SetEvictedCallback([&](const TerrainTileStreamer::Tile&) { ++evicted; });
+
+		auto start = std::chrono::steady_clock::now();
+		bool opened = open(streamer);
+		auto stop = std::chrono::steady_clock::now();
+		double openMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+		const int frames = 600;
+		const float tileSize = desc.Spacing*desc.TileCells;
+		std::size_t peakBytes = 0;
+		double firstTileMs = 0.0;
+		double updateMs = 0.0;
+		double worstUpdateMs = 0.0;
+		for(int frame = 0; opened && frame < frames; ++frame)
+		{
+			float f = (frame + 0.5f) / frames;
+			XMFLOAT3 eye(desc.OriginX + 0.05f*width + 0.9f*width*f, 300.0f, desc.OriginZ - 0.05f*width - 0.9f*width*f);
+
+			auto updateStart = std::chrono::steady_clock::now();
+			streamer.Update(eye);
+			auto updateStop = std::chrono::steady_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(updateStop - updateStart).count();
+			updateMs += ms;
+			worstUpdateMs = std::max(worstUpdateMs, ms);
+			peakBytes = std::max(peakBytes, streamer.ResidentBytes());
+
+			if(frame == 0)
+			{
+				int tileRow = (int)((desc.OriginZ - eye.z) / tileSize);
+				int tileCol = (int)((eye.x - desc.OriginX) / tileSize);
+				while(!streamer.Find(tileRow, tileCol))
+				{
+					streamer.WaitForLoads();
+					streamer.Update(eye);
+				}
+				firstTileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		streamer.WaitForLoads();
+
+		// Neighbours in the last resident set must agree on their shared border.
+		bool seamless = true;
+		for(int r = 0; r < streamer.TileRows(); ++r)
+		{
+			for(int c = 0; c < streamer.TileCols(); ++c)
+			{
+				const TerrainTileStreamer::Tile* tile = streamer.Find(r, c);
+				const TerrainTileStreamer::Tile* right = streamer.Find(r, c + 1);
+				const TerrainTileStreamer::Tile* below = streamer.Find(r + 1, c);
+				for(int i = 0; tile && right && i < tile->Rows; ++i)
+				{
+					const Vertex& a = tile->Vertices[(size_t)i*tile->Cols + tile->Cols - 1];
+					const Vertex& b = right->Vertices[(size_t)i*right->Cols];
+					seamless = seamless && a.Pos.y == b.Pos.y && MaxDifference(a.Normal, b.Normal) <= 1e-6f;
+				}
+				for(int j = 0; tile && below && j < tile->Cols; ++j)
+				{
+					const Vertex& a = tile->Vertices[(size_t)(tile->Rows - 1)*tile->Cols + j];
+					const Vertex& b = below->Vertices[j];
+					seamless = seamless && a.Pos.y == b.Pos.y && MaxDifference(a.Normal, b.Normal) <= 1e-6f;
+				}
+			}
+		}
+
+		bool ok = opened && peakBytes <= desc.MemoryBudget && seamless && ready == streamer.LoadCount() &&
+			evicted == streamer.EvictionCount() && ready - evicted == streamer.ResidentCount();
+		double mapBytes = double(streamer.TileRows()*desc.TileCells + 1)*(streamer.TileCols()*desc.TileCells + 1)*
+			(sizeof(float) + sizeof(Vertex));
+		printf("%s in %dx%d tiles of %d cells, %.0f MB budget, %.0f unit radius\n", name,
+			streamer.TileRows(), streamer.TileCols(), desc.TileCells, desc.MemoryBudget / 1048576.0, desc.LoadRadius);
+		printf("open %.2f ms, first tile %.2f ms, update %.3f ms avg %.3f ms worst, %d loads, %d evictions, "
+			"peak %.1f MB of %.1f MB for the whole map, borders %s%s\n",
+			openMs, firstTileMs, updateMs / frames, worstUpdateMs, streamer.LoadCount(), streamer.EvictionCount(),
+			peakBytes / 1048576.0, mapBytes / 1048576.0, seamless ? "match" : "DIFFER", ok ? "" : "  FAILED");
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: TerrainBenchmark [-sizes a,b,..] [-threads a,b,..] [-seed N] [-temp path]\n");
+		return 1;
+	}
+
+	// Terrain's spacing: 500 units over 511 cells.
+	const float dx = 500.0f / 511.0f;
+	const float dz = dx;
+	const float tolerance = 1e-3f;
+	bool passed = true;
+
+	//
+	// Normals and tangents: the triangle accumulation once, then the row kernel
+	// at every thread count, each checked against it.
+	//
+	printf("Heightfield normals, seed %u, tolerance %g\n", options.Seed, tolerance);
+	printf("%6s %10s %12s %14s %10s %12s %12s\n", "size", "threads", "time (ms)", "ns/vertex",
+		"speedup", "max dN", "max dT");
+
+	for(int size : options.Sizes)
+	{
+		std::vector<float> heights = MakeHeightmap(size, options.Seed + size);
+		double vertexCount = double(size)*size;
+
+		std::vector<Vertex> reference;
+		BuildPositions(heights, size, dx, dz, reference);
+		auto start = std::chrono::steady_clock::now();
+		AccumulateNormals(reference, size);
+		auto stop = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(stop - start).count();
+		printf("%6d %10s %12.2f %14.2f\n", size, "triangles", seconds*1000.0, seconds*1e9 / vertexCount);
+
+		double baseline = 0.0;
+		for(int threads : options.Threads)
+		{
+			TaskScheduler scheduler(threads - 1);
+
+			std::vector<Vertex> vertices;
+			BuildPositions(heights, size, dx, dz, vertices);
+			ComputeHeightfieldNormals(heights.data(), size, size, size, dx, dz, vertices.data(), &scheduler);
+
+			const int runs = 5;
+			start = std::chrono::steady_clock::now();
+			for(int r = 0; r < runs; ++r)
+				ComputeHeightfieldNormals(heights.data(), size, size, size, dx, dz, vertices.data(), &scheduler);
+			stop = std::chrono::steady_clock::now();
+			seconds = std::chrono::duration<double>(stop - start).count() / runs;
+
+			if(baseline == 0.0)
+				baseline = seconds;
+
+			float maxNormal = 0.0f;
+			float maxTangent = 0.0f;
+			for(size_t v = 0; v < vertices.size(); ++v)
+			{
+				maxNormal = std::max(maxNormal, MaxDifference(vertices[v].Normal, reference[v].Normal));
+				maxTangent = std::max(maxTangent, MaxDifference(
+					ScaleByTilt(vertices[v].TangentU, vertices[v].Normal), ScaleByTilt(reference[v].TangentU, reference[v].Normal)));
+			}
+
+			bool ok = maxNormal <= tolerance && maxTangent <= tolerance;
+			passed = passed && ok;
+			printf("%6d %10d %12.2f %14.2f %10.2f %12.3g %12.3g%s\n", size, threads, seconds*1000.0,
+				seconds*1e9 / vertexCount, baseline / seconds, maxNormal, maxTangent, ok ? "" : "  FAILED");
+		}
+	}
+
+	//
+	// Chunked LOD: build time and memory of the tree, then the triangles selected
+	// from above the centre of the grid and from further and further away.
+	//
+	const float pixelsPerUnit = 1080.0f / (2.0f*tanf(0.5f*XM_PIDIV4));
+	const float maxScreenError = 2.0f;
+	const float distances[] = { 0.0f, 0.5f, 1.0f, 2.0f, 4.0f };
+
+	printf("\nChunked LOD, %d cells per chunk, %g px at 1080p\n", TerrainQuadtree::ChunkCells, maxScreenError);
+	printf("%6s %12s %8s %8s %10s %12s %8s", "size", "build (ms)", "nodes", "lists", "vertices", "indices (KB)", "saved");
+	for(float distance : distances)
+	{
+		char label[32];
+		snprintf(label, sizeof(label), "tris @%gw", distance);
+		printf(" %14s", label);
+	}
+	printf("\n");
+
+	for(int size : options.Sizes)
+	{
+		std::vector<float> heights = MakeHeightmap(size, options.Seed + size, 0);
+		std::vector<Vertex> grid;
+		BuildPositions(heights, size, dx, dz, grid);
+		ComputeHeightfieldNormals(heights.data(), size, size, size, dx, dz, grid.data());
+
+		TerrainQuadtree tree;
+		TerrainIndexTemplates templates;
+		std::vector<Vertex> vertices;
+		auto start = std::chrono::steady_clock::now();
+		tree.Build(grid.data(), size, size, vertices, templates);
+		auto stop = std::chrono::steady_clock::now();
+
+		// Vertices against the full grid, indices against a 32-bit copy per node.
+		double copies = 0.0;
+		for(const TerrainQuadtree::Node& node : tree.Nodes())
+			copies += 6.0*(node.Rows - 1)*(node.Cols - 1) + 12.0*((node.Rows - 1) + (node.Cols - 1));
+		double copyBytes = copies*sizeof(std::uint32_t);
+		double templateBytes = double(templates.Indices16().size())*sizeof(std::uint16_t) +
+			double(templates.Indices32().size())*sizeof(std::uint32_t);
+		double fullTriangles = 2.0*(size - 1)*(size - 1);
+		printf("%6d %12.2f %8d %8d %9.2fx %12.0f %7.1f%%", size, std::chrono::duration<double, std::milli>(stop - start).count(),
+			(int)tree.Nodes().size(), (int)templates.Count(), double(vertices.size()) / (double(size)*size),
+			templateBytes / 1024.0, 100.0*(1.0 - templateBytes / copyBytes));
+
+		// The eye 20 units above the ground, moved off along -z by distance times the width.
+		const float width = dx*(size - 1);
+		std::vector<unsigned char> covered((size_t)(size - 1)*(size - 1));
+		std::vector<TerrainQuadtree::Selection> selected;
+		bool ok = templates.Indices32().empty();
+		for(float distance : distances)
+		{
+			XMFLOAT3 eye(0.0f, 20.0f + 255.0f, -distance*width);
+			selected.clear();
+			std::uint32_t triangles = tree.Select(eye, pixelsPerUnit, maxScreenError, selected);
+
+			std::fill(covered.begin(), covered.end(), (unsigned char)0);
+			for(const TerrainQuadtree::Selection& selection : selected)
+			{
+				const TerrainQuadtree::Node& node = tree.Nodes()[selection.Node];
+				for(int r = node.Row0; r < node.Row1; ++r)
+					for(int c = node.Col0; c < node.Col1; ++c)
+						++covered[(size_t)r*(size - 1) + c];
+
+				// The triangles, stitched or not, must tile the node seen from above:
+				// all facing up and adding up to its area.  Skirts have no area.
+				double area = 0.0;
+				const std::uint16_t* index = &templates.Indices16()[selection.StartIndex];
+				for(std::uint32_t t = 0; t < selection.IndexCount; t += 3)
+				{
+					const XMFLOAT3& a = vertices[selection.BaseVertex + index[t]].Pos;
+					const XMFLOAT3& b = vertices[selection.BaseVertex + index[t + 1]].Pos;
+					const XMFLOAT3& c = vertices[selection.BaseVertex + index[t + 2]].Pos;
+					double facing = 0.5*((double(b.z) - a.z)*(double(c.x) - a.x) - (double(b.x) - a.x)*(double(c.z) - a.z));
+					ok = ok && facing > -1e-6;
+					area += facing;
+				}
+				double nodeArea = double(dx)*(node.Col1 - node.Col0)*dz*(node.Row1 - node.Row0);
+				ok = ok && fabs(area - nodeArea) <= 1e-4*nodeArea;
+			}
+			ok = ok && std::all_of(covered.begin(), covered.end(), [](unsigned char n) { return n == 1; });
+
+			char cell[32];
+			snprintf(cell, sizeof(cell), "%u (%.0fx)", triangles, fullTriangles / triangles);
+			printf(" %14s", cell);
+		}
+		passed = passed && ok;
+		printf("%s\n", ok ? "" : "  FAILED");
+	}
+
+	//
+	// Compact vertices: the octahedral error over random directions, then every grid
+	// encoded and decoded against its float vertices.
+	//
+	const float maxNormalAngle = 1.0f;	// degrees
+	float worstAngle = 0.0f;
+	{
+		std::mt19937 rng(options.Seed);
+		std::normal_distribution<float> gauss;
+		for(int k = 0; k < 1000000; ++k)
+		{
+			XMFLOAT3 n(gauss(rng), gauss(rng), gauss(rng));
+			XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&n)));
+			std::int8_t encoded[2];
+			EncodeOctahedral(n, encoded);
+			XMFLOAT3 d = DecodeOctahedral(encoded);
+			float cosine = std::min(1.0f, n.x*d.x + n.y*d.y + n.z*d.z);
+			worstAngle = std::max(worstAngle, acosf(cosine)*180.0f / XM_PI);
+		}
+	}
+	bool octahedralOk = worstAngle <= maxNormalAngle;
+	passed = passed && octahedralOk;
+
+	printf("\nCompact vertices, %d -> %d bytes, octahedral normals within %.3g deg over random directions%s\n",
+		(int)sizeof(Vertex), (int)sizeof(TerrainVertex), worstAngle, octahedralOk ? "" : "  FAILED");
+	printf("%6s %12s %14s %12s %12s %12s %12s\n", "size", "encode (ms)", "memory (MB)", "max dXZ", "max dY/step",
+		"max dN (deg)", "max dT");
+
+	for(int size : options.Sizes)
+	{
+		std::vector<float> heights = MakeHeightmap(size, options.Seed + size);
+		std::vector<Vertex> vertices;
+		BuildPositions(heights, size, dx, dz, vertices);
+		ComputeHeightfieldNormals(heights.data(), size, size, size, dx, dz, vertices.data());
+
+		TerrainVertexQuantization q;
+		q.OriginX = vertices.front().Pos.x;
+		q.OriginZ = vertices.front().Pos.z;
+		q.SpacingX = dx;
+		q.SpacingZ = dz;
+		q.HeightMin = *std::min_element(heights.begin(), heights.end());
+		q.HeightRange = std::max(*std::max_element(heights.begin(), heights.end()) - q.HeightMin, 1e-3f);
+
+		std::vector<TerrainVertex> compact(vertices.size());
+		auto start = std::chrono::steady_clock::now();
+		TaskScheduler::GetInstance()->ParallelForRange(0, (int)vertices.size(), 4096, [&](int first, int last)
+		{
+			for(int v = first; v < last; ++v)
+				compact[v] = EncodeTerrainVertex(vertices[v], q);
+		});
+		auto stop = std::chrono::steady_clock::now();
+
+		const float step = q.HeightRange / 65535.0f;
+		float maxXZ = 0.0f;
+		float maxY = 0.0f;
+		float maxAngle = 0.0f;
+		float maxTangent = 0.0f;
+		bool ok = true;
+		for(size_t v = 0; v < vertices.size(); ++v)
+		{
+			const Vertex& a = vertices[v];
+			Vertex b = DecodeTerrainVertex(compact[v], q);
+			ok = ok && compact[v].Col == v % size && compact[v].Row == v / size &&
+				b.TexC.x == a.TexC.x && b.TexC.y == a.TexC.y;
+			maxXZ = std::max(maxXZ, std::max(fabsf(b.Pos.x - a.Pos.x), fabsf(b.Pos.z - a.Pos.z)));
+			maxY = std::max(maxY, fabsf(b.Pos.y - a.Pos.y) / step);
+			float cosine = std::min(1.0f, a.Normal.x*b.Normal.x + a.Normal.y*b.Normal.y + a.Normal.z*b.Normal.z);
+			maxAngle = std::max(maxAngle, acosf(cosine)*180.0f / XM_PI);
+			maxTangent = std::max(maxTangent, MaxDifference(ScaleByTilt(b.TangentU, b.Normal), ScaleByTilt(a.TangentU, a.Normal)));
+		}
+
+		ok = ok && maxXZ <= 1e-3f*dx && maxY <= 0.5f + 1e-2f && maxAngle <= maxNormalAngle;
+		passed = passed && ok;
+		char memory[32];
+		snprintf(memory, sizeof(memory), "%.1f / %.1f", vertices.size()*sizeof(Vertex) / 1048576.0,
+			compact.size()*sizeof(TerrainVertex) / 1048576.0);
+		printf("%6d %12.2f %14s %12.3g %12.3g %12.3g %12.3g%s\n", size, std::chrono::duration<double, std::milli>(stop - start).count(),
+			memory, maxXZ, maxY, maxAngle, maxTangent, ok ? "" : "  FAILED");
+	}
+
+	//
+	// Height queries on the largest grid.
+	//
+	{
+		int size = options.Sizes.back();
+		std::vector<float> heights = MakeHeightmap(size, options.Seed);
+		const float originX = -0.5f*dx*(size - 1);
+		const float originZ = 0.5f*dz*(size - 1);
+		const float width = dx*(size - 1);
+
+		TerrainHeightfield field;
+		auto start = std::chrono::steady_clock::now();
+		field.Build(heights.data(), size, size, size, originX, originZ, dx, dz);
+		auto stop = std::chrono::steady_clock::now();
+		printf("\nHeight queries, %dx%d, %d pyramid levels built in %.2f ms\n", size, size, field.Levels(),
+			std::chrono::duration<double, std::milli>(stop - start).count());
+
+		// Positions up to a tenth of the width outside the grid, to cover the clamping.
+		std::mt19937 rng(options.Seed);
+		std::uniform_real_distribution<float> across(-0.6f*width, 0.6f*width);
+		const size_t queryCount = 1 << 22;
+		std::vector<XMFLOAT2> positions(queryCount);
+		for(XMFLOAT2& p : positions)
+			p = XMFLOAT2(across(rng), across(rng));
+
+		// Grid points, the batch against the single query, normals against central
+		// differences a thousandth of a cell apart in the middle of cells.
+		float maxGrid = 0.0f;
+		for(int i = 0; i < size; i += 7)
+			for(int j = 0; j < size; j += 5)
+				maxGrid = std::max(maxGrid, fabsf(field.SampleHeight(originX + dx*j, originZ - dz*i) - heights[(size_t)i*size + j]));
+
+		std::vector<float> batch(queryCount);
+		field.SampleHeights(positions.data(), batch.data(), queryCount);
+		float maxBatch = 0.0f;
+		for(size_t q = 0; q < queryCount; ++q)
+			maxBatch = std::max(maxBatch, fabsf(batch[q] - field.SampleHeight(positions[q].x, positions[q].y)));
+
+		float maxNormal = 0.0f;
+		std::uniform_real_distribution<float> inner(0.2f, 0.8f);
+		std::uniform_int_distribution<int> cell(0, size - 2);
+		for(int k = 0; k < 100000; ++k)
+		{
+			float x = originX + dx*(cell(rng) + inner(rng));
+			float z = originZ - dz*(cell(rng) + inner(rng));
+			const float e = 0.05f*dx;
+			float dhdx = (field.SampleHeight(x + e, z) - field.SampleHeight(x - e, z)) / (2.0f*e);
+			float dhdz = (field.SampleHeight(x, z + e) - field.SampleHeight(x, z - e)) / (2.0f*e);
+			XMFLOAT3 expected;
+			XMStoreFloat3(&expected, XMVector3Normalize(XMVectorSet(-dhdx, 1.0f, -dhdz, 0.0f)));
+			maxNormal = std::max(maxNormal, MaxDifference(field.SampleNormal(x, z), expected));
+		}
+
+		// Rays from above the terrain, aimed at random points on the ground plane
+		// and a bit beyond it, some nearly horizontal.
+		const int rayCount = 2000;
+		std::uniform_real_distribution<float> height(field.MaxHeight() + 1.0f, field.MaxHeight() + 100.0f);
+		std::vector<TerrainHeightfield::Ray> rays(rayCount);
+		for(TerrainHeightfield::Ray& ray : rays)
+		{
+			ray.Origin = XMFLOAT3(across(rng), height(rng), across(rng));
+			XMFLOAT3 target(across(rng), field.MinHeight() - 20.0f*inner(rng), across(rng));
+			ray.Direction = XMFLOAT3(target.x - ray.Origin.x, target.y - ray.Origin.y, target.z - ray.Origin.z);
+			ray.MaxDistance = 2.0f*width;
+		}
+
+		const float step = 0.05f*dx;
+		int rayErrors = 0;
+		int hitCount = 0;
+		for(const TerrainHeightfield::Ray& ray : rays)
+		{
+			TerrainHeightfield::RayHit hit;
+			bool hitFound = field.Raycast(ray, hit);
+			hitCount += hitFound ? 1 : 0;
+
+			XMFLOAT3 unit;
+			XMStoreFloat3(&unit, XMVector3Normalize(XMLoadFloat3(&ray.Direction)));
+			float marched = -1.0f;
+			for(float t = 0.0f; t <= ray.MaxDistance; t += step)
+			{
+				float x = ray.Origin.x + unit.x*t;
+				float z = ray.Origin.z + unit.z*t;
+				bool inside = x >= originX && x <= originX + width && z <= originZ && z >= originZ - width;
+				if(inside && ray.Origin.y + unit.y*t <= field.SampleHeight(x, z))
+				{
+					marched = t;
+					break;
+				}
+			}
+
+			// A hit is at or below the ground, and just before it the ray was above
+			// the ground or outside the grid.  Float positions far along the ray are
+			// off by a few ulps of the distance.
+			float tolerance = 1e-3f + 1e-5f*(hitFound ? hit.Distance : 0.0f);
+			bool valid = !hitFound;
+			if(hitFound)
+			{
+				float t = hit.Distance - 1e-2f;
+				float x = ray.Origin.x + unit.x*t;
+				float z = ray.Origin.z + unit.z*t;
+				bool inside = x >= originX && x <= originX + width && z <= originZ && z >= originZ - width;
+				valid = hit.Position.y <= field.SampleHeight(hit.Position.x, hit.Position.z) + tolerance &&
+					(t <= 0.0f || !inside || ray.Origin.y + unit.y*t > field.SampleHeight(x, z));
+			}
+			bool ok = valid && (marched < 0.0f || (hitFound && hit.Distance <= marched + tolerance));
+			rayErrors += ok ? 0 : 1;
+		}
+
+		bool ok = maxGrid <= 1e-2f && maxBatch <= 1e-4f && maxNormal <= 1e-2f && rayErrors == 0;
+		passed = passed && ok;
+		printf("max diff at grid points %.3g, batch %.3g, normals %.3g; rays %d/%d hit, %d wrong%s\n",
+			maxGrid, maxBatch, maxNormal, hitCount, rayCount, rayErrors, ok ? "" : "  FAILED");
+
+		// Throughput.
+		printf("%24s %10s %14s %14s\n", "query", "threads", "time (ms)", "Mqueries/s");
+		float sink = 0.0f;
+		start = std::chrono::steady_clock::now();
+		for(size_t q = 0; q < queryCount; ++q)
+			sink += field.SampleHeight(positions[q].x, positions[q].y);
+		stop = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(stop - start).count();
+		printf("%24s %10d %14.2f %14.1f\n", "SampleHeight", 1, seconds*1000.0, queryCount / seconds / 1e6);
+
+		start = std::chrono::steady_clock::now();
+		field.SampleHeights(positions.data(), batch.data(), queryCount);
+		stop = std::chrono::steady_clock::now();
+		seconds = std::chrono::duration<double>(stop - start).count();
+		printf("%24s %10d %14.2f %14.1f\n", "SampleHeights", 1, seconds*1000.0, queryCount / seconds / 1e6);
+
+		start = std::chrono::steady_clock::now();
+		for(size_t q = 0; q < queryCount; ++q)
+			sink += field.SampleNormal(positions[q].x, positions[q].y).y;
+		stop = std::chrono::steady_clock::now();
+		seconds = std::chrono::duration<double>(stop - start).count();
+		printf("%24s %10d %14.2f %14.1f\n", "SampleNormal", 1, seconds*1000.0, queryCount / seconds / 1e6);
+
+		// The same rays many times over, so the cost is the descent and not the misses.
+		const int batchRays = 1 << 18;
+		std::vector<TerrainHeightfield::Ray> manyRays(batchRays);
+		for(int r = 0; r < batchRays; ++r)
+			manyRays[r] = rays[r % rayCount];
+		std::vector<TerrainHeightfield::RayHit> hits(batchRays);
+		for(int threads : options.Threads)
+		{
+			TaskScheduler scheduler(threads - 1);
+			start = std::chrono::steady_clock::now();
+			field.Raycast(manyRays.data(), hits.data(), batchRays, &scheduler);
+			stop = std::chrono::steady_clock::now();
+			seconds = std::chrono::duration<double>(stop - start).count();
+			printf("%24s %10d %14.2f %14.1f\n", "Raycast", threads, seconds*1000.0, batchRays / seconds / 1e6);
+		}
+		if(sink == 1.0f)
+			printf("\n");
+	}
+
+	//
+	// Noise heights: every size generated with fBm and ridged noise, one thread row by row
+	// and then split over the shared pool.  A source opened again with the same seed, a
+	// window read at an odd offset and single samples must give exactly the same heights,
+	// and every height must lie within the amplitude.
+	//
+	printf("\nNoise heights, %d octaves\n", NoiseHeightSource::Desc().Octaves);
+	printf("%8s %8s %14s %14s %12s %12s %8s\n", "size", "fractal", "1 thread (ms)", "pool (ms)", "ns/sample",
+		"range", "check");
+	for(int size : options.Sizes)
+	{
+		for(int ridged = 0; ridged < 2; ++ridged)
+		{
+			NoiseHeightSource::Desc noise;
+			noise.Type = ridged ? NoiseHeightSource::Fractal::Ridged : NoiseHeightSource::Fractal::FBm;
+			noise.Seed = options.Seed;
+			noise.Width = size;
+			noise.Height = size;
+
+			NoiseHeightSource source;
+			NoiseHeightSource again;
+			bool ok = source.Open(noise) && again.Open(noise);
+
+			std::vector<float> heights((size_t)size*size);
+			std::vector<float> pooled((size_t)size*size);
+			auto start = std::chrono::steady_clock::now();
+			for(int i = 0; ok && i < size; ++i)
+				source.ReadRow(i, 0, size, &heights[(size_t)i*size]);
+			auto stop = std::chrono::steady_clock::now();
+			double serialMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+			start = std::chrono::steady_clock::now();
+			if(ok)
+				again.ReadWindow(0, 0, size, size, pooled.data(), size);
+			stop = std::chrono::steady_clock::now();
+			double poolMs = std::chrono::duration<double, std::milli>(stop - start).count();
+			ok = ok && memcmp(heights.data(), pooled.data(), heights.size()*sizeof(float)) == 0;
+
+			// an odd window, so its lane groups start elsewhere than the full rows'
+			int row = size / 3;
+			int col = size / 5 + 1;
+			int rows = std::min(37, size - row);
+			int cols = std::min(53, size - col);
+			std::vector<float> window((size_t)rows*cols);
+			if(ok)
+				source.ReadWindow(row, col, rows, cols, window.data(), cols);
+			for(int i = 0; ok && i < rows; ++i)
+				ok = memcmp(&window[(size_t)i*cols], &heights[(size_t)(row + i)*size + col], cols*sizeof(float)) == 0;
+			for(int k = 0; ok && k < 64; ++k)
+			{
+				int r = (k*7919) % size;
+				int c = (k*104729) % size;
+				ok = source.Sample(r, c) == heights[(size_t)r*size + c];
+			}
+
+			float low = *std::min_element(heights.begin(), heights.end());
+			float high = *std::max_element(heights.begin(), heights.end());
+			ok = ok && low >= 0.0f && high <= noise.Amplitude;
+			passed = passed && ok;
+			printf("%8d %8s %14.2f %14.2f %12.1f %5.0f..%-6.0f %8s\n", size, ridged ? "ridged" : "fBm", serialMs, poolMs,
+				serialMs*1e6 / heights.size(), low, high, ok ? "ok" : "FAILED");
+		}
+	}
+	{
+		// another seed must give another world
+		NoiseHeightSource::Desc noise;
+		NoiseHeightSource a;
+		NoiseHeightSource b;
+		noise.Seed = options.Seed;
+		a.Open(noise);
+		noise.Seed = options.Seed + 1;
+		b.Open(noise);
+		int same = 0;
+		for(int k = 0; k < 256; ++k)
+			same += a.Sample(k*3, k*4) == b.Sample(k*3, k*4);
+		bool ok = same < 16;
+		passed = passed && ok;
+		printf("seeds %u and %u share %d of 256 samples%s\n", options.Seed, options.Seed + 1, same, ok ? "" : "  FAILED");
+	}
+
+	//
+	// Tile streaming: a camera flying corner to corner over the largest map as a tiled
+	// file, then over a noise world of 16385 x 16385 samples that exists nowhere.
+	//
+	{
+		int size = options.Sizes.back();
+		std::vector<float> heights = MakeHeightmap(size, options.Seed);
+		if(!WriteHeightmap(options.Temp, heights, size, HeightmapSource::Format::R16, HeightmapSource::Endian::Little, 256))
+		{
+			printf("cannot write %s\n", options.Temp.c_str());
+			return 1;
+		}
+
+		TerrainTileStreamer::Desc desc;
+		desc.TileCells = 128;
+		desc.OriginX = -0.5f*dx*(size - 1);
+		desc.OriginZ = 0.5f*dz*(size - 1);
+		desc.Spacing = dx;
+		desc.LoadRadius = 300.0f;
+		desc.MemoryBudget = 32 << 20;
+
+		char name[64];
+		printf("\nTile streaming\n");
+		snprintf(name, sizeof(name), "%dx%d tiled file", size, size);
+		passed = FlyOver(name, [&](TerrainTileStreamer& streamer) { return streamer.OpenTiled(options.Temp, desc); },
+			desc, dx*(size - 1)) && passed;
+		remove(options.Temp.c_str());
+
+		NoiseHeightSource::Desc noise;
+		noise.Seed = options.Seed;
+		noise.Width = 16385;
+		noise.Height = 16385;
+		desc.OriginX = -0.5f*dx*(noise.Width - 1);
+		desc.OriginZ = 0.5f*dz*(noise.Height - 1);
+		snprintf(name, sizeof(name), "%dx%d noise", noise.Width, noise.Height);
+		passed = FlyOver(name, [&](TerrainTileStreamer& streamer) { return streamer.OpenNoise(noise, desc); },
+			desc, dx*(noise.Width - 1)) && passed;
+	}
+
+	//
+	// Loaders: the old ifstream + byte copy + float copy path against mapping the
+	// file and decoding it, for every format.
+	//
+	int size = options.Sizes.back();
+	std::vector<float> heights = MakeHeightmap(size, options.Seed);
+	std::vector<float> decoded((size_t)size*size);
+
+	printf("\nHeightmap loaders, %dx%d\n", size, size);
+	printf("%14s %12s %12s %14s\n", "format", "open (ms)", "read (ms)", "ns/sample");
+
+	struct Layout
+	{
+		const char* Name;
+		HeightmapSource::Format Format;
+		HeightmapSource::Endian ByteOrder;
+		int TileSize;
+	};
+	const Layout layouts[] =
+	{
+		{ "r8",				HeightmapSource::Format::R8,	HeightmapSource::Endian::Little,	0 },
+		{ "r16 le",			HeightmapSource::Format::R16,	HeightmapSource::Endian::Little,	0 },
+		{ "r16 be",			HeightmapSource::Format::R16,	HeightmapSource::Endian::Big,		0 },
+		{ "r32f",			HeightmapSource::Format::R32F,	HeightmapSource::Endian::Little,	0 },
+		{ "tiled r16 256",	HeightmapSource::Format::R16,	HeightmapSource::Endian::Little,	256 },
+		{ "tiled r32f 100",	HeightmapSource::Format::R32F,	HeightmapSource::Endian::Big,		100 },
+	};
+
+	for(const Layout& layout : layouts)
+	{
+		if(!WriteHeightmap(options.Temp, heights, size, layout.Format, layout.ByteOrder, layout.TileSize))
+		{
+			printf("cannot write %s\n", options.Temp.c_str());
+			return 1;
+		}
+
+		if(layout.Format == HeightmapSource::Format::R8)
+		{
+			// What Terrain::ReadRawFile did.
+			auto start = std::chrono::steady_clock::now();
+			std::ifstream file(options.Temp, std::ios::binary);
+			file.seekg(0, std::ios::end);
+			std::vector<unsigned char> bytes((size_t)file.tellg());
+			file.seekg(0, std::ios::beg);
+			file.read((char*)bytes.data(), bytes.size());
+			std::vector<float> copy(bytes.begin(), bytes.end());
+			auto stop = std::chrono::steady_clock::now();
+			printf("%14s %12.2f %12s %14.2f\n", "r8 ifstream", std::chrono::duration<double, std::milli>(stop - start).count(),
+				"-", std::chrono::duration<double, std::nano>(stop - start).count() / copy.size());
+		}
+
+		HeightmapSource source;
+		auto start = std::chrono::steady_clock::now();
+		bool opened = layout.TileSize == 0 ?
+			source.OpenRaw(options.Temp, HeightmapSource::RawDesc{ layout.Format, layout.ByteOrder, 0, 0 }) :
+			source.OpenTiled(options.Temp);
+		auto mapped = std::chrono::steady_clock::now();
+		if(opened)
+			source.ReadWindow(0, 0, size, size, decoded.data(), size);
+		auto stop = std::chrono::steady_clock::now();
+
+		bool ok = opened && source.Width() == size && source.Height() == size && decoded == heights;
+		passed = passed && ok;
+		printf("%14s %12.2f %12.2f %14.2f%s\n", layout.Name,
+			std::chrono::duration<double, std::milli>(mapped - start).count(),
+			std::chrono::duration<double, std::milli>(stop - mapped).count(),
+			std::chrono::duration<double, std::nano>(stop - start).count() / decoded.size(), ok ? "" : "  FAILED");
+	}
+	remove(options.Temp.c_str());
+
+	printf("\n%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
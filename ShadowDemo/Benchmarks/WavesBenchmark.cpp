@@ -0,0 +1,459 @@
+//***************************************************************************************
+// WavesBenchmark.cpp
+//
+// Headless benchmark for the Waves solver and the spectral ocean.  It does not touch D3D12 and builds on
+// Linux as well as Windows, e.g.
+//
+//   g++ -std=c++14 -O2 -march=native -pthread -I<DirectXMath>/Inc -I..
+//       WavesBenchmark.cpp ../Waves.cpp ../SpectralWaves.cpp ../Common/TaskScheduler.cpp
+//       -o WavesBenchmark
+//
+// (DirectXMath is header only; on Linux it also needs a sal.h shim on the include path.)
+//
+// Usage: WavesBenchmark [options]
+//   -sizes a,b,...     square grid sizes to sweep       (128,256,512,1024,2048,4096)
+//   -threads a,b,...   thread counts to sweep           (1, 2, 4, ... hardware threads)
+//   -rates a,b,...     impulses per step to sweep       (0,64,1024)
+//   -cells N           cell updates per measurement     (2e8)
+//   -seed N            seed of every random sequence    (1)
+//
+// Runs are reproducible: impulses come from a std::mt19937 seeded from -seed and
+// the grid size, never from global state.  Speedup and efficiency are relative
+// to the first thread count of the sweep.
+//
+// The emit runs write the surface into three output buffers in turn, as the demo's
+// frame resources take it.  Under rain every tile changes every frame; after a single
+// disturbance only the tiles the wave has reached are written.
+//
+// The splat runs check that an impulse wider than MaxSplatRadius falls off within the
+// capped footprint, as one of that radius does, instead of ending in a step.
+//***************************************************************************************
+
+#include "../Waves.h"
+#include "../SpectralWaves.h"
+#include "../Common/TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		std::vector<int> Sizes = { 128, 256, 512, 1024, 2048, 4096 };
+		std::vector<int> Threads;
+		std::vector<int> Rates = { 0, 64, 1024 };
+		double Cells = 2e8;
+		unsigned Seed = 1;
+	};
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		const char* p = text;
+		while(*p)
+		{
+			char* end = nullptr;
+			long value = strtol(p, &end, 10);
+			if(end == p)
+				break;
+
+			values.push_back((int)value);
+			p = *end == ',' ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options& options)
+	{
+		if(argc % 2 == 0)
+			return false;
+
+		for(int i = 1; i + 1 < argc; i += 2)
+		{
+			if(strcmp(argv[i], "-sizes") == 0)
+				options.Sizes = ParseList(argv[i + 1]);
+			else if(strcmp(argv[i], "-threads") == 0)
+				options.Threads = ParseList(argv[i + 1]);
+			else if(strcmp(argv[i], "-rates") == 0)
+				options.Rates = ParseList(argv[i + 1]);
+			else if(strcmp(argv[i], "-cells") == 0)
+				options.Cells = atof(argv[i + 1]);
+			else if(strcmp(argv[i], "-seed") == 0)
+				options.Seed = (unsigned)strtoul(argv[i + 1], nullptr, 10);
+			else
+				return false;
+		}
+
+		if(options.Threads.empty())
+		{
+			int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+			for(int threads = 1; threads < hardware; threads *= 2)
+				options.Threads.push_back(threads);
+			options.Threads.push_back(hardware);
+		}
+
+		for(int size : options.Sizes)
+		{
+			if(size < 8)
+				return false;
+		}
+		for(int threads : options.Threads)
+		{
+			if(threads < 1)
+				return false;
+		}
+
+		return !options.Sizes.empty() && options.Cells > 0.0;
+	}
+
+	// count impulses spread uniformly over a rows x cols grid, heights within
+	// +-magnitude.
+	std::vector<Waves::Impulse> MakeImpulses(int count, int rows, int cols, unsigned seed, float magnitude)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> row(0, rows - 1);
+		std::uniform_int_distribution<int> col(0, cols - 1);
+		std::uniform_real_distribution<float> height(-magnitude, magnitude);
+		std::uniform_real_distribution<float> radius(0.0f, 3.0f);
+
+		std::vector<Waves::Impulse> impulses(count);
+		for(auto& impulse : impulses)
+			impulse = { row(rng), col(rng), height(rng), radius(rng) };
+		return impulses;
+	}
+
+	// Runs steps steps, each preceded by rate impulses taken in turn from pool,
+	// and returns the wall time in seconds.
+	double TimeSteps(Waves& waves, int steps, int rate, const std::vector<Waves::Impulse>& pool, size_t& next)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for(int s = 0; s < steps; ++s)
+		{
+			if(rate > 0)
+			{
+				if(next + rate > pool.size())
+					next = 0;
+				waves.DisturbBatch(&pool[next], rate);
+				next += rate;
+			}
+			waves.Simulate(1);
+		}
+		auto stop = std::chrono::steady_clock::now();
+
+		return std::chrono::duration<double>(stop - start).count();
+	}
+
+	// Lower bound of the memory traffic of one cell update: the stencil reads
+	// both height buffers and writes one.  Normals are only computed by
+	// EmitVertices, timed on its own.  Neighbouring rows are assumed to hit the cache.
+	double BytesPerCellUpdate(int heightBytes)
+	{
+		return 3.0*heightBytes;
+	}
+
+	// Applies frames batches of impulses, one step after each, and returns the
+	// wall time of the DisturbBatch calls alone in seconds.
+	double TimeDisturbs(Waves& waves, const std::vector<Waves::Impulse>& impulses, int frames)
+	{
+		double seconds = 0.0;
+		for(int f = 0; f < frames; ++f)
+		{
+			auto start = std::chrono::steady_clock::now();
+			waves.DisturbBatch(impulses.data(), (int)impulses.size());
+			auto stop = std::chrono::steady_clock::now();
+			seconds += std::chrono::duration<double>(stop - start).count();
+
+			waves.Simulate(1);
+		}
+		return seconds;
+	}
+
+	// Runs the same seeded scenario on a solver with the given height storage:
+	// a burst of impulses, then steps steps.  Returns the wall time of the steps
+	// and the final heights.
+	template<typename Height>
+	double RunScenario(int rows, int cols, int steps, TaskScheduler& scheduler,
+		const std::vector<Waves::Impulse>& impulses, std::vector<float>& heights)
+	{
+		BasicWaves<Height> waves(rows, cols, 1.0f, 0.03f, 4.0f, 0.2f);
+		waves.SetScheduler(&scheduler);
+		waves.SetRestThreshold(0.0f);
+
+		std::vector<typename BasicWaves<Height>::Impulse> splats;
+		for(auto& impulse : impulses)
+			splats.push_back({ impulse.Row, impulse.Col, impulse.Magnitude, impulse.Radius });
+		waves.DisturbBatch(splats.data(), (int)splats.size());
+
+		auto start = std::chrono::steady_clock::now();
+		waves.Simulate(steps);
+		auto stop = std::chrono::steady_clock::now();
+
+		heights.resize(waves.VertexCount());
+		for(int i = 0; i < waves.VertexCount(); ++i)
+			heights[i] = waves.Position(i).y;
+
+		return std::chrono::duration<double>(stop - start).count();
+	}
+
+	// One splat of the given radius in the middle of a calm grid.  Returns the height at
+	// the centre and along the centre row at the footprint's edge, MaxSplatRadius cells
+	// out for a wider radius, and just past it.
+	void MeasureSplat(float radius, float& centre, float& edge, float& outside)
+	{
+		const int size = 4*Waves::MaxSplatRadius;
+		Waves waves(size, size, 1.0f, 0.03f, 4.0f, 0.2f);
+		int reach = std::min((int)ceilf(radius), (int)Waves::MaxSplatRadius);
+		Waves::Impulse impulse = { size / 2, size / 2, 1.0f, radius };
+		waves.DisturbBatch(&impulse, 1);
+
+		int row = (size / 2)*size;
+		centre = waves.Position(row + size / 2).y;
+		edge = waves.Position(row + size / 2 + reach).y;
+		outside = waves.Position(row + size / 2 + reach + 1).y;
+	}
+
+	// Compares a run against the float reference.
+	void PrintFormat(const char* name, int bytes, double seconds, double cellUpdates,
+		const std::vector<float>& heights, const std::vector<float>& reference)
+	{
+		double maxError = 0.0;
+		double sumSq = 0.0;
+		double refSq = 0.0;
+		for(size_t i = 0; i < heights.size(); ++i)
+		{
+			double e = fabs(double(heights[i]) - reference[i]);
+			maxError = std::max(maxError, e);
+			sumSq += e*e;
+			refSq += double(reference[i])*reference[i];
+		}
+
+		printf("%8s %6d %14.3f %12.3g %12.3g %12.3g\n", name, bytes, seconds*1e9 / cellUpdates,
+			maxError, sqrt(sumSq / heights.size()), refSq > 0.0 ? sqrt(sumSq / refSq) : 0.0);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: WavesBenchmark [-sizes a,b,..] [-threads a,b,..] [-rates a,b,..] [-cells N] [-seed N]\n");
+		return 1;
+	}
+
+	const float dt = 0.03f;
+	int maxThreads = *std::max_element(options.Threads.begin(), options.Threads.end());
+
+	//
+	// Step sweep.  Rate 0 starts from a single disturbance in the middle and lets
+	// the calm part of the grid sleep; the other rates keep raining on all of it.
+	//
+	printf("seed %u, %.3g cell updates per measurement\n\n", options.Seed, options.Cells);
+	printf("%6s %6s %8s %8s %12s %14s %10s %10s %11s\n", "size", "rate", "threads", "steps",
+		"time (ms)", "ns/cell-step", "GB/s", "speedup", "efficiency");
+
+	for(int size : options.Sizes)
+	{
+		double cells = double(size - 2)*(size - 2);
+		int steps = std::max(10, (int)(options.Cells / cells));
+		double cellUpdates = cells*steps;
+
+		for(int rate : options.Rates)
+		{
+			std::vector<Waves::Impulse> pool = MakeImpulses(std::max(rate, 1)*16, size, size, options.Seed + size, 0.05f);
+
+			double baseline = 0.0;
+			for(int threads : options.Threads)
+			{
+				// The caller takes part in every loop, so threads - 1 workers.
+				TaskScheduler scheduler(threads - 1);
+
+				Waves waves(size, size, 1.0f, dt, 4.0f, 0.2f);
+				waves.SetScheduler(&scheduler);
+				waves.Disturb(size / 2, size / 2, 1.0f);
+
+				// Warm up caches and the pool before timing.
+				size_t next = 0;
+				TimeSteps(waves, 10, rate, pool, next);
+				double seconds = TimeSteps(waves, steps, rate, pool, next);
+
+				if(baseline == 0.0)
+					baseline = seconds;
+
+				double speedup = baseline / seconds;
+				printf("%6d %6d %8d %8d %12.2f %14.3f %10.2f %10.2f %10.1f%%\n", size, rate, threads, steps,
+					seconds*1000.0, seconds*1e9 / cellUpdates,
+					cellUpdates*BytesPerCellUpdate(sizeof(float)) / seconds*1e-9,
+					speedup, 100.0*speedup*options.Threads.front() / threads);
+			}
+		}
+	}
+
+	//
+	// Rain: 10k small splats per frame over the whole surface.
+	//
+	int rows = std::min(options.Sizes.back(), 1024);
+	int cols = rows;
+	const int impulseCount = 10000;
+	const int frames = 100;
+
+	std::vector<Waves::Impulse> impulses = MakeImpulses(impulseCount, rows, cols, options.Seed, 0.05f);
+
+	printf("\nDisturbBatch, %dx%d, %d impulses x %d frames\n", rows, cols, impulseCount, frames);
+	printf("%8s %14s %14s %10s\n", "threads", "ms/frame", "ns/impulse", "speedup");
+
+	double baseline = 0.0;
+	for(int threads : options.Threads)
+	{
+		TaskScheduler scheduler(threads - 1);
+
+		Waves waves(rows, cols, 1.0f, dt, 4.0f, 0.2f);
+		waves.SetScheduler(&scheduler);
+
+		TimeDisturbs(waves, impulses, 5);
+		double seconds = TimeDisturbs(waves, impulses, frames);
+
+		if(baseline == 0.0)
+			baseline = seconds;
+
+		printf("%8d %14.3f %14.2f %10.2f\n", threads, seconds*1000.0 / frames,
+			seconds*1e9 / (double(impulseCount)*frames), baseline / seconds);
+	}
+
+	//
+	// Emit: SetOutputBuffers once, then EmitVertices into the buffers in turn.
+	//
+	const int outputCount = 3;
+	const int rainPerFrame = impulseCount / 10;
+	printf("\nEmitVertices, %dx%d, %d output buffers, %d frames\n", rows, cols, outputCount, frames);
+	printf("%8s %8s %14s %14s %10s %10s\n", "scene", "threads", "ms/frame", "ns/vertex", "GB/s", "written");
+
+	for(int rain = 1; rain >= 0; --rain)
+	{
+		for(int threads : options.Threads)
+		{
+			TaskScheduler scheduler(threads - 1);
+
+			Waves waves(rows, cols, 1.0f, dt, 4.0f, 0.2f);
+			waves.SetScheduler(&scheduler);
+			std::vector<std::vector<Vertex>> storage(outputCount, std::vector<Vertex>(waves.VertexCount()));
+			std::vector<Vertex*> outputs;
+			for(auto& buffer : storage)
+				outputs.push_back(buffer.data());
+			waves.SetOutputBuffers(outputs.data(), outputCount);
+			if(!rain)
+				waves.Disturb(rows / 2, cols / 2, 1.0f);
+
+			// the first frames fill every buffer once and are not timed
+			const int warmup = outputCount;
+			double seconds = 0.0;
+			double bytes = 0.0;
+			for(int f = 0; f < warmup + frames; ++f)
+			{
+				if(rain)
+					waves.DisturbBatch(&impulses[(f % 10)*rainPerFrame], rainPerFrame);
+				waves.Simulate(1);
+
+				auto start = std::chrono::steady_clock::now();
+				waves.EmitVertices(f % outputCount);
+				auto stop = std::chrono::steady_clock::now();
+				if(f < warmup)
+					continue;
+
+				seconds += std::chrono::duration<double>(stop - start).count();
+				for(const auto& range : waves.DirtyRanges())
+					bytes += double(range.Size);
+			}
+
+			double vertices = double(waves.VertexCount())*frames;
+			printf("%8s %8d %14.3f %14.3f %10.2f %9.1f%%\n", rain ? "rain" : "calm", threads,
+				seconds*1000.0 / frames, seconds*1e9 / vertices, bytes / seconds*1e-9,
+				100.0*bytes / (vertices*sizeof(Vertex)));
+		}
+	}
+
+	//
+	// Splat footprints: a radius past MaxSplatRadius is capped, bump and footprint
+	// alike, so the bump has faded to about 1% where the footprint ends instead of
+	// being cut off.
+	//
+	printf("\nSplat footprints, MaxSplatRadius %d\n", (int)Waves::MaxSplatRadius);
+	printf("%8s %12s %12s %12s %10s\n", "radius", "centre", "edge", "outside", "ok");
+
+	bool splatsOk = true;
+	for(float radius : { 8.0f, (float)Waves::MaxSplatRadius, 48.0f, 100.0f })
+	{
+		float centre, edge, outside;
+		MeasureSplat(radius, centre, edge, outside);
+		// exp(-4.5) at the edge, in float
+		bool ok = fabsf(centre - 1.0f) < 1e-6f && edge > 0.0f && edge < 0.012f && outside == 0.0f;
+		printf("%8g %12.6f %12.6f %12.6f %10s\n", radius, centre, edge, outside, ok ? "yes" : "NO");
+		splatsOk = splatsOk && ok;
+	}
+
+	//
+	// Height formats: speed of the stencil and divergence from the float solver
+	// after the same steps.
+	//
+	int steps = std::max(10, (int)(options.Cells / (double(rows - 2)*(cols - 2))));
+	double cellUpdates = double(rows - 2)*(cols - 2)*steps;
+	std::vector<Waves::Impulse> burst = MakeImpulses(200, rows, cols, options.Seed, 0.5f);
+
+	printf("\nHeight formats, %dx%d, %d steps, %d threads\n", rows, cols, steps, maxThreads);
+	printf("%8s %6s %14s %12s %12s %12s\n", "format", "bytes", "ns/cell-step", "max error", "rms error", "rel. rms");
+
+	TaskScheduler scheduler(maxThreads - 1);
+	std::vector<float> reference, heights;
+
+	double seconds = RunScenario<float>(rows, cols, steps, scheduler, burst, reference);
+	PrintFormat("float", 4, seconds, cellUpdates, reference, reference);
+
+	seconds = RunScenario<DirectX::PackedVector::HALF>(rows, cols, steps, scheduler, burst, heights);
+	PrintFormat("half", 2, seconds, cellUpdates, heights, reference);
+
+	seconds = RunScenario<std::int16_t>(rows, cols, steps, scheduler, burst, heights);
+	PrintFormat("int16", 2, seconds, cellUpdates, heights, reference);
+
+	//
+	// Spectral ocean: one Update is a spectrum evaluation and three 2D FFTs,
+	// whatever the time step.  Power of two sizes only.
+	//
+	printf("\nSpectralWaves, %d threads\n", maxThreads);
+	printf("%6s %8s %12s %14s\n", "size", "updates", "ms/update", "ns/cell");
+
+	for(int size : options.Sizes)
+	{
+		if((size & (size - 1)) != 0)
+			continue;
+
+		SpectralWaves::Desc desc;
+		desc.Size = size;
+		desc.PatchSize = float(size);
+		desc.Seed = options.Seed;
+
+		SpectralWaves ocean(desc);
+		ocean.SetScheduler(&scheduler);
+
+		int updates = std::max(5, (int)(options.Cells / (20.0*size*size)));
+		ocean.Update(dt);
+
+		auto start = std::chrono::steady_clock::now();
+		for(int u = 0; u < updates; ++u)
+			ocean.Update(dt);
+		auto stop = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(stop - start).count();
+		printf("%6d %8d %12.3f %14.3f\n", size, updates, seconds*1000.0 / updates,
+			seconds*1e9 / (double(size)*size*updates));
+	}
+
+	printf("\n%s\n", splatsOk ? "passed" : "FAILED");
+	return splatsOk ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+
+namespace
+{
+	//Scheduler the current thread works for, and the queue it owns there.
+	thread_local const TaskScheduler* t_scheduler = nullptr;
+	thread_local int t_queueIndex = 0;
+}
+
+TaskScheduler::TaskScheduler(int workerCount)
+	: m_queuedTasks(0)
+{
+	if (workerCount < 0)
+		workerCount = std::max(1, (int)std::thread::hardware_concurrency()) - 1;
+
+	//queue 0 belongs to the threads outside the pool
+	for (int i = 0; i <= workerCount; ++i)
+		m_queues.push_back(std::make_unique<WorkQueue>());
+
+	for (int i = 1; i <= workerCount; ++i)
+		m_workers.emplace_back(&TaskScheduler::WorkerMain, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+		m_stop = true;
+	}
+	m_wakeUp.notify_all();
+
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+int TaskScheduler::WorkerCount()const
+{
+	return (int)m_workers.size();
+}
+
+void TaskScheduler::Run(std::function<void()> job)
+{
+	if (m_workers.empty())
+	{
+		job();
+		return;
+	}
+
+	//straight to a worker queue, round robin; see Steal
+	DetachedJob* owner = new DetachedJob{ [job](int, int) { job(); }, { 1 } };
+	int queueIndex = 1 + m_nextJobQueue.fetch_add(1) % (int)m_workers.size();
+	Push(queueIndex, Task{ &owner->body, 0, 1, 1, &owner->pending, owner });
+}
+
+void TaskScheduler::ParallelForRange(int begin, int end, int grainSize, const RangeFunc& body)
+{
+	if (end <= begin)
+		return;
+
+	grainSize = std::max(1, grainSize);
+	if (m_workers.empty() || end - begin <= grainSize)
+	{
+		body(begin, end);
+		return;
+	}
+
+	std::atomic<int> pending(1);
+	int queueIndex = CurrentQueueIndex();
+	Execute(queueIndex, Task{ &body, begin, end, grainSize, &pending, nullptr });
+
+	//help out until every range of this loop has finished
+	while (pending.load(std::memory_order_acquire) != 0)
+	{
+		Task task;
+		if (FindTask(queueIndex, task))
+			Execute(queueIndex, task);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void TaskScheduler::WorkerMain(int queueIndex)
+{
+	t_scheduler = this;
+	t_queueIndex = queueIndex;
+
+	for (;;)
+	{
+		Task task;
+		if (FindTask(queueIndex, task))
+		{
+			Execute(queueIndex, task);
+			continue;
+		}
+
+		//leave queued Run jobs to the other workers before stopping
+		std::unique_lock<std::mutex> lock(m_sleepLock);
+		m_wakeUp.wait(lock, [this] { return m_stop || m_queuedTasks.load() > 0; });
+		if (m_stop && m_queuedTasks.load() == 0)
+			return;
+	}
+}
+
+int TaskScheduler::CurrentQueueIndex()const
+{
+	return t_scheduler == this ? t_queueIndex : 0;
+}
+
+void TaskScheduler::Push(int queueIndex, const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queues[queueIndex]->lock);
+		m_queues[queueIndex]->tasks.push_back(task);
+	}
+	m_queuedTasks.fetch_add(1);
+
+	//take the sleep lock so a worker cannot miss the wake up between its check and its wait
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+	}
+	m_wakeUp.notify_one();
+}
+
+//own queue: newest first, its data is most likely still in cache
+bool TaskScheduler::Pop(int queueIndex, Task& task)
+{
+	WorkQueue& queue = *m_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.lock);
+	if (queue.tasks.empty())
+		return false;
+
+	task = queue.tasks.back();
+	queue.tasks.pop_back();
+	m_queuedTasks.fetch_sub(1);
+	return true;
+}
+
+//other queues: oldest first, those are the largest ranges.  Threads outside the pool
+//leave Run jobs alone, so a loop on the main thread is never held up by one
+bool TaskScheduler::Steal(int thiefIndex, Task& task)
+{
+	int queueCount = (int)m_queues.size();
+	for (int i = 1; i < queueCount; ++i)
+	{
+		WorkQueue& queue = *m_queues[(thiefIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.lock);
+		if (queue.tasks.empty() || (thiefIndex == 0 && queue.tasks.front().owner))
+			continue;
+
+		task = queue.tasks.front();
+		queue.tasks.pop_front();
+		m_queuedTasks.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+bool TaskScheduler::FindTask(int queueIndex, Task& task)
+{
+	return Pop(queueIndex, task) || Steal(queueIndex, task);
+}
+
+void TaskScheduler::Execute(int queueIndex, Task task)
+{
+	//keep the left half, publish the right half for thieves
+	while (task.end - task.begin > task.grainSize)
+	{
+		int mid = task.begin + (task.end - task.begin) / 2;
+
+		Task right = task;
+		right.begin = mid;
+		task.end = mid;
+
+		task.pending->fetch_add(1);
+		Push(queueIndex, right);
+	}
+
+	(*task.body)(task.begin, task.end);
+	//a loop's counter may be gone right after the decrement, the owner of a job is not
+	DetachedJob* owner = task.owner;
+	if (task.pending->fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete owner;
+}
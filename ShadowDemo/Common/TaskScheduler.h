@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Small portable work-stealing job system.
+//A fixed pool of workers is created up front.  Every worker owns a queue; it pops
+//its own work LIFO and steals from the other queues FIFO, so thieves take the
+//largest pending ranges.  Threads that are not workers (the main thread) share
+//queue 0 and take part in the work while they wait.
+class TaskScheduler
+{
+public:
+	//Loop body, called with a half open sub range [begin, end).
+	typedef std::function<void(int begin, int end)> RangeFunc;
+
+	//workerCount < 0 picks hardware_concurrency - 1, the caller being the last thread.
+	//With 0 workers every loop runs inline on the caller.
+	explicit TaskScheduler(int workerCount = -1);
+	TaskScheduler(const TaskScheduler& rhs) = delete;
+	TaskScheduler& operator=(const TaskScheduler& rhs) = delete;
+	~TaskScheduler();
+
+	//Pool shared by the whole application.
+	static TaskScheduler* GetInstance()
+	{
+		static TaskScheduler instance;
+
+		return &instance;
+	}
+
+	//Number of worker threads, not counting the calling thread.
+	int WorkerCount()const;
+
+	//Queues job for a worker and returns at once.  Without workers it runs inline.
+	//Jobs still queued when the scheduler is destroyed are run before it returns.
+	void Run(std::function<void()> job);
+
+	//Runs body over [begin, end) and blocks until every sub range is done.
+	//Ranges are split in halves until they hold at most grainSize items.
+	void ParallelForRange(int begin, int end, int grainSize, const RangeFunc& body);
+
+	//Same as ParallelForRange, body is called once per index.
+	template<typename Func>
+	void ParallelFor(int begin, int end, int grainSize, const Func& body)
+	{
+		ParallelForRange(begin, end, grainSize, [&body](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+				body(i);
+		});
+	}
+
+private:
+	//Body and counter of a job queued by Run, freed by whoever finishes its last range.
+	struct DetachedJob
+	{
+		RangeFunc body;
+		std::atomic<int> pending;
+	};
+
+	struct Task
+	{
+		const RangeFunc* body;
+		int begin;
+		int end;
+		int grainSize;
+		std::atomic<int>* pending;		//outstanding ranges of the owning ParallelFor
+		DetachedJob* owner;				//set for Run jobs, null for loops
+	};
+
+	struct WorkQueue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerMain(int queueIndex);
+	int CurrentQueueIndex()const;
+
+	void Push(int queueIndex, const Task& task);
+	bool Pop(int queueIndex, Task& task);
+	bool Steal(int thiefIndex, Task& task);
+	bool FindTask(int queueIndex, Task& task);
+	void Execute(int queueIndex, Task task);
+
+private:
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;	//[0] is shared by non-worker threads
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_sleepLock;
+	std::condition_variable m_wakeUp;
+	std::atomic<int> m_queuedTasks;
+	std::atomic<unsigned> m_nextJobQueue{ 0 };	//worker queue of the next Run job
+	bool m_stop = false;
+};
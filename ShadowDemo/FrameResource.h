@@ -3,6 +3,7 @@
 #include "Common\d3dUtil.h"
 #include "Common\MathHelper.h"
 #include "Common\UploadBuffer.h"
+#include "Vertex.h"
 
 struct ObjectConstants
 {
@@ -58,15 +59,6 @@ struct MaterialData
 	UINT MaterialPad2;
 };
 
-//ṹ
-struct Vertex
-{
-    DirectX::XMFLOAT3 Pos;
-    DirectX::XMFLOAT3 Normal;
-	DirectX::XMFLOAT2 TexC;
-	DirectX::XMFLOAT3 TangentU;
-};
-
 //ÿһ֡Ҫresources.  
 struct FrameResource
 {
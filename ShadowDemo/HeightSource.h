@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+//Heights on a Width() x Height() grid of samples, read or generated when asked for.
+//Terrain and TerrainTileStreamer build from any source through ReadWindow.
+class HeightSource
+{
+public:
+	virtual ~HeightSource() {}
+
+	virtual int Width()const = 0;
+	virtual int Height()const = 0;
+
+	//Writes a rows x cols window starting at (row, col), each sample times scale;
+	//dst rows are dstStride floats apart.
+	virtual void ReadWindow(int row, int col, int rows, int cols, float* dst, std::size_t dstStride,
+		float scale = 1.f)const = 0;
+};
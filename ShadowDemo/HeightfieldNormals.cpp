@@ -0,0 +1,259 @@
+#include "HeightfieldNormals.h"
+#include "Common/TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+//Same kernel selection as Waves: 8 columns at a time with AVX2, 4 with SSE2,
+//the scalar loop otherwise.
+#if !defined(_XM_NO_INTRINSICS_) && defined(__AVX2__)
+#define HEIGHTFIELD_AVX2
+#include <immintrin.h>
+#elif !defined(_XM_NO_INTRINSICS_) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define HEIGHTFIELD_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+#if defined(HEIGHTFIELD_AVX2)
+	typedef __m256 Lanes;
+	const int LaneCount = 8;
+
+	inline Lanes Load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void Store(float* p, Lanes v) { _mm256_storeu_ps(p, v); }
+	inline Lanes Splat(float f) { return _mm256_set1_ps(f); }
+	inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	inline Lanes Sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+	inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline Lanes InvSqrt(Lanes a) { return _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(a)); }
+	inline Lanes Positive(Lanes a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GT_OQ); }
+	inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b, a, mask); }
+#elif defined(HEIGHTFIELD_SSE)
+	typedef __m128 Lanes;
+	const int LaneCount = 4;
+
+	inline Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+	inline void Store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+	inline Lanes Splat(float f) { return _mm_set1_ps(f); }
+	inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+	inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes InvSqrt(Lanes a) { return _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(a)); }
+	inline Lanes Positive(Lanes a) { return _mm_cmpgt_ps(a, _mm_setzero_ps()); }
+	inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+#endif
+
+	//Unit normals of both triangles of every quad in one row of quads.  Quad q is
+	//stored at [q + 1]; [0] and [quads + 1] stay zero and stand for the quads left
+	//and right of the grid, so every vertex sums the same six entries.
+	struct FaceRow
+	{
+		float* X1;
+		float* Y1;
+		float* Z1;
+		float* X2;
+		float* Y2;
+		float* Z2;
+	};
+
+	void ClearFaceRow(FaceRow& faces, int quads)
+	{
+		size_t bytes = (quads + 2) * sizeof(float);
+		memset(faces.X1, 0, bytes);
+		memset(faces.Y1, 0, bytes);
+		memset(faces.Z1, 0, bytes);
+		memset(faces.X2, 0, bytes);
+		memset(faces.Y2, 0, bytes);
+		memset(faces.Z2, 0, bytes);
+	}
+
+	//Face normals of the quads between height rows top and bottom.
+	//With x to the right and z decreasing down the rows the cross products are
+	//  (i,j)(i,j+1)(i+1,j):      (-dz*(t1 - t0), dx*dz, dx*(b0 - t0))
+	//  (i,j+1)(i+1,j+1)(i+1,j):  (-dz*(b1 - b0), dx*dz, dx*(b1 - t1))
+	void ComputeFaceRow(const float* top, const float* bottom, int quads, float dx, float dz, FaceRow& faces)
+	{
+		const float dxdz = dx * dz;
+		float* x1 = faces.X1 + 1;
+		float* y1 = faces.Y1 + 1;
+		float* z1 = faces.Z1 + 1;
+		float* x2 = faces.X2 + 1;
+		float* y2 = faces.Y2 + 1;
+		float* z2 = faces.Z2 + 1;
+
+		int q = 0;
+#if defined(HEIGHTFIELD_AVX2) || defined(HEIGHTFIELD_SSE)
+		const Lanes vNegDz = Splat(-dz);
+		const Lanes vDx = Splat(dx);
+		const Lanes vDxDz = Splat(dxdz);
+		const Lanes vDxDzSq = Splat(dxdz * dxdz);
+		for (; q + LaneCount <= quads; q += LaneCount)
+		{
+			Lanes t0 = Load(top + q);
+			Lanes t1 = Load(top + q + 1);
+			Lanes b0 = Load(bottom + q);
+			Lanes b1 = Load(bottom + q + 1);
+
+			Lanes ax = Mul(vNegDz, Sub(t1, t0));
+			Lanes az = Mul(vDx, Sub(b0, t0));
+			Lanes invA = InvSqrt(Add(Add(Mul(ax, ax), vDxDzSq), Mul(az, az)));
+			Store(x1 + q, Mul(ax, invA));
+			Store(y1 + q, Mul(vDxDz, invA));
+			Store(z1 + q, Mul(az, invA));
+
+			Lanes bx = Mul(vNegDz, Sub(b1, b0));
+			Lanes bz = Mul(vDx, Sub(b1, t1));
+			Lanes invB = InvSqrt(Add(Add(Mul(bx, bx), vDxDzSq), Mul(bz, bz)));
+			Store(x2 + q, Mul(bx, invB));
+			Store(y2 + q, Mul(vDxDz, invB));
+			Store(z2 + q, Mul(bz, invB));
+		}
+#endif
+		for (; q < quads; ++q)
+		{
+			float ax = -dz * (top[q + 1] - top[q]);
+			float az = dx * (bottom[q] - top[q]);
+			float invA = 1.f / sqrtf(ax * ax + dxdz * dxdz + az * az);
+			x1[q] = ax * invA;
+			y1[q] = dxdz * invA;
+			z1[q] = az * invA;
+
+			float bx = -dz * (bottom[q + 1] - bottom[q]);
+			float bz = dx * (bottom[q + 1] - top[q + 1]);
+			float invB = 1.f / sqrtf(bx * bx + dxdz * dxdz + bz * bz);
+			x2[q] = bx * invB;
+			y2[q] = dxdz * invB;
+			z2[q] = bz * invB;
+		}
+
+		faces.X1[0] = faces.Y1[0] = faces.Z1[0] = 0.f;
+		faces.X2[0] = faces.Y2[0] = faces.Z2[0] = 0.f;
+		x1[quads] = y1[quads] = z1[quads] = 0.f;
+		x2[quads] = y2[quads] = z2[quads] = 0.f;
+	}
+
+	//Sum of the six triangles around vertex j of a row, above from the quads over
+	//the row, below from the quads under it.  Added in the order the index buffer
+	//visits them.
+	inline float SumFaces(const float* above1, const float* above2, const float* below1, const float* below2, int j)
+	{
+		return ((((above2[j] + above1[j + 1]) + above2[j + 1]) + below1[j]) + below2[j]) + below1[j + 1];
+	}
+
+	//Normals and tangents of one row of cols vertices into n*/t*.
+	void ComputeVertexRow(const FaceRow& above, const FaceRow& below, int cols,
+		float* nx, float* ny, float* nz, float* tx, float* tz)
+	{
+		int j = 0;
+#if defined(HEIGHTFIELD_AVX2) || defined(HEIGHTFIELD_SSE)
+		const Lanes vOne = Splat(1.f);
+		const Lanes vZero = Splat(0.f);
+		for (; j + LaneCount <= cols; j += LaneCount)
+		{
+			Lanes sx = Add(Add(Add(Add(Add(Load(above.X2 + j), Load(above.X1 + j + 1)), Load(above.X2 + j + 1)),
+				Load(below.X1 + j)), Load(below.X2 + j)), Load(below.X1 + j + 1));
+			Lanes sy = Add(Add(Add(Add(Add(Load(above.Y2 + j), Load(above.Y1 + j + 1)), Load(above.Y2 + j + 1)),
+				Load(below.Y1 + j)), Load(below.Y2 + j)), Load(below.Y1 + j + 1));
+			Lanes sz = Add(Add(Add(Add(Add(Load(above.Z2 + j), Load(above.Z1 + j + 1)), Load(above.Z2 + j + 1)),
+				Load(below.Z1 + j)), Load(below.Z2 + j)), Load(below.Z1 + j + 1));
+
+			Lanes horizontal = Add(Mul(sx, sx), Mul(sz, sz));
+			Lanes invN = InvSqrt(Add(horizontal, Mul(sy, sy)));
+			Store(nx + j, Mul(sx, invN));
+			Store(ny + j, Mul(sy, invN));
+			Store(nz + j, Mul(sz, invN));
+
+			//N x up = (-nz, 0, nx), (1,0,0) where N is vertical
+			Lanes tilted = Positive(horizontal);
+			Lanes invT = InvSqrt(horizontal);
+			Store(tx + j, Select(tilted, Mul(Sub(vZero, sz), invT), vOne));
+			Store(tz + j, Select(tilted, Mul(sx, invT), vZero));
+		}
+#endif
+		for (; j < cols; ++j)
+		{
+			float sx = SumFaces(above.X1, above.X2, below.X1, below.X2, j);
+			float sy = SumFaces(above.Y1, above.Y2, below.Y1, below.Y2, j);
+			float sz = SumFaces(above.Z1, above.Z2, below.Z1, below.Z2, j);
+
+			float horizontal = sx * sx + sz * sz;
+			float invN = 1.f / sqrtf(horizontal + sy * sy);
+			nx[j] = sx * invN;
+			ny[j] = sy * invN;
+			nz[j] = sz * invN;
+
+			if (horizontal > 0.f)
+			{
+				float invT = 1.f / sqrtf(horizontal);
+				tx[j] = -sz * invT;
+				tz[j] = sx * invT;
+			}
+			else
+			{
+				tx[j] = 1.f;
+				tz[j] = 0.f;
+			}
+		}
+	}
+}
+
+void ComputeHeightfieldNormals(const float* heights, int stride, int rows, int cols,
+	float dx, float dz, Vertex* vertices, TaskScheduler* scheduler)
+{
+	//a grid smaller than 2x2 has no triangles
+	if (rows < 2 || cols < 2)
+		return;
+
+	if (!scheduler)
+		scheduler = TaskScheduler::GetInstance();
+
+	const int quads = cols - 1;
+	const int grain = std::max(4, 16384 / cols);
+
+	scheduler->ParallelForRange(0, rows, grain, [&](int first, int last)
+	{
+		//two rows of face normals, padded, and one row of results
+		const size_t faceCount = quads + 2;
+		std::vector<float> scratch(12 * faceCount + 5 * cols);
+		float* p = scratch.data();
+		FaceRow above = { p, p + faceCount, p + 2 * faceCount, p + 3 * faceCount, p + 4 * faceCount, p + 5 * faceCount };
+		p += 6 * faceCount;
+		FaceRow below = { p, p + faceCount, p + 2 * faceCount, p + 3 * faceCount, p + 4 * faceCount, p + 5 * faceCount };
+		p += 6 * faceCount;
+		float* nx = p;
+		float* ny = nx + cols;
+		float* nz = ny + cols;
+		float* tx = nz + cols;
+		float* tz = tx + cols;
+
+		//the first row of the band also needs the quads above it
+		if (first > 0)
+			ComputeFaceRow(heights + stride * (first - 1), heights + stride * first, quads, dx, dz, above);
+		else
+			ClearFaceRow(above, quads);
+
+		for (int i = first; i < last; ++i)
+		{
+			if (i + 1 < rows)
+				ComputeFaceRow(heights + stride * i, heights + stride * (i + 1), quads, dx, dz, below);
+			else
+				ClearFaceRow(below, quads);
+
+			ComputeVertexRow(above, below, cols, nx, ny, nz, tx, tz);
+
+			Vertex* row = vertices + (size_t)cols * i;
+			for (int j = 0; j < cols; ++j)
+			{
+				row[j].Normal = XMFLOAT3(nx[j], ny[j], nz[j]);
+				row[j].TangentU = XMFLOAT3(tx[j], 0.f, tz[j]);
+			}
+
+			std::swap(above, below);
+		}
+	});
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Vertex.h"
+
+class TaskScheduler;
+
+//Writes Normal and TangentU of a rows x cols grid of vertices straight from its heights.
+//heights points at the first height of the grid, stride is the distance between two rows
+//of the heightmap, dx and dz the spacing of the grid in x and -z.  vertices holds the
+//grid row by row; Pos and TexC are left alone.
+//
+//Each quad is split into (i,j)(i,j+1)(i+1,j) and (i,j+1)(i+1,j+1)(i+1,j), as in Terrain's
+//index buffer.  A normal is the normalized sum of the unit normals of the up to six
+//triangles around its vertex, i.e. the same as accumulating face normals through the
+//index buffer, but every row is computed on its own without any scatter.
+//TangentU is normalize(N x up), or (1,0,0) where the normal points straight up.
+//
+//Rows are split over scheduler, the shared pool when it is null.
+void ComputeHeightfieldNormals(const float* heights, int stride, int rows, int cols,
+	float dx, float dz, Vertex* vertices, TaskScheduler* scheduler = nullptr);
@@ -0,0 +1,238 @@
+#include "HeightmapSource.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	int BytesPerSample(HeightmapSource::Format format)
+	{
+		switch (format)
+		{
+		case HeightmapSource::Format::R8:
+			return 1;
+		case HeightmapSource::Format::R16:
+			return 2;
+		case HeightmapSource::Format::R32F:
+			return 4;
+		}
+		return 0;
+	}
+
+	//Samples are assembled from their bytes, so the file's byte order does not have to
+	//match the machine's.
+	void Decode(const std::uint8_t* p, int count, HeightmapSource::Format format, HeightmapSource::Endian byteOrder,
+		float scale, float* dst)
+	{
+		const bool big = byteOrder == HeightmapSource::Endian::Big;
+		switch (format)
+		{
+		case HeightmapSource::Format::R8:
+			for (int i = 0; i < count; ++i)
+				dst[i] = p[i] * scale;
+			break;
+
+		case HeightmapSource::Format::R16:
+			if (big)
+			{
+				for (int i = 0; i < count; ++i, p += 2)
+					dst[i] = std::uint16_t(p[0] << 8 | p[1]) * scale;
+			}
+			else
+			{
+				for (int i = 0; i < count; ++i, p += 2)
+					dst[i] = std::uint16_t(p[0] | p[1] << 8) * scale;
+			}
+			break;
+
+		case HeightmapSource::Format::R32F:
+			for (int i = 0; i < count; ++i, p += 4)
+			{
+				std::uint32_t bits = big ?
+					std::uint32_t(p[0]) << 24 | std::uint32_t(p[1]) << 16 | std::uint32_t(p[2]) << 8 | p[3] :
+					std::uint32_t(p[3]) << 24 | std::uint32_t(p[2]) << 16 | std::uint32_t(p[1]) << 8 | p[0];
+				float value;
+				memcpy(&value, &bits, sizeof(value));
+				dst[i] = value * scale;
+			}
+			break;
+		}
+	}
+}
+
+const std::uint32_t HeightmapSource::TiledVersion;
+
+HeightmapSource::HeightmapSource()
+{
+}
+
+HeightmapSource::~HeightmapSource()
+{
+	Close();
+}
+
+bool HeightmapSource::OpenRaw(const std::string& path, const RawDesc& desc)
+{
+	Close();
+	int sampleBytes = BytesPerSample(desc.SampleFormat);
+	if (sampleBytes == 0 || desc.Width < 0 || desc.Height < 0 || !m_file.Open(path, MappedFile::Access::ReadOnly))
+		return false;
+
+	//work out the missing dimensions from the file size
+	std::uint64_t samples = m_file.Size() / sampleBytes;
+	std::uint64_t width = desc.Width;
+	std::uint64_t height = desc.Height;
+	if (width == 0)
+	{
+		width = (std::uint64_t)std::sqrt((double)samples);
+		while (width * width > samples)
+			--width;
+		while ((width + 1) * (width + 1) <= samples)
+			++width;
+	}
+	if (height == 0)
+		height = width ? samples / width : 0;
+
+	if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX ||
+		width * height * sampleBytes != m_file.Size())
+	{
+		Close();
+		return false;
+	}
+
+	m_data = m_file.Data();
+	m_format = desc.SampleFormat;
+	m_byteOrder = desc.ByteOrder;
+	m_sampleBytes = sampleBytes;
+	m_width = (int)width;
+	m_height = (int)height;
+	m_tileSize = 0;
+	m_tilesPerRow = 0;
+	return true;
+}
+
+bool HeightmapSource::OpenTiled(const std::string& path)
+{
+	Close();
+	if (!m_file.Open(path, MappedFile::Access::ReadOnly))
+		return false;
+
+	TiledHeader header;
+	if (m_file.Size() < sizeof(header))
+	{
+		Close();
+		return false;
+	}
+	memcpy(&header, m_file.Data(), sizeof(header));
+
+	Format format = (Format)header.SampleFormat;
+	int sampleBytes = BytesPerSample(format);
+	bool valid = memcmp(header.Magic, "HMTL", 4) == 0 && header.Version == TiledVersion &&
+		sampleBytes != 0 && header.ByteOrder <= (std::uint32_t)Endian::Big &&
+		header.Width > 0 && header.Height > 0 && header.TileSize > 0 &&
+		header.Width <= INT32_MAX && header.Height <= INT32_MAX && header.TileSize <= 65536;
+	if (valid)
+	{
+		std::uint64_t tilesPerRow = (header.Width + header.TileSize - 1) / header.TileSize;
+		std::uint64_t tilesPerCol = (header.Height + header.TileSize - 1) / header.TileSize;
+		std::uint64_t bytes = tilesPerRow * tilesPerCol * header.TileSize * header.TileSize * sampleBytes;
+		valid = m_file.Size() - sizeof(header) >= bytes;
+		m_tilesPerRow = (int)tilesPerRow;
+	}
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	m_data = m_file.Data() + sizeof(header);
+	m_format = format;
+	m_byteOrder = (Endian)header.ByteOrder;
+	m_sampleBytes = sampleBytes;
+	m_width = (int)header.Width;
+	m_height = (int)header.Height;
+	m_tileSize = (int)header.TileSize;
+	return true;
+}
+
+void HeightmapSource::Close()
+{
+	m_file.Close();
+	m_data = nullptr;
+	m_width = 0;
+	m_height = 0;
+	m_tileSize = 0;
+	m_tilesPerRow = 0;
+}
+
+bool HeightmapSource::IsOpen()const
+{
+	return m_data != nullptr;
+}
+
+int HeightmapSource::Width()const
+{
+	return m_width;
+}
+
+int HeightmapSource::Height()const
+{
+	return m_height;
+}
+
+HeightmapSource::Format HeightmapSource::SampleFormat()const
+{
+	return m_format;
+}
+
+float HeightmapSource::Sample(int row, int col, float scale)const
+{
+	float value;
+	ReadRow(row, col, 1, &value, scale);
+	return value;
+}
+
+void HeightmapSource::ReadRow(int row, int col, int count, float* dst, float scale)const
+{
+	assert(IsOpen());
+	assert(row >= 0 && row < m_height && col >= 0 && count >= 0 && col + count <= m_width);
+
+	//one run per tile the row crosses, a single run for row by row files
+	while (count > 0)
+	{
+		int contiguous;
+		const std::uint8_t* p = SamplePointer(row, col, contiguous);
+		int n = contiguous < count ? contiguous : count;
+		Decode(p, n, m_format, m_byteOrder, scale, dst);
+		dst += n;
+		col += n;
+		count -= n;
+	}
+}
+
+void HeightmapSource::ReadWindow(int row, int col, int rows, int cols, float* dst, std::size_t dstStride, float scale)const
+{
+	for (int i = 0; i < rows; ++i)
+		ReadRow(row + i, col, cols, dst + dstStride * i, scale);
+}
+
+const std::uint8_t* HeightmapSource::SamplePointer(int row, int col, int& contiguous)const
+{
+	if (m_tileSize == 0)
+	{
+		contiguous = m_width - col;
+		return m_data + ((std::size_t)row * m_width + col) * m_sampleBytes;
+	}
+
+	int tileRow = row / m_tileSize;
+	int tileCol = col / m_tileSize;
+	int r = row - tileRow * m_tileSize;
+	int c = col - tileCol * m_tileSize;
+	contiguous = m_tileSize - c;
+	if (contiguous > m_width - col)
+		contiguous = m_width - col;
+
+	std::size_t tile = (std::size_t)tileRow * m_tilesPerRow + tileCol;
+	std::size_t sample = (tile * m_tileSize + r) * m_tileSize + c;
+	return m_data + sample * m_sampleBytes;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "HeightSource.h"
+#include "MappedFile.h"
+
+//Read only view of a heightmap file mapped into memory.
+//Nothing is copied when the file is opened; samples are decoded to float when they are
+//read, so only the pages that are actually sampled are ever loaded.
+class HeightmapSource : public HeightSource
+{
+public:
+	enum class Format : std::uint32_t
+	{
+		R8 = 0,		//8-bit unsigned
+		R16 = 1,	//16-bit unsigned
+		R32F = 2,	//32-bit float
+	};
+
+	enum class Endian : std::uint32_t
+	{
+		Little = 0,
+		Big = 1,
+	};
+
+	//Layout of a headerless RAW file: Height rows of Width samples.
+	struct RawDesc
+	{
+		Format SampleFormat = Format::R8;
+		Endian ByteOrder = Endian::Little;
+		int Width = 0;			//0 for a square map, the size is then taken from the file
+		int Height = 0;
+	};
+
+	//Header of a tiled heightmap.  The map is cut into TileSize x TileSize tiles stored
+	//one after the other, row of tiles by row of tiles, each tile row by row.  Tiles on
+	//the right and bottom edge are stored at full size.  Sample data starts right
+	//after the header.
+	struct TiledHeader
+	{
+		char Magic[4];				//"HMTL"
+		std::uint32_t Version;		//TiledVersion
+		std::uint32_t Width;
+		std::uint32_t Height;
+		std::uint32_t TileSize;
+		std::uint32_t SampleFormat;	//Format
+		std::uint32_t ByteOrder;	//Endian
+		std::uint32_t Reserved;
+	};
+
+	static const std::uint32_t TiledVersion = 1;
+
+	HeightmapSource();
+	HeightmapSource(const HeightmapSource& rhs) = delete;
+	HeightmapSource& operator=(const HeightmapSource& rhs) = delete;
+	~HeightmapSource();
+
+	//Maps a headerless RAW file.  Fails when the file is missing or its size does not
+	//match the layout.
+	bool OpenRaw(const std::string& path, const RawDesc& desc);
+
+	//Maps a file starting with a TiledHeader.
+	bool OpenTiled(const std::string& path);
+
+	void Close();
+
+	bool IsOpen()const;
+	virtual int Width()const override;
+	virtual int Height()const override;
+	Format SampleFormat()const;
+
+	//Sample at (row, col) times scale.  8 and 16-bit samples keep their integer value,
+	//e.g. 0..65535 for R16.
+	float Sample(int row, int col, float scale = 1.f)const;
+
+	//Decodes count samples of row starting at col into dst, each times scale.
+	void ReadRow(int row, int col, int count, float* dst, float scale = 1.f)const;
+
+	//Decodes a rows x cols window starting at (row, col); dst rows are dstStride floats apart.
+	virtual void ReadWindow(int row, int col, int rows, int cols, float* dst, std::size_t dstStride,
+		float scale = 1.f)const override;
+
+private:
+	const std::uint8_t* SamplePointer(int row, int col, int& contiguous)const;
+
+private:
+	const std::uint8_t* m_data = nullptr;	//start of the sample data
+	MappedFile m_file;						//read-only
+
+	Format m_format = Format::R8;
+	Endian m_byteOrder = Endian::Little;
+	int m_sampleBytes = 1;
+	int m_width = 0;
+	int m_height = 0;
+	int m_tileSize = 0;						//0 for row by row
+	int m_tilesPerRow = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//A whole file mapped into memory, on Windows and POSIX.  A read-only view must not be
+//written; a copy-on-write view may be, and the changes stay in this process.
+class MappedFile
+{
+public:
+	enum class Access
+	{
+		ReadOnly,
+		CopyOnWrite,
+	};
+
+	MappedFile();
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	~MappedFile();
+
+	//Maps the file at path.  Fails when it is missing, empty or too large to map.
+	bool Open(const std::string& path, Access access);
+	void Close();
+
+	bool IsOpen()const;
+
+	//Start of the mapping, null when closed.
+	std::uint8_t* Data()const;
+
+	//Bytes mapped.
+	std::size_t Size()const;
+
+private:
+	std::uint8_t* m_view = nullptr;
+	std::size_t m_size = 0;
+	void* m_file = nullptr;				//Windows file and mapping handles
+	void* m_mapping = nullptr;
+};
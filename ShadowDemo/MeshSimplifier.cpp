@@ -0,0 +1,786 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace
+{
+	//Weight of the planes that hold seams and borders in place, against the faces' area.
+	const double BoundaryWeight = 10.0;
+
+	//A flip test rejects a collapse that turns a triangle further than about 75 degrees.
+	const double MinNormalCos = 0.25;
+
+	struct Position
+	{
+		double x, y, z;
+	};
+
+	Position Sub(const Position& a, const Position& b)
+	{
+		return Position{ a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	Position Cross(const Position& a, const Position& b)
+	{
+		return Position{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	double Dot(const Position& a, const Position& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	//Sum of weighted squared distances to planes, p.A.p + 2 b.p + c, and the sum of the weights.
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double w = 0;
+
+		//Plane n.p + d = 0, n of unit length.
+		void AddPlane(const Position& n, double d, double weight)
+		{
+			a00 += weight * n.x * n.x;
+			a01 += weight * n.x * n.y;
+			a02 += weight * n.x * n.z;
+			a11 += weight * n.y * n.y;
+			a12 += weight * n.y * n.z;
+			a22 += weight * n.z * n.z;
+			b0 += weight * n.x * d;
+			b1 += weight * n.y * d;
+			b2 += weight * n.z * d;
+			c += weight * d * d;
+			w += weight;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02;
+			a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			w += q.w;
+		}
+
+		double Evaluate(const Position& p)const
+		{
+			double e = p.x * (a00 * p.x + a01 * p.y + a02 * p.z)
+				+ p.y * (a01 * p.x + a11 * p.y + a12 * p.z)
+				+ p.z * (a02 * p.x + a12 * p.y + a22 * p.z)
+				+ 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+			return std::max(e, 0.0);
+		}
+	};
+
+	//Squared mean distance of p from the planes of a and b together.  Only orders the
+	//collapses; a mean says nothing about the largest distance, KeepsDeviation bounds that.
+	double CollapseError(const Quadric& a, const Quadric& b, const Position& p)
+	{
+		double w = a.w + b.w;
+		return w > 0.0 ? (a.Evaluate(p) + b.Evaluate(p)) / w : 0.0;
+	}
+
+	//Squared distance of p from the triangle abc, after Ericson, "Real-Time Collision
+	//Detection", 5.1.5.
+	double TriangleDistanceSq(const Position& p, const Position& a, const Position& b, const Position& c)
+	{
+		Position ab = Sub(b, a), ac = Sub(c, a), ap = Sub(p, a);
+		double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+		Position closest;
+		if (d1 <= 0.0 && d2 <= 0.0)
+			closest = a;
+		else
+		{
+			Position bp = Sub(p, b);
+			double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+			Position cp = Sub(p, c);
+			double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+			double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+			if (d3 >= 0.0 && d4 <= d3)
+				closest = b;
+			else if (d6 >= 0.0 && d5 <= d6)
+				closest = c;
+			else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+			{
+				double v = d1 / (d1 - d3);
+				closest = Position{ a.x + v * ab.x, a.y + v * ab.y, a.z + v * ab.z };
+			}
+			else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+			{
+				double w = d2 / (d2 - d6);
+				closest = Position{ a.x + w * ac.x, a.y + w * ac.y, a.z + w * ac.z };
+			}
+			else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+			{
+				double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+				closest = Position{ b.x + w * (c.x - b.x), b.y + w * (c.y - b.y), b.z + w * (c.z - b.z) };
+			}
+			else
+			{
+				double denom = 1.0 / (va + vb + vc);
+				double v = vb * denom, w = vc * denom;
+				closest = Position{ a.x + ab.x * v + ac.x * w, a.y + ab.y * v + ac.y * w, a.z + ab.z * v + ac.z * w };
+			}
+		}
+		Position d = Sub(p, closest);
+		return Dot(d, d);
+	}
+
+	enum class VertexKind : unsigned char
+	{
+		Manifold,		//one attribute set, inside the surface: collapses to any neighbour
+		Border,			//one attribute set, on an open border: collapses along the border
+		Seam,			//two attribute sets split along a seam: collapses along the seam
+		Locked			//never moves
+	};
+
+	//What is known of an edge between two positions, from the triangles of level 0.
+	struct EdgeInfo
+	{
+		int Triangles = 0;
+		std::uint32_t A, B;			//vertices at the smaller and the larger position, first triangle
+		bool Seam = false;			//a second triangle uses other vertices
+		std::uint32_t Triangle;		//first triangle
+	};
+
+	std::uint64_t EdgeKey(std::uint32_t a, std::uint32_t b)
+	{
+		return a < b ? (std::uint64_t)a << 32 | b : (std::uint64_t)b << 32 | a;
+	}
+
+	struct PositionKey
+	{
+		float x, y, z;
+
+		bool operator==(const PositionKey& rhs)const
+		{
+			return memcmp(this, &rhs, sizeof(PositionKey)) == 0;
+		}
+	};
+
+	struct PositionHash
+	{
+		std::size_t operator()(const PositionKey& key)const
+		{
+			std::uint32_t bits[3];
+			memcpy(bits, &key, sizeof(bits));
+			return (std::size_t)((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u));
+		}
+	};
+
+	struct Candidate
+	{
+		std::uint32_t From;
+		std::uint32_t To;
+		double Error;				//squared
+	};
+
+	//State of one chain: positions welded from the vertices, and the triangles left.
+	class Simplifier
+	{
+	public:
+		Simplifier(const float* positions, const float* attributes, std::size_t attributeCount,
+			std::size_t stride, std::size_t vertexCount, const std::vector<std::uint32_t>& indices);
+
+		float Radius()const { return m_radius; }
+		std::size_t TriangleCount()const { return m_triangles.size() / 3; }
+		const std::vector<std::uint32_t>& Triangles()const { return m_triangles; }
+
+		//Collapses edges cheapest first while every original position stays within
+		//maxError of the triangles left.
+		void Reduce(double maxError);
+
+		//Largest distance of an original position from the triangles left, measured over
+		//the triangles around the position standing for it, so never below the distance
+		//from the whole surface.
+		double Deviation();
+
+	private:
+		void Classify();
+		void BuildAdjacency();
+		bool Pass(double maxErrorSq);
+		std::uint32_t CornerAt(std::uint32_t triangle, std::uint32_t position)const;
+		int SharedTriangles(std::uint32_t from, std::uint32_t to)const;
+		bool CanCollapse(std::uint32_t from, std::uint32_t to)const;
+		bool KeepsOrientation(std::uint32_t from, std::uint32_t to)const;
+		bool KeepsManifold(std::uint32_t from, std::uint32_t to);
+		bool KeepsDeviation(std::uint32_t from, std::uint32_t to, double maxErrorSq);
+		double PointDistanceSq(std::uint32_t point, std::uint32_t around, std::uint32_t from, std::uint32_t to,
+			double enoughSq)const;
+		bool PointsWithin(std::uint32_t first, std::uint32_t around, std::uint32_t from, std::uint32_t to,
+			double maxErrorSq)const;
+		void Perform(std::uint32_t from, std::uint32_t to);
+		bool Untouched(std::uint32_t from)const;
+
+	private:
+		std::vector<std::uint32_t> m_position;		//per vertex
+		std::vector<Position> m_points;				//per position
+		std::vector<VertexKind> m_kinds;
+		std::vector<Quadric> m_quadrics;
+		std::vector<std::uint32_t> m_triangles;		//3 vertices each, none degenerate
+		std::vector<std::uint32_t> m_remap;			//per vertex, for the pass under way
+		float m_radius = 0.f;
+
+		//the original positions every position stands for, a list through m_nextPoint
+		std::vector<std::uint32_t> m_firstPoint;	//per position, ~0u for none
+		std::vector<std::uint32_t> m_lastPoint;
+		std::vector<std::uint32_t> m_nextPoint;		//per original position
+
+		//triangles around every position, rebuilt after every pass
+		std::vector<std::uint32_t> m_firstTriangle;
+		std::vector<std::uint32_t> m_aroundTriangles;
+
+		std::vector<unsigned char> m_touched;		//per position, in the pass under way
+		std::vector<unsigned char> m_settled;		//per position, no collapse to try until around it changes
+		std::vector<std::uint32_t> m_stamps;		//per position, for KeepsManifold
+		std::uint32_t m_stamp = 0;
+	};
+
+	Simplifier::Simplifier(const float* positions, const float* attributes, std::size_t attributeCount,
+		std::size_t stride, std::size_t vertexCount, const std::vector<std::uint32_t>& indices)
+	{
+		auto vertex = [stride](const float* base, std::size_t i)
+		{
+			return reinterpret_cast<const float*>(reinterpret_cast<const char*>(base) + i * stride);
+		};
+
+		//weld the vertices by position; the attributes do not matter to the shape
+		m_position.resize(vertexCount);
+		std::unordered_map<PositionKey, std::uint32_t, PositionHash> welded;
+		welded.reserve(vertexCount);
+		for (std::size_t i = 0; i < vertexCount; ++i)
+		{
+			const float* p = vertex(positions, i);
+			auto inserted = welded.emplace(PositionKey{ p[0], p[1], p[2] }, (std::uint32_t)m_points.size());
+			if (inserted.second)
+				m_points.push_back(Position{ p[0], p[1], p[2] });
+			m_position[i] = inserted.first->second;
+		}
+
+		//and the vertices of a position by attributes, into one vertex per attribute set:
+		//an importer that does not join identical vertices gives every triangle its own
+		std::vector<std::uint32_t> wedge(vertexCount);
+		std::vector<std::uint32_t> firstWedge(m_points.size(), ~0u);
+		std::vector<std::uint32_t> nextWedge(vertexCount, ~0u);
+		for (std::uint32_t i = 0; i < (std::uint32_t)vertexCount; ++i)
+		{
+			std::uint32_t w = firstWedge[m_position[i]];
+			while (w != ~0u && attributeCount > 0 &&
+				memcmp(vertex(attributes, w), vertex(attributes, i), attributeCount * sizeof(float)) != 0)
+				w = nextWedge[w];
+			if (w == ~0u)
+			{
+				nextWedge[i] = firstWedge[m_position[i]];
+				firstWedge[m_position[i]] = i;
+				w = i;
+			}
+			wedge[i] = w;
+		}
+
+		m_triangles.reserve(indices.size());
+		for (std::size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			std::uint32_t a = indices[t], b = indices[t + 1], c = indices[t + 2];
+			if (a >= vertexCount || b >= vertexCount || c >= vertexCount)
+				continue;
+			a = wedge[a];
+			b = wedge[b];
+			c = wedge[c];
+			std::uint32_t pa = m_position[a], pb = m_position[b], pc = m_position[c];
+			if (pa == pb || pb == pc || pc == pa)
+				continue;
+			m_triangles.push_back(a);
+			m_triangles.push_back(b);
+			m_triangles.push_back(c);
+		}
+
+		Position lo = { 1e300, 1e300, 1e300 };
+		Position hi = { -1e300, -1e300, -1e300 };
+		for (std::uint32_t v : m_triangles)
+		{
+			const Position& p = m_points[m_position[v]];
+			lo = Position{ std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+			hi = Position{ std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+		}
+		Position diagonal = Sub(hi, lo);
+		m_radius = m_triangles.empty() ? 0.f : (float)(0.5 * std::sqrt(Dot(diagonal, diagonal)));
+
+		m_remap.resize(vertexCount);
+		for (std::size_t i = 0; i < vertexCount; ++i)
+			m_remap[i] = (std::uint32_t)i;
+		m_touched.resize(m_points.size());
+		m_settled.resize(m_points.size());
+		m_stamps.resize(m_points.size());
+
+		//every position on a triangle stands for itself
+		m_firstPoint.assign(m_points.size(), ~0u);
+		m_lastPoint.assign(m_points.size(), ~0u);
+		m_nextPoint.assign(m_points.size(), ~0u);
+		for (std::uint32_t v : m_triangles)
+			m_firstPoint[m_position[v]] = m_lastPoint[m_position[v]] = m_position[v];
+
+		Classify();
+	}
+
+	//Kinds and quadrics of the positions, from the triangles of level 0.
+	void Simplifier::Classify()
+	{
+		const std::size_t positions = m_points.size();
+		m_quadrics.assign(positions, Quadric());
+
+		std::unordered_map<std::uint64_t, EdgeInfo> edges;
+		edges.reserve(m_triangles.size());
+		std::vector<std::uint32_t> wedges(positions * 2, ~0u);
+		std::vector<unsigned char> wedgeCount(positions);
+		for (std::uint32_t t = 0; t < (std::uint32_t)m_triangles.size(); t += 3)
+		{
+			const std::uint32_t* v = &m_triangles[t];
+			const Position& p0 = m_points[m_position[v[0]]];
+			const Position& p1 = m_points[m_position[v[1]]];
+			const Position& p2 = m_points[m_position[v[2]]];
+			Position n = Cross(Sub(p1, p0), Sub(p2, p0));
+			double length = std::sqrt(Dot(n, n));
+			if (length > 0.0)
+			{
+				Position unit = { n.x / length, n.y / length, n.z / length };
+				double d = -Dot(unit, p0);
+				for (int k = 0; k < 3; ++k)
+					m_quadrics[m_position[v[k]]].AddPlane(unit, d, 0.5 * length);
+			}
+
+			for (int k = 0; k < 3; ++k)
+			{
+				//distinct vertices per position, counted up to 3, which is Locked anyway
+				std::uint32_t position = m_position[v[k]];
+				std::uint32_t* known = &wedges[position * 2];
+				unsigned char& count = wedgeCount[position];
+				if (count < 3 && known[0] != v[k] && known[1] != v[k])
+				{
+					if (count < 2)
+						known[count] = v[k];
+					++count;
+				}
+
+				std::uint32_t a = v[k], b = v[(k + 1) % 3];
+				if (m_position[a] > m_position[b])
+					std::swap(a, b);
+				EdgeInfo& edge = edges[EdgeKey(m_position[a], m_position[b])];
+				if (edge.Triangles++ == 0)
+				{
+					edge.A = a;
+					edge.B = b;
+					edge.Triangle = t;
+				}
+				else if (edge.A != a || edge.B != b)
+					edge.Seam = true;
+			}
+		}
+
+		std::vector<unsigned char> borders(positions), seams(positions), complex(positions);
+		for (const auto& entry : edges)
+		{
+			const EdgeInfo& edge = entry.second;
+			std::uint32_t pa = m_position[edge.A], pb = m_position[edge.B];
+			bool border = edge.Triangles == 1;
+			bool seam = edge.Triangles == 2 && edge.Seam;
+			if (edge.Triangles > 2)
+				complex[pa] = complex[pb] = 1;
+			if (border)
+				++borders[pa], ++borders[pb];
+			if (seam)
+				++seams[pa], ++seams[pb];
+			if (!border && !seam)
+				continue;
+
+			//a plane through the edge, across its first triangle, keeps it in place
+			const std::uint32_t* v = &m_triangles[edge.Triangle];
+			const Position& p0 = m_points[m_position[v[0]]];
+			Position n = Cross(Sub(m_points[m_position[v[1]]], p0), Sub(m_points[m_position[v[2]]], p0));
+			Position e = Sub(m_points[pb], m_points[pa]);
+			Position across = Cross(e, n);
+			double length = std::sqrt(Dot(across, across));
+			if (length <= 0.0)
+				continue;
+			Position unit = { across.x / length, across.y / length, across.z / length };
+			double d = -Dot(unit, m_points[pa]);
+			double weight = Dot(e, e) * BoundaryWeight;
+			m_quadrics[pa].AddPlane(unit, d, weight);
+			m_quadrics[pb].AddPlane(unit, d, weight);
+		}
+
+		m_kinds.assign(positions, VertexKind::Locked);
+		for (std::size_t p = 0; p < positions; ++p)
+		{
+			if (complex[p])
+				continue;
+			if (wedgeCount[p] == 1 && borders[p] == 0 && seams[p] == 0)
+				m_kinds[p] = VertexKind::Manifold;
+			else if (wedgeCount[p] == 1 && borders[p] == 2 && seams[p] == 0)
+				m_kinds[p] = VertexKind::Border;
+			else if (wedgeCount[p] == 2 && borders[p] == 0 && seams[p] == 2)
+				m_kinds[p] = VertexKind::Seam;
+		}
+	}
+
+	void Simplifier::BuildAdjacency()
+	{
+		const std::size_t positions = m_points.size();
+		m_firstTriangle.assign(positions + 1, 0);
+		for (std::uint32_t v : m_triangles)
+			++m_firstTriangle[m_position[v] + 1];
+		for (std::size_t p = 0; p < positions; ++p)
+			m_firstTriangle[p + 1] += m_firstTriangle[p];
+
+		m_aroundTriangles.resize(m_triangles.size());
+		std::vector<std::uint32_t> next(m_firstTriangle.begin(), m_firstTriangle.end() - 1);
+		for (std::uint32_t i = 0; i < (std::uint32_t)m_triangles.size(); ++i)
+			m_aroundTriangles[next[m_position[m_triangles[i]]]++] = i / 3 * 3;
+	}
+
+	//The vertex of triangle at position, or ~0u.
+	std::uint32_t Simplifier::CornerAt(std::uint32_t triangle, std::uint32_t position)const
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			if (m_position[m_triangles[triangle + k]] == position)
+				return m_triangles[triangle + k];
+		}
+		return ~0u;
+	}
+
+	int Simplifier::SharedTriangles(std::uint32_t from, std::uint32_t to)const
+	{
+		int shared = 0;
+		for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+			shared += CornerAt(m_aroundTriangles[i], to) != ~0u;
+		return shared;
+	}
+
+	//Whether from may move onto to: along a border or seam for those kinds, and every vertex
+	//at from must have one vertex at to to become.
+	bool Simplifier::CanCollapse(std::uint32_t from, std::uint32_t to)const
+	{
+		VertexKind kind = m_kinds[from];
+		if (kind == VertexKind::Locked)
+			return false;
+		int shared = SharedTriangles(from, to);
+		if (kind == VertexKind::Border && shared != 1)
+			return false;
+		if (kind == VertexKind::Seam && shared != 2)
+			return false;
+
+		//at most two vertices per movable position
+		std::uint32_t wedge[2] = { ~0u, ~0u }, target[2] = { ~0u, ~0u };
+		for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+		{
+			std::uint32_t triangle = m_aroundTriangles[i];
+			std::uint32_t u = CornerAt(triangle, from);
+			int w = wedge[0] == u || wedge[0] == ~0u ? 0 : wedge[1] == u || wedge[1] == ~0u ? 1 : -1;
+			if (w < 0)
+				return false;
+			wedge[w] = u;
+			std::uint32_t v = CornerAt(triangle, to);
+			if (v == ~0u)
+				continue;
+			if (target[w] != ~0u && target[w] != v)
+				return false;
+			target[w] = v;
+		}
+		return (wedge[0] == ~0u || target[0] != ~0u) && (wedge[1] == ~0u || target[1] != ~0u);
+	}
+
+	//No triangle left around from may turn over, or nearly, once from sits on to.
+	bool Simplifier::KeepsOrientation(std::uint32_t from, std::uint32_t to)const
+	{
+		const Position& target = m_points[to];
+		for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+		{
+			std::uint32_t triangle = m_aroundTriangles[i];
+			if (CornerAt(triangle, to) != ~0u)
+				continue;
+
+			Position before[3], after[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				std::uint32_t position = m_position[m_triangles[triangle + k]];
+				before[k] = m_points[position];
+				after[k] = position == from ? target : before[k];
+			}
+			Position n0 = Cross(Sub(before[1], before[0]), Sub(before[2], before[0]));
+			Position n1 = Cross(Sub(after[1], after[0]), Sub(after[2], after[0]));
+			double n0n1 = Dot(n0, n1);
+			if (n0n1 <= 0.0 || n0n1 * n0n1 < MinNormalCos * MinNormalCos * Dot(n0, n0) * Dot(n1, n1))
+				return false;
+		}
+		return true;
+	}
+
+	//The link condition: from and to may only share the neighbours across the triangles
+	//on their edge, else the collapse folds the surface onto itself.
+	bool Simplifier::KeepsManifold(std::uint32_t from, std::uint32_t to)
+	{
+		//stamp the neighbours of to, then count the neighbours of from among them once each
+		std::uint32_t toStamp = ++m_stamp;
+		for (std::uint32_t i = m_firstTriangle[to]; i < m_firstTriangle[to + 1]; ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+				m_stamps[m_position[m_triangles[m_aroundTriangles[i] + k]]] = toStamp;
+		}
+		std::uint32_t countedStamp = ++m_stamp;
+		int common = 0;
+		for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				std::uint32_t position = m_position[m_triangles[m_aroundTriangles[i] + k]];
+				if (position == from || position == to || m_stamps[position] != toStamp)
+					continue;
+				m_stamps[position] = countedStamp;
+				++common;
+			}
+		}
+		return common <= SharedTriangles(from, to);
+	}
+
+	//Squared distance of the original position point from the triangles around around, with
+	//from moved onto to; around is to or a neighbour of from.  Stops once within enoughSq.
+	double Simplifier::PointDistanceSq(std::uint32_t point, std::uint32_t around, std::uint32_t from,
+		std::uint32_t to, double enoughSq)const
+	{
+		double nearest = std::numeric_limits<double>::max();
+		//the triangles of to once from is on it include those around from
+		for (int ring = 0; ring < (around == to && from != to ? 2 : 1); ++ring)
+		{
+			std::uint32_t center = ring == 0 ? around : from;
+			for (std::uint32_t i = m_firstTriangle[center]; i < m_firstTriangle[center + 1]; ++i)
+			{
+				std::uint32_t p[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					p[k] = m_position[m_triangles[m_aroundTriangles[i] + k]];
+					p[k] = p[k] == from ? to : p[k];
+				}
+				if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0])
+					continue;
+				nearest = std::min(nearest, TriangleDistanceSq(m_points[point], m_points[p[0]], m_points[p[1]], m_points[p[2]]));
+				if (nearest <= enoughSq)
+					return nearest;
+			}
+		}
+		return nearest;
+	}
+
+	bool Simplifier::PointsWithin(std::uint32_t first, std::uint32_t around, std::uint32_t from, std::uint32_t to,
+		double maxErrorSq)const
+	{
+		for (std::uint32_t point = first; point != ~0u; point = m_nextPoint[point])
+		{
+			//around itself is a corner of all its triangles
+			if (point != around && PointDistanceSq(point, around, from, to, maxErrorSq) > maxErrorSq)
+				return false;
+		}
+		return true;
+	}
+
+	//Every original position whose triangles the collapse changes stays within maxError of
+	//them: those standing by to, which also takes over from's, and by the other neighbours.
+	bool Simplifier::KeepsDeviation(std::uint32_t from, std::uint32_t to, double maxErrorSq)
+	{
+		std::uint32_t stamp = ++m_stamp;
+		m_stamps[from] = stamp;
+		for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				std::uint32_t position = m_position[m_triangles[m_aroundTriangles[i] + k]];
+				if (m_stamps[position] == stamp)
+					continue;
+				m_stamps[position] = stamp;
+				if (!PointsWithin(m_firstPoint[position], position, from, to, maxErrorSq))
+					return false;
+				if (position == to && !PointsWithin(m_firstPoint[from], to, from, to, maxErrorSq))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	double Simplifier::Deviation()
+	{
+		BuildAdjacency();
+		double largest = 0.0;
+		for (std::uint32_t position = 0; position < (std::uint32_t)m_points.size(); ++position)
+		{
+			if (m_firstTriangle[position] == m_firstTriangle[position + 1])
+				continue;
+			//a point within the largest distance so far need not be measured exactly
+			for (std::uint32_t point = m_firstPoint[position]; point != ~0u; point = m_nextPoint[point])
+				largest = std::max(largest, PointDistanceSq(point, position, position, position, largest));
+		}
+		return std::sqrt(largest);
+	}
+
+	void Simplifier::Perform(std::uint32_t from, std::uint32_t to)
+	{
+		for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+		{
+			std::uint32_t triangle = m_aroundTriangles[i];
+			std::uint32_t v = CornerAt(triangle, to);
+			if (v != ~0u)
+				m_remap[CornerAt(triangle, from)] = v;
+			for (int k = 0; k < 3; ++k)
+				m_touched[m_position[m_triangles[triangle + k]]] = 1;
+		}
+		m_quadrics[to].Add(m_quadrics[from]);
+
+		if (m_firstPoint[from] != ~0u)
+		{
+			if (m_firstPoint[to] == ~0u)
+				m_firstPoint[to] = m_firstPoint[from];
+			else
+				m_nextPoint[m_lastPoint[to]] = m_firstPoint[from];
+			m_lastPoint[to] = m_lastPoint[from];
+			m_firstPoint[from] = m_lastPoint[from] = ~0u;
+		}
+	}
+
+	//Whether no position around from has been in a collapse of the pass under way, so that
+	//the triangles around all of them are still as the adjacency has them.
+	bool Simplifier::Untouched(std::uint32_t from)const
+	{
+		for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				if (m_touched[m_position[m_triangles[m_aroundTriangles[i] + k]]])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	//One round of collapses, each position at most once.  Returns whether any was made.
+	bool Simplifier::Pass(double maxErrorSq)
+	{
+		BuildAdjacency();
+
+		std::vector<Candidate> candidates;
+		for (std::uint32_t from = 0; from < (std::uint32_t)m_points.size(); ++from)
+		{
+			if (m_kinds[from] == VertexKind::Locked || m_settled[from] || m_firstTriangle[from] == m_firstTriangle[from + 1])
+				continue;
+
+			Candidate best = { from, ~0u, maxErrorSq };
+			for (std::uint32_t i = m_firstTriangle[from]; i < m_firstTriangle[from + 1]; ++i)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					std::uint32_t to = m_position[m_triangles[m_aroundTriangles[i] + k]];
+					if (to == from || to == best.To)
+						continue;
+					double error = CollapseError(m_quadrics[from], m_quadrics[to], m_points[to]);
+					if (error <= best.Error && CanCollapse(from, to))
+					{
+						best.To = to;
+						best.Error = error;
+					}
+				}
+			}
+			if (best.To != ~0u)
+				candidates.push_back(best);
+			else
+				m_settled[from] = 1;
+		}
+		std::sort(candidates.begin(), candidates.end(),
+			[](const Candidate& a, const Candidate& b) { return a.Error < b.Error; });
+
+		std::fill(m_touched.begin(), m_touched.end(), 0);
+		int collapses = 0;
+		for (const Candidate& candidate : candidates)
+		{
+			if (!Untouched(candidate.From))
+				continue;
+			if (!KeepsOrientation(candidate.From, candidate.To) || !KeepsManifold(candidate.From, candidate.To) ||
+				!KeepsDeviation(candidate.From, candidate.To, maxErrorSq))
+			{
+				m_settled[candidate.From] = 1;
+				continue;
+			}
+
+			Perform(candidate.From, candidate.To);
+			++collapses;
+		}
+		if (collapses == 0)
+			return false;
+
+		//move the triangles over and drop the ones the collapses closed; what the checks of a
+		//position look at is within two triangles of it, so the positions next to a touched
+		//one try again
+		std::size_t kept = 0;
+		for (std::size_t t = 0; t < m_triangles.size(); t += 3)
+		{
+			std::uint32_t a = m_remap[m_triangles[t]], b = m_remap[m_triangles[t + 1]], c = m_remap[m_triangles[t + 2]];
+			std::uint32_t pa = m_position[a], pb = m_position[b], pc = m_position[c];
+			if (pa == pb || pb == pc || pc == pa)
+				continue;
+			if (m_touched[pa] || m_touched[pb] || m_touched[pc])
+				m_settled[pa] = m_settled[pb] = m_settled[pc] = 0;
+			m_triangles[kept++] = a;
+			m_triangles[kept++] = b;
+			m_triangles[kept++] = c;
+		}
+		m_triangles.resize(kept);
+		return true;
+	}
+
+	void Simplifier::Reduce(double maxError)
+	{
+		std::fill(m_settled.begin(), m_settled.end(), 0);
+		while (Pass(maxError * maxError))
+		{
+		}
+	}
+}
+
+std::vector<MeshLod> BuildMeshLods(const float* positions, const float* attributes, std::size_t attributeCount,
+	std::size_t stride, std::size_t vertexCount, std::vector<std::uint32_t>& indices, const MeshLodDesc& desc)
+{
+	std::vector<MeshLod> lods;
+	lods.push_back(MeshLod{ 0, (std::uint32_t)indices.size(), 0.f, -1 });
+	if (desc.Errors.empty() || indices.size() < 3 || indices.size() % 3 != 0)
+		return lods;
+
+	Simplifier simplifier(positions, attributes, attributeCount, stride, vertexCount, indices);
+	std::size_t previous = indices.size() / 3;
+	for (int target = 0; target < (int)desc.Errors.size(); ++target)
+	{
+		simplifier.Reduce(desc.Errors[target] * simplifier.Radius());
+		std::size_t triangles = simplifier.TriangleCount();
+		if (triangles == 0 || triangles > previous * desc.MaxTriangleRatio)
+			continue;
+
+		const std::vector<std::uint32_t>& level = simplifier.Triangles();
+		lods.push_back(MeshLod{ (std::uint32_t)indices.size(), (std::uint32_t)level.size(), (float)simplifier.Deviation(),
+			target });
+		indices.insert(indices.end(), level.begin(), level.end());
+		previous = triangles;
+	}
+	return lods;
+}
+
+int SelectMeshLod(const MeshLod* lods, int count, float distance, float pixelsPerUnit, float maxScreenError)
+{
+	//error * pixelsPerUnit / distance <= maxScreenError, the errors growing with the level
+	int lod = 0;
+	for (int i = 1; i < count; ++i)
+	{
+		if (lods[i].Error * pixelsPerUnit > maxScreenError * distance)
+			break;
+		lod = i;
+	}
+	return lod;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Level of detail chains for indexed triangle meshes, by edge collapse under the quadric
+//error metric of Garland and Heckbert, "Surface Simplification Using Quadric Error
+//Metrics".  Every collapse moves a vertex onto one of its neighbours, so all levels index
+//the original vertices and a chain costs only indices: one vertex buffer, an index range
+//per level.  The quadrics only order the collapses: a collapse is taken only while every
+//original position stays within the level's target of the triangles left, so the error of
+//a level bounds how far its surface is from the full mesh's vertices.
+//Vertices sharing a position and attributes are one vertex to the levels; vertices sharing
+//only a position, as along texture seams and hard edges, move together.  Seams and open
+//borders only collapse along themselves, so the levels neither crack at seams nor shrink
+//at borders.  Vertices with more than two attribute sets at one position, or on
+//non-manifold edges, never move.
+
+struct MeshLodDesc
+{
+	//Error targets of the levels after the full one, growing, one level each, as
+	//fractions of the mesh's bounding radius: the largest distance of an original vertex
+	//from the level's triangles.
+	std::vector<float> Errors = { 0.005f, 0.02f, 0.06f };
+	//A level is dropped unless it has at most this fraction of the triangles of the
+	//level before it; the next target goes on from it.
+	float MaxTriangleRatio = 0.8f;
+};
+
+//One level of a chain: a range of its index list.
+struct MeshLod
+{
+	std::uint32_t StartIndex;
+	std::uint32_t IndexCount;
+	float Error;						//largest distance of an original vertex from the level, in units of the positions
+	int Target;							//index of the MeshLodDesc::Errors target it was built for, -1 for level 0
+};
+
+//Builds the chain of the triangle list in indices over vertexCount vertices, stride bytes
+//apart: 3 floats of position at positions, and attributeCount floats of attributes at
+//attributes that tell the vertices of one position apart (null and 0 for none).  Level 0
+//is the list itself, the coarser levels are appended to indices.  Returns the levels,
+//finest first; only level 0 for an empty desc or a mesh that cannot be reduced.
+std::vector<MeshLod> BuildMeshLods(const float* positions, const float* attributes, std::size_t attributeCount,
+	std::size_t stride, std::size_t vertexCount, std::vector<std::uint32_t>& indices, const MeshLodDesc& desc);
+
+//The coarsest of count levels whose error, seen from distance, is at most maxScreenError
+//pixels.  pixelsPerUnit is the projected size of a unit of the positions at unit
+//distance, as for TerrainQuadtree::Select.  For an orthographic view pass a distance of 1
+//and the pixels per unit of the view.
+int SelectMeshLod(const MeshLod* lods, int count, float distance, float pixelsPerUnit, float maxScreenError);
@@ -6,14 +6,59 @@ Model::Model(std::string name, std::string path)
 {
 	m_name = name;
 	m_path = path;
-	m_pModelImporter = new ModelImporter(name);
-	m_pModelImporter->LoadModel(path);
-	m_meshes = m_pModelImporter->m_meshes;
+	m_asset = LoadAsset(name, path);
 }
 
-Model::~Model()
+Model::Model(std::string name, AssetHandle asset)
 {
+	m_name = name;
+	m_path = asset ? asset->Path : std::string();
+	m_asset = std::move(asset);
+}
+
+AssetRegistry<const ModelAsset>* Model::Assets()
+{
+	static AssetRegistry<const ModelAsset> assets;
+
+	return &assets;
+}
+
+Model::AssetHandle Model::LoadAsset(const std::string& name, const std::string& path, bool useCache,
+	const MeshLodDesc& lods)
+{
+	return Assets()->Acquire(path, [&name, &path, useCache, &lods](const std::string& canonicalPath) -> AssetHandle
+	{
+		//the importer lives only as long as the import
+		ModelImporter importer(name);
+		if (!importer.LoadModel(path, useCache))
+			return nullptr;
 
+		auto asset = std::make_shared<ModelAsset>();
+		asset->Path = canonicalPath;
+		asset->Meshes = std::move(importer.m_meshes);
+		for (auto& mesh : asset->Meshes)
+		{
+			if (mesh.vertices.empty())
+				continue;
+
+			//normals and texture coordinates tell vertices apart, the tangents follow from them
+			mesh.lods = BuildMeshLods(&mesh.vertices.data()->Pos.x, &mesh.vertices.data()->Normal.x, 5,
+				sizeof(ModelImporter::ModelVertex), mesh.vertices.size(), mesh.indices, lods);
+		}
+		return asset;
+	});
+}
+
+const std::vector<ModelImporter::ModelMesh>& Model::Meshes()const
+{
+	static const std::vector<ModelImporter::ModelMesh> none;
+
+	return m_asset ? m_asset->Meshes : none;
+}
+
+const std::string& Model::AssetPath()const
+{
+	return m_asset ? m_asset->Path : m_path;
 }
 
 void Model::SetScaleRotateOffset(DirectX::CXMMATRIX scale, DirectX::CXMMATRIX rotate, DirectX::CXMMATRIX offset)
@@ -1,19 +1,42 @@
 #pragma once
+#include <memory>
 #include <string>
 
+#include "AssetRegistry.h"
 #include "ModelImporter.h"
 
+//Meshes of one model file, shared by every Model made from it.
+struct ModelAsset
+{
+	std::string Path;	//canonical
+	std::vector<ModelImporter::ModelMesh> Meshes;
+};
+
 class Model
 {
 public:
+	typedef std::shared_ptr<const ModelAsset> AssetHandle;
+
 	Model(std::string name, std::string path);
-	~Model();
+	//asset already loaded, e.g. by ModelLoader
+	Model(std::string name, AssetHandle asset);
+
+	//Registry of the model files in use, shared by every Model.
+	static AssetRegistry<const ModelAsset>* Assets();
+	//The model file at path, imported by a ModelImporter named name unless somebody holds
+	//it already; material and texture names and LOD chains then follow the first caller's.
+	//Every mesh is given the LOD chain of lods.  Null when the import fails.
+	static AssetHandle LoadAsset(const std::string& name, const std::string& path, bool useCache = true,
+		const MeshLodDesc& lods = MeshLodDesc());
 public:
 	std::string m_name;
 	std::string m_path;
-	std::vector<ModelImporter::ModelMesh> m_meshes;
-	ModelImporter* m_pModelImporter;
+	AssetHandle m_asset;
 public:
+	//empty when the model failed to load
+	const std::vector<ModelImporter::ModelMesh>& Meshes()const;
+	//canonical path of the model file, the same for every Model sharing it
+	const std::string& AssetPath()const;
 	DirectX::XMMATRIX GetWorld();
 	void SetScaleRotateOffset(DirectX::CXMMATRIX scale, DirectX::CXMMATRIX rotate, DirectX::CXMMATRIX offset);
 private:
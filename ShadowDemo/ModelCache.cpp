@@ -0,0 +1,291 @@
+#include "ModelCache.h"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//Layout of a cache file, each part starting on a 16 byte boundary:
+//Header, Mesh[MeshCount], vertices, indices, strings.  The strings start with the
+//source path.
+struct ModelCache::Header
+{
+	char Magic[4];					//"MDLC"
+	std::uint32_t Version;
+	std::uint64_t FileSize;
+	std::uint64_t SourceHash;
+	std::uint32_t PostProcessFlags;
+	std::uint32_t VertexStride;
+	std::uint32_t MeshCount;
+	std::uint32_t SourcePathLength;
+	std::uint64_t MeshesOffset;
+	std::uint64_t VerticesOffset;
+	std::uint64_t VerticesBytes;
+	std::uint64_t IndicesOffset;
+	std::uint64_t IndicesBytes;
+	std::uint64_t StringsOffset;
+	std::uint64_t StringsBytes;
+};
+
+namespace
+{
+	const std::uint64_t Alignment = 16;
+
+	//the file layout must not depend on the compiler or the pointer size
+	static_assert(sizeof(ModelCache::Reference<void>) == 8, "a reference must be 8 bytes");
+	static_assert(sizeof(ModelCache::Mesh) == 72, "the mesh table layout must be fixed");
+
+	std::uint64_t AlignUp(std::uint64_t offset)
+	{
+		return (offset + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	//true when [offset, offset + bytes) lies within [begin, begin + size)
+	bool Within(std::uint64_t offset, std::uint64_t bytes, std::uint64_t begin, std::uint64_t size)
+	{
+		return offset >= begin && offset - begin <= size && bytes <= size - (offset - begin);
+	}
+
+	bool WriteAt(std::FILE* file, std::uint64_t& position, std::uint64_t offset, const void* data, std::size_t bytes)
+	{
+		static const char zeros[Alignment] = {};
+		assert(offset >= position && offset - position < Alignment);
+		if (offset > position && std::fwrite(zeros, 1, (std::size_t)(offset - position), file) != offset - position)
+			return false;
+		position = offset + bytes;
+		return bytes == 0 || std::fwrite(data, 1, bytes, file) == bytes;
+	}
+}
+
+const std::uint32_t ModelCache::Version;
+
+ModelCache::ModelCache()
+{
+}
+
+ModelCache::~ModelCache()
+{
+	Close();
+}
+
+std::string ModelCache::FullPath(const std::string& path)
+{
+#ifdef _WIN32
+	char full[MAX_PATH];
+	DWORD length = GetFullPathNameA(path.c_str(), MAX_PATH, full, nullptr);
+	return length > 0 && length < MAX_PATH ? std::string(full, length) : path;
+#else
+	char* full = realpath(path.c_str(), nullptr);
+	std::string result = full ? full : path;
+	free(full);
+	return result;
+#endif
+}
+
+//FNV-1a over 64-bit words, then over the bytes left; enough to tell an edited source.
+bool ModelCache::HashFile(const std::string& path, std::uint64_t& hash)
+{
+	const std::uint64_t prime = 0x100000001b3ull;
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	std::vector<std::uint8_t> buffer(1 << 20);
+	std::uint64_t h = 0xcbf29ce484222325ull;
+	std::uint64_t length = 0;
+	std::size_t read;
+	while ((read = std::fread(buffer.data(), 1, buffer.size(), file)) > 0)
+	{
+		//the buffer is a whole number of words, so only the last read has a tail
+		std::size_t words = read / 8;
+		for (std::size_t i = 0; i < words; ++i)
+		{
+			std::uint64_t word;
+			memcpy(&word, buffer.data() + i * 8, 8);
+			h = (h ^ word) * prime;
+		}
+		for (std::size_t i = words * 8; i < read; ++i)
+			h = (h ^ buffer[i]) * prime;
+		length += read;
+	}
+	bool failed = std::ferror(file) != 0;
+	std::fclose(file);
+
+	hash = (h ^ length) * prime;
+	return !failed;
+}
+
+bool ModelCache::Write(const std::string& path, const Key& key, const std::vector<MeshData>& meshes)
+{
+	Header header = {};
+	memcpy(header.Magic, "MDLC", 4);
+	header.Version = Version;
+	header.SourceHash = key.SourceHash;
+	header.PostProcessFlags = key.PostProcessFlags;
+	header.VertexStride = key.VertexStride;
+	header.MeshCount = (std::uint32_t)meshes.size();
+	header.SourcePathLength = (std::uint32_t)key.SourcePath.size();
+
+	//lay the arrays out first, then point the mesh table at them
+	std::vector<Mesh> table(meshes.size());
+	header.MeshesOffset = AlignUp(sizeof(Header));
+	header.VerticesOffset = AlignUp(header.MeshesOffset + sizeof(Mesh) * meshes.size());
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		table[i].Vertices.Offset = header.VerticesOffset + header.VerticesBytes;
+		table[i].VertexCount = meshes[i].VertexCount;
+		header.VerticesBytes += (std::uint64_t)meshes[i].VertexCount * key.VertexStride;
+	}
+	header.IndicesOffset = AlignUp(header.VerticesOffset + header.VerticesBytes);
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		table[i].Indices.Offset = header.IndicesOffset + header.IndicesBytes;
+		table[i].IndexCount = meshes[i].IndexCount;
+		header.IndicesBytes += (std::uint64_t)meshes[i].IndexCount * sizeof(std::uint32_t);
+	}
+
+	header.StringsOffset = AlignUp(header.IndicesOffset + header.IndicesBytes);
+	std::string strings = key.SourcePath;
+	strings.push_back('\0');
+	auto addString = [&](const std::string& s)
+	{
+		std::uint64_t offset = header.StringsOffset + strings.size();
+		strings.append(s);
+		strings.push_back('\0');
+		return offset;
+	};
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		table[i].DiffuseMapName.Offset = addString(meshes[i].DiffuseMapName);
+		table[i].NormalMapName.Offset = addString(meshes[i].NormalMapName);
+		memcpy(table[i].DiffuseAlbedo, meshes[i].DiffuseAlbedo, sizeof(table[i].DiffuseAlbedo));
+		memcpy(table[i].FresnelR0, meshes[i].FresnelR0, sizeof(table[i].FresnelR0));
+		table[i].Roughness = meshes[i].Roughness;
+	}
+	header.StringsBytes = strings.size();
+	header.FileSize = header.StringsOffset + header.StringsBytes;
+
+	const std::string temp = path + ".tmp";
+	std::FILE* file = std::fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+
+	std::uint64_t position = 0;
+	bool written = WriteAt(file, position, 0, &header, sizeof(header)) &&
+		WriteAt(file, position, header.MeshesOffset, table.data(), sizeof(Mesh) * table.size());
+	for (std::size_t i = 0; written && i < meshes.size(); ++i)
+	{
+		written = WriteAt(file, position, i == 0 ? header.VerticesOffset : position, meshes[i].Vertices,
+			(std::size_t)meshes[i].VertexCount * key.VertexStride);
+	}
+	for (std::size_t i = 0; written && i < meshes.size(); ++i)
+	{
+		written = WriteAt(file, position, i == 0 ? header.IndicesOffset : position, meshes[i].Indices,
+			(std::size_t)meshes[i].IndexCount * sizeof(std::uint32_t));
+	}
+	written = written && WriteAt(file, position, header.StringsOffset, strings.data(), strings.size());
+	written = std::fclose(file) == 0 && written;
+
+	if (written)
+	{
+		std::remove(path.c_str());
+		written = std::rename(temp.c_str(), path.c_str()) == 0;
+	}
+	if (!written)
+		std::remove(temp.c_str());
+	return written;
+}
+
+bool ModelCache::Open(const std::string& path, const Key& key)
+{
+	Close();
+	if (!m_file.Open(path, MappedFile::Access::CopyOnWrite))
+		return false;
+	if (!FixUp(key))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ModelCache::Close()
+{
+	m_file.Close();
+	m_meshes = nullptr;
+	m_meshCount = 0;
+}
+
+bool ModelCache::IsOpen()const
+{
+	return m_meshes != nullptr;
+}
+
+int ModelCache::MeshCount()const
+{
+	return m_meshCount;
+}
+
+const ModelCache::Mesh& ModelCache::GetMesh(int i)const
+{
+	assert(i >= 0 && i < m_meshCount);
+	return m_meshes[i];
+}
+
+std::size_t ModelCache::Size()const
+{
+	return m_file.Size();
+}
+
+//Checks the header against the key and every reference against its part of the file,
+//turning the references into pointers as it goes.
+bool ModelCache::FixUp(const Key& key)
+{
+	std::uint8_t* view = m_file.Data();
+	const std::size_t size = m_file.Size();
+	Header header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, view, sizeof(header));
+
+	if (memcmp(header.Magic, "MDLC", 4) != 0 || header.Version != Version || header.FileSize != size ||
+		header.SourceHash != key.SourceHash || header.PostProcessFlags != key.PostProcessFlags ||
+		header.VertexStride != key.VertexStride || key.VertexStride == 0 ||
+		header.SourcePathLength != key.SourcePath.size())
+		return false;
+
+	if (header.MeshesOffset % Alignment != 0 ||
+		!Within(header.MeshesOffset, (std::uint64_t)header.MeshCount * sizeof(Mesh), 0, size) ||
+		!Within(header.VerticesOffset, header.VerticesBytes, 0, size) ||
+		!Within(header.IndicesOffset, header.IndicesBytes, 0, size) ||
+		!Within(header.StringsOffset, header.StringsBytes, 0, size) ||
+		header.StringsBytes <= header.SourcePathLength || view[header.StringsOffset + header.StringsBytes - 1] != '\0' ||
+		memcmp(view + header.StringsOffset, key.SourcePath.data(), key.SourcePath.size()) != 0)
+		return false;
+
+	Mesh* meshes = reinterpret_cast<Mesh*>(view + header.MeshesOffset);
+	for (std::uint32_t i = 0; i < header.MeshCount; ++i)
+	{
+		Mesh& mesh = meshes[i];
+		if (!Within(mesh.Vertices.Offset, (std::uint64_t)mesh.VertexCount * key.VertexStride,
+				header.VerticesOffset, header.VerticesBytes) ||
+			!Within(mesh.Indices.Offset, (std::uint64_t)mesh.IndexCount * sizeof(std::uint32_t),
+				header.IndicesOffset, header.IndicesBytes) ||
+			mesh.Vertices.Offset % 4 != 0 || mesh.Indices.Offset % 4 != 0 ||
+			!Within(mesh.DiffuseMapName.Offset, 1, header.StringsOffset, header.StringsBytes) ||
+			!Within(mesh.NormalMapName.Offset, 1, header.StringsOffset, header.StringsBytes))
+			return false;
+
+		mesh.Vertices.Pointer = view + mesh.Vertices.Offset;
+		mesh.Indices.Pointer = reinterpret_cast<const std::uint32_t*>(view + mesh.Indices.Offset);
+		mesh.DiffuseMapName.Pointer = reinterpret_cast<const char*>(view + mesh.DiffuseMapName.Offset);
+		mesh.NormalMapName.Pointer = reinterpret_cast<const char*>(view + mesh.NormalMapName.Offset);
+	}
+
+	m_meshes = meshes;
+	m_meshCount = (int)header.MeshCount;
+	return true;
+}
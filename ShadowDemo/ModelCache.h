@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+//Baked copy of an imported model, so that a model is parsed and post-processed once
+//rather than on every start.
+//A cache file holds the final vertices, indices and materials of every mesh, each kind
+//in one contiguous array, behind a table of meshes whose references are file offsets.
+//Open() maps the file copy-on-write and turns those offsets into pointers in place;
+//only the pages of the mesh table are ever written, the arrays are used where they lie.
+//A file is only accepted for the Key it was written with: the source path, a hash of
+//the source file's contents, the post-process flags and the vertex layout.  Anything
+//else, including a file written by another Version, is a miss.
+class ModelCache
+{
+public:
+	struct Key
+	{
+		std::string SourcePath;
+		std::uint64_t SourceHash = 0;		//HashFile() of the source
+		std::uint32_t PostProcessFlags = 0;
+		std::uint32_t VertexStride = 0;		//bytes per vertex
+	};
+
+	//A file offset until the file is opened, a pointer after.
+	template<class T>
+	union Reference
+	{
+		std::uint64_t Offset;
+		const T* Pointer;
+	};
+
+	//One mesh as it lies in the file.  Strings are NUL terminated.
+	struct Mesh
+	{
+		Reference<void> Vertices;
+		Reference<std::uint32_t> Indices;
+		Reference<char> DiffuseMapName;
+		Reference<char> NormalMapName;
+		std::uint32_t VertexCount;
+		std::uint32_t IndexCount;
+		float DiffuseAlbedo[4];
+		float FresnelR0[3];
+		float Roughness;
+	};
+
+	//One mesh to write.
+	struct MeshData
+	{
+		const void* Vertices = nullptr;
+		std::uint32_t VertexCount = 0;
+		const std::uint32_t* Indices = nullptr;
+		std::uint32_t IndexCount = 0;
+		std::string DiffuseMapName;
+		std::string NormalMapName;
+		float DiffuseAlbedo[4] = { 1.f, 1.f, 1.f, 1.f };
+		float FresnelR0[3] = { 0.f, 0.f, 0.f };
+		float Roughness = 0.f;
+	};
+
+	static const std::uint32_t Version = 1;
+
+	ModelCache();
+	ModelCache(const ModelCache& rhs) = delete;
+	ModelCache& operator=(const ModelCache& rhs) = delete;
+	~ModelCache();
+
+	//Absolute form of path, for keys that do not depend on the working directory.
+	static std::string FullPath(const std::string& path);
+
+	//Hash of the contents of a file; false when it cannot be read.
+	static bool HashFile(const std::string& path, std::uint64_t& hash);
+
+	//Writes the meshes to path, through a temporary file, so that a reader never sees
+	//half a file.
+	static bool Write(const std::string& path, const Key& key, const std::vector<MeshData>& meshes);
+
+	//Maps the file at path.  Fails when it is missing, damaged or written for another key.
+	bool Open(const std::string& path, const Key& key);
+	void Close();
+
+	bool IsOpen()const;
+	int MeshCount()const;
+	const Mesh& GetMesh(int i)const;
+
+	//Bytes mapped.
+	std::size_t Size()const;
+
+private:
+	struct Header;
+
+	bool FixUp(const Key& key);
+
+private:
+	MappedFile m_file;					//copy-on-write: the fix-ups stay in this process
+
+	const Mesh* m_meshes = nullptr;
+	int m_meshCount = 0;
+};
@@ -1,8 +1,32 @@
 #include "ModelImporter.h"
+#include <cstring>
+#include "ModelVertexStreams.h"
+#include <type_traits>
 
 using namespace std;
 using namespace DirectX;
 
+//Ķ㰴ֽԭʹ
+static_assert(std::is_trivially_copyable<ModelImporter::ModelVertex>::value, "ModelVertex is baked as bytes");
+//InterleaveModelVerticesд11float
+static_assert(sizeof(ModelImporter::ModelVertex) == 11 * sizeof(float), "ModelVertex is 11 floats");
+static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "Assimp streams are 3 floats per vertex");
+
+namespace
+{
+	//ģĿ¼,ͼ·
+	std::string BasePath(const std::string& filepath)
+	{
+		return filepath.substr(0, filepath.find_last_of('\\') + 1);
+	}
+
+	//ģĿ¼ͼ·,Ŀ¼決Ҳ
+	std::string RelativeTo(const std::string& path, const std::string& basePath)
+	{
+		return path.compare(0, basePath.size(), basePath) == 0 ? path.substr(basePath.size()) : path;
+	}
+}
+
 ModelImporter::ModelImporter(std::string name)
 {
 	this->m_name = name;
@@ -13,17 +37,36 @@ ModelImporter::~ModelImporter()
 
 }
 
-bool ModelImporter::LoadModel(const std::string filepath)
+std::string ModelImporter::CachePath(const std::string& filepath)
+{
+	return filepath + ".baked";
+}
+
+bool ModelImporter::LoadModel(const std::string filepath, bool useCache)
+{
+	ModelCache::Key key;
+	bool cacheable = useCache && MakeCacheKey(filepath, key);
+	if (cacheable && LoadBaked(filepath, key))
+		return true;
+
+	if (!ImportModel(filepath))
+		return false;
+	//дʧֻӰ´
+	if (cacheable)
+		WriteBaked(filepath, key);
+	return true;
+}
+
+bool ModelImporter::BakeModel(const std::string filepath)
+{
+	ModelCache::Key key;
+	return MakeCacheKey(filepath, key) && ImportModel(filepath) && WriteBaked(filepath, key);
+}
+
+bool ModelImporter::ImportModel(const std::string& filepath)
 {
 	Assimp::Importer importer;
-	const aiScene* pScene = importer.ReadFile(filepath, 
-		aiProcess_Triangulate | //ǻ
-		aiProcess_FlipUVs | //ת
-		aiProcess_CalcTangentSpace | //߿ռ
-		aiProcess_FixInfacingNormals | //
-		aiProcess_ConvertToLeftHanded |//Ϊϵ
-		aiProcess_GenNormals
-	);
+	const aiScene* pScene = importer.ReadFile(filepath, PostProcessFlags);
 
 	if (!pScene)
 	{
@@ -31,12 +74,82 @@ bool ModelImporter::LoadModel(const std::string filepath)
 		return false;
 	}
 
+	m_meshes.clear();
 	this->filepath = filepath;
 	this->ProcessNode(pScene->mRootNode, pScene);
+	return true;
+}
+
+bool ModelImporter::MakeCacheKey(const std::string& filepath, ModelCache::Key& key)const
+{
+	key.SourcePath = ModelCache::FullPath(filepath);
+	key.PostProcessFlags = PostProcessFlags;
+	key.VertexStride = sizeof(ModelVertex);
+	return ModelCache::HashFile(filepath, key.SourceHash);
+}
+
+//ӳĻ鿽,͵ʱһMesh
+bool ModelImporter::LoadBaked(const std::string& filepath, const ModelCache::Key& key)
+{
+	ModelCache cache;
+	if (!cache.Open(CachePath(filepath), key))
+		return false;
+
+	std::string basePath = BasePath(filepath);
+	m_meshes.clear();
+	m_meshes.resize(cache.MeshCount());
+	for (int i = 0; i < cache.MeshCount(); ++i)
+	{
+		const ModelCache::Mesh& baked = cache.GetMesh(i);
+		ModelMesh& mesh = m_meshes[i];
+
+		const ModelVertex* vertices = static_cast<const ModelVertex*>(baked.Vertices.Pointer);
+		mesh.vertices.assign(vertices, vertices + baked.VertexCount);
+		mesh.indices.assign(baked.Indices.Pointer, baked.Indices.Pointer + baked.IndexCount);
+
+		ModelMaterial& material = mesh.material;
+		material.Name = m_name + to_string(i);
+		material.DiffuseAlbedo = XMFLOAT4(baked.DiffuseAlbedo);
+		material.FresnelR0 = XMFLOAT3(baked.FresnelR0);
+		material.Roughness = baked.Roughness;
+		if (*baked.DiffuseMapName.Pointer)
+			material.DiffuseMapName = basePath + baked.DiffuseMapName.Pointer;
+		if (*baked.NormalMapName.Pointer)
+			material.NormalMapName = basePath + baked.NormalMapName.Pointer;
+	}
+
+	this->filepath = filepath;
+	return true;
+}
+
+bool ModelImporter::WriteBaked(const std::string& filepath, const ModelCache::Key& key)const
+{
+	std::string basePath = BasePath(filepath);
+	std::vector<ModelCache::MeshData> meshes(m_meshes.size());
+	for (size_t i = 0; i < m_meshes.size(); ++i)
+	{
+		const ModelMesh& mesh = m_meshes[i];
+		ModelCache::MeshData& data = meshes[i];
+		data.Vertices = mesh.vertices.data();
+		data.VertexCount = (std::uint32_t)mesh.vertices.size();
+		data.Indices = mesh.indices.data();
+		data.IndexCount = (std::uint32_t)mesh.indices.size();
+		if (!mesh.material.DiffuseMapName.empty())
+			data.DiffuseMapName = RelativeTo(mesh.material.DiffuseMapName, basePath);
+		if (!mesh.material.NormalMapName.empty())
+			data.NormalMapName = RelativeTo(mesh.material.NormalMapName, basePath);
+		memcpy(data.DiffuseAlbedo, &mesh.material.DiffuseAlbedo, sizeof(data.DiffuseAlbedo));
+		memcpy(data.FresnelR0, &mesh.material.FresnelR0, sizeof(data.FresnelR0));
+		data.Roughness = mesh.material.Roughness;
+	}
+	return ModelCache::Write(CachePath(filepath), key, meshes);
 }
 
 void ModelImporter::ProcessNode(aiNode* node, const aiScene* scene)
 {
+	//ڵʱMeshԤ
+	if (node == scene->mRootNode)
+		m_meshes.reserve(m_meshes.size() + scene->mNumMeshes);
 	// ӵǰڵеMesh
 	for (int i = 0; i < node->mNumMeshes; i++)
 	{
@@ -52,63 +165,20 @@ void ModelImporter::ProcessNode(aiNode* node, const aiScene* scene)
 
 ModelImporter::ModelMesh ModelImporter::ProcessMesh(aiMesh* mesh, const aiScene* scene)
 {
-	vector<ModelVertex> vertices;
-	vector<UINT> indices;
-	ModelMaterial material;
-
-	//
-	for (int i = 0; i < mesh->mNumVertices; i++)
-	{
-		ModelVertex vertex;
+	ModelMesh result;
+	ModelMaterial& material = result.material;
 
-		vertex.Pos = XMFLOAT3
-		{
-			mesh->mVertices[i].x,
-			mesh->mVertices[i].y,
-			mesh->mVertices[i].z
-		};
-		
-		vertex.Normal = XMFLOAT3
-		{
-			mesh->mNormals[i].x,
-			mesh->mNormals[i].y,
-			 mesh->mNormals[i].z
-		};
-		
-		if (mesh->mTextureCoords[0]) // Ƿuv
-		{
-			vertex.TexC = XMFLOAT2
-			{
-				mesh->mTextureCoords[0][i].x,
-				mesh->mTextureCoords[0][i].y
-			};
-		}
-		else
-			vertex.TexC = XMFLOAT2{ 0.0f, 0.0f };
+	//,һη,齻֯ModelVertex
+	result.vertices.resize(mesh->mNumVertices);
+	InterleaveModelVertices(reinterpret_cast<const float*>(mesh->mVertices),
+		reinterpret_cast<const float*>(mesh->mNormals),
+		reinterpret_cast<const float*>(mesh->mTextureCoords[0]), // ûuvʱΪ0
+		reinterpret_cast<const float*>(mesh->mTangents), //ûʱΪ0
+		mesh->mNumVertices, reinterpret_cast<float*>(result.vertices.data()));
 
-		//Ƿ
-		if (mesh->mTangents)
-		{
-			vertex.TangentU = XMFLOAT3
-			{
-				mesh->mTangents[i].x,
-				mesh->mTangents[i].y,
-				mesh->mTangents[i].z
-			};
-		}
-		
-		vertices.push_back(vertex);
-	}
-	
-	//
-	for (int i = 0; i < mesh->mNumFaces; i++)
-	{
-		aiFace face = mesh->mFaces[i];
-		for (int j = 0; j < face.mNumIndices; j++)
-		{
-			indices.push_back(face.mIndices[j]);
-		}
-	}
+	//,ԭضȡ,aiFace
+	result.indices.resize(CountFaceIndices(mesh->mFaces, mesh->mNumFaces));
+	CopyFaceIndices(mesh->mFaces, mesh->mNumFaces, result.indices.data());
 
 	int lastPos = filepath.find_last_of('\\');
 	std::string basePath = filepath.substr(0, lastPos + 1);
@@ -167,5 +237,5 @@ ModelImporter::ModelMesh ModelImporter::ProcessMesh(aiMesh* mesh, const aiScene*
 
 	}
 
-	return ModelMesh(vertices, indices, material);
+	return result;
 }
\ No newline at end of file
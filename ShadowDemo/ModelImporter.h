@@ -5,6 +5,8 @@
 #include "assimp\scene.h"
 #include "assimp\postprocess.h"
 #include "Common\d3dUtil.h"
+#include "ModelCache.h"
+#include "MeshSimplifier.h"
 
 class ModelImporter
 {
@@ -28,17 +30,6 @@ public:
 	{
 	public:
 		ModelMaterial() = default;
-		ModelMaterial& operator=(const ModelMaterial& rhs)
-		{
-			this->Name = rhs.Name;
-			this->DiffuseAlbedo = rhs.DiffuseAlbedo;
-			this->FresnelR0 = rhs.FresnelR0;
-			this->Roughness = rhs.Roughness;
-			this->DiffuseMapName = rhs.DiffuseMapName;
-			this->NormalMapName = rhs.NormalMapName;
-			return *this;
-		
-		}
 
 		std::string Name;
 
@@ -57,21 +48,41 @@ public:
 		std::vector<ModelVertex> vertices;
 		std::vector<UINT> indices;
 		ModelMaterial material;
+		//LOD,vertices,ÿindicesһ,lods[0]һ;Ϊʱindicesֻһ
+		std::vector<MeshLod> lods;
 
 		ModelMesh() = default;
+		//ֵ,߿԰ѻmove
 		ModelMesh(std::vector<ModelVertex> vertices, std::vector<UINT> indices, ModelMaterial material)
+			: vertices(std::move(vertices)), indices(std::move(indices)), material(std::move(material))
 		{
-			this->vertices = vertices;
-			this->indices = indices;
-			this->material = material;
 		}
 	};
 
-	bool LoadModel(const std::string filepath);
+	//ʱõĺ,ҲǺ決һ
+	static const unsigned int PostProcessFlags =
+		aiProcess_Triangulate | //ǻ
+		aiProcess_FlipUVs | //ת
+		aiProcess_CalcTangentSpace | //߿ռ
+		aiProcess_FixInfacingNormals | //
+		aiProcess_ConvertToLeftHanded |//Ϊϵ
+		aiProcess_GenNormals;
+
+	//ģļĺ決Ա
+	static std::string CachePath(const std::string& filepath);
+
+	//ȶ決,ȱʧʱAssimp,д;useCacheΪfalseʱֻAssimp
+	bool LoadModel(const std::string filepath, bool useCache = true);
+	//Assimp벢д,決
+	bool BakeModel(const std::string filepath);
 	std::vector<ModelMesh> m_meshes;
 	std::string m_name;
 	std::string filepath;
 private:	
+	bool ImportModel(const std::string& filepath);	//Assimp
+	bool MakeCacheKey(const std::string& filepath, ModelCache::Key& key)const;
+	bool LoadBaked(const std::string& filepath, const ModelCache::Key& key);
+	bool WriteBaked(const std::string& filepath, const ModelCache::Key& key)const;
 	void ProcessNode(aiNode* node, const aiScene* scene);	//ÿڵ
 	ModelMesh ProcessMesh(aiMesh* mesh, const aiScene* scene);	//ÿMesh
 
@@ -0,0 +1,119 @@
+#include "ModelLoader.h"
+#include <algorithm>
+
+ModelLoader::ModelLoader()
+	: ModelLoader(Desc())
+{
+}
+
+ModelLoader::ModelLoader(const Desc& desc)
+	: m_desc(desc)
+{
+	m_desc.MaxImportsInFlight = std::max(1, desc.MaxImportsInFlight);
+	m_loaders = std::make_unique<TaskScheduler>(std::max(1, desc.LoaderThreads));
+}
+
+//the jobs left find nothing to import; the scheduler runs them out and joins
+ModelLoader::~ModelLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_queued.clear();
+	}
+	m_loaders.reset();
+}
+
+int ModelLoader::Load(const std::string& name, const std::string& path, LoadedCallback callback)
+{
+	int id = m_nextId++;
+	m_callbacks[id] = std::move(callback);
+
+	bool start = false;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_queued.push_back(Request{ id, name, path });
+		if (m_importers < m_desc.MaxImportsInFlight)
+		{
+			++m_importers;
+			start = true;
+		}
+	}
+	if (start)
+		m_loaders->Run([this]() { Import(); });
+	return id;
+}
+
+//Body of an importer job: imports queued models one after the other until none is left.
+void ModelLoader::Import()
+{
+	for (;;)
+	{
+		Request request;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (m_queued.empty())
+			{
+				--m_importers;
+				return;
+			}
+			request = std::move(m_queued.front());
+			m_queued.pop_front();
+		}
+
+		Result result;
+		result.Id = request.Id;
+		result.Name = std::move(request.Name);
+		result.Path = std::move(request.Path);
+		result.Asset = Model::LoadAsset(result.Name, result.Path, m_desc.UseCache, m_desc.Lods);
+		result.Loaded = result.Asset != nullptr;
+
+		//notified under the lock: once it is released this may be gone
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_finished.push_back(std::move(result));
+		m_finishedSignal.notify_all();
+	}
+}
+
+void ModelLoader::Update()
+{
+	std::vector<Result> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		finished.swap(m_finished);
+	}
+	for (auto& result : finished)
+	{
+		int id = result.Id;
+		m_ready.emplace(id, std::move(result));
+	}
+
+	while (!m_ready.empty() && m_ready.begin()->first == m_nextHandover)
+	{
+		Result result = std::move(m_ready.begin()->second);
+		m_ready.erase(m_ready.begin());
+		++m_nextHandover;
+
+		auto callback = m_callbacks.find(result.Id);
+		LoadedCallback loaded = std::move(callback->second);
+		m_callbacks.erase(callback);
+		if (loaded)
+			loaded(result);
+	}
+}
+
+void ModelLoader::Finish()
+{
+	while (!m_callbacks.empty())
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_finishedSignal.wait(lock, [this] { return !m_finished.empty(); });
+		}
+		Update();
+	}
+}
+
+int ModelLoader::Pending()const
+{
+	return (int)m_callbacks.size();
+}
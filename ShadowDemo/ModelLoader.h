@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Model.h"
+#include "Common/TaskScheduler.h"
+
+//Imports models on loader threads.  Load() queues a model and returns at once; at most
+//MaxImportsInFlight models are imported at a time, each by its own ModelImporter (so its
+//own Assimp importer), from its baked cache where there is one.  Models go through
+//Model::Assets(), so a file queued twice, or already held, is imported once.  Finished models are
+//handed over by Update() through their callbacks, in the order they were queued, so the
+//GPU upload stays on the calling thread.  Independent models import side by side, and a
+//set of them takes about as long as the slowest one, given a thread each.
+//Load(), Update(), Finish() and the callbacks belong to one thread, normally the main thread.
+class ModelLoader
+{
+public:
+	struct Desc
+	{
+		int MaxImportsInFlight = 4;
+		int LoaderThreads = 4;
+		bool UseCache = true;				//read and write the baked caches
+		MeshLodDesc Lods;					//LOD chain of every mesh, built on the loader threads
+	};
+
+	struct Result
+	{
+		int Id;								//returned by Load()
+		std::string Name;
+		std::string Path;
+		bool Loaded;						//false when the import failed, Asset is null then
+		Model::AssetHandle Asset;
+	};
+
+	typedef std::function<void(Result& result)> LoadedCallback;
+
+	ModelLoader();
+	explicit ModelLoader(const Desc& desc);
+	ModelLoader(const ModelLoader& rhs) = delete;
+	ModelLoader& operator=(const ModelLoader& rhs) = delete;
+	//Drops the models not started yet and waits for the imports in flight, without
+	//calling back.
+	~ModelLoader();
+
+	//Queues the model at path, name being the ModelImporter's; callback is called with it
+	//from Update().  Returns the Id of its result, counting from 0.
+	int Load(const std::string& name, const std::string& path, LoadedCallback callback);
+
+	//Calls back for the models finished since the last call, as far as every model
+	//queued before them has been handed over.
+	void Update();
+
+	//Blocks until every queued model has been imported and handed over.
+	void Finish();
+
+	//Models queued and not handed over yet.
+	int Pending()const;
+
+private:
+	struct Request
+	{
+		int Id;
+		std::string Name;
+		std::string Path;
+	};
+
+	void Import();
+
+private:
+	Desc m_desc;
+	std::unique_ptr<TaskScheduler> m_loaders;
+
+	std::unordered_map<int, LoadedCallback> m_callbacks;	//per model not handed over yet
+	std::map<int, Result> m_ready;			//finished, waiting for earlier models
+	int m_nextId = 0;
+	int m_nextHandover = 0;
+
+	//Shared with the loaders.  Every importer job takes queued models until there
+	//are none left, so the number of jobs bounds the imports in flight.
+	std::mutex m_lock;
+	std::condition_variable m_finishedSignal;
+	std::deque<Request> m_queued;
+	std::vector<Result> m_finished;
+	int m_importers = 0;
+};
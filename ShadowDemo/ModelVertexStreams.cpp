@@ -0,0 +1,61 @@
+#include "ModelVertexStreams.h"
+
+#if !defined(_XM_NO_INTRINSICS_) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MODELVERTEX_SSE
+#include <emmintrin.h>
+#endif
+
+void InterleaveModelVertices(const float* positions, const float* normals, const float* texCoords,
+	const float* tangents, std::size_t count, float* dst)
+{
+	//a missing stream reads the same zeros for every vertex
+	static const float zeros[4] = {};
+	const std::size_t normalStride = normals ? 3 : 0;
+	const std::size_t texStride = texCoords ? 3 : 0;
+	const std::size_t tangentStride = tangents ? 3 : 0;
+	if (!normals)
+		normals = zeros;
+	if (!texCoords)
+		texCoords = zeros;
+	if (!tangents)
+		tangents = zeros;
+
+	std::size_t i = 0;
+#if defined(MODELVERTEX_SSE)
+	//Each load takes a vertex's 3 floats and the first of the next one, and the tangent
+	//store spills into the next vertex, which is written over right after; the last
+	//vertex is left to the scalar loop so that nothing runs past the arrays.
+	for (; i + 1 < count; ++i)
+	{
+		__m128 p = _mm_loadu_ps(positions + 3 * i);					//px py pz -
+		__m128 n = _mm_loadu_ps(normals + normalStride * i);		//nx ny nz -
+		__m128 t = _mm_loadu_ps(texCoords + texStride * i);			//u  v  -  -
+		__m128 g = _mm_loadu_ps(tangents + tangentStride * i);		//tx ty tz -
+
+		__m128 pzNx = _mm_shuffle_ps(p, n, _MM_SHUFFLE(0, 0, 2, 2));	//pz pz nx nx
+		float* v = dst + 11 * i;
+		_mm_storeu_ps(v, _mm_shuffle_ps(p, pzNx, _MM_SHUFFLE(2, 0, 1, 0)));		//px py pz nx
+		_mm_storeu_ps(v + 4, _mm_shuffle_ps(n, t, _MM_SHUFFLE(1, 0, 2, 1)));	//ny nz u  v
+		_mm_storeu_ps(v + 8, g);												//tx ty tz -
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const float* p = positions + 3 * i;
+		const float* n = normals + normalStride * i;
+		const float* t = texCoords + texStride * i;
+		const float* g = tangents + tangentStride * i;
+		float* v = dst + 11 * i;
+		v[0] = p[0];
+		v[1] = p[1];
+		v[2] = p[2];
+		v[3] = n[0];
+		v[4] = n[1];
+		v[5] = n[2];
+		v[6] = t[0];
+		v[7] = t[1];
+		v[8] = g[0];
+		v[9] = g[1];
+		v[10] = g[2];
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+//Conversion of a mesh as Assimp keeps it, one array per attribute, into
+//ModelImporter's interleaved vertices and flat index list.  Kept apart from
+//ModelImporter so that it builds without Assimp.
+
+//Writes count vertices of 11 floats to dst, in the layout of ModelImporter::ModelVertex:
+//position, normal, texture coordinate and tangent.  Every stream holds 3 floats per
+//vertex, like aiVector3D; the third texture coordinate is dropped.  A null normal,
+//texture coordinate or tangent stream writes zeros.  4 floats are loaded at a time
+//where SSE2 is there.
+void InterleaveModelVertices(const float* positions, const float* normals, const float* texCoords,
+	const float* tangents, std::size_t count, float* dst);
+
+//Number of indices in count faces; Face has mNumIndices and mIndices, like aiFace.
+template<class Face>
+std::size_t CountFaceIndices(const Face* faces, std::size_t count)
+{
+	std::size_t indices = 0;
+	for (std::size_t i = 0; i < count; ++i)
+		indices += faces[i].mNumIndices;
+	return indices;
+}
+
+//Writes the indices of count faces one after the other to dst, which must hold
+//CountFaceIndices() of them.  Faces are read in place, never copied.
+template<class Face, class Index>
+void CopyFaceIndices(const Face* faces, std::size_t count, Index* dst)
+{
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const Face& face = faces[i];
+		for (unsigned int j = 0; j < face.mNumIndices; ++j)
+			*dst++ = (Index)face.mIndices[j];
+	}
+}
@@ -0,0 +1,336 @@
+#include "NoiseHeightSource.h"
+#include "Common/TaskScheduler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+//Same kernel selection as HeightfieldNormals: 8 samples at a time with AVX2, 4 with SSE2.
+//Without either the kernel runs on plain floats, one sample at a time.
+#if !defined(_XM_NO_INTRINSICS_) && defined(__AVX2__)
+#define NOISE_AVX2
+#include <immintrin.h>
+#elif !defined(_XM_NO_INTRINSICS_) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NOISE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+#if defined(NOISE_AVX2)
+	typedef __m256 Floats;
+	typedef __m256i Ints;
+	const int LaneCount = 8;
+
+	inline void Store(float* p, Floats v) { _mm256_storeu_ps(p, v); }
+	inline Floats Splat(float f) { return _mm256_set1_ps(f); }
+	inline Floats Ramp() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+	inline Floats Add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+	inline Floats Sub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+	inline Floats Mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+	inline Floats Min(Floats a, Floats b) { return _mm256_min_ps(a, b); }
+	inline Floats Max(Floats a, Floats b) { return _mm256_max_ps(a, b); }
+	inline Floats Abs(Floats a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+	inline Floats Floor(Floats a) { return _mm256_floor_ps(a); }
+	inline Floats FlipSign(Floats a, Ints signBit) { return _mm256_xor_ps(a, _mm256_castsi256_ps(signBit)); }
+	inline Floats Select(Ints mask, Floats a, Floats b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask)); }
+
+	inline Ints ToInt(Floats a) { return _mm256_cvttps_epi32(a); }
+	inline Ints SplatInt(std::uint32_t i) { return _mm256_set1_epi32((int)i); }
+	inline Ints AddInt(Ints a, Ints b) { return _mm256_add_epi32(a, b); }
+	inline Ints MulInt(Ints a, Ints b) { return _mm256_mullo_epi32(a, b); }
+	inline Ints Xor(Ints a, Ints b) { return _mm256_xor_si256(a, b); }
+	inline Ints And(Ints a, Ints b) { return _mm256_and_si256(a, b); }
+	inline Ints IsZero(Ints a) { return _mm256_cmpeq_epi32(a, _mm256_setzero_si256()); }
+	template<int Bits> inline Ints ShiftLeft(Ints a) { return _mm256_slli_epi32(a, Bits); }
+	template<int Bits> inline Ints ShiftRight(Ints a) { return _mm256_srli_epi32(a, Bits); }
+#elif defined(NOISE_SSE)
+	typedef __m128 Floats;
+	typedef __m128i Ints;
+	const int LaneCount = 4;
+
+	inline void Store(float* p, Floats v) { _mm_storeu_ps(p, v); }
+	inline Floats Splat(float f) { return _mm_set1_ps(f); }
+	inline Floats Ramp() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+	inline Floats Add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+	inline Floats Sub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+	inline Floats Mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+	inline Floats Min(Floats a, Floats b) { return _mm_min_ps(a, b); }
+	inline Floats Max(Floats a, Floats b) { return _mm_max_ps(a, b); }
+	inline Floats Abs(Floats a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+	inline Floats FlipSign(Floats a, Ints signBit) { return _mm_xor_ps(a, _mm_castsi128_ps(signBit)); }
+	inline Floats Select(Ints mask, Floats a, Floats b)
+	{
+		Floats m = _mm_castsi128_ps(mask);
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+	}
+	//truncate, then step down where that rounded up, i.e. for negative fractions
+	inline Floats Floor(Floats a)
+	{
+		Floats t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.f)));
+	}
+
+	inline Ints ToInt(Floats a) { return _mm_cvttps_epi32(a); }
+	inline Ints SplatInt(std::uint32_t i) { return _mm_set1_epi32((int)i); }
+	inline Ints AddInt(Ints a, Ints b) { return _mm_add_epi32(a, b); }
+	inline Ints Xor(Ints a, Ints b) { return _mm_xor_si128(a, b); }
+	inline Ints And(Ints a, Ints b) { return _mm_and_si128(a, b); }
+	inline Ints IsZero(Ints a) { return _mm_cmpeq_epi32(a, _mm_setzero_si128()); }
+	template<int Bits> inline Ints ShiftLeft(Ints a) { return _mm_slli_epi32(a, Bits); }
+	template<int Bits> inline Ints ShiftRight(Ints a) { return _mm_srli_epi32(a, Bits); }
+	//SSE2 has no 32-bit mullo: multiply the even and the odd lanes to 64 bits and keep the low halves
+	inline Ints MulInt(Ints a, Ints b)
+	{
+		Ints even = _mm_mul_epu32(a, b);
+		Ints odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+#else
+	typedef float Floats;
+	typedef std::uint32_t Ints;
+	const int LaneCount = 1;
+
+	inline void Store(float* p, Floats v) { *p = v; }
+	inline Floats Splat(float f) { return f; }
+	inline Floats Ramp() { return 0.f; }
+	inline Floats Add(Floats a, Floats b) { return a + b; }
+	inline Floats Sub(Floats a, Floats b) { return a - b; }
+	inline Floats Mul(Floats a, Floats b) { return a * b; }
+	inline Floats Min(Floats a, Floats b) { return a < b ? a : b; }
+	inline Floats Max(Floats a, Floats b) { return a > b ? a : b; }
+	inline Floats Abs(Floats a) { return fabsf(a); }
+	inline Floats Floor(Floats a) { return floorf(a); }
+	inline Floats FlipSign(Floats a, Ints signBit)
+	{
+		std::uint32_t bits;
+		memcpy(&bits, &a, sizeof(bits));
+		bits ^= signBit;
+		memcpy(&a, &bits, sizeof(a));
+		return a;
+	}
+	inline Floats Select(Ints mask, Floats a, Floats b) { return mask ? a : b; }
+
+	inline Ints ToInt(Floats a) { return (std::uint32_t)(std::int32_t)a; }
+	inline Ints SplatInt(std::uint32_t i) { return i; }
+	inline Ints AddInt(Ints a, Ints b) { return a + b; }
+	inline Ints MulInt(Ints a, Ints b) { return a * b; }
+	inline Ints Xor(Ints a, Ints b) { return a ^ b; }
+	inline Ints And(Ints a, Ints b) { return a & b; }
+	inline Ints IsZero(Ints a) { return a == 0 ? ~0u : 0u; }
+	template<int Bits> inline Ints ShiftLeft(Ints a) { return a << Bits; }
+	template<int Bits> inline Ints ShiftRight(Ints a) { return a >> Bits; }
+#endif
+
+	//Steps of the lattice hash; odd, so multiplying by them loses no bit of a coordinate.
+	const std::uint32_t PrimeX = 0x8da6b343u;
+	const std::uint32_t PrimeY = 0xd8163841u;
+	const std::uint32_t Mix = 0x7feb352du;
+
+	//Scalar form of the lattice hash, for the per-octave seeds and offsets.
+	std::uint32_t Hash(std::uint32_t h)
+	{
+		h ^= h >> 16;
+		h *= Mix;
+		h ^= h >> 15;
+		h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	//Hash of a lattice point from its x * PrimeX and y * PrimeY.  Only the top three
+	//bits are used, and those depend on every bit of the input.
+	inline Ints LatticeHash(Ints hx, Ints hy, Ints seed)
+	{
+		Ints h = Xor(Xor(hx, hy), seed);
+		h = Xor(h, ShiftRight<16>(h));
+		return MulInt(h, SplatInt(Mix));
+	}
+
+	//One of eight gradients picked by the top three bits of h, dotted with (x, y):
+	//(+-x +-2y) or (+-y +-2x), as in Gustavson's grad2.
+	inline Floats Gradient(Ints h, Floats x, Floats y)
+	{
+		const Ints signBit = SplatInt(0x80000000u);
+		Ints keep = IsZero(And(h, signBit));
+		Floats u = FlipSign(Select(keep, x, y), And(ShiftLeft<1>(h), signBit));
+		Floats v = FlipSign(Select(keep, y, x), And(ShiftLeft<2>(h), signBit));
+		return Add(u, Add(v, v));
+	}
+
+	//6t^5 - 15t^4 + 10t^3, flat at both ends so the noise has no creases at cell edges
+	inline Floats Fade(Floats t)
+	{
+		return Mul(Mul(Mul(t, t), t), Add(Mul(t, Sub(Mul(t, Splat(6.f)), Splat(15.f))), Splat(10.f)));
+	}
+
+	inline Floats Lerp(Floats a, Floats b, Floats t)
+	{
+		return Add(a, Mul(Sub(b, a), t));
+	}
+
+	//2D gradient noise, about -1..1 and zero on the lattice points.
+	inline Floats GradientNoise(Floats x, Floats y, Ints seed)
+	{
+		Floats x0 = Floor(x);
+		Floats y0 = Floor(y);
+		Floats fx = Sub(x, x0);
+		Floats fy = Sub(y, y0);
+		Floats fx1 = Sub(fx, Splat(1.f));
+		Floats fy1 = Sub(fy, Splat(1.f));
+
+		Ints hx = MulInt(ToInt(x0), SplatInt(PrimeX));
+		Ints hy = MulInt(ToInt(y0), SplatInt(PrimeY));
+		Ints hx1 = AddInt(hx, SplatInt(PrimeX));
+		Ints hy1 = AddInt(hy, SplatInt(PrimeY));
+
+		Floats n00 = Gradient(LatticeHash(hx, hy, seed), fx, fy);
+		Floats n10 = Gradient(LatticeHash(hx1, hy, seed), fx1, fy);
+		Floats n01 = Gradient(LatticeHash(hx, hy1, seed), fx, fy1);
+		Floats n11 = Gradient(LatticeHash(hx1, hy1, seed), fx1, fy1);
+
+		Floats u = Fade(fx);
+		Floats v = Fade(fy);
+		return Mul(Lerp(Lerp(n00, n10, u), Lerp(n01, n11, u), v), Splat(0.507f));
+	}
+}
+
+NoiseHeightSource::NoiseHeightSource()
+{
+}
+
+NoiseHeightSource::~NoiseHeightSource()
+{
+}
+
+bool NoiseHeightSource::Open(const Desc& desc)
+{
+	Close();
+	if (desc.Width < 1 || desc.Height < 1 || desc.Octaves < 1 || desc.Octaves > MaxOctaves ||
+		!(desc.Frequency > 0.f) || !(desc.Lacunarity > 0.f) || !(desc.Amplitude > 0.f))
+		return false;
+
+	m_desc = desc;
+	float frequency = desc.Frequency;
+	float amplitude = 1.f;
+	float sum = 0.f;
+	std::uint32_t seed = desc.Seed;
+	for (int i = 0; i < desc.Octaves; ++i)
+	{
+		Octave octave;
+		octave.Frequency = frequency;
+		octave.Amplitude = amplitude;
+		seed = Hash(seed + 0x9e3779b9u);
+		octave.Seed = seed;
+		std::uint32_t offset = Hash(seed);
+		octave.OffsetX = (offset & 0xffff) / 65536.f;
+		octave.OffsetY = (offset >> 16) / 65536.f;
+		m_octaves.push_back(octave);
+
+		sum += amplitude;
+		frequency *= desc.Lacunarity;
+		amplitude *= desc.Gain;
+	}
+	m_normalize = sum > 0.f ? 1.f / sum : 1.f;
+	m_open = true;
+	return true;
+}
+
+void NoiseHeightSource::Close()
+{
+	m_octaves.clear();
+	m_open = false;
+}
+
+bool NoiseHeightSource::IsOpen()const
+{
+	return m_open;
+}
+
+int NoiseHeightSource::Width()const
+{
+	return m_open ? m_desc.Width : 0;
+}
+
+int NoiseHeightSource::Height()const
+{
+	return m_open ? m_desc.Height : 0;
+}
+
+const NoiseHeightSource::Desc& NoiseHeightSource::GetDesc()const
+{
+	return m_desc;
+}
+
+float NoiseHeightSource::Sample(int row, int col, float scale)const
+{
+	float value;
+	ReadRow(row, col, 1, &value, scale);
+	return value;
+}
+
+//Every sample goes through the lane kernel, the last partial group through a padded
+//copy, so a sample comes out the same whichever window it is read in.
+void NoiseHeightSource::ReadRow(int row, int col, int count, float* dst, float scale)const
+{
+	assert(IsOpen());
+	assert(row >= 0 && row < m_desc.Height && col >= 0 && count >= 0 && col + count <= m_desc.Width);
+
+	const bool ridged = m_desc.Type == Fractal::Ridged;
+	const Floats normalize = Splat(m_normalize);
+	const Floats heightScale = Splat(m_desc.Amplitude * scale);
+	const Floats y = Splat((float)row);
+	for (int j = 0; j < count; j += LaneCount)
+	{
+		Floats x = Add(Splat((float)(col + j)), Ramp());
+		Floats sum = Splat(0.f);
+		Floats weight = Splat(1.f);
+		for (const Octave& octave : m_octaves)
+		{
+			Floats frequency = Splat(octave.Frequency);
+			Floats n = GradientNoise(Add(Mul(x, frequency), Splat(octave.OffsetX)),
+				Add(Mul(y, frequency), Splat(octave.OffsetY)), SplatInt(octave.Seed));
+			if (ridged)
+			{
+				//sharp crests where the noise crosses zero; each octave is weighted by
+				//the one below it, so the valleys stay smooth
+				Floats s = Sub(Splat(1.f), Abs(n));
+				s = Mul(Mul(s, s), weight);
+				weight = Min(Max(Add(s, s), Splat(0.f)), Splat(1.f));
+				sum = Add(sum, Mul(s, Splat(octave.Amplitude)));
+			}
+			else
+			{
+				sum = Add(sum, Mul(n, Splat(octave.Amplitude)));
+			}
+		}
+
+		//fBm lies in -1..1 and ridged in 0..1 of the amplitude sum; both to 0..1, then to heights
+		Floats t = Mul(sum, normalize);
+		if (!ridged)
+			t = Mul(Add(t, Splat(1.f)), Splat(0.5f));
+		Floats h = Mul(Min(Max(t, Splat(0.f)), Splat(1.f)), heightScale);
+
+		if (count - j >= LaneCount)
+		{
+			Store(dst + j, h);
+		}
+		else
+		{
+			float rest[LaneCount];
+			Store(rest, h);
+			std::copy(rest, rest + (count - j), dst + j);
+		}
+	}
+}
+
+void NoiseHeightSource::ReadWindow(int row, int col, int rows, int cols, float* dst, std::size_t dstStride, float scale)const
+{
+	int grainSize = std::max(1, 4096 / std::max(cols, 1));
+	TaskScheduler::GetInstance()->ParallelForRange(0, rows, grainSize, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+			ReadRow(row + i, col, cols, dst + dstStride * i, scale);
+	});
+}
@@ -28,7 +28,7 @@ struct MaterialData
 TextureCube gCubeMap : register(t0);
 Texture2D gShadowMap : register(t1);
 
-Texture2D gTextureMaps[10] : register(t2);
+Texture2D gTextureMaps[12] : register(t2);
 
 StructuredBuffer<MaterialData> gMaterialData : register(t0, space1);
 
@@ -5,11 +5,15 @@
 // Include common HLSL code.
 #include "Common.hlsl"
 
+#ifdef COMPACT_TERRAIN
+#include "TerrainVertex.hlsl"
+#else
 struct VertexIn
 {
 	float3 PosL    : POSITION;
 	float2 TexC    : TEXCOORD;
 };
+#endif
 
 struct VertexOut
 {
@@ -24,13 +28,19 @@ VertexOut VS(VertexIn vin)
 	MaterialData matData = gMaterialData[gMaterialIndex];
 	
     // Transform to world space.
+#ifdef COMPACT_TERRAIN
+    float4 posW = mul(float4(TerrainPosL(vin), 1.0f), gWorld);
+	float2 texCL = TerrainTexC(vin);
+#else
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+	float2 texCL = vin.TexC;
+#endif
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+	float4 texC = mul(float4(texCL, 0.0f, 1.0f), gTexTransform);
 	vout.TexC = mul(texC, matData.MatTransform).xy;
 	
     return vout;
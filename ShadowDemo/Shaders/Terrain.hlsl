@@ -0,0 +1,138 @@
+//***************************************************************************************
+// Terrain.hlsl
+//
+// Draws the whole terrain with one material.  gMaterialIndex is the terrain material,
+// whose diffuse map is the splat map of Terrain::SplatMap(); its four channels weight
+// the layer materials that follow it (ground, grass, road, water bottom).  Each layer
+// tiles its own textures through its MatTransform, and gTexTransform takes the
+// heightmap texture coordinates to the splat map.
+//***************************************************************************************
+
+#ifndef NUM_DIR_LIGHTS
+    #define NUM_DIR_LIGHTS 3
+#endif
+
+#ifndef NUM_POINT_LIGHTS
+    #define NUM_POINT_LIGHTS 0
+#endif
+
+#ifndef NUM_SPOT_LIGHTS
+    #define NUM_SPOT_LIGHTS 0
+#endif
+
+#define TERRAIN_LAYERS 4
+
+#include "Common.hlsl"
+
+#ifdef COMPACT_TERRAIN
+#include "TerrainVertex.hlsl"
+#else
+struct VertexIn
+{
+	float3 PosL    : POSITION;
+    float3 NormalL : NORMAL;
+	float2 TexC    : TEXCOORD;
+	float3 TangentU : TANGENT;
+};
+#endif
+
+struct VertexOut
+{
+	float4 PosH    : SV_POSITION;
+    float4 ShadowPosH : POSITION0;
+    float3 PosW    : POSITION1;
+    float3 NormalW : NORMAL;
+	float3 TangentW : TANGENT;
+	float2 TexC    : TEXCOORD0;		// heightmap position, tiled per layer in the PS
+	float2 SplatC  : TEXCOORD1;
+};
+
+VertexOut VS(VertexIn vin)
+{
+	VertexOut vout = (VertexOut)0.0f;
+
+#ifdef COMPACT_TERRAIN
+    float4 posW = mul(float4(TerrainPosL(vin), 1.0f), gWorld);
+    vout.PosW = posW.xyz;
+
+    // gWorld only places the grid, the normal is decoded straight to world space.
+    vout.NormalW = DecodeOctahedral(vin.Oct);
+
+	vout.TangentW = TerrainTangent(vout.NormalW);
+	vout.TexC = TerrainTexC(vin);
+#else
+    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    vout.PosW = posW.xyz;
+
+    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+	vout.TangentW = mul(vin.TangentU, (float3x3)gWorld);
+	vout.TexC = vin.TexC;
+#endif
+
+    // Transform to homogeneous clip space.
+    vout.PosH = mul(posW, gViewProj);
+
+	vout.SplatC = mul(float4(vout.TexC, 0.0f, 1.0f), gTexTransform).xy;
+
+    // Generate projective tex-coords to project shadow map onto scene.
+    vout.ShadowPosH = mul(posW, gShadowTransform);
+
+    return vout;
+}
+
+float4 PS(VertexOut pin) : SV_Target
+{
+	MaterialData splatData = gMaterialData[gMaterialIndex];
+	float4 weights = gTextureMaps[splatData.DiffuseMapIndex].Sample(gsamLinearClamp, pin.SplatC);
+
+	// Interpolating normal can unnormalize it, so renormalize it.
+    pin.NormalW = normalize(pin.NormalW);
+
+	// Blend the layers' surface properties, then light once.
+	float4 diffuseAlbedo = 0.0f;
+	float3 fresnelR0 = 0.0f;
+	float  roughness = 0.0f;
+	float4 normalMapSample = 0.0f;
+
+	[unroll]
+	for (int i = 0; i < TERRAIN_LAYERS; ++i)
+	{
+		MaterialData matData = gMaterialData[gMaterialIndex + 1 + i];
+		float2 texC = mul(float4(pin.TexC, 0.0f, 1.0f), matData.MatTransform).xy;
+
+		diffuseAlbedo += weights[i] * matData.DiffuseAlbedo *
+			gTextureMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, texC);
+		normalMapSample += weights[i] * gTextureMaps[matData.NormalMapIndex].Sample(gsamAnisotropicWrap, texC);
+		fresnelR0 += weights[i] * matData.FresnelR0;
+		roughness += weights[i] * matData.Roughness;
+	}
+
+	float3 bumpedNormalW = NormalSampleToWorldSpace(normalMapSample.rgb, pin.NormalW, pin.TangentW);
+
+    // Vector from point being lit to eye.
+    float3 toEyeW = normalize(gEyePosW - pin.PosW);
+
+    // Light terms.
+    float4 ambient = gAmbientLight*diffuseAlbedo;
+
+    // Only the first light casts a shadow.
+    float3 shadowFactor = float3(1.0f, 1.0f, 1.0f);
+    shadowFactor[0] = CalcShadowFactor(pin.ShadowPosH);
+
+    const float shininess = (1.0f - roughness) * normalMapSample.a;
+    Material mat = { diffuseAlbedo, fresnelR0, shininess };
+    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
+        bumpedNormalW, toEyeW, shadowFactor);
+
+    float4 litColor = ambient + directLight;
+
+	// Add in specular reflections.
+    float3 r = reflect(-toEyeW, bumpedNormalW);
+    float4 reflectionColor = gCubeMap.Sample(gsamLinearWrap, r);
+    float3 fresnelFactor = SchlickFresnel(fresnelR0, bumpedNormalW, r);
+    litColor.rgb += shininess * fresnelFactor * reflectionColor.rgb;
+
+    litColor.a = 1.0f;
+
+    return litColor;
+}
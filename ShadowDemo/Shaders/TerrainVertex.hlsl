@@ -0,0 +1,41 @@
+//***************************************************************************************
+// TerrainVertex.hlsl
+//
+// The compact terrain vertex of TerrainVertex.h.  Terrain.hlsl and Shadows.hlsl include
+// it in place of their VertexIn when COMPACT_TERRAIN is defined.  gWorld of a terrain
+// item is TerrainVertexQuantization::LocalToWorld(), which takes (column, height, row)
+// to world space; the normals are stored in world space already.
+//***************************************************************************************
+
+struct VertexIn
+{
+	uint2  Grid    : POSITION;	// column, row
+	float  Height  : HEIGHT;	// R16_UNORM over the terrain's height range
+	float2 Oct     : NORMAL;	// R8G8_SNORM, octahedral around +y
+};
+
+float3 TerrainPosL(VertexIn vin)
+{
+	return float3(vin.Grid.x, vin.Height, vin.Grid.y);
+}
+
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e.x, 1.0f - abs(e.x) - abs(e.y), e.y);
+	float t = saturate(-n.y);
+	n.xz += n.xz >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+// N x up normalized, (1, 0, 0) for a level normal, like Terrain's float vertices.
+float3 TerrainTangent(float3 n)
+{
+	float len = length(n.xz);
+	return len > 0.0f ? float3(-n.z, 0.0f, n.x) / len : float3(1.0f, 0.0f, 0.0f);
+}
+
+// The heightmap position times the grid spacing, which is gWorld[0][0].
+float2 TerrainTexC(VertexIn vin)
+{
+	return float2(vin.Grid.y, vin.Grid.x) * gWorld[0][0];
+}
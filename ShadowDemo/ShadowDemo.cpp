@@ -9,6 +9,8 @@
 #include "ShadowMap.h"
 #include "ModelImporter.h"
 #include "Model.h"
+#include "ModelLoader.h"
+#include "AssetRegistry.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -41,12 +43,25 @@ struct RenderItem
 	UINT indexCount = 0;
 	UINT startIndexLocation = 0;
 	int baseVertexLocation = 0;
+
+	//ΰLODѡĿ,Ϊʱ
+	const std::vector<SubmeshGeometry>* chunks = nullptr;
+
+	//ģ͵LOD,Ϊʱѡеһ,startIndexLocation
+	const std::vector<MeshLod>* lods = nullptr;
+	int lod = 0;
+	//Ӱpassõһ,lodϸ
+	int shadowLod = 0;
+	//ռİΧ,Լ,LOD㵽ռ
+	BoundingSphere lodBounds;
+	float lodScale = 1.f;
 };
 
 //
 enum class RenderLayer : int
 {
 	Opaque = 0,
+	Terrain,
 	Sky,
 	Transparent,
 	Debug,
@@ -82,8 +97,12 @@ private:
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateShadowPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt);
+	void UpdateModelLods(float pixelsPerUnit);
 
 	void LoadTextures();
+	UINT ModelTextureSrvIndex(const std::string& fileName);
+	void BuildTerrainSplatMap();
+	void RequestModels();
 	void LoadModels();
 	void BuildRootSignature();
 	void BuildDescriptorHeaps();
@@ -96,7 +115,8 @@ private:
 	void BuildFrameResources();
 	void BuildMaterials();
 	void BuildRenderItems();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems,
+		bool shadowPass = false);
 	void DrawSceneToShadowMap();
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> GetStaticSamplers();
@@ -119,6 +139,7 @@ private:
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> m_PSOs;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> m_inputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> m_terrainInputLayout;
 
 	RenderItem* m_wavesRitem = nullptr;
 
@@ -128,6 +149,7 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> m_ritemLayer[(int)RenderLayer::Count];
 
+	UINT m_terrainSplatHeapIndex = 0;
 	UINT m_skyTexHeapIndex = 0;
 	UINT m_shadowMapHeapIndex = 0;
 
@@ -150,8 +172,11 @@ private:
 
 	//ģ
 	UINT m_modelSrvHeapIndex = 0;
-	std::vector<std::string> m_modelTexNames;
+	AssetRegistry<Texture> m_textureAssets;				//ģͼ,淶·
+	std::vector<AssetRegistry<Texture>::Handle> m_modelTextures;	//ظ,SRV˳
+	std::unordered_map<std::string, UINT> m_modelTexIndices;	//淶· -> m_modelTextures±
 	std::vector<Model> m_models;
+	std::unique_ptr<ModelLoader> m_pModelLoader;	//ʼڼں̨ģ
 
 	DirectX::BoundingSphere m_sceneBounds;
 
@@ -237,7 +262,15 @@ bool ShadowDemo::Initialize()
 
 	m_cbvSrvDescriptorSize = m_pD3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-	m_pTerrain = std::make_unique<Terrain>(500, 500, 511, 511, 1.f);
+	//ģں̨,͵ΡƵͬʱ
+	RequestModels();
+
+	m_pTerrain = std::make_unique<Terrain>(500, 500, 511, 511, 1.f, TerrainVertexFormat::Compact);
+	if (!m_pTerrain->IsLoaded())
+	{
+		MessageBox(nullptr, L"read terrain file failed!", L"error", MB_OK);
+		return false;
+	}
 
 	m_waves = std::make_unique<Waves>(500, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 
@@ -252,6 +285,7 @@ bool ShadowDemo::Initialize()
 
 	LoadModels();
 	LoadTextures();
+	BuildTerrainSplatMap();
 	BuildRootSignature();
 	BuildDescriptorHeaps();
 	BuildShadersAndInputLayout();
@@ -275,29 +309,44 @@ bool ShadowDemo::Initialize()
 	return true;
 }
 
-void ShadowDemo::LoadModels()
+void ShadowDemo::RequestModels()
 {
-	//ħʦ
+	struct ModelDesc
 	{
-		Model magician("fox", "..\\Models\\fox\\file.fbx");
-		XMMATRIX modelScale = XMMatrixScaling(5.f, 5.f, 5.f);
-		XMMATRIX modelRot = XMMatrixRotationZ(MathHelper::Pi / 2) * XMMatrixRotationY(MathHelper::Pi / 2);
-		XMMATRIX modelOffset = XMMatrixTranslation(40.0f, 101.0f, 0.0f);
-		magician.SetScaleRotateOffset(modelScale, modelRot, modelOffset);
-		m_models.push_back(magician);
-	}
+		const char* name;
+		const char* path;
+		float offsetX;
+	};
+	const ModelDesc models[] =
+	{
+		{ "fox", "..\\Models\\fox\\file.fbx", 40.0f },			//
+		{ "magician", "..\\Models\\magician\\file.fbx", -40.0f },	//ħʦ
+	};
 
-	//
+	//ÿģ͸һ߳,˳򽻻߳
+	m_pModelLoader = std::make_unique<ModelLoader>();
+	for (const ModelDesc& desc : models)
 	{
-		Model magician("magician", "..\\Models\\magician\\file.fbx");
-		XMMATRIX modelScale = XMMatrixScaling(5.f, 5.f, 5.f);
-		XMMATRIX modelRot = XMMatrixRotationZ(MathHelper::Pi / 2) * XMMatrixRotationY(MathHelper::Pi / 2);
-		XMMATRIX modelOffset = XMMatrixTranslation(-40.0f, 101.0f, 0.0f);
-		magician.SetScaleRotateOffset(modelScale, modelRot, modelOffset);
-		m_models.push_back(magician);
+		float offsetX = desc.offsetX;
+		m_pModelLoader->Load(desc.name, desc.path, [this, offsetX](ModelLoader::Result& result)
+		{
+			Model model(result.Name, std::move(result.Asset));
+			XMMATRIX modelScale = XMMatrixScaling(5.f, 5.f, 5.f);
+			XMMATRIX modelRot = XMMatrixRotationZ(MathHelper::Pi / 2) * XMMatrixRotationY(MathHelper::Pi / 2);
+			XMMATRIX modelOffset = XMMatrixTranslation(offsetX, 101.0f, 0.0f);
+			model.SetScaleRotateOffset(modelScale, modelRot, modelOffset);
+			m_models.push_back(std::move(model));
+		});
 	}
 }
 
+//ȴ̨,ģͽm_models,֮ϴGPU
+void ShadowDemo::LoadModels()
+{
+	m_pModelLoader->Finish();
+	m_pModelLoader.reset();
+}
+
 void ShadowDemo::CreateRtvAndDsvDescriptorHeaps()
 {
 	// Add +6 RTV for cube render target.
@@ -334,6 +383,10 @@ void ShadowDemo::OnMouseMove(WPARAM btnState, int x, int y) {}
 void ShadowDemo::Update(const GameTimer& gt)
 {
 	UpdateCamera(gt);
+	//ǰΪѡ,2ص
+	float pixelsPerUnit = m_clientHeight / (2.f * tanf(0.5f * m_camera.GetFovY()));
+	m_pTerrain->SelectChunks(m_eyePos, pixelsPerUnit, 2.f);
+	UpdateModelLods(pixelsPerUnit);
 
 
 	m_currFrameResourceIndex = (m_currFrameResourceIndex + 1) % gNumFrameResources;
@@ -415,6 +468,9 @@ void ShadowDemo::Draw(const GameTimer& gt)
 	m_pCommandList->SetPipelineState(m_PSOs["opaque"].Get());
 	DrawRenderItems(m_pCommandList.Get(), m_ritemLayer[(int)RenderLayer::Opaque]);
 
+	m_pCommandList->SetPipelineState(m_PSOs["terrain"].Get());
+	DrawRenderItems(m_pCommandList.Get(), m_ritemLayer[(int)RenderLayer::Terrain]);
+
 	//render sky
 	m_pCommandList->SetPipelineState(m_PSOs["sky"].Get());
 	DrawRenderItems(m_pCommandList.Get(), m_ritemLayer[(int)RenderLayer::Sky]);
@@ -477,6 +533,12 @@ void ShadowDemo::UpdateCamera(const GameTimer& gt)
 		m_lastMousePos.y = mouseY;
 	}
 
+	//ڵ2λ
+	XMFLOAT3 eye = m_camera.GetPosition();
+	float ground = m_pTerrain->SampleHeight(eye.x, eye.z) + 2.f;
+	if (eye.y < ground)
+		m_camera.SetPosition(eye.x, ground, eye.z);
+
 	m_camera.UpdateViewMatrix();
 
 	//cameraӽǡͶӰ
@@ -665,25 +727,35 @@ void ShadowDemo::UpdateWaves(const GameTimer& gt)
 	// Update the wave simulation.
 	m_waves->Update(gt.DeltaTime());
 
-	// Update the wave vertex buffer with the new solution.
+	// Bring this frame's wave vertex buffer up to date; Waves writes straight
+	// into it (see BuildFrameResources).
 	auto currWavesVB = m_pCurrFrameResource->WavesVB.get();
-	for (int i = 0; i < m_waves->VertexCount(); ++i)
-	{
-		Vertex v;
+	m_waves->EmitVertices(m_currFrameResourceIndex);
 
-		v.Pos = m_waves->Position(i);
-		v.Normal = m_waves->Normal(i);
+	// Set the dynamic VB of the wave renderitem to the current frame VB.
+	m_wavesRitem->geo->VertexBufferGPU = currWavesVB->Resource();
+}
 
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / m_waves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / m_waves->Depth();
+void ShadowDemo::UpdateModelLods(float pixelsPerUnit)
+{
+	//ӰͼͶӰ,ÿλ޹
+	float shadowPixelsPerUnit = m_pShadowMap->Width() / (2.f * m_sceneBounds.Radius);
+	XMVECTOR eyePos = XMLoadFloat3(&m_eyePos);
 
-		currWavesVB->CopyData(i, v);
+	for (auto ri : m_ritemLayer[(int)RenderLayer::Opaque])
+	{
+		if (!ri->lods)
+			continue;
+
+		const MeshLod* lods = ri->lods->data();
+		int count = (int)ri->lods->size();
+		//Χľ,ʱһ;1ص
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri->lodBounds.Center) - eyePos)) -
+			ri->lodBounds.Radius;
+		ri->lod = distance > 0.f ? SelectMeshLod(lods, count, distance, pixelsPerUnit * ri->lodScale, 1.f) : 0;
+		//Ӱͼһظסܴһ,2ص
+		ri->shadowLod = std::max(ri->lod, SelectMeshLod(lods, count, 1.f, shadowPixelsPerUnit * ri->lodScale, 2.f));
 	}
-
-	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	m_wavesRitem->geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
 void ShadowDemo::UpdateShadowPassCB(const GameTimer& gt)
@@ -750,30 +822,6 @@ void ShadowDemo::LoadTextures()
 		L"../Textures/grasscube1024.dds"
 	};
 
-	for (int i = 0; i < m_models.size(); ++i)
-	{
-		//ģͼ
-		for (int j = 0; j < m_models[i].m_meshes.size(); ++j)
-		{
-			std::string diffuseFileName = m_models[i].m_meshes[j].material.DiffuseMapName;
-			std::string normalFileName = m_models[i].m_meshes[j].material.NormalMapName;
-			if (diffuseFileName != "")
-			{
-				m_modelTexNames.push_back(m_models[i].m_meshes[j].material.Name + "DiffuseMap");
-				texNames.push_back(m_models[i].m_meshes[j].material.Name + "DiffuseMap");
-				texFilenames.push_back(AnsiToWString(diffuseFileName));
-			}
-			if (normalFileName != "")
-			{
-				m_modelTexNames.push_back(m_models[i].m_meshes[j].material.Name + "NormalMap");
-				texNames.push_back(m_models[i].m_meshes[j].material.Name + "NormalMap");
-				texFilenames.push_back(AnsiToWString(normalFileName));
-			}
-		}
-
-	}
-	
-
 	for (int i = 0; i < (int)texNames.size(); ++i)
 	{
 		if (m_textures.find(texNames[i]) == std::end(m_textures))
@@ -787,6 +835,76 @@ void ShadowDemo::LoadTextures()
 			m_textures[texMap->Name] = std::move(texMap);
 		}
 	}
+
+	//ģͼ,淶·ȥ,Meshģͬһͼʱֻغϴһ
+	auto addModelTexture = [this](const std::string& fileName)
+	{
+		auto texture = m_textureAssets.Acquire(fileName, [this](const std::string& canonicalPath)
+		{
+			auto texMap = std::make_shared<Texture>();
+			texMap->Name = canonicalPath;
+			texMap->Filename = AnsiToWString(canonicalPath);
+			ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(m_pD3dDevice.Get(),
+				m_pCommandList.Get(), texMap->Filename.c_str(),
+				texMap->Resource, texMap->UploadHeap));
+			return texMap;
+		});
+		if (m_modelTexIndices.emplace(texture->Name, (UINT)m_modelTextures.size()).second)
+			m_modelTextures.push_back(texture);
+	};
+	for (const Model& model : m_models)
+	{
+		for (const auto& mesh : model.Meshes())
+		{
+			if (mesh.material.DiffuseMapName != "")
+				addModelTexture(mesh.material.DiffuseMapName);
+			if (mesh.material.NormalMapName != "")
+				addModelTexture(mesh.material.NormalMapName);
+		}
+	}
+}
+
+UINT ShadowDemo::ModelTextureSrvIndex(const std::string& fileName)
+{
+	return m_modelSrvHeapIndex + m_modelTexIndices[CanonicalAssetPath(fileName)];
+}
+
+//ѵεsplat mapϴΪR8G8B8A8,ÿͨһʵȨ
+void ShadowDemo::BuildTerrainSplatMap()
+{
+	const std::vector<uint32_t>& splatMap = m_pTerrain->SplatMap();
+
+	auto texMap = std::make_unique<Texture>();
+	texMap->Name = "terrainSplatMap";
+
+	D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM,
+		m_pTerrain->SplatMapWidth(), m_pTerrain->SplatMapHeight(), 1, 1);
+	ThrowIfFailed(m_pD3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&texMap->Resource)));
+
+	const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texMap->Resource.Get(), 0, 1);
+	ThrowIfFailed(m_pD3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&texMap->UploadHeap)));
+
+	D3D12_SUBRESOURCE_DATA subResourceData = {};
+	subResourceData.pData = splatMap.data();
+	subResourceData.RowPitch = m_pTerrain->SplatMapWidth() * sizeof(uint32_t);
+	subResourceData.SlicePitch = subResourceData.RowPitch * m_pTerrain->SplatMapHeight();
+	UpdateSubresources<1>(m_pCommandList.Get(), texMap->Resource.Get(), texMap->UploadHeap.Get(), 0, 0, 1, &subResourceData);
+	m_pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texMap->Resource.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	m_textures[texMap->Name] = std::move(texMap);
 }
 
 void ShadowDemo::BuildRootSignature()
@@ -795,7 +913,7 @@ void ShadowDemo::BuildRootSignature()
 	texTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 0);
 
 	CD3DX12_DESCRIPTOR_RANGE texTable1;
-	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 10, 2, 0);//ԭ20
+	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 12, 2, 0);//ԭ20
 
 	CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
@@ -855,16 +973,17 @@ void ShadowDemo::BuildDescriptorHeaps()
 		m_textures["waterBottomDiffuseMap"]->Resource,
 		m_textures["waterBottomNormalMap"]->Resource,
 		m_textures["waterDiffuseMap"]->Resource,
-		m_textures["waterNormalMap"]->Resource
+		m_textures["waterNormalMap"]->Resource,
+		m_textures["terrainSplatMap"]->Resource
 	};
 
+	m_terrainSplatHeapIndex = (UINT)tex2DList.size() - 1;
 	m_modelSrvHeapIndex = (UINT)tex2DList.size();
 
-	for (UINT i = 0; i < (UINT)m_modelTexNames.size(); ++i)
+	for (const auto& texture : m_modelTextures)
 	{
-		auto texResource = m_textures[m_modelTexNames[i]]->Resource;
-		assert(texResource != nullptr);
-		tex2DList.push_back(texResource);
+		assert(texture->Resource != nullptr);
+		tex2DList.push_back(texture->Resource);
 	}
 
 	auto skyTex = m_textures["skyCubeMap"]->Resource;
@@ -931,6 +1050,12 @@ void ShadowDemo::BuildShadersAndInputLayout()
 		NULL, NULL
 	};
 
+	const D3D_SHADER_MACRO compactTerrainDefines[] =
+	{
+		"COMPACT_TERRAIN", "1",
+		NULL, NULL
+	};
+
 	m_shaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
 	m_shaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
 
@@ -938,6 +1063,13 @@ void ShadowDemo::BuildShadersAndInputLayout()
 	m_shaders["shadowOpaquePS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", nullptr, "PS", "ps_5_1");
 	m_shaders["shadowAlphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", alphaTestDefines, "PS", "ps_5_1");
 
+	//ΰsplat mapϸ,TerrainVertexʱӦİ汾
+	const D3D_SHADER_MACRO* terrainDefines =
+		m_pTerrain->VertexFormat() == TerrainVertexFormat::Compact ? compactTerrainDefines : nullptr;
+	m_shaders["terrainVS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", terrainDefines, "VS", "vs_5_1");
+	m_shaders["terrainPS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", terrainDefines, "PS", "ps_5_1");
+	m_shaders["shadowTerrainVS"] = d3dUtil::CompileShader(L"Shaders\\Shadows.hlsl", compactTerrainDefines, "VS", "vs_5_1");
+
 	//m_shaders["debugVS"] = d3dUtil::CompileShader(L"Shaders\\ShadowDebug.hlsl", nullptr, "VS", "vs_5_1");
 	//m_shaders["debugPS"] = d3dUtil::CompileShader(L"Shaders\\ShadowDebug.hlsl", nullptr, "PS", "ps_5_1");
 
@@ -951,135 +1083,49 @@ void ShadowDemo::BuildShadersAndInputLayout()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 	};
+
+	//TerrainVertex: к,ĸ߶,巨
+	m_terrainInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16_UINT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "HEIGHT", 0, DXGI_FORMAT_R16_UNORM, 0, 4, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R8G8_SNORM, 0, 6, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+	};
 }
 
 //
 void ShadowDemo::BuildTerrainGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-
-	//create vertex offset
-	UINT groundVertexOffset = 0;
-	UINT grassVertexOffset = m_pTerrain->m_vertexItems["ground"].size();
-	UINT roadVertexOffset = grassVertexOffset + m_pTerrain->m_vertexItems["grass"].size();
-	UINT waterVertexOffset = roadVertexOffset + m_pTerrain->m_vertexItems["road"].size();
-	UINT sphereVertexOffset = waterVertexOffset + m_pTerrain->m_vertexItems["waterBottom"].size();
-
-	//create start index
-	UINT groundIndexOffset = 0;
-	UINT grassIndexOffset = m_pTerrain->m_indexItems["ground"].size();
-	UINT roadIndexOffset = grassIndexOffset + m_pTerrain->m_indexItems["grass"].size();
-	UINT waterIndexOffset = roadIndexOffset + m_pTerrain->m_indexItems["road"].size();
-	UINT sphereIndexOffset = waterIndexOffset + m_pTerrain->m_indexItems["waterBottom"].size();
-
-	SubmeshGeometry groundSubmesh;
-	groundSubmesh.IndexCount = m_pTerrain->m_indexItems["ground"].size();
-	groundSubmesh.StartIndexLocation = groundIndexOffset;
-	groundSubmesh.BaseVertexLocation = groundVertexOffset;
-
-	SubmeshGeometry grassSubmesh;
-	grassSubmesh.IndexCount = m_pTerrain->m_indexItems["grass"].size();
-	grassSubmesh.StartIndexLocation = grassIndexOffset;
-	grassSubmesh.BaseVertexLocation = grassVertexOffset;
-
-	SubmeshGeometry roadSubmesh;
-	roadSubmesh.IndexCount = m_pTerrain->m_indexItems["road"].size();
-	roadSubmesh.StartIndexLocation = roadIndexOffset;
-	roadSubmesh.BaseVertexLocation = roadVertexOffset;
-
-	SubmeshGeometry waterSubmesh;
-	waterSubmesh.IndexCount = m_pTerrain->m_indexItems["waterBottom"].size();
-	waterSubmesh.StartIndexLocation = waterIndexOffset;
-	waterSubmesh.BaseVertexLocation = waterVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	auto totalVertexCount =
-		m_pTerrain->m_vertexItems["ground"].size() + m_pTerrain->m_vertexItems["grass"].size()
-		+ m_pTerrain->m_vertexItems["road"].size() + m_pTerrain->m_vertexItems["waterBottom"].size() + sphere.Vertices.size();
-
-	std::vector<Vertex> vertices(totalVertexCount);
-	UINT k = 0;
-	for (size_t i = 0; i < m_pTerrain->m_vertexItems["ground"].size(); ++i, ++k)
-	{
-		vertices[k].Pos = m_pTerrain->m_vertexItems["ground"][i].Pos;
-		vertices[k].Normal = m_pTerrain->m_vertexItems["ground"][i].Normal;
-		vertices[k].TexC = m_pTerrain->m_vertexItems["ground"][i].TexC;
-		vertices[k].TangentU = m_pTerrain->m_vertexItems["ground"][i].TangentU;
-	}
-
-	for (size_t i = 0; i < m_pTerrain->m_vertexItems["grass"].size(); ++i, ++k)
-	{
-		vertices[k].Pos = m_pTerrain->m_vertexItems["grass"][i].Pos;
-		vertices[k].Normal = m_pTerrain->m_vertexItems["grass"][i].Normal;
-		vertices[k].TexC = m_pTerrain->m_vertexItems["grass"][i].TexC;
-		vertices[k].TangentU = m_pTerrain->m_vertexItems["grass"][i].TangentU;
-	}
-
-	for (size_t i = 0; i < m_pTerrain->m_vertexItems["road"].size(); ++i, ++k)
-	{
-		vertices[k].Pos = m_pTerrain->m_vertexItems["road"][i].Pos;
-		vertices[k].Normal = m_pTerrain->m_vertexItems["road"][i].Normal;
-		vertices[k].TexC = m_pTerrain->m_vertexItems["road"][i].TexC;
-		vertices[k].TangentU = m_pTerrain->m_vertexItems["road"][i].TangentU;
-	}
+	//ֻеεĿ,㰴εĸʽ,Ϊ鹲õ16λģ
+	const bool compact = m_pTerrain->VertexFormat() == TerrainVertexFormat::Compact;
+	const void* vertices = compact ? (const void*)m_pTerrain->m_compactVertices.data() : m_pTerrain->m_vertices.data();
+	const UINT vertexByteStride = compact ? sizeof(TerrainVertex) : sizeof(Vertex);
+	const UINT vertexCount = (UINT)(compact ? m_pTerrain->m_compactVertices.size() : m_pTerrain->m_vertices.size());
+	const std::vector<std::uint16_t>& indices = m_pTerrain->m_indexTemplates.Indices16();
 
-	for (size_t i = 0; i < m_pTerrain->m_vertexItems["waterBottom"].size(); ++i, ++k)
-	{
-		vertices[k].Pos = m_pTerrain->m_vertexItems["waterBottom"][i].Pos;
-		vertices[k].Normal = m_pTerrain->m_vertexItems["waterBottom"][i].Normal;
-		vertices[k].TexC = m_pTerrain->m_vertexItems["waterBottom"][i].TexC;
-		vertices[k].TangentU = m_pTerrain->m_vertexItems["waterBottom"][i].TangentU;
-	}
-
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
-		vertices[k].TangentU = sphere.Vertices[i].TangentU;
-	}
-
-	std::vector<UINT> indices;
-	indices.insert(indices.end(), m_pTerrain->m_indexItems["ground"].begin(), m_pTerrain->m_indexItems["ground"].end());
-	indices.insert(indices.end(), m_pTerrain->m_indexItems["grass"].begin(), m_pTerrain->m_indexItems["grass"].end());
-	indices.insert(indices.end(), m_pTerrain->m_indexItems["road"].begin(), m_pTerrain->m_indexItems["road"].end());
-	indices.insert(indices.end(), m_pTerrain->m_indexItems["waterBottom"].begin(), m_pTerrain->m_indexItems["waterBottom"].end());
-	indices.insert(indices.end(), std::begin(sphere.Indices32), std::end(sphere.Indices32));
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(UINT);
+	const UINT vbByteSize = vertexCount * vertexByteStride;
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "terrainGeo";
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices, vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(m_pD3dDevice.Get(),
-		m_pCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		m_pCommandList.Get(), vertices, vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(m_pD3dDevice.Get(),
 		m_pCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = vertexByteStride;
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	geo->DrawArgs["ground"] = groundSubmesh;
-	geo->DrawArgs["grass"] = grassSubmesh;
-	geo->DrawArgs["road"] = roadSubmesh;
-	geo->DrawArgs["waterBottom"] = waterSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-
 	m_geometries[geo->Name] = std::move(geo);
 }
 
@@ -1088,11 +1134,14 @@ void ShadowDemo::BuildShapeGeometry()
 	GeometryGenerator geoGen;
 	GeometryGenerator::MeshData box = geoGen.CreateBox(10.0f, 10.0f, 1.0f, 3);
 	GeometryGenerator::MeshData quad = geoGen.CreateQuad(0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
 
 	UINT boxVertexOffset = 0;
 	UINT quadVertexOffset = boxVertexOffset + (UINT)box.Vertices.size();
+	UINT sphereVertexOffset = quadVertexOffset + (UINT)quad.Vertices.size();
 	UINT boxIndexOffset = 0;
 	UINT quadIndexOffset = boxIndexOffset + (UINT)box.Indices32.size();
+	UINT sphereIndexOffset = quadIndexOffset + (UINT)quad.Indices32.size();
 
 	SubmeshGeometry boxSubmesh;
 	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
@@ -1104,7 +1153,12 @@ void ShadowDemo::BuildShapeGeometry()
 	quadSubmesh.StartIndexLocation = quadIndexOffset;
 	quadSubmesh.BaseVertexLocation = quadVertexOffset;
 
-	auto totalVertexCount = box.Vertices.size() + quad.Vertices.size();
+	SubmeshGeometry sphereSubmesh;
+	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
+	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
+	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
+
+	auto totalVertexCount = box.Vertices.size() + quad.Vertices.size() + sphere.Vertices.size();
 
 
 	std::vector<Vertex> vertices(totalVertexCount);
@@ -1124,10 +1178,18 @@ void ShadowDemo::BuildShapeGeometry()
 		vertices[k].TexC = quad.Vertices[i].TexC;
 		vertices[k].TangentU = quad.Vertices[i].TangentU;
 	}
+	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	{
+		vertices[k].Pos = sphere.Vertices[i].Position;
+		vertices[k].Normal = sphere.Vertices[i].Normal;
+		vertices[k].TexC = sphere.Vertices[i].TexC;
+		vertices[k].TangentU = sphere.Vertices[i].TangentU;
+	}
 
 	std::vector<UINT> indices;
 	indices.insert(indices.end(), std::begin(box.Indices32), std::end(box.Indices32));
 	indices.insert(indices.end(), std::begin(quad.Indices32), std::end(quad.Indices32));
+	indices.insert(indices.end(), std::begin(sphere.Indices32), std::end(sphere.Indices32));
 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(UINT);
@@ -1154,6 +1216,7 @@ void ShadowDemo::BuildShapeGeometry()
 
 	geo->DrawArgs["box"] = boxSubmesh;
 	geo->DrawArgs["quad"] = quadSubmesh;
+	geo->DrawArgs["sphere"] = sphereSubmesh;
 
 	m_geometries[geo->Name] = std::move(geo);
 }
@@ -1217,24 +1280,38 @@ void ShadowDemo::BuildModelsGeometry()
 {
 	for (int modelIndex = 0; modelIndex < m_models.size(); ++modelIndex)
 	{
+		//ͬһģļModelһݶ
+		if (m_geometries.count(m_models[modelIndex].AssetPath()))
+			continue;
+
 		std::vector<ModelImporter::ModelVertex> vertices;
 		std::vector<UINT> indices;
 
-		for (int i = 0; i < m_models[modelIndex].m_meshes.size(); ++i)
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		for (const auto& mesh : m_models[modelIndex].Meshes())
+		{
+			vertexCount += mesh.vertices.size();
+			indexCount += mesh.indices.size();
+		}
+		vertices.reserve(vertexCount);
+		indices.reserve(indexCount);
+
+		for (int i = 0; i < m_models[modelIndex].Meshes().size(); ++i)
 		{
 			vertices.insert(vertices.end(),
-				m_models[modelIndex].m_meshes[i].vertices.begin(),
-				m_models[modelIndex].m_meshes[i].vertices.end());
+				m_models[modelIndex].Meshes()[i].vertices.begin(),
+				m_models[modelIndex].Meshes()[i].vertices.end());
 			indices.insert(indices.end(),
-				m_models[modelIndex].m_meshes[i].indices.begin(),
-				m_models[modelIndex].m_meshes[i].indices.end());
+				m_models[modelIndex].Meshes()[i].indices.begin(),
+				m_models[modelIndex].Meshes()[i].indices.end());
 		}
 
 		const UINT vbByteSize = (UINT)vertices.size() * sizeof(ModelImporter::ModelVertex);
 		const UINT ibByteSize = (UINT)indices.size() * sizeof(UINT);
 
 		auto geo = std::make_unique<MeshGeometry>();
-		geo->Name = m_models[modelIndex].m_name;
+		geo->Name = m_models[modelIndex].AssetPath();
 
 		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
@@ -1253,16 +1330,20 @@ void ShadowDemo::BuildModelsGeometry()
 		geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 		geo->IndexBufferByteSize = ibByteSize;
 
-		int startOffset = 0;
-		for (UINT i = 0; i <m_models[modelIndex].m_meshes.size(); ++i)
+		//ÿmeshԼĵһ;LODʱsubmeshһ,
+		UINT startOffset = 0;
+		INT vertexOffset = 0;
+		for (UINT i = 0; i <m_models[modelIndex].Meshes().size(); ++i)
 		{
+			const auto& mesh = m_models[modelIndex].Meshes()[i];
 			SubmeshGeometry submesh;
 			std::string name = "sm_" + std::to_string(i);
 
-			submesh.IndexCount = (UINT)m_models[modelIndex].m_meshes[i].indices.size();
+			submesh.IndexCount = mesh.lods.empty() ? (UINT)mesh.indices.size() : mesh.lods[0].IndexCount;
 			submesh.StartIndexLocation = startOffset;
-			submesh.BaseVertexLocation = 0;
-			startOffset += submesh.IndexCount;
+			submesh.BaseVertexLocation = vertexOffset;
+			startOffset += (UINT)mesh.indices.size();
+			vertexOffset += (INT)mesh.vertices.size();
 
 			geo->DrawArgs[name] = submesh;
 		}
@@ -1323,6 +1404,32 @@ void ShadowDemo::BuildPSOs()
 	smapPsoDesc.NumRenderTargets = 0;
 	ThrowIfFailed(m_pD3dDevice->CreateGraphicsPipelineState(&smapPsoDesc, IID_PPV_ARGS(&m_PSOs["shadow_opaque"])));
 
+	//εPSO,ΪTerrainVertexʱɶӦ벼ֺӰVS
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC terrainPsoDesc = opaquePsoDesc;
+	terrainPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(m_shaders["terrainVS"]->GetBufferPointer()),
+		m_shaders["terrainVS"]->GetBufferSize()
+	};
+	terrainPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(m_shaders["terrainPS"]->GetBufferPointer()),
+		m_shaders["terrainPS"]->GetBufferSize()
+	};
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC smapTerrainPsoDesc = smapPsoDesc;
+	if (m_pTerrain->VertexFormat() == TerrainVertexFormat::Compact)
+	{
+		terrainPsoDesc.InputLayout = { m_terrainInputLayout.data(), (UINT)m_terrainInputLayout.size() };
+		smapTerrainPsoDesc.InputLayout = terrainPsoDesc.InputLayout;
+		smapTerrainPsoDesc.VS =
+		{
+			reinterpret_cast<BYTE*>(m_shaders["shadowTerrainVS"]->GetBufferPointer()),
+			m_shaders["shadowTerrainVS"]->GetBufferSize()
+		};
+	}
+	ThrowIfFailed(m_pD3dDevice->CreateGraphicsPipelineState(&terrainPsoDesc, IID_PPV_ARGS(&m_PSOs["terrain"])));
+	ThrowIfFailed(m_pD3dDevice->CreateGraphicsPipelineState(&smapTerrainPsoDesc, IID_PPV_ARGS(&m_PSOs["shadow_terrain"])));
+
 	/* PSO for debug layer.
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC debugPsoDesc = opaquePsoDesc;
 	debugPsoDesc.pRootSignature = m_pRootSignature.Get();
@@ -1385,49 +1492,70 @@ void ShadowDemo::BuildFrameResources()
 			2, (UINT)m_allRenderItems.size(), (UINT)m_materials.size(), m_waves->VertexCount()));
 		//2frame pass -- mainPassshadowPass
 	}
+
+	// The frame resources own the wave vertex buffers, Waves writes into them.
+	std::vector<Vertex*> wavesVBs;
+	for (auto& frameResource : m_frameResources)
+		wavesVBs.push_back(frameResource->WavesVB->MappedData());
+	m_waves->SetOutputBuffers(wavesVBs.data(), (int)wavesVBs.size());
 }
 
 void ShadowDemo::BuildMaterials()
 {
+	//βֻsplat map,4ϵĸ,
+	//MatTransformͼڵϵƽܶ
+	auto terrainMat = std::make_unique<Material>();
+	terrainMat->Name = "terrain";
+	terrainMat->MatCBIndex = 0;
+	terrainMat->DiffuseSrvHeapIndex = m_terrainSplatHeapIndex;
+	terrainMat->NormalSrvHeapIndex = 0;
+	terrainMat->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	terrainMat->FresnelR0 = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	terrainMat->Roughness = 1.0f;
+
 	auto groudMat = std::make_unique<Material>();
 	groudMat->Name = "ground";
-	groudMat->MatCBIndex = 0;
+	groudMat->MatCBIndex = 1;
 	groudMat->DiffuseSrvHeapIndex = 1;
 	groudMat->NormalSrvHeapIndex = 2;
 	groudMat->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 	groudMat->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
 	groudMat->Roughness = 0.6f;
+	XMStoreFloat4x4(&groudMat->MatTransform, XMMatrixScaling(0.02f, 0.02f, 1.f));
 
 	auto grassMat = std::make_unique<Material>();
 	grassMat->Name = "grass";
-	grassMat->MatCBIndex = 1;
+	grassMat->MatCBIndex = 2;
 	grassMat->DiffuseSrvHeapIndex = 3;
 	grassMat->NormalSrvHeapIndex = 4;
 	grassMat->DiffuseAlbedo = XMFLOAT4(1.f, 1.f, 1.f, 1.0f);
 	grassMat->FresnelR0 = XMFLOAT3(0.0f, 0.0f,0.0f);
 	grassMat->Roughness = 0.0f;
+	XMStoreFloat4x4(&grassMat->MatTransform, XMMatrixScaling(0.1f, 0.1f, 1.f));
 
 	auto roadMat = std::make_unique<Material>();
 	roadMat->Name = "road";
-	roadMat->MatCBIndex = 2;
+	roadMat->MatCBIndex = 3;
 	roadMat->DiffuseSrvHeapIndex = 5;
 	roadMat->NormalSrvHeapIndex = 6;
 	roadMat->DiffuseAlbedo = XMFLOAT4(1.f, 1.f, 1.f, 1.0f);
 	roadMat->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
 	roadMat->Roughness = 0.8f;
+	XMStoreFloat4x4(&roadMat->MatTransform, XMMatrixScaling(0.03f, 0.03f, 1.f));
 
 	auto waterBottomMat = std::make_unique<Material>();
 	waterBottomMat->Name = "waterBottom";
-	waterBottomMat->MatCBIndex = 3;
+	waterBottomMat->MatCBIndex = 4;
 	waterBottomMat->DiffuseSrvHeapIndex = 7;
 	waterBottomMat->NormalSrvHeapIndex = 8;
 	waterBottomMat->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 	waterBottomMat->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
 	waterBottomMat->Roughness = 0.5f;
+	XMStoreFloat4x4(&waterBottomMat->MatTransform, XMMatrixScaling(0.02f, 0.02f, 1.f));
 
 	auto water = std::make_unique<Material>();
 	water->Name = "water";
-	water->MatCBIndex = 4;
+	water->MatCBIndex = 5;
 	water->DiffuseSrvHeapIndex = 9; 
 	water->NormalSrvHeapIndex = 0;//޷ͼ,з ͼ
 	water->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);//ֵΪ0.5
@@ -1436,42 +1564,56 @@ void ShadowDemo::BuildMaterials()
 
 	auto sky = std::make_unique<Material>();
 	sky->Name = "sky";
-	sky->MatCBIndex = 5;
+	sky->MatCBIndex = 6;
 	sky->DiffuseSrvHeapIndex = 10;
 	sky->NormalSrvHeapIndex = 0;//޷ͼ
 	sky->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 	sky->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
 	sky->Roughness = 1.0f;
+
+	auto boxMat = std::make_unique<Material>();
+	boxMat->Name = "box";
+	boxMat->MatCBIndex = 7;
+	boxMat->DiffuseSrvHeapIndex = 1;
+	boxMat->NormalSrvHeapIndex = 2;
+	boxMat->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	boxMat->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
+	boxMat->Roughness = 0.6f;
 	
+	m_materials["terrain"] = std::move(terrainMat);
 	m_materials["ground"] = std::move(groudMat);
 	m_materials["grass"] = std::move(grassMat);
 	m_materials["road"] = std::move(roadMat);
 	m_materials["waterBottom"] = std::move(waterBottomMat);
 	m_materials["water"] = std::move(water);
 	m_materials["sky"] = std::move(sky);
+	m_materials["box"] = std::move(boxMat);
 
-	UINT matCBIndex = 6;
-	UINT srvHeapIndex = m_modelSrvHeapIndex;
+	UINT matCBIndex = 8;
 	for (UINT modelIndex = 0; modelIndex < m_models.size(); ++modelIndex)
 	{
-		for (UINT i = 0; i < m_models[modelIndex].m_meshes.size(); ++i)
+		for (UINT i = 0; i < m_models[modelIndex].Meshes().size(); ++i)
 		{
+			//ͬһģļModelò
+			if (m_materials.count(m_models[modelIndex].Meshes()[i].material.Name))
+				continue;
+
 			auto mat = std::make_unique<Material>();
-			mat->Name = m_models[modelIndex].m_meshes[i].material.Name;
+			mat->Name = m_models[modelIndex].Meshes()[i].material.Name;
 			mat->MatCBIndex = matCBIndex++;
 			//ͼ
-			if (m_models[modelIndex].m_meshes[i].material.DiffuseMapName != "")
-				mat->DiffuseSrvHeapIndex = srvHeapIndex++;
+			if (m_models[modelIndex].Meshes()[i].material.DiffuseMapName != "")
+				mat->DiffuseSrvHeapIndex = ModelTextureSrvIndex(m_models[modelIndex].Meshes()[i].material.DiffuseMapName);
 			else
 				mat->DiffuseSrvHeapIndex = 0;
 			//зͼ
-			if (m_models[modelIndex].m_meshes[i].material.NormalMapName != "")
-				mat->NormalSrvHeapIndex = srvHeapIndex++;
+			if (m_models[modelIndex].Meshes()[i].material.NormalMapName != "")
+				mat->NormalSrvHeapIndex = ModelTextureSrvIndex(m_models[modelIndex].Meshes()[i].material.NormalMapName);
 			else
 				mat->NormalSrvHeapIndex = 0;
-			mat->DiffuseAlbedo = m_models[modelIndex].m_meshes[i].material.DiffuseAlbedo;
-			mat->FresnelR0 = m_models[modelIndex].m_meshes[i].material.FresnelR0;
-			mat->Roughness = m_models[modelIndex].m_meshes[i].material.Roughness;
+			mat->DiffuseAlbedo = m_models[modelIndex].Meshes()[i].material.DiffuseAlbedo;
+			mat->FresnelR0 = m_models[modelIndex].Meshes()[i].material.FresnelR0;
+			mat->Roughness = m_models[modelIndex].Meshes()[i].material.Roughness;
 
 			m_materials[mat->Name] = std::move(mat);
 		}
@@ -1486,7 +1628,7 @@ void ShadowDemo::BuildRenderItems()
 	skyRitem->texTransform = MathHelper::Identity4x4();
 	skyRitem->objCBIndex = 0;
 	skyRitem->mat = m_materials["sky"].get();
-	skyRitem->geo = m_geometries["terrainGeo"].get();
+	skyRitem->geo = m_geometries["shapeGeo"].get();
 	skyRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	skyRitem->indexCount = skyRitem->geo->DrawArgs["sphere"].IndexCount;
 	skyRitem->startIndexLocation = skyRitem->geo->DrawArgs["sphere"].StartIndexLocation;
@@ -1494,60 +1636,28 @@ void ShadowDemo::BuildRenderItems()
 	m_ritemLayer[(int)RenderLayer::Sky].push_back(skyRitem.get());
 	m_allRenderItems.push_back(std::move(skyRitem));
 
-	auto groundRitem = std::make_unique<RenderItem>();
-	groundRitem->objCBIndex = 1;
-	groundRitem->mat = m_materials["ground"].get();
-	groundRitem->geo = m_geometries["terrainGeo"].get();
-	//任ԵͼС
-	XMStoreFloat4x4(&groundRitem->texTransform, XMMatrixScaling(.02f, 0.02f, 1.f));
-	groundRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	groundRitem->indexCount = groundRitem->geo->DrawArgs["ground"].IndexCount;
-	groundRitem->startIndexLocation = groundRitem->geo->DrawArgs["ground"].StartIndexLocation;
-	groundRitem->baseVertexLocation = groundRitem->geo->DrawArgs["ground"].BaseVertexLocation;
-	m_ritemLayer[(int)RenderLayer::Opaque].push_back(groundRitem.get());
-	m_allRenderItems.push_back(std::move(groundRitem));
-	
-	auto grassRitem = std::make_unique<RenderItem>();
-	grassRitem->objCBIndex = 2;
-	grassRitem->mat = m_materials["grass"].get();
-	grassRitem->geo = m_geometries["terrainGeo"].get();
-	XMStoreFloat4x4(&grassRitem->texTransform, XMMatrixScaling(0.1f, 0.1f, 1.f));
-	grassRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	grassRitem->indexCount = grassRitem->geo->DrawArgs["grass"].IndexCount;
-	grassRitem->startIndexLocation = grassRitem->geo->DrawArgs["grass"].StartIndexLocation;
-	grassRitem->baseVertexLocation = grassRitem->geo->DrawArgs["grass"].BaseVertexLocation;
-	m_ritemLayer[(int)RenderLayer::Opaque].push_back(grassRitem.get());
-	m_allRenderItems.push_back(std::move(grassRitem));
-	
-	auto roadRitem = std::make_unique<RenderItem>();
-	roadRitem->objCBIndex = 3;
-	roadRitem->mat = m_materials["road"].get();
-	roadRitem->geo = m_geometries["terrainGeo"].get();
-	XMStoreFloat4x4(&roadRitem->texTransform, XMMatrixScaling(0.03f, 0.03f, 1.f));
-	roadRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	roadRitem->indexCount = roadRitem->geo->DrawArgs["road"].IndexCount;
-	roadRitem->startIndexLocation = roadRitem->geo->DrawArgs["road"].StartIndexLocation;
-	roadRitem->baseVertexLocation = roadRitem->geo->DrawArgs["road"].BaseVertexLocation;
-	m_ritemLayer[(int)RenderLayer::Opaque].push_back(roadRitem.get());
-	m_allRenderItems.push_back(std::move(roadRitem));
-
-	auto waterRitem = std::make_unique<RenderItem>();
-	waterRitem->objCBIndex = 4;
-	waterRitem->mat = m_materials["waterBottom"].get();
-	waterRitem->geo = m_geometries["terrainGeo"].get();
-	XMStoreFloat4x4(&waterRitem->texTransform, XMMatrixScaling(0.02f, 0.02f, 1.f));
-	waterRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	waterRitem->indexCount = waterRitem->geo->DrawArgs["waterBottom"].IndexCount;
-	waterRitem->startIndexLocation = waterRitem->geo->DrawArgs["waterBottom"].StartIndexLocation;
-	waterRitem->baseVertexLocation = waterRitem->geo->DrawArgs["waterBottom"].BaseVertexLocation;
-	m_ritemLayer[(int)RenderLayer::Opaque].push_back(waterRitem.get());
-	m_allRenderItems.push_back(std::move(waterRitem));
+	//CompactھֲռΪ(,߶,),Żԭλ
+	XMFLOAT4X4 terrainWorld = m_pTerrain->VertexFormat() == TerrainVertexFormat::Compact ?
+		m_pTerrain->Quantization().LocalToWorld() : MathHelper::Identity4x4();
+
+	//һrender item,ÿѡеchunkһdraw call
+	auto terrainRitem = std::make_unique<RenderItem>();
+	terrainRitem->world = terrainWorld;
+	terrainRitem->objCBIndex = 1;
+	terrainRitem->mat = m_materials["terrain"].get();
+	terrainRitem->geo = m_geometries["terrainGeo"].get();
+	//任ѵ任splat map
+	terrainRitem->texTransform = m_pTerrain->SplatTransform();
+	terrainRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	terrainRitem->chunks = &m_pTerrain->Chunks();
+	m_ritemLayer[(int)RenderLayer::Terrain].push_back(terrainRitem.get());
+	m_allRenderItems.push_back(std::move(terrainRitem));
 	
 	auto wavesRitem = std::make_unique<RenderItem>();
-	XMMATRIX wavesWorld = XMMatrixTranslation(0.f, 93.f, 0.f);
+	XMMATRIX wavesWorld = XMMatrixTranslation(0.f, m_pTerrain->WaterHeight(), 0.f);
 	XMStoreFloat4x4(&wavesRitem->world, wavesWorld);
 	XMStoreFloat4x4(&wavesRitem->texTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	wavesRitem->objCBIndex = 5;
+	wavesRitem->objCBIndex = 2;
 	wavesRitem->mat = m_materials["water"].get();
 	wavesRitem->geo = m_geometries["waterGeo"].get();
 	wavesRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1561,8 +1671,8 @@ void ShadowDemo::BuildRenderItems()
 	auto boxRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&boxRitem->world, XMMatrixScaling(2.0f, 2.0f, 2.0f)*XMMatrixTranslation(100.0f, 120.f, 0.0f));
 	XMStoreFloat4x4(&boxRitem->texTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-	boxRitem->objCBIndex = 6;
-	boxRitem->mat = m_materials["ground"].get();
+	boxRitem->objCBIndex = 3;
+	boxRitem->mat = m_materials["box"].get();
 	boxRitem->geo = m_geometries["shapeGeo"].get();
 	boxRitem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	boxRitem->indexCount = boxRitem->geo->DrawArgs["box"].IndexCount;
@@ -1571,11 +1681,11 @@ void ShadowDemo::BuildRenderItems()
 	m_ritemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
 	m_allRenderItems.push_back(std::move(boxRitem));
 
-	UINT objCBIndex = 7;
+	UINT objCBIndex = 4;
 
 	for (UINT modelIndex = 0; modelIndex < m_models.size(); ++modelIndex)
 	{
-		for (UINT i = 0; i < m_models[modelIndex].m_meshes.size(); ++i)
+		for (UINT i = 0; i < m_models[modelIndex].Meshes().size(); ++i)
 		{
 			std::string submeshName = "sm_" + std::to_string(i);
 
@@ -1591,12 +1701,23 @@ void ShadowDemo::BuildRenderItems()
 
 			ritem->texTransform = MathHelper::Identity4x4();
 			ritem->objCBIndex = objCBIndex++;
-			ritem->mat = m_materials[m_models[modelIndex].m_meshes[i].material.Name].get();
-			ritem->geo = m_geometries[m_models[modelIndex].m_name].get();
+			ritem->mat = m_materials[m_models[modelIndex].Meshes()[i].material.Name].get();
+			ritem->geo = m_geometries[m_models[modelIndex].AssetPath()].get();
 			ritem->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 			ritem->indexCount = ritem->geo->DrawArgs[submeshName].IndexCount;
 			ritem->startIndexLocation = ritem->geo->DrawArgs[submeshName].StartIndexLocation;
 			ritem->baseVertexLocation = ritem->geo->DrawArgs[submeshName].BaseVertexLocation;
+
+			const auto& mesh = m_models[modelIndex].Meshes()[i];
+			if (mesh.lods.size() > 1)
+			{
+				ritem->lods = &mesh.lods;
+				BoundingSphere bounds;
+				BoundingSphere::CreateFromPoints(bounds, mesh.vertices.size(), &mesh.vertices[0].Pos,
+					sizeof(ModelImporter::ModelVertex));
+				bounds.Transform(ritem->lodBounds, m_models[modelIndex].GetWorld());
+				ritem->lodScale = bounds.Radius > 0.f ? ritem->lodBounds.Radius / bounds.Radius : 1.f;
+			}
 			m_ritemLayer[(int)RenderLayer::Opaque].push_back(ritem.get());
 			m_allRenderItems.push_back(std::move(ritem));
 		}
@@ -1604,7 +1725,8 @@ void ShadowDemo::BuildRenderItems()
 	
 }
 
-void ShadowDemo::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ShadowDemo::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems,
+	bool shadowPass)
 {
 	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
@@ -1623,6 +1745,21 @@ void ShadowDemo::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::
 
 		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
 
+		if (ri->chunks)
+		{
+			for (const auto& chunk : *ri->chunks)
+				cmdList->DrawIndexedInstanced(chunk.IndexCount, 1, chunk.StartIndexLocation, chunk.BaseVertexLocation, 0);
+			continue;
+		}
+
+		if (ri->lods)
+		{
+			const MeshLod& level = (*ri->lods)[shadowPass ? ri->shadowLod : ri->lod];
+			cmdList->DrawIndexedInstanced(level.IndexCount, 1, ri->startIndexLocation + level.StartIndex,
+				ri->baseVertexLocation, 0);
+			continue;
+		}
+
 		cmdList->DrawIndexedInstanced(ri->indexCount, 1, ri->startIndexLocation, ri->baseVertexLocation, 0);
 	}
 
@@ -1655,7 +1792,11 @@ void ShadowDemo::DrawSceneToShadowMap()
 
 	m_pCommandList->SetPipelineState(m_PSOs["shadow_opaque"].Get());
 
-	DrawRenderItems(m_pCommandList.Get(), m_ritemLayer[(int)RenderLayer::Opaque]);
+	//ģͻһЩLOD
+	DrawRenderItems(m_pCommandList.Get(), m_ritemLayer[(int)RenderLayer::Opaque], true);
+
+	m_pCommandList->SetPipelineState(m_PSOs["shadow_terrain"].Get());
+	DrawRenderItems(m_pCommandList.Get(), m_ritemLayer[(int)RenderLayer::Terrain]);
 
 	// Change back to GENERIC_READ so we can read the texture in a shader.
 	m_pCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_pShadowMap->Resource(),
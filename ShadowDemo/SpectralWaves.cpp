@@ -0,0 +1,452 @@
+//***************************************************************************************
+// SpectralWaves.cpp
+//***************************************************************************************
+
+#include "SpectralWaves.h"
+#include "Common/TaskScheduler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	typedef std::complex<float> Complex;
+
+	const float Pi = 3.1415926535f;
+	const float Gravity = 9.81f;
+
+	// Multiplies by i.
+	Complex TimesI(const Complex& c)
+	{
+		return Complex(-c.imag(), c.real());
+	}
+
+	// In-place inverse FFT of one contiguous row of n = 2^logN values, without
+	// the 1/n scale.  After the bit reversal one radix-2 pass runs when logN is
+	// odd, the remaining passes are radix-4: each combines the four length-m
+	// transforms of x[4k], x[4k+2], x[4k+1] and x[4k+3] (in that order after the
+	// bit reversal) into one of length 4m, halving the passes over the row.
+	void InverseFFT(Complex* x, int n, int logN, const Complex* twiddles, const int* bitReverse)
+	{
+		for(int k = 0; k < n; ++k)
+		{
+			int r = bitReverse[k];
+			if(r > k)
+				std::swap(x[k], x[r]);
+		}
+
+		int m = 1;
+		if(logN & 1)
+		{
+			for(int k = 0; k < n; k += 2)
+			{
+				Complex a = x[k];
+				Complex b = x[k + 1];
+				x[k] = a + b;
+				x[k + 1] = a - b;
+			}
+			m = 2;
+		}
+
+		for(; 4*m <= n; m *= 4)
+		{
+			// twiddles[j] = exp(2 pi i j / n); the pass needs exp(2 pi i k / 4m).
+			int stride = n / (4*m);
+			for(int base = 0; base < n; base += 4*m)
+			{
+				Complex* x0 = x + base;
+				Complex* x1 = x0 + m;
+				Complex* x2 = x1 + m;
+				Complex* x3 = x2 + m;
+				for(int k = 0; k < m; ++k)
+				{
+					Complex a = x0[k];
+					Complex b = x1[k]*twiddles[2*k*stride];
+					Complex c = x2[k]*twiddles[k*stride];
+					Complex d = x3[k]*twiddles[3*k*stride];
+
+					Complex apb = a + b;
+					Complex amb = a - b;
+					Complex cpd = c + d;
+					Complex cmd = TimesI(c - d);
+
+					x0[k] = apb + cpd;
+					x1[k] = amb + cmd;
+					x2[k] = apb - cpd;
+					x3[k] = amb - cmd;
+				}
+			}
+		}
+	}
+
+	// Directional wave spectra, per unit area of wave vector space.
+	float Phillips(float kx, float kz, const XMFLOAT2& windDir, float windSpeed, float amplitude)
+	{
+		float kSq = kx*kx + kz*kz;
+		if(kSq < 1e-12f)
+			return 0.0f;
+
+		// Largest wave that can arise from the wind, and a cutoff that
+		// suppresses the very small ones.
+		float largest = windSpeed*windSpeed / Gravity;
+		float smallest = largest*0.001f;
+
+		float cosWind = (kx*windDir.x + kz*windDir.y) / sqrtf(kSq);
+
+		// Phillips' constant for A, 0.0081.
+		return 0.0081f*amplitude*expf(-1.0f / (kSq*largest*largest)) / (kSq*kSq) *
+			cosWind*cosWind*expf(-kSq*smallest*smallest);
+	}
+
+	float Jonswap(float kx, float kz, const XMFLOAT2& windDir, float windSpeed,
+		float fetch, float gamma, float amplitude)
+	{
+		float k = sqrtf(kx*kx + kz*kz);
+		if(k < 1e-6f)
+			return 0.0f;
+
+		// Frequency spectrum S(w) for a fetch limited sea.
+		float omega = sqrtf(Gravity*k);
+		float alpha = 0.076f*powf(windSpeed*windSpeed / (fetch*Gravity), 0.22f);
+		float omegaPeak = 22.0f*powf(Gravity*Gravity / (windSpeed*fetch), 1.0f / 3.0f);
+		float sigma = omega <= omegaPeak ? 0.07f : 0.09f;
+		float r = expf(-(omega - omegaPeak)*(omega - omegaPeak) / (2.0f*sigma*sigma*omegaPeak*omegaPeak));
+		float ratio = omegaPeak / omega;
+		float s = alpha*Gravity*Gravity / powf(omega, 5.0f) *
+			expf(-1.25f*ratio*ratio*ratio*ratio)*powf(gamma, r);
+
+		// cos^2 spreading around the wind, waves moving with it only.
+		float cosWind = (kx*windDir.x + kz*windDir.y) / k;
+		if(cosWind <= 0.0f)
+			return 0.0f;
+		float spread = 2.0f / Pi*cosWind*cosWind;
+
+		// S(k, theta) = S(w) D(theta) dw/dk / k
+		return amplitude*s*spread*(0.5f*Gravity / omega) / k;
+	}
+}
+
+SpectralWaves::SpectralWaves(const Desc& desc)
+{
+	mSize = desc.Size;
+	assert(mSize >= 4 && (mSize & (mSize - 1)) == 0);
+
+	while((1 << mLogSize) < mSize)
+		++mLogSize;
+
+	mSpatialStep = desc.PatchSize / mSize;
+	mChoppiness = desc.Choppiness;
+
+	int n = mSize;
+	mTwiddles.resize(n);
+	mBitReverse.resize(n);
+	for(int j = 0; j < n; ++j)
+	{
+		float angle = 2.0f*Pi*j / n;
+		mTwiddles[j] = Complex(cosf(angle), sinf(angle));
+
+		int r = 0;
+		for(int b = 0; b < mLogSize; ++b)
+			r |= ((j >> b) & 1) << (mLogSize - 1 - b);
+		mBitReverse[j] = r;
+	}
+
+	mField0.resize(n*n);
+	mField1.resize(n*n);
+	mField2.resize(n*n);
+	mHeight.assign(n*n, 0.0f);
+	mDisplaceX.assign(n*n, 0.0f);
+	mDisplaceZ.assign(n*n, 0.0f);
+	mSlopeX.assign(n*n, 0.0f);
+	mSlopeZ.assign(n*n, 0.0f);
+
+	InitSpectrum(desc);
+
+	SetScheduler(TaskScheduler::GetInstance());
+	Update(0.0f);
+}
+
+SpectralWaves::~SpectralWaves()
+{
+}
+
+int SpectralWaves::RowCount()const
+{
+	return mSize;
+}
+
+int SpectralWaves::ColumnCount()const
+{
+	return mSize;
+}
+
+int SpectralWaves::VertexCount()const
+{
+	return mSize*mSize;
+}
+
+int SpectralWaves::TriangleCount()const
+{
+	return (mSize - 1)*(mSize - 1)*2;
+}
+
+float SpectralWaves::Width()const
+{
+	return mSize*mSpatialStep;
+}
+
+float SpectralWaves::Depth()const
+{
+	return mSize*mSpatialStep;
+}
+
+XMFLOAT3 SpectralWaves::Position(int i)const
+{
+	int row = i / mSize;
+	int col = i - row*mSize;
+
+	float halfSize = (mSize - 1)*mSpatialStep*0.5f;
+
+	return XMFLOAT3(-halfSize + col*mSpatialStep + mChoppiness*mDisplaceX[i],
+		mHeight[i],
+		halfSize - row*mSpatialStep + mChoppiness*mDisplaceZ[i]);
+}
+
+XMFLOAT3 SpectralWaves::Normal(int i)const
+{
+	float sx = mSlopeX[i];
+	float sz = mSlopeZ[i];
+	float invLength = 1.0f / sqrtf(sx*sx + 1.0f + sz*sz);
+
+	return XMFLOAT3(-sx*invLength, invLength, -sz*invLength);
+}
+
+XMFLOAT3 SpectralWaves::TangentX(int i)const
+{
+	float sx = mSlopeX[i];
+	float invLength = 1.0f / sqrtf(1.0f + sx*sx);
+
+	return XMFLOAT3(invLength, sx*invLength, 0.0f);
+}
+
+void SpectralWaves::SetScheduler(TaskScheduler* scheduler, int rowGrain)
+{
+	mScheduler = scheduler;
+
+	// Default to roughly 16K values per task.
+	if(rowGrain <= 0)
+		rowGrain = std::max(1, 16384 / mSize);
+	mRowGrain = rowGrain;
+}
+
+void SpectralWaves::InitSpectrum(const Desc& desc)
+{
+	int n = mSize;
+	mH0.resize(n*n);
+	mH0MinusConj.resize(n*n);
+	mOmega.resize(n*n);
+
+	float windSpeed = sqrtf(desc.Wind.x*desc.Wind.x + desc.Wind.y*desc.Wind.y);
+	XMFLOAT2 windDir(1.0f, 0.0f);
+	if(windSpeed > 0.0f)
+		windDir = XMFLOAT2(desc.Wind.x / windSpeed, desc.Wind.y / windSpeed);
+	else
+		windSpeed = 1.0f;
+
+	// Variance of one sample is spectrum * dk^2.
+	float dk = 2.0f*Pi / desc.PatchSize;
+
+	std::mt19937 rng(desc.Seed);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+	for(int m = 0; m < n; ++m)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			float kx, kz;
+			WaveVector(m, j, kx, kz);
+
+			float spectrum = desc.Shape == Spectrum::Phillips ?
+				Phillips(kx, kz, windDir, windSpeed, desc.Amplitude) :
+				Jonswap(kx, kz, windDir, windSpeed, desc.Fetch, desc.PeakEnhancement, desc.Amplitude);
+
+			// The Nyquist row and column have no mirror image on the grid; they
+			// are left out so every field stays real.
+			if(m == n / 2 || j == n / 2)
+				spectrum = 0.0f;
+
+			float re = gauss(rng);
+			float im = gauss(rng);
+			mH0[m*n + j] = Complex(re, im)*sqrtf(0.5f*spectrum*dk*dk);
+			mOmega[m*n + j] = sqrtf(Gravity*sqrtf(kx*kx + kz*kz));
+		}
+	}
+
+	for(int m = 0; m < n; ++m)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			int mirror = ((n - m) & (n - 1))*n + ((n - j) & (n - 1));
+			mH0MinusConj[m*n + j] = std::conj(mH0[mirror]);
+		}
+	}
+}
+
+void SpectralWaves::WaveVector(int m, int j, float& kx, float& kz)const
+{
+	// Frequencies are stored wrapped: index m stands for m - n above n/2.
+	// Row indices run along -z (see Position), hence the sign of kz.
+	int fm = m < mSize / 2 ? m : m - mSize;
+	int fj = j < mSize / 2 ? j : j - mSize;
+
+	float dk = 2.0f*Pi / Width();
+	kx = dk*fj;
+	kz = -dk*fm;
+}
+
+void SpectralWaves::Update(float dt)
+{
+	mTime += dt;
+
+	int n = mSize;
+
+	//
+	// Evaluate the spectrum at the current time and derive the other fields
+	// from it in frequency space:
+	//   h(k, t) = h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt)
+	//   D(k, t) = -i k/|k| h(k, t)		horizontal displacement
+	//   S(k, t) = i k h(k, t)				slope
+	//
+	mScheduler->ParallelFor(0, n, mRowGrain, [this, n](int m)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			int index = m*n + j;
+
+			float kx, kz;
+			WaveVector(m, j, kx, kz);
+			float k = sqrtf(kx*kx + kz*kz);
+
+			float phase = mOmega[index]*mTime;
+			Complex rotate(cosf(phase), sinf(phase));
+			Complex h = mH0[index]*rotate + mH0MinusConj[index]*std::conj(rotate);
+
+			Complex ih = TimesI(h);
+			Complex dx = k > 0.0f ? -ih*(kx / k) : Complex(0.0f);
+			Complex dz = k > 0.0f ? -ih*(kz / k) : Complex(0.0f);
+
+			mField0[index] = h + TimesI(dx);
+			mField1[index] = dz + TimesI(ih*kx);
+			mField2[index] = ih*kz;
+		}
+	});
+
+	InverseFFT2D(mField0.data());
+	InverseFFT2D(mField1.data());
+	InverseFFT2D(mField2.data());
+
+	mScheduler->ParallelFor(0, n, mRowGrain, [this, n](int i)
+	{
+		for(int j = i*n; j < (i + 1)*n; ++j)
+		{
+			mHeight[j] = mField0[j].real();
+			mDisplaceX[j] = mField0[j].imag();
+			mDisplaceZ[j] = mField1[j].real();
+			mSlopeX[j] = mField1[j].imag();
+			mSlopeZ[j] = mField2[j].real();
+		}
+	});
+}
+
+void SpectralWaves::InverseFFT2D(Complex* data)
+{
+	int n = mSize;
+
+	// Rows, then columns as rows of the transpose, then back.  Every pass
+	// walks memory in order.
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		mScheduler->ParallelFor(0, n, mRowGrain, [this, data, n](int i)
+		{
+			InverseFFT(data + i*n, n, mLogSize, mTwiddles.data(), mBitReverse.data());
+		});
+
+		Transpose(data);
+	}
+}
+
+void SpectralWaves::Transpose(Complex* data)
+{
+	int n = mSize;
+
+	// In place, in blocks that fit in L1; task bi swaps block (bi, bj) with
+	// (bj, bi) for every bj >= bi, so no two tasks touch the same block.
+	const int Block = 16;
+	int blocks = (n + Block - 1) / Block;
+
+	mScheduler->ParallelFor(0, blocks, 1, [data, n](int bi)
+	{
+		int i0 = bi*Block;
+		int i1 = std::min(i0 + Block, n);
+		for(int j0 = i0; j0 < n; j0 += Block)
+		{
+			int j1 = std::min(j0 + Block, n);
+			for(int i = i0; i < i1; ++i)
+			{
+				for(int j = std::max(j0, i + 1); j < j1; ++j)
+					std::swap(data[i*n + j], data[j*n + i]);
+			}
+		}
+	});
+}
+
+void SpectralWaves::EmitVertices(Vertex* dst, int count)const
+{
+	assert(count >= VertexCount());
+
+	int n = mSize;
+	float halfSize = (n - 1)*mSpatialStep*0.5f;
+
+	mScheduler->ParallelFor(0, n, mRowGrain, [&](int i)
+	{
+		float z = halfSize - i*mSpatialStep;
+		for(int j = 0; j < n; ++j)
+		{
+			int index = i*n + j;
+			float sx = mSlopeX[index];
+			float sz = mSlopeZ[index];
+			float invN = 1.0f / sqrtf(sx*sx + 1.0f + sz*sz);
+			float invT = 1.0f / sqrtf(1.0f + sx*sx);
+
+			Vertex& v = dst[index];
+			v.Pos.x = -halfSize + j*mSpatialStep + mChoppiness*mDisplaceX[index];
+			v.Pos.y = mHeight[index];
+			v.Pos.z = z + mChoppiness*mDisplaceZ[index];
+			v.Normal.x = -sx*invN;
+			v.Normal.y = invN;
+			v.Normal.z = -sz*invN;
+			v.TangentU.x = invT;
+			v.TangentU.y = sx*invT;
+			v.TangentU.z = 0.0f;
+		}
+	});
+}
+
+void SpectralWaves::EmitTexCoords(Vertex* dst, int count)const
+{
+	assert(count >= VertexCount());
+
+	// The patch repeats, so do the texture coordinates: [0,1) per tile.
+	int n = mSize;
+	for(int i = 0; i < n; ++i)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			dst[i*n + j].TexC.x = float(j) / n;
+			dst[i*n + j].TexC.y = float(i) / n;
+		}
+	}
+}
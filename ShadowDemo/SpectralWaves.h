@@ -0,0 +1,123 @@
+//***************************************************************************************
+// SpectralWaves.h
+//
+// FFT ocean after Tessendorf, "Simulating Ocean Water".  A Phillips or JONSWAP
+// spectrum is sampled once; every Update evaluates it at the current time and
+// runs inverse FFTs for height, horizontal displacement and slopes.  The cost is
+// O(N^2 log N) per update whatever the time step, and the patch tiles
+// seamlessly, so one patch can be repeated over the whole sea.
+//
+// Offers Position/Normal/TangentX per grid point like Waves, and EmitVertices to
+// write the whole grid into a caller's vertex array.
+//***************************************************************************************
+
+#ifndef SPECTRALWAVES_H
+#define SPECTRALWAVES_H
+
+#include <complex>
+#include <vector>
+#include <DirectXMath.h>
+#include "Vertex.h"
+
+class TaskScheduler;
+
+class SpectralWaves
+{
+public:
+	enum class Spectrum
+	{
+		Phillips,
+		Jonswap
+	};
+
+	struct Desc
+	{
+		int Size = 256;								// grid points per side, a power of two
+		float PatchSize = 256.0f;					// world size of one tile
+		DirectX::XMFLOAT2 Wind = { 10.0f, 0.0f };	// direction in xz, length is the speed in m/s
+		Spectrum Shape = Spectrum::Phillips;
+		float Amplitude = 1.0f;						// scale of the spectrum, 1 is the measured energy
+		float Fetch = 100000.0f;					// JONSWAP: distance the wind has blown over, in m
+		float PeakEnhancement = 3.3f;				// JONSWAP: gamma
+		float Choppiness = 1.0f;					// horizontal displacement scale, 0 disables it
+		unsigned Seed = 1;
+	};
+
+	explicit SpectralWaves(const Desc& desc);
+	SpectralWaves(const SpectralWaves& rhs) = delete;
+	SpectralWaves& operator=(const SpectralWaves& rhs) = delete;
+	~SpectralWaves();
+
+	int RowCount()const;
+	int ColumnCount()const;
+	int VertexCount()const;
+	int TriangleCount()const;
+	float Width()const;
+	float Depth()const;
+
+	// Returns the displaced surface point at the ith grid point.
+	DirectX::XMFLOAT3 Position(int i)const;
+
+	// Returns the surface normal at the ith grid point.
+	DirectX::XMFLOAT3 Normal(int i)const;
+
+	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
+	DirectX::XMFLOAT3 TangentX(int i)const;
+
+	// Runs the FFT passes on scheduler (the shared pool by default), at least
+	// rowGrain rows per task.  rowGrain <= 0 picks a grain from the grid size.
+	void SetScheduler(TaskScheduler* scheduler, int rowGrain = 0);
+
+	// Advances the time and evaluates the surface at it.
+	void Update(float dt);
+
+	// Writes Pos, Normal and TangentU of the current surface into dst
+	// (VertexCount() vertices, typically the mapped upload buffer).
+	void EmitVertices(Vertex* dst, int count)const;
+
+	// Writes the static texture coordinates, [0,1) across one patch so they tile
+	// with it.  Only needs to be done once per destination buffer.
+	void EmitTexCoords(Vertex* dst, int count)const;
+
+private:
+	typedef std::complex<float> Complex;
+
+	void InitSpectrum(const Desc& desc);
+	void WaveVector(int m, int j, float& kx, float& kz)const;
+	void InverseFFT2D(Complex* data);
+	void Transpose(Complex* data);
+
+private:
+	int mSize = 0;
+	int mLogSize = 0;
+	float mSpatialStep = 0.0f;
+	float mChoppiness = 0.0f;
+	float mTime = 0.0f;
+
+	TaskScheduler* mScheduler = nullptr;
+	int mRowGrain = 1;
+
+	// Spectrum at t = 0: h0(k) and conj(h0(-k)), and the dispersion w(k).
+	std::vector<Complex> mH0;
+	std::vector<Complex> mH0MinusConj;
+	std::vector<float> mOmega;
+
+	// Inverse FFT tables for one row.
+	std::vector<Complex> mTwiddles;
+	std::vector<int> mBitReverse;
+
+	// Two real fields share one complex FFT, a + ib, as both are real in space:
+	// (height, x displacement), (z displacement, x slope), (z slope, unused).
+	std::vector<Complex> mField0;
+	std::vector<Complex> mField1;
+	std::vector<Complex> mField2;
+
+	// The surface, structure of arrays.
+	std::vector<float> mHeight;
+	std::vector<float> mDisplaceX;
+	std::vector<float> mDisplaceZ;
+	std::vector<float> mSlopeX;
+	std::vector<float> mSlopeZ;
+};
+
+#endif // SPECTRALWAVES_H
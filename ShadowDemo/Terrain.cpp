@@ -1,13 +1,40 @@
 #include "Terrain.h"
+#include "HeightfieldNormals.h"
+#include "Common\TaskScheduler.h"
+#include <algorithm>
 using namespace DirectX;
 
-Terrain::Terrain(float width, float height, UINT m, UINT n, float scale)
+namespace
 {
-	if (!ReadRawFile("..\\Textures\\terrain_ps2.raw"))
-		MessageBox(nullptr, L"error", L"read terrain file failed!", MB_OK);
-	if(!InitTerrain(500, 500, 511, 511, 1.f))
-		MessageBox(nullptr, L"error", L"init terrain  failed!", MB_OK);
+	//ab֮01ƽ
+	float SmoothStep(float a, float b, float x)
+	{
+		float t = b > a ? std::min(std::max((x - a) / (b - a), 0.f), 1.f) : (x >= b ? 1.f : 0.f);
+		return t * t * (3.f - 2.f * t);
+	}
+}
+
+Terrain::Terrain(float width, float height, UINT m, UINT n, float scale, TerrainVertexFormat format) :
+	m_vertexFormat(format)
+{
+	//8λRAW߶ͼ
+	//ʧʱɵͨIsLoaded()
+	HeightmapSource::RawDesc desc;
+	auto heightmap = std::make_unique<HeightmapSource>();
+	if (heightmap->OpenRaw("..\\Textures\\terrain_ps2.raw", desc))
+		m_source = std::move(heightmap);
+	m_loaded = InitTerrain(width, height, m, n, scale);
+
+}
 
+Terrain::Terrain(float width, float height, UINT m, UINT n, float scale, const NoiseHeightSource::Desc& noise,
+	TerrainVertexFormat format) :
+	m_vertexFormat(format)
+{
+	auto source = std::make_unique<NoiseHeightSource>();
+	if (source->Open(noise))
+		m_source = std::move(source);
+	m_loaded = InitTerrain(width, height, m, n, scale);
 }
 
 
@@ -15,8 +42,11 @@ Terrain::~Terrain()
 {
 }
 
-bool Terrain::InitTerrain(float width, float height, UINT m, UINT n, float scale) 
-{
+//һ,һ鹹ȫֱʶ,ĲɸĿ,m_vertices,
+//ģm_indexTemplates.
+//ߺֱɸ߶ȼ,ͬĲɻȨͼshaderл,ٰп
+bool Terrain::InitTerrain(float width, float height, UINT m, UINT n, float scale) 
+{
 	m_cellsPerRow = m;
 	m_cellsPerCol = n;
 	m_verticesPerRow = m + 1;
@@ -26,408 +56,254 @@ bool Terrain::InitTerrain(float width, float height, UINT m, UINT n, float scale
 	m_height = height;
 	m_heightScale = scale;
 
-	//õźĸ߶
-	for (auto& item : m_heightInfos)
-	{
-		item *= m_heightScale;
-	}
+	//߶ͼ븲
+	if (!m_source || m_source->Width() < m_verticesPerRow || m_source->Height() < m_verticesPerCol)
+		return false;
 
 	//ʼx z
-	float oX = -width * 0.5f;
-	float oZ = height * 0.5f;
+	const float oX = -m_width * 0.5f;
+	const float oZ = m_height * 0.5f;
 	//ÿһ仯
-	float dx = width / m;
-	float dz = height / n;	
+	const float dx = m_width / m_cellsPerRow;
+	const float dz = m_height / m_cellsPerCol;
+	const int rows = m_verticesPerCol;
+	const int cols = m_verticesPerRow;
 
-	//ground
+	//ֻ񸲸ǵĸ߶,.m_heightfieldһ,õ漴ͷ
 	{
-		//ground
-		UINT groundWidth = 225;
-		UINT groundHeight = 512;
-		m_vertexItems["ground"].resize(groundWidth * groundHeight);
-		//512
-		for (UINT i = 0; i < groundHeight; ++i)
-		{
-			float tempZ = oZ - dz * i;
-			//225
-			for (UINT j = 0; j < groundWidth; ++j)
-			{
-				UINT index = groundWidth * i + j;
-				m_vertexItems["ground"][index].Pos.x = oX + dx * j;
-				m_vertexItems["ground"][index].Pos.y = m_heightInfos[m_verticesPerRow*i + j];
-				m_vertexItems["ground"][index].Pos.z = tempZ;
-				m_vertexItems["ground"][index].TexC = XMFLOAT2(dx*i, dx*j);
-				m_vertexItems["ground"][index].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-				m_vertexItems["ground"][index].Normal = XMFLOAT3(0.f, 0.f, 0.f);
-			}
-		}
+		std::vector<float> decoded(m_numsVertices);
+		m_source->ReadWindow(0, 0, rows, cols, decoded.data(), cols, m_heightScale);
+		if (!m_heightfield.Build(decoded.data(), rows, cols, cols, oX, oZ, dx, dz))
+			return false;
+	}
+	const float* gridHeights = m_heightfield.Row(0);
 
-		//ground
-		m_indexItems["ground"].resize(6 * (groundWidth - 1)*(groundHeight - 1));
-		UINT tmp = 0;
-		for (UINT i = 0; i < groundHeight - 1; ++i)
+	std::vector<Vertex> grid(m_numsVertices);
+	for (int i = 0; i < rows; ++i)
+	{
+		const float* heights = gridHeights + cols * i;
+		Vertex* row = &grid[cols * i];
+		float z = oZ - dz * i;
+		for (int j = 0; j < cols; ++j)
 		{
-			for (UINT j = 0; j < groundWidth - 1; ++j)
-			{
-				m_indexItems["ground"][tmp] = i * groundWidth + j;
-				m_indexItems["ground"][tmp + 1] = i * groundWidth + j + 1;
-				m_indexItems["ground"][tmp + 2] = (i + 1) * groundWidth + j;
-				//㷨
-				XMFLOAT3 temp;
-				ComputeNomal(m_vertexItems["ground"][m_indexItems["ground"][tmp]],
-					m_vertexItems["ground"][m_indexItems["ground"][tmp + 1]],
-					m_vertexItems["ground"][m_indexItems["ground"][tmp + 2]], temp);
-
-				XMFloat3Add(m_vertexItems["ground"][m_indexItems["ground"][tmp]].Normal, temp);
-				XMFloat3Add(m_vertexItems["ground"][m_indexItems["ground"][tmp + 1]].Normal, temp);
-				XMFloat3Add(m_vertexItems["ground"][m_indexItems["ground"][tmp + 2]].Normal, temp);
-
-				m_indexItems["ground"][tmp + 3] = i * groundWidth + j + 1;
-				m_indexItems["ground"][tmp + 4] = (i + 1) * groundWidth + j + 1;
-				m_indexItems["ground"][tmp + 5] = (i + 1) * groundWidth + j;
-				ComputeNomal(m_vertexItems["ground"][m_indexItems["ground"][tmp + 3]],
-					m_vertexItems["ground"][m_indexItems["ground"][tmp + 4]],
-					m_vertexItems["ground"][m_indexItems["ground"][tmp + 5]], temp);
-
-				XMFloat3Add(m_vertexItems["ground"][m_indexItems["ground"][tmp + 3]].Normal, temp);
-				XMFloat3Add(m_vertexItems["ground"][m_indexItems["ground"][tmp + 4]].Normal, temp);
-				XMFloat3Add(m_vertexItems["ground"][m_indexItems["ground"][tmp + 5]].Normal, temp);
-
-				tmp += 6;
-			}
+			row[j].Pos = XMFLOAT3(oX + dx * j, heights[j], z);
+			//߶ͼϵλ,TerrainVertexһ
+			row[j].TexC = XMFLOAT2(dx * i, dx * j);
 		}
+	}
 
+	//ߺ
+	ComputeHeightfieldNormals(gridHeights, cols, rows, cols, dx, dz, grid.data());
 
-		//һз,
-		for (int i = 0; i < m_vertexItems["ground"].size(); ++i)
-		{
-			XMFloat3Normalize(m_vertexItems["ground"][i].Normal);
-			CalcTangent(m_vertexItems["ground"][i].TangentU, m_vertexItems["ground"][i].Normal);
-			
-		}
-	}
+	m_vertices.clear();
+	m_indexTemplates.Clear();
+	m_tree.Build(grid.data(), rows, cols, m_vertices, m_indexTemplates);
 
-	//grass
-	{
-		//grass
-		UINT grassWidth = 225;
-		UINT grassHeight = 512;
-		m_vertexItems["grass"].resize(grassWidth * grassHeight);
-		UINT offsetX = 287;
-		//512
-		for (UINT i = 0; i < grassHeight; ++i)
-		{
-			float tempZ = oZ - dz * i;
-			//225
-			for (UINT j = 0; j < grassWidth; ++j)
-			{
-				UINT index = grassWidth * i + j;
-				m_vertexItems["grass"][index].Pos.x = oX + dx * (j + offsetX);
-				m_vertexItems["grass"][index].Pos.y = m_heightInfos[m_verticesPerRow*i + (j + offsetX)];
-				m_vertexItems["grass"][index].Pos.z = tempZ;
-				m_vertexItems["grass"][index].TexC = XMFLOAT2(dx*i, dx*j);
-				m_vertexItems["grass"][index].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-				m_vertexItems["grass"][index].Normal = XMFLOAT3(0.f, 0.f, 0.f);
-			}
-		}
+	if (m_vertexFormat == TerrainVertexFormat::Compact)
+		CompactVertices();
 
-		//grass
-		m_indexItems["grass"].resize(6 * (grassWidth - 1)*(grassHeight - 1));
-		UINT tmp = 0;
-		for (UINT i = 0; i < grassHeight - 1; ++i)
-		{
-			for (UINT j = 0; j < grassWidth - 1; ++j)
-			{
-				m_indexItems["grass"][tmp] = i * grassWidth + j;
-				m_indexItems["grass"][tmp + 1] = i * grassWidth + j + 1;
-				m_indexItems["grass"][tmp + 2] = (i + 1) * grassWidth + j;
-				//㷨
-				XMFLOAT3 temp;
-				ComputeNomal(m_vertexItems["grass"][m_indexItems["grass"][tmp]],
-					m_vertexItems["grass"][m_indexItems["grass"][tmp + 1]],
-					m_vertexItems["grass"][m_indexItems["grass"][tmp + 2]], temp);
-
-				XMFloat3Add(m_vertexItems["grass"][m_indexItems["grass"][tmp]].Normal, temp);
-				XMFloat3Add(m_vertexItems["grass"][m_indexItems["grass"][tmp + 1]].Normal, temp);
-				XMFloat3Add(m_vertexItems["grass"][m_indexItems["grass"][tmp + 2]].Normal, temp);
-
-
-				m_indexItems["grass"][tmp + 3] = i * grassWidth + j + 1;
-				m_indexItems["grass"][tmp + 4] = (i + 1) * grassWidth + j + 1;
-				m_indexItems["grass"][tmp + 5] = (i + 1) * grassWidth + j;
-				ComputeNomal(m_vertexItems["grass"][m_indexItems["grass"][tmp + 3]],
-					m_vertexItems["grass"][m_indexItems["grass"][tmp + 4]],
-					m_vertexItems["grass"][m_indexItems["grass"][tmp + 5]], temp);
-
-				XMFloat3Add(m_vertexItems["grass"][m_indexItems["grass"][tmp + 3]].Normal, temp);
-				XMFloat3Add(m_vertexItems["grass"][m_indexItems["grass"][tmp + 4]].Normal, temp);
-				XMFloat3Add(m_vertexItems["grass"][m_indexItems["grass"][tmp + 5]].Normal, temp);
-
-				tmp += 6;
-			}
-		}
+	BuildSplatMap();
 
-		//һз
-		for (int i = 0; i < m_vertexItems["grass"].size(); ++i)
-		{
-			XMFloat3Normalize(m_vertexItems["grass"][i].Normal);
-			CalcTangent(m_vertexItems["grass"][i].TangentU, m_vertexItems["grass"][i].Normal);
-		}
-	}
+	return true;
+}
 
-	//water
+//m_verticesΪm_compactVertices,Ȼͷm_vertices
+void Terrain::CompactVertices()
+{
+	//߶ȷΧȹ
+	float minY = m_vertices.empty() ? 0.f : m_vertices[0].Pos.y;
+	float maxY = minY;
+	for (const auto& v : m_vertices)
 	{
-		//water
-		UINT waterWidth = 64;
-		UINT waterHeight = 512;
-		m_vertexItems["waterBottom"].resize(waterWidth * waterHeight);
-		UINT offsetX = 224;
-		//512
-		for (UINT i = 0; i < waterHeight; ++i)
-		{
-			float tempZ = oZ - dz * i;
-			//64
-			for (UINT j = 0; j < waterWidth; ++j)
-			{
-				UINT index = waterWidth * i + j;
-				m_vertexItems["waterBottom"][index].Pos.x = oX + dx * (j + offsetX);
-				m_vertexItems["waterBottom"][index].Pos.y = m_heightInfos[m_verticesPerRow*i + (j + offsetX)];
-				m_vertexItems["waterBottom"][index].Pos.z = tempZ;
-				m_vertexItems["waterBottom"][index].TexC = XMFLOAT2(dx*i, dx*j);
-				m_vertexItems["waterBottom"][index].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-				m_vertexItems["waterBottom"][index].Normal = XMFLOAT3(0.f, 0.f, 0.f);
-			}
-		}
-		//waterBottom
-		m_indexItems["waterBottom"].resize(6 * (waterWidth - 1)*(waterHeight - 1));
-		UINT tmp = 0;
-		for (UINT i = 0; i < waterHeight - 1; ++i)
-		{
-			for (UINT j = 0; j < waterWidth - 1; ++j)
-			{
-				m_indexItems["waterBottom"][tmp] = i * waterWidth + j;
-				m_indexItems["waterBottom"][tmp + 1] = i * waterWidth + j + 1;
-				m_indexItems["waterBottom"][tmp + 2] = (i + 1) * waterWidth + j;
-				//㷨
-				XMFLOAT3 temp;
-				ComputeNomal(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp]],
-					m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 1]],
-					m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 2]], temp);
-				XMFloat3Add(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp]].Normal, temp);
-				XMFloat3Add(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 1]].Normal, temp);
-				XMFloat3Add(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 2]].Normal, temp);
-
-
-				m_indexItems["waterBottom"][tmp + 3] = i * waterWidth + j + 1;
-				m_indexItems["waterBottom"][tmp + 4] = (i + 1) * waterWidth + j + 1;
-				m_indexItems["waterBottom"][tmp + 5] = (i + 1) * waterWidth + j;
-				ComputeNomal(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 3]],
-					m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 4]],
-					m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 5]], temp);
-				XMFloat3Add(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 3]].Normal, temp);
-				XMFloat3Add(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 4]].Normal, temp);
-				XMFloat3Add(m_vertexItems["waterBottom"][m_indexItems["waterBottom"][tmp + 5]].Normal, temp);
-
-				tmp += 6;
-			}
-		}
-
-		//һз
-		for (int i = 0; i < m_vertexItems["waterBottom"].size(); ++i)
-		{
-			XMFloat3Normalize(m_vertexItems["waterBottom"][i].Normal);
-			CalcTangent(m_vertexItems["waterBottom"][i].TangentU, m_vertexItems["waterBottom"][i].Normal);
-		}
+		minY = std::min(minY, v.Pos.y);
+		maxY = std::max(maxY, v.Pos.y);
 	}
 
-	//road
-	{
-		//road waterΪΪߺұ
-		UINT roadWidth = 224;//ÿһ߿ȾΪ224
-		UINT roadHeight = 64;
-		m_vertexItems["road"].resize(2 * roadWidth * roadHeight);
-
-		//oZ = height*0.5,ҪΪ1/16*height,offsetZΪ-7/16*height;
-		float offsetZ = -7.f / 16.f*height;
-		UINT rightOffsetX = 288;
-		UINT offsetZ_PixelNum = 224;
-		//ȼ
-		for (UINT i = 0; i < roadHeight; ++i)
-		{
-			float tempZ = oZ - dz * i + offsetZ;
-			for (UINT j = 0; j < roadWidth; ++j)
-			{
-				UINT index = roadWidth * i + j;
-				m_vertexItems["road"][index].Pos.x = oX + dx * (j + rightOffsetX);
-				m_vertexItems["road"][index].Pos.y = m_heightInfos[m_verticesPerRow*(i + offsetZ_PixelNum) + j] + 0.1f;
-				m_vertexItems["road"][index].Pos.z = tempZ;
-				m_vertexItems["road"][index].TexC = XMFLOAT2(dx*i, dx*j);
-				m_vertexItems["road"][index].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-				m_vertexItems["road"][index].Normal = XMFLOAT3(0.f, 0.f, 0.f);
-			}
-		}
+	m_quantization.OriginX = -m_width * 0.5f;
+	m_quantization.OriginZ = m_height * 0.5f;
+	m_quantization.SpacingX = m_width / m_cellsPerRow;
+	m_quantization.SpacingZ = m_height / m_cellsPerCol;
+	m_quantization.HeightMin = minY;
+	m_quantization.HeightRange = std::max(maxY - minY, 1e-3f);
 
-		int startVertexIndex = roadWidth * (roadHeight - 1) + roadWidth + 1;
-		//ټұ
-		for (UINT i = 0; i < roadHeight; ++i)
-		{
-			float tempZ = oZ - dz * i + offsetZ;
-			for (UINT j = 0; j < roadWidth; ++j)
-			{
-				UINT index = startVertexIndex + roadWidth * i + j;
-				m_vertexItems["road"][index].Pos.x = oX + dx * j;
-				m_vertexItems["road"][index].Pos.y = m_heightInfos[m_verticesPerRow*(i + offsetZ_PixelNum) + j
-					+ rightOffsetX] + 0.1f;
-				m_vertexItems["road"][index].Pos.z = tempZ;
-				m_vertexItems["road"][index].TexC = XMFLOAT2(dx*i, dx*j);
-				m_vertexItems["road"][index].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-				m_vertexItems["road"][index].Normal = XMFLOAT3(0.f, 0.f, 0.f);
-			}
-		}
+	m_compactVertices.resize(m_vertices.size());
+	TaskScheduler::GetInstance()->ParallelForRange(0, (int)m_vertices.size(), 4096, [this](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+			m_compactVertices[i] = EncodeTerrainVertex(m_vertices[i], m_quantization);
+	});
 
+	std::vector<Vertex>().swap(m_vertices);
+}
 
-		//road 
-		m_indexItems["road"].resize(2 * 6 * (roadWidth - 1)*(roadHeight - 1));
-		UINT tmp = 0;
-		//
-		for (UINT i = 0; i < roadHeight - 1; ++i)
-		{
-			for (UINT j = 0; j < roadWidth - 1; ++j)
-			{
-				m_indexItems["road"][tmp] = i * roadWidth + j;
-				m_indexItems["road"][tmp + 1] = i * roadWidth + j + 1;
-				m_indexItems["road"][tmp + 2] = (i + 1) * roadWidth + j;
-				//㷨
-				XMFLOAT3 temp;
-				ComputeNomal(m_vertexItems["road"][m_indexItems["road"][tmp]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 1]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 2]], temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 1]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 2]].Normal, temp);
-
-
-				m_indexItems["road"][tmp + 3] = i * roadWidth + j + 1;
-				m_indexItems["road"][tmp + 4] = (i + 1) * roadWidth + j + 1;
-				m_indexItems["road"][tmp + 5] = (i + 1) * roadWidth + j;
-				ComputeNomal(m_vertexItems["road"][m_indexItems["road"][tmp + 3]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 4]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 5]], temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 3]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 4]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 5]].Normal, temp);
-
-				tmp += 6;
-			}
-		}
+//߶Ⱥ¶Ȩ.ˮ׿ʼ,ΰѵ桢ݵء·ԵĸǶ
+//Ĳ,Ȩ֮Ϊ1.
+//߶ȡm_heightfield;¶õķ߰зֶɸ߶,ֻһڴ
+void Terrain::BuildSplatMap()
+{
+	const int rows = m_verticesPerCol;
+	const int cols = m_verticesPerRow;
+	const float dx = m_width / m_cellsPerRow;
+	const float dz = m_height / m_cellsPerCol;
+	const float* heights = m_heightfield.Row(0);
+	//ÿԼ2^18,¸һ,ʹαϵķһͬ
+	const int bandRows = std::max(1, (1 << 18) / cols);
+	std::vector<Vertex> band;
+
+	m_splatMap.resize(m_numsVertices);
+	for (int bandFirst = 0; bandFirst < rows; bandFirst += bandRows)
+	{
+		const int bandLast = std::min(bandFirst + bandRows, rows);
+		const int windowFirst = std::max(bandFirst - 1, 0);
+		const int windowRows = std::min(bandLast + 1, rows) - windowFirst;
+		band.resize((size_t)windowRows * cols);
+		ComputeHeightfieldNormals(heights + (size_t)cols * windowFirst, cols, windowRows, cols, dx, dz, band.data());
 
-		int startIndex = roadWidth * (roadHeight - 1) + roadWidth + 1;
-		//ұ
-		for (UINT i = 0; i < roadHeight - 1; ++i)
+		TaskScheduler::GetInstance()->ParallelForRange(bandFirst * cols, bandLast * cols, 4096, [&](int first, int last)
 		{
-			for (UINT j = 0; j < roadWidth - 1; ++j)
+			for (int i = first; i < last; ++i)
 			{
-				m_indexItems["road"][tmp] = startIndex + i * roadWidth + j;
-				m_indexItems["road"][tmp + 1] = startIndex + i * roadWidth + j + 1;
-				m_indexItems["road"][tmp + 2] = startIndex + (i + 1) * roadWidth + j;
-				//㷨
-				XMFLOAT3 temp;
-				ComputeNomal(m_vertexItems["road"][m_indexItems["road"][tmp]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 1]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 2]], temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 1]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 2]].Normal, temp);
-
-
-				m_indexItems["road"][tmp + 3] = startIndex + i * roadWidth + j + 1;
-				m_indexItems["road"][tmp + 4] = startIndex + (i + 1) * roadWidth + j + 1;
-				m_indexItems["road"][tmp + 5] = startIndex + (i + 1) * roadWidth + j;
-				ComputeNomal(m_vertexItems["road"][m_indexItems["road"][tmp + 3]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 4]],
-					m_vertexItems["road"][m_indexItems["road"][tmp + 5]], temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 3]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 4]].Normal, temp);
-				XMFloat3Add(m_vertexItems["road"][m_indexItems["road"][tmp + 5]].Normal, temp);
-
-				tmp += 6;
+				const float h = heights[i];
+				float weights[SplatLayerCount] = {};
+				weights[SplatWaterBottom] = 1.f;
+
+				const float cover[SplatLayerCount] =
+				{
+					SmoothStep(m_waterHeight, m_groundHeight, h),
+					SmoothStep(m_grassHeight - m_layerBlend, m_grassHeight, h) *
+						SmoothStep(m_grassSlope - 0.05f, m_grassSlope + 0.05f, band[i - cols * windowFirst].Normal.y),
+					SmoothStep(m_roadHeight - m_layerBlend, m_roadHeight, h),
+					0.f,
+				};
+				for (int layer = SplatGround; layer <= SplatRoad; ++layer)
+				{
+					for (float& w : weights)
+						w *= 1.f - cover[layer];
+					weights[layer] += cover[layer];
+				}
+
+				//Ϊֽ,һ,ʹǡΪ255
+				int bytes[SplatLayerCount];
+				int sum = 0;
+				int largest = 0;
+				for (int layer = 0; layer < SplatLayerCount; ++layer)
+				{
+					bytes[layer] = (int)(weights[layer] * 255.f + 0.5f);
+					sum += bytes[layer];
+					if (bytes[layer] > bytes[largest])
+						largest = layer;
+				}
+				bytes[largest] += 255 - sum;
+
+				m_splatMap[i] = (std::uint32_t)bytes[0] | (std::uint32_t)bytes[1] << 8 |
+					(std::uint32_t)bytes[2] << 16 | (std::uint32_t)bytes[3] << 24;
 			}
-		}
-
-		//һз
-		for (int i = 0; i < m_vertexItems["road"].size(); ++i)
-		{
-			XMFloat3Normalize(m_vertexItems["road"][i].Normal);
-			CalcTangent(m_vertexItems["road"][i].TangentU, m_vertexItems["road"][i].Normal);
-		}
+		});
 	}
+}
 
-	return true;
-}
-
-bool Terrain::ReadRawFile(std::string filePath) 
+UINT Terrain::SelectChunks(const XMFLOAT3& eye, float pixelsPerUnit, float maxScreenError)
 {
-	std::ifstream inFile;
-	//Ʒʽļ
-	inFile.open(filePath.c_str(), std::ios::binary);
-	//ļָƶĩβ
-	inFile.seekg(0, std::ios::end);
-	//СΪǰС
-	std::vector<BYTE> inData(inFile.tellg());
-	//ļָƶͷ
-	inFile.seekg(std::ios::beg);
-	//ȡ߶Ϣ
-	inFile.read((char*)&inData[0], inData.size());
-	inFile.close();
-
-	m_heightInfos.resize(inData.size());
-	for (unsigned int i = 0; i < inData.size(); ++i)
+	m_chunks.clear();
+	m_selected.clear();
+	UINT triangles = m_tree.Select(eye, pixelsPerUnit, maxScreenError, m_selected);
+	for (const auto& selection : m_selected)
 	{
-		m_heightInfos[i] = inData[i];
+		const TerrainQuadtree::Node& node = m_tree.Nodes()[selection.Node];
+		SubmeshGeometry chunk;
+		chunk.IndexCount = selection.IndexCount;
+		chunk.StartIndexLocation = selection.StartIndex;
+		chunk.BaseVertexLocation = selection.BaseVertex;
+		BoundingBox::CreateFromPoints(chunk.Bounds, XMLoadFloat3(&node.BoundsMin), XMLoadFloat3(&node.BoundsMax));
+		m_chunks.push_back(chunk);
 	}
+	return triangles;
+}
 
-	return true;
+const std::vector<SubmeshGeometry>& Terrain::Chunks()const
+{
+	return m_chunks;
 }
 
-void Terrain::ComputeNomal(Vertex& v1, Vertex& v2, Vertex& v3, DirectX::XMFLOAT3& normal) 
+bool Terrain::IsLoaded()const
 {
-	XMFLOAT3 f1(v2.Pos.x - v1.Pos.x, v2.Pos.y - v1.Pos.y, v2.Pos.z - v1.Pos.z);
-	XMFLOAT3 f2(v3.Pos.x - v1.Pos.x, v3.Pos.y - v1.Pos.y, v3.Pos.z - v1.Pos.z);
-	XMVECTOR vec1 = XMLoadFloat3(&f1);
-	XMVECTOR vec2 = XMLoadFloat3(&f2);
-	XMVECTOR temp = XMVector3Normalize(XMVector3Cross(vec1, vec2));
-	XMStoreFloat3(&normal, temp);
+	return m_loaded;
 }
 
-//dst += vec3
-void Terrain::XMFloat3Add(DirectX::XMFLOAT3& dst, DirectX::XMFLOAT3& vec3)
+TerrainVertexFormat Terrain::VertexFormat()const
 {
-	XMVECTOR v1 = XMLoadFloat3(&dst);
-	XMVECTOR v2 = XMLoadFloat3(&vec3);
-	v1 += v2;
-	XMStoreFloat3(&dst, v1);
+	return m_vertexFormat;
 }
 
-//һXMFloat3
-void Terrain::XMFloat3Normalize(DirectX::XMFLOAT3& vec3)
+const TerrainVertexQuantization& Terrain::Quantization()const
 {
-	XMVECTOR v = XMLoadFloat3(&vec3);
-	XMVECTOR temp = XMVector3Normalize(v);
-	XMStoreFloat3(&vec3, temp);
+	return m_quantization;
 }
 
-//
-void Terrain::CalcTangent(DirectX::XMFLOAT3& tangent, DirectX::XMFLOAT3& normal)
+void Terrain::SetLayerHeights(float water, float ground, float grass, float road)
 {
-	XMFLOAT3 up(0.f, 1.f, 0.f);
-	XMVECTOR vecUp = XMLoadFloat3(&up);
-	XMVECTOR vecNor = XMLoadFloat3(&normal);
-	XMVECTOR vecTan = XMVector3Cross(vecNor, vecUp);
-	XMVECTOR temp = XMVector3Normalize(vecTan);
-	XMStoreFloat3(&tangent, temp);
-	//tangentΪ0.f,0.f,0.fΪ1.f,0.f,0.f;
-	if (tangent.x == 0.f && tangent.y == 0.f && tangent.z == 0.f)
-	{
-		tangent = XMFLOAT3(1.f, 0.f, 0.f);
-	}	
-}
\ No newline at end of file
+	m_waterHeight = water;
+	m_groundHeight = ground;
+	m_grassHeight = grass;
+	m_roadHeight = road;
+	if (m_loaded)
+		BuildSplatMap();
+}
+
+float Terrain::WaterHeight()const
+{
+	return m_waterHeight;
+}
+
+const std::vector<std::uint32_t>& Terrain::SplatMap()const
+{
+	return m_splatMap;
+}
+
+UINT Terrain::SplatMapWidth()const
+{
+	return m_verticesPerRow;
+}
+
+UINT Terrain::SplatMapHeight()const
+{
+	return m_verticesPerCol;
+}
+
+//Ϊ(*dx, *dx),uvΪ((+0.5)/, (+0.5)/)
+XMFLOAT4X4 Terrain::SplatTransform()const
+{
+	const float dx = m_width / m_cellsPerRow;
+	XMFLOAT4X4 transform;
+	XMStoreFloat4x4(&transform, XMMatrixSet(
+		0.f, 1.f / (dx * m_verticesPerCol), 0.f, 0.f,
+		1.f / (dx * m_verticesPerRow), 0.f, 0.f, 0.f,
+		0.f, 0.f, 1.f, 0.f,
+		0.5f / m_verticesPerRow, 0.5f / m_verticesPerCol, 0.f, 1.f));
+	return transform;
+}
+
+float Terrain::SampleHeight(float x, float z)const
+{
+	return m_heightfield.SampleHeight(x, z);
+}
+
+XMFLOAT3 Terrain::SampleNormal(float x, float z)const
+{
+	return m_heightfield.SampleNormal(x, z);
+}
+
+void Terrain::SampleHeights(const XMFLOAT2* positions, float* heights, std::size_t count)const
+{
+	m_heightfield.SampleHeights(positions, heights, count);
+}
+
+bool Terrain::Raycast(const TerrainHeightfield::Ray& ray, TerrainHeightfield::RayHit& hit)const
+{
+	return m_heightfield.Raycast(ray, hit);
+}
+
+const TerrainHeightfield& Terrain::Heightfield()const
+{
+	return m_heightfield;
+}
@@ -1,28 +1,79 @@
 #pragma once
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <DirectXMath.h>
 #include "Common\d3dUtil.h"
 #include "Common\MathHelper.h"
 #include "FrameResource.h"
+#include "HeightmapSource.h"
+#include "NoiseHeightSource.h"
+#include "TerrainHeightfield.h"
+#include "TerrainQuadtree.h"
+#include "TerrainVertex.h"
 
 class Terrain
 {
 public:
-	Terrain(float width, float height, UINT m, UINT n, float scale);
+	//Ȩͼĸͨ,shaderвʲ˳һ
+	enum SplatLayer
+	{
+		SplatGround = 0,
+		SplatGrass,
+		SplatRoad,
+		SplatWaterBottom,
+		SplatLayerCount
+	};
+
+	//formatΪCompactʱֻ8ֽڵTerrainVertex
+	Terrain(float width, float height, UINT m, UINT n, float scale,
+		TerrainVertexFormat format = TerrainVertexFormat::Full);
+	//߶,߶ͼļ,ͬһӵõͬĵ
+	Terrain(float width, float height, UINT m, UINT n, float scale, const NoiseHeightSource::Desc& noise,
+		TerrainVertexFormat format = TerrainVertexFormat::Full);
 	Terrain(const Terrain& rhs) = delete;
 	Terrain& operator =(const Terrain& rhs) = delete;
 	~Terrain();
 
+	//߶ͼȡ͵ιǷɹ
+	bool IsLoaded()const;
+
+	//ĻѡҪĿ,eyeΪλ,pixelsPerUnitΪ1λ
+	//Ӧ,ӿڸ߶/(2*tan(fovY/2)).
+	UINT SelectChunks(const DirectX::XMFLOAT3& eye, float pixelsPerUnit, float maxScreenError);
+	//ϴSelectChunksѡĿ
+	const std::vector<SubmeshGeometry>& Chunks()const;
+
+	TerrainVertexFormat VertexFormat()const;
+	//CompactĽ,εӦΪLocalToWorld()
+	const TerrainVertexQuantization& Quantization()const;
+
+	//ʵĸ߶(),֮ɻȨͼ:
+	//waterΪˮ,waterground֮ˮ׹ɵ,grassϵƽΪݵ,roadΪ·
+	void SetLayerHeights(float water, float ground, float grass, float road);
+	float WaterHeight()const;
+
+	//ÿ߶ͼһRGBA8,ΪSplatLayerȨ,Ϊ255
+	const std::vector<std::uint32_t>& SplatMap()const;
+	UINT SplatMapWidth()const;
+	UINT SplatMapHeight()const;
+	//ѵε(,гԸ)任Ȩͼuv,
+	DirectX::XMFLOAT4X4 SplatTransform()const;
+
+	//ȫֱʵĵѯ,(x, z)Ϊ,ʱȡԵ
+	float SampleHeight(float x, float z)const;
+	DirectX::XMFLOAT3 SampleNormal(float x, float z)const;
+	void SampleHeights(const DirectX::XMFLOAT2* positions, float* heights, std::size_t count)const;
+	bool Raycast(const TerrainHeightfield::Ray& ray, TerrainHeightfield::RayHit& hit)const;
+	const TerrainHeightfield& Heightfield()const;
+
 private:
-	bool InitTerrain(float width, float height, UINT m, UINT n, float scale);
-	bool ReadRawFile(std::string filePath);										//Ӹ߶ͼȡ߶Ϣ
-	void ComputeNomal(Vertex& v1, Vertex& v2, Vertex& v3, DirectX::XMFLOAT3& normal);	//㷨
-	void XMFloat3Add(DirectX::XMFLOAT3& dst, DirectX::XMFLOAT3& vec3);
-	void XMFloat3Normalize(DirectX::XMFLOAT3& vec3);
-	void CalcTangent(DirectX::XMFLOAT3& tangent, DirectX::XMFLOAT3& normal);
+	bool InitTerrain(float width, float height, UINT m, UINT n, float scale);
+	void CompactVertices();
+	void BuildSplatMap();
 
 
-	std::vector<float>	m_heightInfos;		//߶ͼ߶Ϣ
+	std::unique_ptr<HeightSource> m_source;	//߶Դ:߶ͼļ,ȡ
 	int		m_cellsPerRow;					//ÿеԪ
 	int		m_cellsPerCol;					//ÿеԪ
 	int		m_verticesPerRow;				//ÿж
@@ -31,15 +82,30 @@ private:
 	float	m_width;						//ο
 	float	m_height;						//θ߶
 	float	m_heightScale;					//߶ϵ
+	bool	m_loaded = false;				//ɹ
+	TerrainVertexFormat m_vertexFormat;		//ʽ
+	TerrainVertexQuantization m_quantization;	//Compact
 
 	//ͬζӦĸ߶ȣԱ費ͬĲͼshaderȵ
-	float   m_waterHeight;
-	float	m_groundHeight;
-	float   m_roadHeight;
-	float   m_grassHeight;
-
-public:
-	std::unordered_map<std::string, std::vector<Vertex>>  m_vertexItems;	//ͬεĶ㼯
-	std::unordered_map<std::string, std::vector<UINT>> m_indexItems;		//ͬε
-};
+	//ĬֵӦterrain_ps2.raw:Ӵ8199,100,·101
+	float   m_waterHeight = 93.f;			//ˮ,ͬʱˮײ
+	float	m_groundHeight = 97.f;			//ȫסˮ׵ĸ߶
+	float   m_roadHeight = 100.5f;
+	float   m_grassHeight = 99.5f;
+	float	m_layerBlend = 0.5f;			//ݵغ·߶ôߵķΧڹ
+	float	m_grassSlope = 0.9f;			//yСڴֵ¶
+
+	std::vector<std::uint32_t> m_splatMap;	//Ȩͼ
 
+	TerrainQuadtree m_tree;					//һĲ
+	std::vector<SubmeshGeometry> m_chunks;	//ǰѡеĿ
+	TerrainHeightfield m_heightfield;		//߶Ȳѯ,ҲǻȨͼΨһĸ߶Դ
+	std::vector<TerrainQuadtree::Selection> m_selected;	//SelectChunksʱ
+
+public:
+	//ĲڵĶ,m_vertexFormatֻһΪ
+	std::vector<Vertex> m_vertices;
+	std::vector<TerrainVertex> m_compactVertices;
+	//鹲õ16λģ,ڸBaseVertexLocation
+	TerrainIndexTemplates m_indexTemplates;
+};
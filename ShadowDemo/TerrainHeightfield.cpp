@@ -0,0 +1,460 @@
+#include "TerrainHeightfield.h"
+#include "Common/TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+//Same kernel selection as HeightfieldNormals: 8 positions at a time with AVX2 and its
+//gathers, 4 with SSE2 and scalar loads, the scalar loop otherwise.
+#if !defined(_XM_NO_INTRINSICS_) && defined(__AVX2__)
+#define TERRAIN_HEIGHTFIELD_AVX2
+#include <immintrin.h>
+#elif !defined(_XM_NO_INTRINSICS_) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TERRAIN_HEIGHTFIELD_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	//Clips [tEnter, tExit] to the part of the ray inside lo <= o + d * t <= hi.
+	inline bool ClipSlab(float o, float d, float lo, float hi, float& tEnter, float& tExit)
+	{
+		if (d == 0.f)
+			return o >= lo && o <= hi;
+
+		float t0 = (lo - o) / d;
+		float t1 = (hi - o) / d;
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tEnter = std::max(tEnter, t0);
+		tExit = std::min(tExit, t1);
+		return tEnter <= tExit;
+	}
+
+	//A pyramid cell still to visit and the part of the ray over it.
+	struct Visit
+	{
+		int Level;
+		int Row;
+		int Col;
+		float TEnter;
+		float TExit;
+	};
+}
+
+bool TerrainHeightfield::Build(const float* heights, int rows, int cols, std::size_t stride,
+	float originX, float originZ, float spacingX, float spacingZ)
+{
+	m_heights.clear();
+	m_levels.clear();
+	m_rows = m_cols = 0;
+	if (rows < 2 || cols < 2)
+		return false;
+
+	m_rows = rows;
+	m_cols = cols;
+	m_originX = originX;
+	m_originZ = originZ;
+	m_spacingX = spacingX;
+	m_spacingZ = spacingZ;
+
+	m_heights.resize((std::size_t)rows * cols);
+	for (int i = 0; i < rows; ++i)
+		std::copy(heights + stride * i, heights + stride * i + cols, &m_heights[(std::size_t)cols * i]);
+
+	//level 0 from the corners of every cell, each level above from up to 4 below
+	Level level;
+	level.Rows = rows - 1;
+	level.Cols = cols - 1;
+	level.Ranges.resize((std::size_t)level.Rows * level.Cols);
+	for (int i = 0; i < level.Rows; ++i)
+	{
+		const float* top = &m_heights[(std::size_t)cols * i];
+		const float* bottom = top + cols;
+		HeightRange* ranges = &level.Ranges[(std::size_t)level.Cols * i];
+		for (int j = 0; j < level.Cols; ++j)
+		{
+			ranges[j].Min = std::min(std::min(top[j], top[j + 1]), std::min(bottom[j], bottom[j + 1]));
+			ranges[j].Max = std::max(std::max(top[j], top[j + 1]), std::max(bottom[j], bottom[j + 1]));
+		}
+	}
+	m_levels.push_back(std::move(level));
+
+	while (m_levels.back().Rows > 1 || m_levels.back().Cols > 1)
+	{
+		const Level& below = m_levels.back();
+		Level above;
+		above.Rows = (below.Rows + 1) / 2;
+		above.Cols = (below.Cols + 1) / 2;
+		above.Ranges.resize((std::size_t)above.Rows * above.Cols);
+		for (int i = 0; i < above.Rows; ++i)
+		{
+			for (int j = 0; j < above.Cols; ++j)
+			{
+				HeightRange range = below.Ranges[(std::size_t)below.Cols * 2 * i + 2 * j];
+				for (int r = 2 * i; r < std::min(2 * i + 2, below.Rows); ++r)
+				{
+					for (int c = 2 * j; c < std::min(2 * j + 2, below.Cols); ++c)
+					{
+						const HeightRange& child = below.Ranges[(std::size_t)below.Cols * r + c];
+						range.Min = std::min(range.Min, child.Min);
+						range.Max = std::max(range.Max, child.Max);
+					}
+				}
+				above.Ranges[(std::size_t)above.Cols * i + j] = range;
+			}
+		}
+		m_levels.push_back(std::move(above));
+	}
+
+	return true;
+}
+
+bool TerrainHeightfield::IsEmpty()const
+{
+	return m_heights.empty();
+}
+
+int TerrainHeightfield::Rows()const
+{
+	return m_rows;
+}
+
+int TerrainHeightfield::Cols()const
+{
+	return m_cols;
+}
+
+float TerrainHeightfield::MinHeight()const
+{
+	return m_levels.empty() ? 0.f : m_levels.back().Ranges[0].Min;
+}
+
+float TerrainHeightfield::MaxHeight()const
+{
+	return m_levels.empty() ? 0.f : m_levels.back().Ranges[0].Max;
+}
+
+int TerrainHeightfield::Levels()const
+{
+	return (int)m_levels.size();
+}
+
+const float* TerrainHeightfield::Row(int row)const
+{
+	return &m_heights[(std::size_t)m_cols * row];
+}
+
+float TerrainHeightfield::Height(int row, int col)const
+{
+	return m_heights[(std::size_t)m_cols * row + col];
+}
+
+//gridX and gridZ are the column and row.  The cell is found by truncating the position
+//clamped to the last cell, the same way the SIMD kernels do it.
+float TerrainHeightfield::Bilinear(float gridX, float gridZ)const
+{
+	gridX = std::min(std::max(gridX, 0.f), (float)(m_cols - 1));
+	gridZ = std::min(std::max(gridZ, 0.f), (float)(m_rows - 1));
+	int col = (int)std::min(gridX, (float)(m_cols - 2));
+	int row = (int)std::min(gridZ, (float)(m_rows - 2));
+	float u = gridX - (float)col;
+	float v = gridZ - (float)row;
+
+	const float* top = &m_heights[(std::size_t)m_cols * row + col];
+	const float* bottom = top + m_cols;
+	float t = top[0] + (top[1] - top[0]) * u;
+	float b = bottom[0] + (bottom[1] - bottom[0]) * u;
+	return t + (b - t) * v;
+}
+
+float TerrainHeightfield::SampleHeight(float x, float z)const
+{
+	if (m_heights.empty())
+		return 0.f;
+
+	return Bilinear((x - m_originX) * (1.f / m_spacingX), (m_originZ - z) * (1.f / m_spacingZ));
+}
+
+XMFLOAT3 TerrainHeightfield::SampleNormal(float x, float z)const
+{
+	if (m_heights.empty())
+		return XMFLOAT3(0.f, 1.f, 0.f);
+
+	float gridX = std::min(std::max((x - m_originX) / m_spacingX, 0.f), (float)(m_cols - 1));
+	float gridZ = std::min(std::max((m_originZ - z) / m_spacingZ, 0.f), (float)(m_rows - 1));
+	int col = (int)std::min(gridX, (float)(m_cols - 2));
+	int row = (int)std::min(gridZ, (float)(m_rows - 2));
+	float u = gridX - (float)col;
+	float v = gridZ - (float)row;
+
+	const float* top = &m_heights[(std::size_t)m_cols * row + col];
+	const float* bottom = top + m_cols;
+	//z decreases down the rows
+	float dhdx = ((top[1] - top[0]) * (1.f - v) + (bottom[1] - bottom[0]) * v) / m_spacingX;
+	float dhdz = -((bottom[0] - top[0]) * (1.f - u) + (bottom[1] - top[1]) * u) / m_spacingZ;
+
+	float invLength = 1.f / sqrtf(dhdx * dhdx + 1.f + dhdz * dhdz);
+	return XMFLOAT3(-dhdx * invLength, invLength, -dhdz * invLength);
+}
+
+void TerrainHeightfield::SampleHeights(const XMFLOAT2* positions, float* heights, std::size_t count)const
+{
+	if (m_heights.empty())
+	{
+		std::fill(heights, heights + count, 0.f);
+		return;
+	}
+
+	const float invSpacingX = 1.f / m_spacingX;
+	const float invSpacingZ = 1.f / m_spacingZ;
+	std::size_t i = 0;
+
+#if defined(TERRAIN_HEIGHTFIELD_AVX2)
+	const __m256 vOriginX = _mm256_set1_ps(m_originX);
+	const __m256 vOriginZ = _mm256_set1_ps(m_originZ);
+	const __m256 vInvX = _mm256_set1_ps(invSpacingX);
+	const __m256 vInvZ = _mm256_set1_ps(invSpacingZ);
+	const __m256 vZero = _mm256_setzero_ps();
+	const __m256 vMaxX = _mm256_set1_ps((float)(m_cols - 1));
+	const __m256 vMaxZ = _mm256_set1_ps((float)(m_rows - 1));
+	const __m256 vLastCol = _mm256_set1_ps((float)(m_cols - 2));
+	const __m256 vLastRow = _mm256_set1_ps((float)(m_rows - 2));
+	const __m256i vCols = _mm256_set1_epi32(m_cols);
+	const float* h00 = m_heights.data();
+	const float* h10 = h00 + m_cols;
+	for (; i + 8 <= count; i += 8)
+	{
+		//x0 z0 .. x3 z3 and x4 z4 .. x7 z7 into x0 .. x7 and z0 .. z7
+		__m256 a = _mm256_loadu_ps(&positions[i].x);
+		__m256 b = _mm256_loadu_ps(&positions[i + 4].x);
+		__m256 xs = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+			_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+		__m256 zs = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+			_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+		__m256 gx = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(xs, vOriginX), vInvX), vZero), vMaxX);
+		__m256 gz = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(vOriginZ, zs), vInvZ), vZero), vMaxZ);
+		__m256i col = _mm256_cvttps_epi32(_mm256_min_ps(gx, vLastCol));
+		__m256i row = _mm256_cvttps_epi32(_mm256_min_ps(gz, vLastRow));
+		__m256 u = _mm256_sub_ps(gx, _mm256_cvtepi32_ps(col));
+		__m256 v = _mm256_sub_ps(gz, _mm256_cvtepi32_ps(row));
+
+		__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(row, vCols), col);
+		__m256 t0 = _mm256_i32gather_ps(h00, index, 4);
+		__m256 t1 = _mm256_i32gather_ps(h00 + 1, index, 4);
+		__m256 b0 = _mm256_i32gather_ps(h10, index, 4);
+		__m256 b1 = _mm256_i32gather_ps(h10 + 1, index, 4);
+
+		__m256 t = _mm256_add_ps(t0, _mm256_mul_ps(_mm256_sub_ps(t1, t0), u));
+		__m256 bt = _mm256_add_ps(b0, _mm256_mul_ps(_mm256_sub_ps(b1, b0), u));
+		_mm256_storeu_ps(heights + i, _mm256_add_ps(t, _mm256_mul_ps(_mm256_sub_ps(bt, t), v)));
+	}
+#elif defined(TERRAIN_HEIGHTFIELD_SSE)
+	const __m128 vOriginX = _mm_set1_ps(m_originX);
+	const __m128 vOriginZ = _mm_set1_ps(m_originZ);
+	const __m128 vInvX = _mm_set1_ps(invSpacingX);
+	const __m128 vInvZ = _mm_set1_ps(invSpacingZ);
+	const __m128 vZero = _mm_setzero_ps();
+	const __m128 vMaxX = _mm_set1_ps((float)(m_cols - 1));
+	const __m128 vMaxZ = _mm_set1_ps((float)(m_rows - 1));
+	const __m128 vLastCol = _mm_set1_ps((float)(m_cols - 2));
+	const __m128 vLastRow = _mm_set1_ps((float)(m_rows - 2));
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(&positions[i].x);
+		__m128 b = _mm_loadu_ps(&positions[i + 2].x);
+		__m128 xs = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 zs = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+		__m128 gx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(xs, vOriginX), vInvX), vZero), vMaxX);
+		__m128 gz = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(vOriginZ, zs), vInvZ), vZero), vMaxZ);
+		__m128i col = _mm_cvttps_epi32(_mm_min_ps(gx, vLastCol));
+		__m128i row = _mm_cvttps_epi32(_mm_min_ps(gz, vLastRow));
+		__m128 u = _mm_sub_ps(gx, _mm_cvtepi32_ps(col));
+		__m128 v = _mm_sub_ps(gz, _mm_cvtepi32_ps(row));
+
+		//SSE2 has no gather, the corners are loaded one by one
+		alignas(16) int cols[4];
+		alignas(16) int rows[4];
+		_mm_store_si128((__m128i*)cols, col);
+		_mm_store_si128((__m128i*)rows, row);
+		alignas(16) float corners[4][4];
+		for (int k = 0; k < 4; ++k)
+		{
+			const float* top = &m_heights[(std::size_t)m_cols * rows[k] + cols[k]];
+			corners[0][k] = top[0];
+			corners[1][k] = top[1];
+			corners[2][k] = top[m_cols];
+			corners[3][k] = top[m_cols + 1];
+		}
+		__m128 t0 = _mm_load_ps(corners[0]);
+		__m128 t1 = _mm_load_ps(corners[1]);
+		__m128 b0 = _mm_load_ps(corners[2]);
+		__m128 b1 = _mm_load_ps(corners[3]);
+
+		__m128 t = _mm_add_ps(t0, _mm_mul_ps(_mm_sub_ps(t1, t0), u));
+		__m128 bt = _mm_add_ps(b0, _mm_mul_ps(_mm_sub_ps(b1, b0), u));
+		_mm_storeu_ps(heights + i, _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(bt, t), v)));
+	}
+#endif
+	for (; i < count; ++i)
+		heights[i] = Bilinear((positions[i].x - m_originX) * invSpacingX, (m_originZ - positions[i].y) * invSpacingZ);
+}
+
+//origin and direction are in grid space: x in columns, y in world units, z in rows, per
+//world unit along the ray.  Along the ray the bilinear patch is a quadratic in t, so the
+//first crossing is the smallest root of y(t) - h(t) after tEnter.
+bool TerrainHeightfield::IntersectCell(int row, int col, const float origin[3], const float direction[3],
+	float tEnter, float tExit, float& t)const
+{
+	const float* top = &m_heights[(std::size_t)m_cols * row + col];
+	const float* bottom = top + m_cols;
+	float a = top[1] - top[0];
+	float b = bottom[0] - top[0];
+	float e = top[0] - top[1] - bottom[0] + bottom[1];
+
+	//measured from tEnter, s in [0, tExit - tEnter]
+	float u0 = origin[0] + direction[0] * tEnter - (float)col;
+	float v0 = origin[2] + direction[2] * tEnter - (float)row;
+	float du = direction[0];
+	float dv = direction[2];
+	float h0 = top[0] + a * u0 + b * v0 + e * u0 * v0;
+	float h1 = a * du + b * dv + e * (u0 * dv + v0 * du);
+	float h2 = e * du * dv;
+
+	float c0 = origin[1] + direction[1] * tEnter - h0;
+	if (c0 <= 0.f)
+	{
+		t = tEnter;
+		return true;
+	}
+
+	//-h2 s^2 + (dy - h1) s + c0 = 0, with the cancellation free pair of roots q / A and c0 / q
+	float qa = -h2;
+	float qb = direction[1] - h1;
+	float discriminant = qb * qb - 4.f * qa * c0;
+	if (discriminant < 0.f)
+		return false;
+
+	float q = -0.5f * (qb + (qb >= 0.f ? sqrtf(discriminant) : -sqrtf(discriminant)));
+	if (q == 0.f)
+		return false;
+
+	float length = tExit - tEnter;
+	float best = length + 1.f;
+	float roots[2] = { qa != 0.f ? q / qa : -1.f, c0 / q };
+	for (float s : roots)
+	{
+		if (s >= 0.f && s <= length)
+			best = std::min(best, s);
+	}
+	if (best > length)
+		return false;
+
+	t = tEnter + best;
+	return true;
+}
+
+//Descends the pyramid depth first, the children of a cell in the order the ray enters
+//them, so the first cell it hits holds the nearest hit.
+bool TerrainHeightfield::Raycast(const Ray& ray, RayHit& hit)const
+{
+	hit.Hit = false;
+	float length = sqrtf(ray.Direction.x * ray.Direction.x + ray.Direction.y * ray.Direction.y +
+		ray.Direction.z * ray.Direction.z);
+	if (m_levels.empty() || length == 0.f)
+		return false;
+
+	const XMFLOAT3 unit(ray.Direction.x / length, ray.Direction.y / length, ray.Direction.z / length);
+	const float origin[3] =
+	{
+		(ray.Origin.x - m_originX) / m_spacingX,
+		ray.Origin.y,
+		(m_originZ - ray.Origin.z) / m_spacingZ,
+	};
+	const float direction[3] = { unit.x / m_spacingX, unit.y, -unit.z / m_spacingZ };
+
+	//at most 4 cells per level are waiting at any time
+	Visit stack[4 * 32];
+	int size = 0;
+
+	Visit root = { (int)m_levels.size() - 1, 0, 0, 0.f, ray.MaxDistance };
+	const int cellRows = m_rows - 1;
+	const int cellCols = m_cols - 1;
+	if (ClipSlab(origin[0], direction[0], 0.f, (float)cellCols, root.TEnter, root.TExit) &&
+		ClipSlab(origin[2], direction[2], 0.f, (float)cellRows, root.TEnter, root.TExit))
+		stack[size++] = root;
+
+	while (size > 0)
+	{
+		Visit visit = stack[--size];
+		const Level& level = m_levels[visit.Level];
+		const HeightRange& range = level.Ranges[(std::size_t)level.Cols * visit.Row + visit.Col];
+		float y0 = origin[1] + direction[1] * visit.TEnter;
+		float y1 = origin[1] + direction[1] * visit.TExit;
+		//only cells the ray passes entirely above are skipped; below the ground counts as a hit
+		if (std::min(y0, y1) > range.Max)
+			continue;
+
+		if (visit.Level == 0)
+		{
+			float t;
+			if (IntersectCell(visit.Row, visit.Col, origin, direction, visit.TEnter, visit.TExit, t))
+			{
+				hit.Hit = true;
+				hit.Distance = t;
+				hit.Position = XMFLOAT3(ray.Origin.x + unit.x * t, ray.Origin.y + unit.y * t, ray.Origin.z + unit.z * t);
+				hit.Normal = SampleNormal(hit.Position.x, hit.Position.z);
+				return true;
+			}
+			continue;
+		}
+
+		//children in grid cells, clipped to the grid
+		const Level& below = m_levels[visit.Level - 1];
+		const int span = 1 << (visit.Level - 1);
+		Visit children[4];
+		int count = 0;
+		for (int r = 2 * visit.Row; r < std::min(2 * visit.Row + 2, below.Rows); ++r)
+		{
+			for (int c = 2 * visit.Col; c < std::min(2 * visit.Col + 2, below.Cols); ++c)
+			{
+				Visit child = { visit.Level - 1, r, c, visit.TEnter, visit.TExit };
+				if (ClipSlab(origin[0], direction[0], (float)(c * span), (float)std::min((c + 1) * span, cellCols),
+						child.TEnter, child.TExit) &&
+					ClipSlab(origin[2], direction[2], (float)(r * span), (float)std::min((r + 1) * span, cellRows),
+						child.TEnter, child.TExit))
+					children[count++] = child;
+			}
+		}
+
+		//farthest first onto the stack
+		for (int k = 1; k < count; ++k)
+		{
+			for (int m = k; m > 0 && children[m - 1].TEnter < children[m].TEnter; --m)
+				std::swap(children[m - 1], children[m]);
+		}
+		for (int k = 0; k < count; ++k)
+			stack[size++] = children[k];
+	}
+	return false;
+}
+
+int TerrainHeightfield::Raycast(const Ray* rays, RayHit* hits, int count, TaskScheduler* scheduler)const
+{
+	if (!scheduler)
+		scheduler = TaskScheduler::GetInstance();
+
+	scheduler->ParallelForRange(0, count, 64, [&](int first, int last)
+	{
+		for (int i = first; i < last; ++i)
+			Raycast(rays[i], hits[i]);
+	});
+
+	int hitCount = 0;
+	for (int i = 0; i < count; ++i)
+		hitCount += hits[i].Hit ? 1 : 0;
+	return hitCount;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <DirectXMath.h>
+
+class TaskScheduler;
+
+//Full resolution heights of a terrain for gameplay queries: ground height and normal at
+//a world position, batches of heights, and rays against the ground.
+//The grid is laid out like Terrain's: rows x cols heights, column j at
+//x = OriginX + SpacingX * j, row i at z = OriginZ - SpacingZ * i.  Between grid points the
+//surface is bilinear; positions outside the grid are clamped to its edge.
+//Rays descend a min/max pyramid over the cells, so they only visit the cells whose
+//height range they pass through.
+class TerrainHeightfield
+{
+public:
+	struct Ray
+	{
+		DirectX::XMFLOAT3 Origin;
+		DirectX::XMFLOAT3 Direction;	//need not be normalized
+		float MaxDistance;				//world units along Direction
+	};
+
+	struct RayHit
+	{
+		bool Hit;
+		float Distance;					//world units from Origin
+		DirectX::XMFLOAT3 Position;
+		DirectX::XMFLOAT3 Normal;
+	};
+
+	//Copies a rows x cols grid whose rows are stride floats apart, then builds the
+	//pyramid.  Fails for grids smaller than 2 x 2.
+	bool Build(const float* heights, int rows, int cols, std::size_t stride,
+		float originX, float originZ, float spacingX, float spacingZ);
+
+	bool IsEmpty()const;
+	int Rows()const;
+	int Cols()const;
+	float MinHeight()const;
+	float MaxHeight()const;
+	int Levels()const;
+
+	//The heights of one row, Cols() of them; the rows follow each other without gaps.
+	const float* Row(int row)const;
+
+	float SampleHeight(float x, float z)const;
+
+	//Normal of the bilinear surface SampleHeight describes, i.e. of what rays hit.
+	DirectX::XMFLOAT3 SampleNormal(float x, float z)const;
+
+	//SampleHeight of count (x, z) pairs, 8 or 4 at a time where AVX2 or SSE2 is there.
+	void SampleHeights(const DirectX::XMFLOAT2* positions, float* heights, std::size_t count)const;
+
+	//First point where the ray reaches the surface.  A ray that starts below the ground,
+	//or comes in through the side of the grid below it, hits where it enters the grid.
+	bool Raycast(const Ray& ray, RayHit& hit)const;
+
+	//Raycast of count rays, split over scheduler, the shared pool when it is null.
+	//Returns the number of hits.
+	int Raycast(const Ray* rays, RayHit* hits, int count, TaskScheduler* scheduler = nullptr)const;
+
+private:
+	struct HeightRange
+	{
+		float Min;
+		float Max;
+	};
+
+	//Cells of one pyramid level; cell (r, c) of level k covers grid cells
+	//[r << k, (r + 1) << k) x [c << k, (c + 1) << k).
+	struct Level
+	{
+		int Rows;
+		int Cols;
+		std::vector<HeightRange> Ranges;
+	};
+
+	float Height(int row, int col)const;
+	float Bilinear(float gridX, float gridZ)const;
+	bool IntersectCell(int row, int col, const float origin[3], const float direction[3],
+		float tEnter, float tExit, float& t)const;
+
+private:
+	std::vector<float> m_heights;
+	std::vector<Level> m_levels;	//[0] one entry per cell, the last a single cell
+	int m_rows = 0;
+	int m_cols = 0;
+	float m_originX = 0.f;
+	float m_originZ = 0.f;
+	float m_spacingX = 1.f;
+	float m_spacingZ = 1.f;
+};
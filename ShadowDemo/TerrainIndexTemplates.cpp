@@ -0,0 +1,186 @@
+#include "TerrainIndexTemplates.h"
+#include <algorithm>
+
+namespace
+{
+	//Triangulates the band between an edge of the chunk and the ring one row or column
+	//inside it, walking both along the edge.  outer(p) and inner(p) are the vertices at
+	//position p along the edge; the edge has n positions and the ring covers 1..n-2.
+	//Triangles come out like the grid's, (0,0)(0,1)(1,0) taken as (outer, outer, inner),
+	//or reversed when flip is set.
+	template<class Outer, class Inner>
+	void Zip(int n, int outerStep, Outer outer, Inner inner, bool flip, std::vector<std::uint32_t>& indices)
+	{
+		auto triangle = [&](std::uint32_t a, std::uint32_t b, std::uint32_t c)
+		{
+			indices.push_back(a);
+			indices.push_back(flip ? c : b);
+			indices.push_back(flip ? b : c);
+		};
+
+		int o = 0;
+		int i = 1;
+		while (o < n - 1 || i < n - 2)
+		{
+			int next = std::min(o + outerStep, n - 1);
+			if (o < n - 1 && (i == n - 2 || next <= i + 1))
+			{
+				triangle(outer(o), outer(next), inner(i));
+				o = next;
+			}
+			else
+			{
+				triangle(outer(o), inner(i + 1), inner(i));
+				++i;
+			}
+		}
+	}
+}
+
+int TerrainIndexTemplates::VertexCount(int rows, int cols)
+{
+	return rows * cols + 2 * (rows + cols);
+}
+
+TerrainIndexTemplates::Range TerrainIndexTemplates::Get(int rows, int cols, unsigned stitchMask)
+{
+	stitchMask = Normalize(rows, cols, stitchMask);
+	auto it = m_templates.find(MakeKey(rows, cols, stitchMask));
+	if (it != m_templates.end())
+		return it->second;
+
+	std::vector<std::uint32_t> indices;
+	Triangulate(rows, cols, stitchMask, indices);
+
+	Range range;
+	range.IndexCount = (std::uint32_t)indices.size();
+	range.Wide = VertexCount(rows, cols) > 65536;
+	if (range.Wide)
+	{
+		range.StartIndex = (std::uint32_t)m_indices32.size();
+		m_indices32.insert(m_indices32.end(), indices.begin(), indices.end());
+	}
+	else
+	{
+		range.StartIndex = (std::uint32_t)m_indices16.size();
+		m_indices16.insert(m_indices16.end(), indices.begin(), indices.end());
+	}
+
+	m_templates[MakeKey(rows, cols, stitchMask)] = range;
+	return range;
+}
+
+TerrainIndexTemplates::Range TerrainIndexTemplates::Find(int rows, int cols, unsigned stitchMask)const
+{
+	auto it = m_templates.find(MakeKey(rows, cols, Normalize(rows, cols, stitchMask)));
+	if (it != m_templates.end())
+		return it->second;
+
+	Range none = { 0, 0, false };
+	return none;
+}
+
+void TerrainIndexTemplates::Clear()
+{
+	m_templates.clear();
+	m_indices16.clear();
+	m_indices32.clear();
+}
+
+std::size_t TerrainIndexTemplates::Count()const
+{
+	return m_templates.size();
+}
+
+const std::vector<std::uint16_t>& TerrainIndexTemplates::Indices16()const
+{
+	return m_indices16;
+}
+
+const std::vector<std::uint32_t>& TerrainIndexTemplates::Indices32()const
+{
+	return m_indices32;
+}
+
+unsigned TerrainIndexTemplates::Normalize(int rows, int cols, unsigned stitchMask)
+{
+	return rows < 3 || cols < 3 ? 0 : stitchMask & (Top | Right | Bottom | Left);
+}
+
+std::uint64_t TerrainIndexTemplates::MakeKey(int rows, int cols, unsigned stitchMask)
+{
+	return (std::uint64_t)(std::uint32_t)rows << 36 | (std::uint64_t)(std::uint32_t)cols << 4 | stitchMask;
+}
+
+//The quads inside the ring one row and column in from the edges, then a band per edge,
+//then the skirt: a quad below every edge segment, facing out of the chunk.
+void TerrainIndexTemplates::Triangulate(int rows, int cols, unsigned stitchMask, std::vector<std::uint32_t>& indices)
+{
+	const std::uint32_t nc = cols;
+	auto quads = [&](int row0, int row1, int col0, int col1)
+	{
+		for (int i = row0; i < row1; ++i)
+		{
+			for (int j = col0; j < col1; ++j)
+			{
+				std::uint32_t a = i * nc + j;
+				std::uint32_t b = a + nc;
+				std::uint32_t quad[6] = { a, a + 1, b, a + 1, b + 1, b };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+	};
+
+	if (rows < 3 || cols < 3)
+	{
+		quads(0, rows - 1, 0, cols - 1);
+	}
+	else
+	{
+		quads(1, rows - 2, 1, cols - 2);
+
+		auto step = [&](Edge edge) { return stitchMask & edge ? 2 : 1; };
+		Zip(cols, step(Top),
+			[&](int p) { return (std::uint32_t)p; },
+			[&](int p) { return nc + p; }, false, indices);
+		Zip(cols, step(Bottom),
+			[&](int p) { return (rows - 1) * nc + p; },
+			[&](int p) { return (rows - 2) * nc + p; }, true, indices);
+		Zip(rows, step(Left),
+			[&](int p) { return p * nc; },
+			[&](int p) { return p * nc + 1; }, true, indices);
+		Zip(rows, step(Right),
+			[&](int p) { return p * nc + nc - 1; },
+			[&](int p) { return p * nc + nc - 2; }, false, indices);
+	}
+
+	//top edge faces +z, bottom -z, left -x, right +x
+	const std::uint32_t top = rows * nc;
+	const std::uint32_t bottom = top + nc;
+	const std::uint32_t left = bottom + nc;
+	const std::uint32_t right = left + rows;
+	for (int j = 0; j + 1 < cols; ++j)
+	{
+		std::uint32_t a = j;
+		std::uint32_t s = top + j;
+		std::uint32_t topQuad[6] = { a, s, a + 1, a + 1, s, s + 1 };
+		indices.insert(indices.end(), topQuad, topQuad + 6);
+
+		a = (rows - 1) * nc + j;
+		s = bottom + j;
+		std::uint32_t bottomQuad[6] = { a, a + 1, s, a + 1, s + 1, s };
+		indices.insert(indices.end(), bottomQuad, bottomQuad + 6);
+	}
+	for (int i = 0; i + 1 < rows; ++i)
+	{
+		std::uint32_t a = i * nc;
+		std::uint32_t s = left + i;
+		std::uint32_t leftQuad[6] = { a, a + nc, s, a + nc, s + 1, s };
+		indices.insert(indices.end(), leftQuad, leftQuad + 6);
+
+		a = i * nc + nc - 1;
+		s = right + i;
+		std::uint32_t rightQuad[6] = { a, s, a + nc, a + nc, s, s + 1 };
+		indices.insert(indices.end(), rightQuad, rightQuad + 6);
+	}
+}
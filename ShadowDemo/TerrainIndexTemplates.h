@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//Index lists shared by every terrain chunk of the same shape.
+//A chunk's vertices are a rows x cols grid stored row by row, followed by its skirt: the
+//top, bottom, left and right edge again (cols, cols, rows and rows vertices).  With that
+//layout the indices only depend on the grid size and on the edges stitched to a coarser
+//neighbour, so one list per (rows, cols, stitch mask) serves every chunk of every level,
+//each drawn with its own base vertex.
+//Lists of chunks with at most 65536 vertices are stored as 16-bit indices, the others as
+//32-bit indices.
+class TerrainIndexTemplates
+{
+public:
+	//Edges of a chunk.  A stitched edge skips every second vertex so that it matches a
+	//neighbour with half the resolution.
+	enum Edge : unsigned
+	{
+		Top = 1,		//first row
+		Right = 2,		//last column
+		Bottom = 4,		//last row
+		Left = 8,		//first column
+	};
+
+	struct Range
+	{
+		std::uint32_t StartIndex;	//into Indices16() or Indices32()
+		std::uint32_t IndexCount;
+		bool Wide;					//32-bit indices
+	};
+
+	//Vertices of a rows x cols chunk, skirt included.
+	static int VertexCount(int rows, int cols);
+
+	//The list for a rows x cols chunk, built on first use.  Chunks with fewer than 3 rows
+	//or columns have no inner ring to stitch against and always get the plain list.
+	Range Get(int rows, int cols, unsigned stitchMask);
+
+	//A list built before by Get; IndexCount is 0 if there is none.
+	Range Find(int rows, int cols, unsigned stitchMask)const;
+
+	void Clear();
+	std::size_t Count()const;
+	const std::vector<std::uint16_t>& Indices16()const;
+	const std::vector<std::uint32_t>& Indices32()const;
+
+private:
+	static unsigned Normalize(int rows, int cols, unsigned stitchMask);
+	static std::uint64_t MakeKey(int rows, int cols, unsigned stitchMask);
+	static void Triangulate(int rows, int cols, unsigned stitchMask, std::vector<std::uint32_t>& indices);
+
+private:
+	std::unordered_map<std::uint64_t, Range> m_templates;
+	std::vector<std::uint16_t> m_indices16;
+	std::vector<std::uint32_t> m_indices32;
+};
@@ -0,0 +1,357 @@
+#include "TerrainQuadtree.h"
+#include "Common/TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	//Number of vertices taken every step from first to last, last always included.
+	int SampleCount(int first, int last, int step)
+	{
+		return (last - first + step - 1) / step + 1;
+	}
+
+	int SampleAt(int first, int last, int step, int k)
+	{
+		return std::min(first + k * step, last);
+	}
+
+	//Squared distance from p to the box, 0 inside.
+	float DistanceSq(const XMFLOAT3& p, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)
+	{
+		float dx = std::max(std::max(boxMin.x - p.x, p.x - boxMax.x), 0.f);
+		float dy = std::max(std::max(boxMin.y - p.y, p.y - boxMax.y), 0.f);
+		float dz = std::max(std::max(boxMin.z - p.z, p.z - boxMax.z), 0.f);
+		return dx * dx + dy * dy + dz * dz;
+	}
+}
+
+const int TerrainQuadtree::ChunkCells;
+
+static_assert((TerrainQuadtree::ChunkCells + 1) * (TerrainQuadtree::ChunkCells + 1) + 4 * (TerrainQuadtree::ChunkCells + 1) <= 65536,
+	"chunk meshes must be drawable with 16-bit indices");
+
+void TerrainQuadtree::Build(const Vertex* grid, int rows, int cols, std::vector<Vertex>& vertices,
+	TerrainIndexTemplates& templates, TaskScheduler* scheduler)
+{
+	m_nodes.clear();
+	m_drawn.clear();
+	m_root = -1;
+	m_skirtDepth = 0.f;
+	m_templates = &templates;
+	if (rows < 2 || cols < 2)
+		return;
+
+	if (!scheduler)
+		scheduler = TaskScheduler::GetInstance();
+
+	m_grid = grid;
+	m_rows = rows;
+	m_cols = cols;
+
+	//enough levels for the root to cover every leaf
+	int leaves = std::max((rows - 2) / ChunkCells + 1, (cols - 2) / ChunkCells + 1);
+	int levels = 0;
+	while ((1 << levels) < leaves)
+		++levels;
+	m_root = AddNode(levels, 0, 0, nullptr);
+	m_drawn.assign(m_nodes.size(), 0);
+
+	//errors and bounds, each node against the full grid
+	scheduler->ParallelFor(0, (int)m_nodes.size(), 1, [this](int i)
+	{
+		MeasureNode(m_nodes[i]);
+	});
+
+	//children come after their parent, so walking backwards sees them first
+	for (int i = (int)m_nodes.size() - 1; i >= 0; --i)
+	{
+		Node& node = m_nodes[i];
+		for (int child : node.Children)
+		{
+			if (child < 0)
+				continue;
+			node.Error = std::max(node.Error, m_nodes[child].Error);
+		}
+	}
+
+	//Every mesh vertex is a grid vertex, so where a finer mesh meets a coarser one the
+	//gap is at most the coarser node's error.  A skirt as deep as the largest error
+	//closes any crack whatever the levels that end up side by side; the half cell
+	//covers rounding at T-junctions on flat ground.
+	float cell = fabsf(grid[1].Pos.x - grid[0].Pos.x);
+	m_skirtDepth = m_nodes[m_root].Error + 0.5f * cell;
+
+	//lay the meshes out one after the other, with every index list a node may be drawn with
+	size_t vertexCount = vertices.size();
+	for (Node& node : m_nodes)
+	{
+		node.BaseVertex = (std::int32_t)vertexCount;
+		vertexCount += TerrainIndexTemplates::VertexCount(node.Rows, node.Cols);
+
+		unsigned mask = node.StitchEdges;
+		do
+		{
+			templates.Get(node.Rows, node.Cols, mask);
+			mask = (mask - 1) & node.StitchEdges;
+		} while (mask != node.StitchEdges);
+	}
+	vertices.resize(vertexCount);
+
+	scheduler->ParallelFor(0, (int)m_nodes.size(), 1, [&](int i)
+	{
+		const Node& node = m_nodes[i];
+		WriteNode(node, &vertices[node.BaseVertex]);
+	});
+
+	m_grid = nullptr;
+}
+
+std::uint32_t TerrainQuadtree::Select(const XMFLOAT3& eye, float pixelsPerUnit, float maxScreenError,
+	std::vector<Selection>& selected)
+{
+	if (m_root < 0)
+		return 0;
+
+	//a node may be drawn once its error seen from distance d is below the bound:
+	//error * pixelsPerUnit / d <= maxScreenError
+	const float errorPerDistance = maxScreenError / pixelsPerUnit;
+	const size_t first = selected.size();
+
+	int stack[128];
+	int top = 0;
+	stack[top++] = m_root;
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const Node& node = m_nodes[index];
+		float allowed = errorPerDistance * sqrtf(DistanceSq(eye, node.BoundsMin, node.BoundsMax));
+		if (node.Level == 0 || node.Error <= allowed)
+		{
+			Selection selection;
+			selection.Node = index;
+			selected.push_back(selection);
+			m_drawn[index] = 1;
+			continue;
+		}
+
+		for (int child : node.Children)
+		{
+			if (child >= 0)
+				stack[top++] = child;
+		}
+	}
+
+	//stitch to the neighbours one level up, now that the whole cut is known
+	std::uint32_t triangles = 0;
+	for (size_t k = first; k < selected.size(); ++k)
+	{
+		Selection& selection = selected[k];
+		const Node& node = m_nodes[selection.Node];
+		const int across[4][2] =
+		{
+			{ node.Row0 - 1, node.Col0 },	//Top
+			{ node.Row0, node.Col1 },		//Right
+			{ node.Row1, node.Col0 },		//Bottom
+			{ node.Row0, node.Col0 - 1 },	//Left
+		};
+
+		selection.StitchMask = 0;
+		for (int edge = 0; edge < 4; ++edge)
+		{
+			unsigned bit = 1u << edge;
+			if ((node.StitchEdges & bit) && m_nodes[SelectedAt(across[edge][0], across[edge][1])].Level == node.Level + 1)
+				selection.StitchMask |= bit;
+		}
+
+		TerrainIndexTemplates::Range range = m_templates->Find(node.Rows, node.Cols, selection.StitchMask);
+		selection.IndexCount = range.IndexCount;
+		selection.StartIndex = range.StartIndex;
+		selection.BaseVertex = node.BaseVertex;
+		triangles += range.IndexCount / 3;
+	}
+
+	for (size_t k = first; k < selected.size(); ++k)
+		m_drawn[selected[k].Node] = 0;
+
+	return triangles;
+}
+
+const std::vector<TerrainQuadtree::Node>& TerrainQuadtree::Nodes()const
+{
+	return m_nodes;
+}
+
+int TerrainQuadtree::Root()const
+{
+	return m_root;
+}
+
+float TerrainQuadtree::SkirtDepth()const
+{
+	return m_skirtDepth;
+}
+
+//A neighbour coarser than a node can only lie across an edge the node shares with its
+//parent: inside the parent the neighbours are its siblings or their children.
+int TerrainQuadtree::AddNode(int level, int row0, int col0, const Node* parent)
+{
+	const int span = ChunkCells << level;
+	const int step = 1 << level;
+
+	Node node;
+	node.Level = level;
+	node.Row0 = row0;
+	node.Row1 = std::min(row0 + span, m_rows - 1);
+	node.Col0 = col0;
+	node.Col1 = std::min(col0 + span, m_cols - 1);
+	node.Error = 0.f;
+	node.Rows = SampleCount(node.Row0, node.Row1, step);
+	node.Cols = SampleCount(node.Col0, node.Col1, step);
+	node.BaseVertex = 0;
+	node.StitchEdges = 0;
+	if (parent)
+	{
+		if (node.Row0 == parent->Row0 && node.Row0 > 0)
+			node.StitchEdges |= TerrainIndexTemplates::Top;
+		if (node.Col1 == parent->Col1 && node.Col1 < m_cols - 1)
+			node.StitchEdges |= TerrainIndexTemplates::Right;
+		if (node.Row1 == parent->Row1 && node.Row1 < m_rows - 1)
+			node.StitchEdges |= TerrainIndexTemplates::Bottom;
+		if (node.Col0 == parent->Col0 && node.Col0 > 0)
+			node.StitchEdges |= TerrainIndexTemplates::Left;
+	}
+
+	int index = (int)m_nodes.size();
+	m_nodes.push_back(node);
+
+	const int half = span / 2;
+	for (int k = 0; k < 4; ++k)
+	{
+		int r = row0 + (k / 2) * half;
+		int c = col0 + (k % 2) * half;
+		int child = -1;
+		if (level > 0 && r < m_rows - 1 && c < m_cols - 1)
+			child = AddNode(level - 1, r, c, &m_nodes[index]);
+		m_nodes[index].Children[k] = child;
+	}
+
+	return index;
+}
+
+//Bounds of the covered vertices, and the largest distance in y between them and the
+//node's decimated mesh.  Coarse quads are split like the grid, (0,0)(0,1)(1,0) and
+//(0,1)(1,1)(1,0), except that the templates split the top left and bottom right corner
+//along (0,0)(1,1); both splits are measured there.
+void TerrainQuadtree::MeasureNode(Node& node)const
+{
+	const int step = 1 << node.Level;
+	const int nr = node.Rows;
+	const int nc = node.Cols;
+
+	float error = 0.f;
+	float minY = m_grid[node.Row0 * m_cols + node.Col0].Pos.y;
+	float maxY = minY;
+
+	for (int a = 0; a + 1 < nr; ++a)
+	{
+		const int r0 = SampleAt(node.Row0, node.Row1, step, a);
+		const int r1 = SampleAt(node.Row0, node.Row1, step, a + 1);
+		const Vertex* top = m_grid + r0 * m_cols;
+		const Vertex* bottom = m_grid + r1 * m_cols;
+		const float invRows = 1.f / (r1 - r0);
+
+		for (int r = r0; r <= r1; ++r)
+		{
+			const float v = (r - r0) * invRows;
+			const Vertex* row = m_grid + r * m_cols;
+			for (int b = 0; b + 1 < nc; ++b)
+			{
+				const int c0 = SampleAt(node.Col0, node.Col1, step, b);
+				const int c1 = SampleAt(node.Col0, node.Col1, step, b + 1);
+				const float h00 = top[c0].Pos.y;
+				const float h01 = top[c1].Pos.y;
+				const float h10 = bottom[c0].Pos.y;
+				const float h11 = bottom[c1].Pos.y;
+				const float invCols = 1.f / (c1 - c0);
+				const bool corner = (a == 0 && b == 0) || (a == nr - 2 && b == nc - 2);
+
+				for (int c = c0; c <= c1; ++c)
+				{
+					const float u = (c - c0) * invCols;
+					const float h = u + v <= 1.f ?
+						h00 + u * (h01 - h00) + v * (h10 - h00) :
+						h11 + (1.f - u) * (h10 - h11) + (1.f - v) * (h01 - h11);
+
+					const float y = row[c].Pos.y;
+					error = std::max(error, fabsf(y - h));
+					if (corner)
+					{
+						const float g = u >= v ?
+							h00 + u * (h01 - h00) + v * (h11 - h01) :
+							h00 + v * (h10 - h00) + u * (h11 - h10);
+						error = std::max(error, fabsf(y - g));
+					}
+					minY = std::min(minY, y);
+					maxY = std::max(maxY, y);
+				}
+			}
+		}
+	}
+
+	//x grows along the columns and z falls down the rows
+	const XMFLOAT3& first = m_grid[node.Row0 * m_cols + node.Col0].Pos;
+	const XMFLOAT3& last = m_grid[node.Row1 * m_cols + node.Col1].Pos;
+	node.Error = error;
+	node.BoundsMin = XMFLOAT3(std::min(first.x, last.x), minY, std::min(first.z, last.z));
+	node.BoundsMax = XMFLOAT3(std::max(first.x, last.x), maxY, std::max(first.z, last.z));
+}
+
+//The selected node covering cell (row, col), found by walking down from the root.
+int TerrainQuadtree::SelectedAt(int row, int col)const
+{
+	int index = m_root;
+	while (!m_drawn[index])
+	{
+		const Node& node = m_nodes[index];
+		const int half = (ChunkCells << node.Level) / 2;
+		int k = (row >= node.Row0 + half ? 2 : 0) + (col >= node.Col0 + half ? 1 : 0);
+		index = node.Children[k];
+	}
+	return index;
+}
+
+//The decimated grid, then the skirt: the vertices of the top, bottom, left and right
+//edge again, lowered by the skirt depth.
+void TerrainQuadtree::WriteNode(const Node& node, Vertex* vertices)const
+{
+	const int step = 1 << node.Level;
+	const int nr = node.Rows;
+	const int nc = node.Cols;
+
+	for (int i = 0; i < nr; ++i)
+	{
+		const Vertex* row = m_grid + SampleAt(node.Row0, node.Row1, step, i) * m_cols;
+		for (int j = 0; j < nc; ++j)
+			vertices[i * nc + j] = row[SampleAt(node.Col0, node.Col1, step, j)];
+	}
+
+	const int top = nr * nc;
+	const int bottom = top + nc;
+	const int left = bottom + nc;
+	const int right = left + nr;
+	for (int j = 0; j < nc; ++j)
+	{
+		vertices[top + j] = vertices[j];
+		vertices[bottom + j] = vertices[(nr - 1) * nc + j];
+	}
+	for (int i = 0; i < nr; ++i)
+	{
+		vertices[left + i] = vertices[i * nc];
+		vertices[right + i] = vertices[i * nc + nc - 1];
+	}
+	for (int k = top; k < right + nr; ++k)
+		vertices[k].Pos.y -= m_skirtDepth;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "TerrainIndexTemplates.h"
+#include "Vertex.h"
+
+class TaskScheduler;
+
+//Chunked level of detail for one grid of terrain vertices, after Ulrich, "Rendering
+//Massive Terrains using Chunked Level of Detail Control".
+//The grid is cut into leaf chunks of ChunkCells x ChunkCells cells and a quadtree is
+//built over them.  Every node owns a mesh of at most ChunkCells x ChunkCells cells taken
+//every 2^Level vertices, so a node at level k draws its area with 1/4^k of the triangles.
+//The nodes own their vertices; their indices come from shared TerrainIndexTemplates.
+//An edge against a neighbour one level coarser is stitched to it, and a skirt hangs down
+//around each mesh to hide the cracks that are left.
+class TerrainQuadtree
+{
+public:
+	static const int ChunkCells = 32;
+
+	//A node picked by Select and its draw arguments.  StartIndex and IndexCount are a
+	//range of TerrainIndexTemplates::Indices16().
+	struct Selection
+	{
+		int Node;
+		unsigned StitchMask;		//TerrainIndexTemplates::Edge bits
+		std::uint32_t IndexCount;
+		std::uint32_t StartIndex;
+		std::int32_t BaseVertex;
+	};
+
+	struct Node
+	{
+		int Level;						//0 for leaves, vertices are taken every 1 << Level
+		int Row0, Row1;					//grid rows covered, both inclusive
+		int Col0, Col1;					//grid columns covered, both inclusive
+		int Children[4];				//-1 where the quadrant is outside the grid
+		float Error;					//largest height error against the full grid, children included
+		DirectX::XMFLOAT3 BoundsMin;	//box around the full resolution vertices covered
+		DirectX::XMFLOAT3 BoundsMax;
+		int Rows, Cols;					//vertices of the node's mesh, skirt not included
+		std::int32_t BaseVertex;		//first vertex of the mesh
+		unsigned StitchEdges;			//edges that may meet a neighbour one level coarser
+	};
+
+	//Builds the tree over a rows x cols grid of finished vertices, stored row by row with
+	//rows running along -z and columns along +x, like Terrain's.  The node vertices
+	//are appended to vertices and the index lists they need are added to templates, which
+	//must outlive the tree.
+	void Build(const Vertex* grid, int rows, int cols, std::vector<Vertex>& vertices,
+		TerrainIndexTemplates& templates, TaskScheduler* scheduler = nullptr);
+
+	//Appends to selected the coarsest nodes whose height error, projected from eye, is at
+	//most maxScreenError pixels.  pixelsPerUnit is the projected size of a unit at unit
+	//distance, viewport height / (2 tan(fovY / 2)).  The selected nodes cover the grid
+	//exactly once.  Returns the number of triangles they draw.
+	std::uint32_t Select(const DirectX::XMFLOAT3& eye, float pixelsPerUnit, float maxScreenError,
+		std::vector<Selection>& selected);
+
+	const std::vector<Node>& Nodes()const;
+	int Root()const;
+	float SkirtDepth()const;
+
+private:
+	int AddNode(int level, int row0, int col0, const Node* parent);
+	void MeasureNode(Node& node)const;
+	void WriteNode(const Node& node, Vertex* vertices)const;
+	int SelectedAt(int row, int col)const;
+
+private:
+	const Vertex* m_grid = nullptr;		//only valid during Build
+	int m_rows = 0;
+	int m_cols = 0;
+	int m_root = -1;
+	float m_skirtDepth = 0.f;
+	std::vector<Node> m_nodes;			//parents before their children
+	const TerrainIndexTemplates* m_templates = nullptr;
+	std::vector<unsigned char> m_drawn;	//nodes picked by the running Select
+};
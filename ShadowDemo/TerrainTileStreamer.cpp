@@ -0,0 +1,315 @@
+#include "TerrainTileStreamer.h"
+#include "HeightfieldNormals.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+std::size_t TerrainTileStreamer::Tile::Bytes()const
+{
+	return sizeof(Tile) + Heights.capacity() * sizeof(float) + Vertices.capacity() * sizeof(Vertex);
+}
+
+TerrainTileStreamer::TerrainTileStreamer()
+{
+}
+
+//the loaders still reference this; running them out before anything else goes is simplest
+TerrainTileStreamer::~TerrainTileStreamer()
+{
+	m_loaders.reset();
+}
+
+bool TerrainTileStreamer::OpenTiled(const std::string& path, const Desc& desc)
+{
+	Close();
+	auto source = std::make_unique<HeightmapSource>();
+	return source->OpenTiled(path) && Start(std::move(source), desc);
+}
+
+bool TerrainTileStreamer::OpenRaw(const std::string& path, const HeightmapSource::RawDesc& raw, const Desc& desc)
+{
+	Close();
+	auto source = std::make_unique<HeightmapSource>();
+	return source->OpenRaw(path, raw) && Start(std::move(source), desc);
+}
+
+bool TerrainTileStreamer::OpenNoise(const NoiseHeightSource::Desc& noise, const Desc& desc)
+{
+	Close();
+	auto source = std::make_unique<NoiseHeightSource>();
+	return source->Open(noise) && Start(std::move(source), desc);
+}
+
+bool TerrainTileStreamer::Start(std::unique_ptr<HeightSource> source, const Desc& desc)
+{
+	if (desc.TileCells < 1 || source->Width() < 2 || source->Height() < 2)
+		return false;
+
+	m_source = std::move(source);
+	m_desc = desc;
+	m_tileRows = (m_source->Height() - 1 + desc.TileCells - 1) / desc.TileCells;
+	m_tileCols = (m_source->Width() - 1 + desc.TileCells - 1) / desc.TileCells;
+	m_frame = 0;
+	m_loadCount = 0;
+	m_evictionCount = 0;
+	if (!m_loaders || m_loaders->WorkerCount() != std::max(1, desc.LoaderThreads))
+		m_loaders = std::make_unique<TaskScheduler>(std::max(1, desc.LoaderThreads));
+	return true;
+}
+
+void TerrainTileStreamer::Close()
+{
+	WaitForLoads();
+	{
+		std::lock_guard<std::mutex> lock(m_finishedLock);
+		m_finished.clear();
+	}
+	m_loading.clear();
+	m_loadingBytes = 0;
+
+	for (auto& entry : m_resident)
+	{
+		if (m_evicted)
+			m_evicted(*entry.second.Data);
+	}
+	m_resident.clear();
+	m_residentBytes = 0;
+	m_tileRows = m_tileCols = 0;
+	m_source.reset();
+}
+
+void TerrainTileStreamer::SetReadyCallback(TileCallback callback)
+{
+	m_ready = std::move(callback);
+}
+
+void TerrainTileStreamer::SetEvictedCallback(TileCallback callback)
+{
+	m_evicted = std::move(callback);
+}
+
+void TerrainTileStreamer::Update(const XMFLOAT3& eye)
+{
+	if (!m_source)
+		return;
+
+	++m_frame;
+	Collect();
+
+	//tiles whose rectangle comes within LoadRadius of the eye, nearest first
+	struct Wanted
+	{
+		int TileRow;
+		int TileCol;
+		float Distance;
+	};
+	std::vector<Wanted> wanted;
+
+	const float tileSize = m_desc.Spacing * m_desc.TileCells;
+	const float eyeX = eye.x - m_desc.OriginX;
+	const float eyeZ = m_desc.OriginZ - eye.z;
+	auto clampTile = [](float t, int count) { return std::min(std::max((int)floorf(t), 0), count - 1); };
+	int row0 = clampTile((eyeZ - m_desc.LoadRadius) / tileSize, m_tileRows);
+	int row1 = clampTile((eyeZ + m_desc.LoadRadius) / tileSize, m_tileRows);
+	int col0 = clampTile((eyeX - m_desc.LoadRadius) / tileSize, m_tileCols);
+	int col1 = clampTile((eyeX + m_desc.LoadRadius) / tileSize, m_tileCols);
+	for (int r = row0; r <= row1; ++r)
+	{
+		for (int c = col0; c <= col1; ++c)
+		{
+			float dx = std::max(std::max(tileSize * c - eyeX, eyeX - tileSize * (c + 1)), 0.f);
+			float dz = std::max(std::max(tileSize * r - eyeZ, eyeZ - tileSize * (r + 1)), 0.f);
+			float distance = sqrtf(dx * dx + dz * dz);
+			if (distance <= m_desc.LoadRadius)
+				wanted.push_back(Wanted{ r, c, distance });
+		}
+	}
+	std::sort(wanted.begin(), wanted.end(), [](const Wanted& a, const Wanted& b) { return a.Distance < b.Distance; });
+
+	//mark everything wanted first, so that making room never evicts one of them
+	for (const Wanted& w : wanted)
+	{
+		auto it = m_resident.find(Key(w.TileRow, w.TileCol));
+		if (it != m_resident.end())
+			it->second.LastWanted = m_frame;
+	}
+
+	for (const Wanted& w : wanted)
+	{
+		std::uint64_t key = Key(w.TileRow, w.TileCol);
+		if (m_resident.count(key) || m_loading.count(key))
+			continue;
+		if ((int)m_loading.size() >= m_desc.MaxLoadsInFlight)
+			break;
+
+		std::size_t bytes = TileBytes(w.TileRow, w.TileCol);
+		if (!MakeRoom(bytes))
+			break;
+
+		m_loading[key] = bytes;
+		m_loadingBytes += bytes;
+		int tileRow = w.TileRow;
+		int tileCol = w.TileCol;
+		m_loaders->Run([this, tileRow, tileCol]()
+		{
+			std::unique_ptr<Tile> tile = Load(tileRow, tileCol);
+			//notified under the lock: once it is released this may be gone
+			std::lock_guard<std::mutex> lock(m_finishedLock);
+			m_finished.push_back(std::move(tile));
+			m_finishedSignal.notify_all();
+		});
+	}
+}
+
+void TerrainTileStreamer::WaitForLoads()
+{
+	std::unique_lock<std::mutex> lock(m_finishedLock);
+	m_finishedSignal.wait(lock, [this] { return m_finished.size() == m_loading.size(); });
+}
+
+//Moves finished tiles over to the resident set.
+void TerrainTileStreamer::Collect()
+{
+	std::vector<std::unique_ptr<Tile>> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_finishedLock);
+		finished.swap(m_finished);
+	}
+
+	for (auto& tile : finished)
+	{
+		std::uint64_t key = Key(tile->TileRow, tile->TileCol);
+		auto loading = m_loading.find(key);
+		m_loadingBytes -= loading->second;
+		m_loading.erase(loading);
+
+		m_residentBytes += tile->Bytes();
+		++m_loadCount;
+		Resident& resident = m_resident[key];
+		resident.Data = std::move(tile);
+		resident.LastWanted = m_frame;
+		if (m_ready)
+			m_ready(*resident.Data);
+	}
+}
+
+//Evicts tiles not wanted by this Update(), least recently wanted first, until bytes more fit.
+bool TerrainTileStreamer::MakeRoom(std::size_t bytes)
+{
+	while (m_residentBytes + m_loadingBytes + bytes > m_desc.MemoryBudget)
+	{
+		auto oldest = m_resident.end();
+		for (auto it = m_resident.begin(); it != m_resident.end(); ++it)
+		{
+			if (it->second.LastWanted < m_frame &&
+				(oldest == m_resident.end() || it->second.LastWanted < oldest->second.LastWanted))
+				oldest = it;
+		}
+		if (oldest == m_resident.end())
+			return false;
+
+		if (m_evicted)
+			m_evicted(*oldest->second.Data);
+		m_residentBytes -= oldest->second.Data->Bytes();
+		m_resident.erase(oldest);
+		++m_evictionCount;
+	}
+	return true;
+}
+
+std::uint64_t TerrainTileStreamer::Key(int tileRow, int tileCol)const
+{
+	return (std::uint64_t)(std::uint32_t)tileRow << 32 | (std::uint32_t)tileCol;
+}
+
+std::size_t TerrainTileStreamer::TileBytes(int tileRow, int tileCol)const
+{
+	std::size_t rows = std::min(m_desc.TileCells, m_source->Height() - 1 - tileRow * m_desc.TileCells) + 1;
+	std::size_t cols = std::min(m_desc.TileCells, m_source->Width() - 1 - tileCol * m_desc.TileCells) + 1;
+	return sizeof(Tile) + rows * cols * (sizeof(float) + sizeof(Vertex));
+}
+
+//Runs on a loader.  The normals are computed over the tile plus one sample around it,
+//where the map has one, so that they match the neighbouring tiles.
+std::unique_ptr<TerrainTileStreamer::Tile> TerrainTileStreamer::Load(int tileRow, int tileCol)const
+{
+	auto tile = std::make_unique<Tile>();
+	tile->TileRow = tileRow;
+	tile->TileCol = tileCol;
+	tile->Row = tileRow * m_desc.TileCells;
+	tile->Col = tileCol * m_desc.TileCells;
+	tile->Rows = std::min(m_desc.TileCells, m_source->Height() - 1 - tile->Row) + 1;
+	tile->Cols = std::min(m_desc.TileCells, m_source->Width() - 1 - tile->Col) + 1;
+
+	const int row0 = std::max(tile->Row - 1, 0);
+	const int col0 = std::max(tile->Col - 1, 0);
+	const int rows = std::min(tile->Row + tile->Rows, m_source->Height() - 1) - row0 + 1;
+	const int cols = std::min(tile->Col + tile->Cols, m_source->Width() - 1) - col0 + 1;
+	std::vector<float> window((std::size_t)rows * cols);
+	m_source->ReadWindow(row0, col0, rows, cols, window.data(), cols, m_desc.HeightScale);
+
+	std::vector<Vertex> apron((std::size_t)rows * cols);
+	ComputeHeightfieldNormals(window.data(), cols, rows, cols, m_desc.Spacing, m_desc.Spacing, apron.data(), m_loaders.get());
+
+	const float dx = m_desc.Spacing;
+	tile->Heights.resize((std::size_t)tile->Rows * tile->Cols);
+	tile->Vertices.resize((std::size_t)tile->Rows * tile->Cols);
+	for (int i = 0; i < tile->Rows; ++i)
+	{
+		const std::size_t src = (std::size_t)(tile->Row - row0 + i) * cols + (tile->Col - col0);
+		const int row = tile->Row + i;
+		for (int j = 0; j < tile->Cols; ++j)
+		{
+			const int col = tile->Col + j;
+			float h = window[src + j];
+			Vertex& v = tile->Vertices[(std::size_t)tile->Cols * i + j];
+			v = apron[src + j];
+			v.Pos = XMFLOAT3(m_desc.OriginX + dx * col, h, m_desc.OriginZ - dx * row);
+			v.TexC = XMFLOAT2(dx * row, dx * col);
+			tile->Heights[(std::size_t)tile->Cols * i + j] = h;
+		}
+	}
+	return tile;
+}
+
+const TerrainTileStreamer::Tile* TerrainTileStreamer::Find(int tileRow, int tileCol)const
+{
+	auto it = m_resident.find(Key(tileRow, tileCol));
+	return it != m_resident.end() ? it->second.Data.get() : nullptr;
+}
+
+int TerrainTileStreamer::TileRows()const
+{
+	return m_tileRows;
+}
+
+int TerrainTileStreamer::TileCols()const
+{
+	return m_tileCols;
+}
+
+std::size_t TerrainTileStreamer::ResidentBytes()const
+{
+	return m_residentBytes;
+}
+
+int TerrainTileStreamer::ResidentCount()const
+{
+	return (int)m_resident.size();
+}
+
+int TerrainTileStreamer::LoadsInFlight()const
+{
+	return (int)m_loading.size();
+}
+
+int TerrainTileStreamer::LoadCount()const
+{
+	return m_loadCount;
+}
+
+int TerrainTileStreamer::EvictionCount()const
+{
+	return m_evictionCount;
+}
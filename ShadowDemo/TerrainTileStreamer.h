@@ -0,0 +1,139 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <DirectXMath.h>
+#include "HeightmapSource.h"
+#include "NoiseHeightSource.h"
+#include "Vertex.h"
+#include "Common/TaskScheduler.h"
+
+//Keeps the part of a large heightmap around the camera in memory as square tiles.
+//The map is cut into tiles of TileCells x TileCells cells that share their border
+//samples.  Update() asks for the tiles within LoadRadius of the eye, nearest first; they
+//are decoded and given normals on loader threads, and handed over on the next Update()
+//through the ready callback.  Resident tiles are kept under MemoryBudget: when a load
+//needs room, the least recently wanted tiles go first, through the evicted callback.
+//Tiles wanted by the current Update() are never evicted, so a budget smaller than the
+//load radius needs leaves the farthest tiles out.
+//Opening the map only maps the file, or sets up the noise, so startup does not depend on
+//the size of the world.
+//Update(), the callbacks and Find() belong to one thread, normally the main thread.
+class TerrainTileStreamer
+{
+public:
+	struct Desc
+	{
+		int TileCells = 128;				//cells per tile side
+		float OriginX = 0.f;				//world position of sample (0, 0)
+		float OriginZ = 0.f;
+		float Spacing = 1.f;				//between samples, in x and -z
+		float HeightScale = 1.f;
+		float LoadRadius = 500.f;			//world units around the eye, in x and z
+		std::size_t MemoryBudget = 64 << 20;	//bytes of resident tiles
+		int MaxLoadsInFlight = 4;
+		int LoaderThreads = 2;
+	};
+
+	//One loaded tile.  Vertices are laid out like Terrain's, with normals that take the
+	//samples around the tile into account, so neighbouring tiles match at their borders.
+	struct Tile
+	{
+		int TileRow;
+		int TileCol;
+		int Row;							//first sample
+		int Col;
+		int Rows;							//samples
+		int Cols;
+		std::vector<float> Heights;			//Rows x Cols, scaled
+		std::vector<Vertex> Vertices;		//Rows x Cols
+
+		std::size_t Bytes()const;
+	};
+
+	typedef std::function<void(const Tile& tile)> TileCallback;
+
+	TerrainTileStreamer();
+	TerrainTileStreamer(const TerrainTileStreamer& rhs) = delete;
+	TerrainTileStreamer& operator=(const TerrainTileStreamer& rhs) = delete;
+	~TerrainTileStreamer();
+
+	//Maps a tiled or a RAW heightmap, or generates the heights from noise; fails when
+	//the source does, or for a map or a tile size smaller than one cell.
+	bool OpenTiled(const std::string& path, const Desc& desc);
+	bool OpenRaw(const std::string& path, const HeightmapSource::RawDesc& raw, const Desc& desc);
+	bool OpenNoise(const NoiseHeightSource::Desc& noise, const Desc& desc);
+
+	//Waits for the loads in flight, then evicts every tile.
+	void Close();
+
+	//Called from Update() for every tile that finished loading, and for every tile about
+	//to be freed.
+	void SetReadyCallback(TileCallback callback);
+	void SetEvictedCallback(TileCallback callback);
+
+	//Hands over finished tiles, then requests and evicts tiles for eye.
+	void Update(const DirectX::XMFLOAT3& eye);
+
+	//Blocks until the loads in flight have finished; they are handed over by the next
+	//Update().
+	void WaitForLoads();
+
+	//A resident tile, or null.
+	const Tile* Find(int tileRow, int tileCol)const;
+
+	int TileRows()const;
+	int TileCols()const;
+	std::size_t ResidentBytes()const;
+	int ResidentCount()const;
+	//Loads requested and not handed over yet.
+	int LoadsInFlight()const;
+
+	//Totals since Open.
+	int LoadCount()const;
+	int EvictionCount()const;
+
+private:
+	struct Resident
+	{
+		std::unique_ptr<Tile> Data;
+		std::uint64_t LastWanted;			//Update() that last wanted it
+	};
+
+	bool Start(std::unique_ptr<HeightSource> source, const Desc& desc);
+	std::uint64_t Key(int tileRow, int tileCol)const;
+	std::size_t TileBytes(int tileRow, int tileCol)const;
+	std::unique_ptr<Tile> Load(int tileRow, int tileCol)const;
+	void Collect();
+	bool MakeRoom(std::size_t bytes);
+
+private:
+	std::unique_ptr<HeightSource> m_source;
+	Desc m_desc;
+	int m_tileRows = 0;
+	int m_tileCols = 0;
+	std::unique_ptr<TaskScheduler> m_loaders;
+
+	TileCallback m_ready;
+	TileCallback m_evicted;
+
+	std::unordered_map<std::uint64_t, Resident> m_resident;
+	std::unordered_map<std::uint64_t, std::size_t> m_loading;	//bytes reserved per tile not handed over yet
+	std::size_t m_residentBytes = 0;
+	std::size_t m_loadingBytes = 0;
+	std::uint64_t m_frame = 0;
+	int m_loadCount = 0;
+	int m_evictionCount = 0;
+
+	//filled by the loaders, emptied by Update()
+	std::mutex m_finishedLock;
+	std::condition_variable m_finishedSignal;
+	std::vector<std::unique_ptr<Tile>> m_finished;
+};
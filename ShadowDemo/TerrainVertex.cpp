@@ -0,0 +1,114 @@
+#include "TerrainVertex.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	float SignNotZero(float v)
+	{
+		return v >= 0.f ? 1.f : -1.f;
+	}
+
+	std::int8_t ToSnorm8(float v)
+	{
+		return (std::int8_t)std::max(-127.f, std::min(127.f, v));
+	}
+
+	//Unnormalized decode, see DecodeOctahedral.
+	XMFLOAT3 Unfold(const std::int8_t encoded[2])
+	{
+		float u = encoded[0] / 127.f;
+		float v = encoded[1] / 127.f;
+		float y = 1.f - fabsf(u) - fabsf(v);
+		float t = std::max(-y, 0.f);
+		u += u >= 0.f ? -t : t;
+		v += v >= 0.f ? -t : t;
+		return XMFLOAT3(u, y, v);
+	}
+
+	//Rounds a value that is never negative.
+	std::uint16_t RoundToUint16(float v)
+	{
+		return (std::uint16_t)(v + 0.5f);
+	}
+}
+
+XMFLOAT4X4 TerrainVertexQuantization::LocalToWorld()const
+{
+	XMFLOAT4X4 world;
+	XMStoreFloat4x4(&world, XMMatrixScaling(SpacingX, HeightRange, -SpacingZ) *
+		XMMatrixTranslation(OriginX, HeightMin, OriginZ));
+	return world;
+}
+
+//Of the four codes around the exact one, keeps the one that decodes closest to n.
+void EncodeOctahedral(const XMFLOAT3& n, std::int8_t encoded[2])
+{
+	float s = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float u = s > 0.f ? n.x / s : 0.f;
+	float v = s > 0.f ? n.z / s : 0.f;
+	if (n.y < 0.f)
+	{
+		float fu = (1.f - fabsf(v)) * SignNotZero(u);
+		float fv = (1.f - fabsf(u)) * SignNotZero(v);
+		u = fu;
+		v = fv;
+	}
+
+	//compares cos^2 with its sign instead of normalizing every candidate
+	float best = -2.f;
+	for (int k = 0; k < 4; ++k)
+	{
+		std::int8_t code[2] =
+		{
+			ToSnorm8(floorf(u * 127.f) + (k & 1)),
+			ToSnorm8(floorf(v * 127.f) + (k >> 1)),
+		};
+		XMFLOAT3 d = Unfold(code);
+		float dot = d.x * n.x + d.y * n.y + d.z * n.z;
+		float score = dot * fabsf(dot) / (d.x * d.x + d.y * d.y + d.z * d.z);
+		if (score > best)
+		{
+			best = score;
+			encoded[0] = code[0];
+			encoded[1] = code[1];
+		}
+	}
+}
+
+XMFLOAT3 DecodeOctahedral(const std::int8_t encoded[2])
+{
+	XMFLOAT3 n = Unfold(encoded);
+	float invLength = 1.f / sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+	return XMFLOAT3(n.x * invLength, n.y * invLength, n.z * invLength);
+}
+
+TerrainVertex EncodeTerrainVertex(const Vertex& v, const TerrainVertexQuantization& q)
+{
+	float height = (v.Pos.y - q.HeightMin) / q.HeightRange;
+	height = std::max(0.f, std::min(1.f, height));
+
+	TerrainVertex t;
+	t.Col = RoundToUint16(std::max(0.f, (v.Pos.x - q.OriginX) / q.SpacingX));
+	t.Row = RoundToUint16(std::max(0.f, (q.OriginZ - v.Pos.z) / q.SpacingZ));
+	t.Height = RoundToUint16(height * 65535.f);
+	EncodeOctahedral(v.Normal, t.Normal);
+	return t;
+}
+
+//Texture coordinates are the heightmap position, (SpacingX * Row, SpacingX * Col), and the
+//tangent is N x up normalized, (1, 0, 0) for a level normal.
+Vertex DecodeTerrainVertex(const TerrainVertex& t, const TerrainVertexQuantization& q)
+{
+	Vertex v;
+	v.Pos = XMFLOAT3(q.OriginX + q.SpacingX * t.Col, q.HeightMin + q.HeightRange * (t.Height / 65535.f),
+		q.OriginZ - q.SpacingZ * t.Row);
+	v.Normal = DecodeOctahedral(t.Normal);
+	v.TexC = XMFLOAT2(q.SpacingX * t.Row, q.SpacingX * t.Col);
+
+	float length = sqrtf(v.Normal.x * v.Normal.x + v.Normal.z * v.Normal.z);
+	v.TangentU = length > 0.f ? XMFLOAT3(-v.Normal.z / length, 0.f, v.Normal.x / length) : XMFLOAT3(1.f, 0.f, 0.f);
+	return v;
+}
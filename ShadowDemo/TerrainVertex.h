@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <DirectXMath.h>
+#include "Vertex.h"
+
+//Which vertices Terrain builds.
+enum class TerrainVertexFormat
+{
+	Full,		//Vertex, 44 bytes
+	Compact,	//TerrainVertex, 8 bytes
+};
+
+//Terrain vertex with everything that follows from the grid left out.  x and z are the
+//heightmap column and row, the height is quantized over the terrain's range and the normal
+//is octahedral encoded.  The texture coordinates and the tangent are derived from those
+//the same way Terrain derives them for Vertex.  Decoded by Shaders/TerrainVertex.hlsl.
+struct TerrainVertex
+{
+	std::uint16_t Col;
+	std::uint16_t Row;
+	std::uint16_t Height;		//0..65535 over HeightMin..HeightMin + HeightRange
+	std::int8_t Normal[2];		//octahedral, snorm
+};
+
+static_assert(sizeof(TerrainVertex) == 8, "TerrainVertex must stay 8 bytes");
+
+//What turns a TerrainVertex back into world space: x = OriginX + SpacingX * Col,
+//z = OriginZ - SpacingZ * Row.
+struct TerrainVertexQuantization
+{
+	float OriginX = 0.f;
+	float OriginZ = 0.f;
+	float SpacingX = 1.f;
+	float SpacingZ = 1.f;
+	float HeightMin = 0.f;
+	float HeightRange = 1.f;
+
+	//World matrix taking (Col, Height / 65535, Row) to world space.  Normals are stored in
+	//world space and must not go through it.
+	DirectX::XMFLOAT4X4 LocalToWorld()const;
+};
+
+//Octahedral encoding of a unit vector around +y, so that the upper hemisphere, where nearly
+//all terrain normals are, gets the inner half of the square.
+void EncodeOctahedral(const DirectX::XMFLOAT3& n, std::int8_t encoded[2]);
+DirectX::XMFLOAT3 DecodeOctahedral(const std::int8_t encoded[2]);
+
+//Col and Row are rounded from the position, the height is clamped to the range.
+TerrainVertex EncodeTerrainVertex(const Vertex& v, const TerrainVertexQuantization& q);
+Vertex DecodeTerrainVertex(const TerrainVertex& v, const TerrainVertexQuantization& q);
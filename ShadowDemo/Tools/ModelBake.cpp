@@ -0,0 +1,62 @@
+//***************************************************************************************
+// ModelBake.cpp
+//
+// Offline baker for the model cache.  Imports every model given on the command line
+// with the same Assimp post-processing as the demo and writes its cache next to it
+// (ModelImporter::CachePath), so that the demo's first start skips the import as well.
+// Build it from this directory against the same Assimp as the demo, e.g.
+//
+//   cl /EHsc /O2 /I.. /I..\..\Assimp-3.1.1\include ModelBake.cpp ..\ModelImporter.cpp
+//      ..\ModelCache.cpp ..\MappedFile.cpp ..\ModelVertexStreams.cpp assimp.lib user32.lib
+//
+// Usage: ModelBake <model file> [<model file> ...]
+//
+// Run it from the demo's directory with the paths the demo loads, e.g.
+//
+//   ModelBake ..\Models\fox\file.fbx ..\Models\magician\file.fbx
+//
+// Caches are keyed by the full path of the model, so any working directory works as
+// long as the paths resolve to the same files.  A model whose file or post-processing
+// changes afterwards is imported again by the demo and its cache rewritten.
+//***************************************************************************************
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "ModelImporter.h"
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		printf("usage: ModelBake <model file> [<model file> ...]\n");
+		return 1;
+	}
+
+	int failed = 0;
+	for(int i = 1; i < argc; ++i)
+	{
+		const std::string path = argv[i];
+		auto start = std::chrono::steady_clock::now();
+
+		ModelImporter importer(path);
+		if(!importer.BakeModel(path))
+		{
+			printf("%s: failed\n", path.c_str());
+			++failed;
+			continue;
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		size_t vertices = 0;
+		size_t indices = 0;
+		for(const auto& mesh : importer.m_meshes)
+		{
+			vertices += mesh.vertices.size();
+			indices += mesh.indices.size();
+		}
+		printf("%s -> %s: %zu meshes, %zu vertices, %zu indices, %.1f ms\n", path.c_str(),
+			ModelImporter::CachePath(path).c_str(), importer.m_meshes.size(), vertices, indices, ms);
+	}
+	return failed ? 1 : 0;
+}
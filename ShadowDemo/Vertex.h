@@ -0,0 +1,13 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+//Kept free of D3D headers so CPU-only code (Waves, benchmarks) can use it.
+//ṹ
+struct Vertex
+{
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+	DirectX::XMFLOAT3 TangentU;
+};
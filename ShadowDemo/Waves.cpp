@@ -3,14 +3,294 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
+#include "Common/TaskScheduler.h"
 #include <algorithm>
 #include <vector>
+#include <cmath>
 #include <cassert>
+#include <cstring>
+
+// Pick the widest stencil kernel the target was compiled for.  AVX2 builds
+// (/arch:AVX2) process 8 columns per instruction, x64/SSE2 builds process 4,
+// and everything else falls back to the scalar loop.
+#if !defined(_XM_NO_INTRINSICS_) && defined(__AVX2__)
+#define WAVES_AVX2
+#include <immintrin.h>
+#elif !defined(_XM_NO_INTRINSICS_) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define WAVES_SSE
+#include <emmintrin.h>
+#endif
 
 using namespace DirectX;
+using namespace DirectX::PackedVector;
 
-Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
+namespace
+{
+	// Damped wave equation update for columns [j0, j1) of one row.  prev is
+	// overwritten in place with the next solution; up/curr/down are rows i-1,
+	// i and i+1 of the current solution.
+	void StepRow(float* prev, const float* up, const float* curr, const float* down,
+		int j0, int j1, float k1, float k2, float k3)
+	{
+		int j = j0;
+#if defined(WAVES_AVX2)
+		const __m256 vk1 = _mm256_set1_ps(k1);
+		const __m256 vk2 = _mm256_set1_ps(k2);
+		const __m256 vk3 = _mm256_set1_ps(k3);
+		for(; j + 8 <= j1; j += 8)
+		{
+			__m256 sum = _mm256_add_ps(
+				_mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j)),
+				_mm256_add_ps(_mm256_loadu_ps(curr + j + 1), _mm256_loadu_ps(curr + j - 1)));
+			__m256 r = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(vk1, _mm256_loadu_ps(prev + j)),
+				              _mm256_mul_ps(vk2, _mm256_loadu_ps(curr + j))),
+				_mm256_mul_ps(vk3, sum));
+			_mm256_storeu_ps(prev + j, r);
+		}
+#elif defined(WAVES_SSE)
+		const __m128 vk1 = _mm_set1_ps(k1);
+		const __m128 vk2 = _mm_set1_ps(k2);
+		const __m128 vk3 = _mm_set1_ps(k3);
+		for(; j + 4 <= j1; j += 4)
+		{
+			__m128 sum = _mm_add_ps(
+				_mm_add_ps(_mm_loadu_ps(up + j), _mm_loadu_ps(down + j)),
+				_mm_add_ps(_mm_loadu_ps(curr + j + 1), _mm_loadu_ps(curr + j - 1)));
+			__m128 r = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(vk1, _mm_loadu_ps(prev + j)),
+				           _mm_mul_ps(vk2, _mm_loadu_ps(curr + j))),
+				_mm_mul_ps(vk3, sum));
+			_mm_storeu_ps(prev + j, r);
+		}
+#endif
+		for(; j < j1; ++j)
+		{
+			prev[j] = k1*prev[j] + k2*curr[j] +
+				k3*(up[j] + down[j] + curr[j+1] + curr[j-1]);
+		}
+	}
+
+	// Finite difference normal and x-axis tangent for columns [j0, j1) of one
+	// row.  With l/r/t/b the neighbouring heights, the unnormalized vectors are
+	// n = (l - r, 2dx, b - t) and T = (2dx, r - l, 0).
+	void NormalRow(const float* up, const float* curr, const float* down,
+		float* nx, float* ny, float* nz, float* tx, float* ty,
+		int j0, int j1, float twoDx)
+	{
+		int j = j0;
+#if defined(WAVES_AVX2)
+		const __m256 vTwoDx = _mm256_set1_ps(twoDx);
+		const __m256 vTwoDxSq = _mm256_set1_ps(twoDx*twoDx);
+		const __m256 vOne = _mm256_set1_ps(1.0f);
+		for(; j + 8 <= j1; j += 8)
+		{
+			__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(curr + j - 1), _mm256_loadu_ps(curr + j + 1));
+			__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+			__m256 dxSq = _mm256_add_ps(_mm256_mul_ps(dx, dx), vTwoDxSq);
+			__m256 invN = _mm256_div_ps(vOne, _mm256_sqrt_ps(_mm256_add_ps(dxSq, _mm256_mul_ps(dz, dz))));
+			__m256 invT = _mm256_div_ps(vOne, _mm256_sqrt_ps(dxSq));
+			_mm256_storeu_ps(nx + j, _mm256_mul_ps(dx, invN));
+			_mm256_storeu_ps(ny + j, _mm256_mul_ps(vTwoDx, invN));
+			_mm256_storeu_ps(nz + j, _mm256_mul_ps(dz, invN));
+			_mm256_storeu_ps(tx + j, _mm256_mul_ps(vTwoDx, invT));
+			_mm256_storeu_ps(ty + j, _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), dx), invT));
+		}
+#elif defined(WAVES_SSE)
+		const __m128 vTwoDx = _mm_set1_ps(twoDx);
+		const __m128 vTwoDxSq = _mm_set1_ps(twoDx*twoDx);
+		const __m128 vOne = _mm_set1_ps(1.0f);
+		for(; j + 4 <= j1; j += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(curr + j - 1), _mm_loadu_ps(curr + j + 1));
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+			__m128 dxSq = _mm_add_ps(_mm_mul_ps(dx, dx), vTwoDxSq);
+			__m128 invN = _mm_div_ps(vOne, _mm_sqrt_ps(_mm_add_ps(dxSq, _mm_mul_ps(dz, dz))));
+			__m128 invT = _mm_div_ps(vOne, _mm_sqrt_ps(dxSq));
+			_mm_storeu_ps(nx + j, _mm_mul_ps(dx, invN));
+			_mm_storeu_ps(ny + j, _mm_mul_ps(vTwoDx, invN));
+			_mm_storeu_ps(nz + j, _mm_mul_ps(dz, invN));
+			_mm_storeu_ps(tx + j, _mm_mul_ps(vTwoDx, invT));
+			_mm_storeu_ps(ty + j, _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), dx), invT));
+		}
+#endif
+		for(; j < j1; ++j)
+		{
+			float dx = curr[j-1] - curr[j+1];
+			float dz = down[j] - up[j];
+			float dxSq = dx*dx + twoDx*twoDx;
+			float invN = 1.0f / sqrtf(dxSq + dz*dz);
+			float invT = 1.0f / sqrtf(dxSq);
+			nx[j] = dx*invN;
+			ny[j] = twoDx*invN;
+			nz[j] = dz*invN;
+			tx[j] = twoDx*invT;
+			ty[j] = -dx*invT;
+		}
+	}
+
+	//
+	// Height storage formats.  Rows are converted to float a chunk at a time,
+	// run through the float kernels above and converted back.
+	//
+
+	// Q3.12 fixed point.
+	const float FixedHeightScale = 4096.0f;
+
+	float DecodeHeight(float h)
+	{
+		return h;
+	}
+
+	float DecodeHeight(HALF h)
+	{
+		return XMConvertHalfToFloat(h);
+	}
+
+	float DecodeHeight(std::int16_t h)
+	{
+		return h*(1.0f / FixedHeightScale);
+	}
+
+	void DecodeHeights(const float* src, float* dst, int count)
+	{
+		memcpy(dst, src, count*sizeof(float));
+	}
+
+	void DecodeHeights(const HALF* src, float* dst, int count)
+	{
+		XMConvertHalfToFloatStream(dst, sizeof(float), src, sizeof(HALF), count);
+	}
+
+	void DecodeHeights(const std::int16_t* src, float* dst, int count)
+	{
+		int j = 0;
+#if defined(WAVES_AVX2) || defined(WAVES_SSE)
+		const __m128 vScale = _mm_set1_ps(1.0f / FixedHeightScale);
+		for(; j + 8 <= count; j += 8)
+		{
+			__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(h, h), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(h, h), 16);
+			_mm_storeu_ps(dst + j, _mm_mul_ps(_mm_cvtepi32_ps(lo), vScale));
+			_mm_storeu_ps(dst + j + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vScale));
+		}
+#endif
+		for(; j < count; ++j)
+			dst[j] = DecodeHeight(src[j]);
+	}
+
+	void EncodeHeights(const float* src, float* dst, int count)
+	{
+		memcpy(dst, src, count*sizeof(float));
+	}
+
+	void EncodeHeights(const float* src, HALF* dst, int count)
+	{
+		XMConvertFloatToHalfStream(dst, sizeof(HALF), src, sizeof(float), count);
+	}
+
+	// Rounds to nearest, halves to even, and saturates to the representable
+	// range.  Both paths round in the current rounding mode, round to nearest
+	// even by default: _mm_cvtps_epi32 by MXCSR, nearbyintf by the C runtime.
+	void EncodeHeights(const float* src, std::int16_t* dst, int count)
+	{
+		int j = 0;
+#if defined(WAVES_AVX2) || defined(WAVES_SSE)
+		const __m128 vScale = _mm_set1_ps(FixedHeightScale);
+		for(; j + 8 <= count; j += 8)
+		{
+			__m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + j), vScale));
+			__m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + j + 4), vScale));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), _mm_packs_epi32(lo, hi));
+		}
+#endif
+		for(; j < count; ++j)
+		{
+			float h = nearbyintf(src[j]*FixedHeightScale);
+			dst[j] = (std::int16_t)std::min(std::max(h, -32768.0f), 32767.0f);
+		}
+	}
+
+	template<typename Height>
+	void AddHeight(Height& h, float delta)
+	{
+		float sum = DecodeHeight(h) + delta;
+		EncodeHeights(&sum, &h, 1);
+	}
+
+	// Columns per conversion chunk; the float copies live on the stack.
+	const int HeightChunk = 256;
+
+	void StepRowT(float* prev, const float* up, const float* curr, const float* down,
+		int j0, int j1, float k1, float k2, float k3)
+	{
+		StepRow(prev, up, curr, down, j0, j1, k1, k2, k3);
+	}
+
+	template<typename Height>
+	void StepRowT(Height* prev, const Height* up, const Height* curr, const Height* down,
+		int j0, int j1, float k1, float k2, float k3)
+	{
+		float p[HeightChunk], u[HeightChunk], c[HeightChunk + 2], d[HeightChunk];
+		for(int c0 = j0; c0 < j1; c0 += HeightChunk)
+		{
+			int count = std::min(HeightChunk, j1 - c0);
+			DecodeHeights(prev + c0, p, count);
+			DecodeHeights(up + c0, u, count);
+			DecodeHeights(curr + c0 - 1, c, count + 2);
+			DecodeHeights(down + c0, d, count);
+			StepRow(p, u, c + 1, d, 0, count, k1, k2, k3);
+			EncodeHeights(p, prev + c0, count);
+		}
+	}
+
+	void NormalRowT(const float* up, const float* curr, const float* down,
+		float* nx, float* ny, float* nz, float* tx, float* ty,
+		int j0, int j1, float twoDx)
+	{
+		NormalRow(up, curr, down, nx, ny, nz, tx, ty, j0, j1, twoDx);
+	}
+
+	template<typename Height>
+	void NormalRowT(const Height* up, const Height* curr, const Height* down,
+		float* nx, float* ny, float* nz, float* tx, float* ty,
+		int j0, int j1, float twoDx)
+	{
+		float u[HeightChunk], c[HeightChunk + 2], d[HeightChunk];
+		for(int c0 = j0; c0 < j1; c0 += HeightChunk)
+		{
+			int count = std::min(HeightChunk, j1 - c0);
+			DecodeHeights(up + c0, u, count);
+			DecodeHeights(curr + c0 - 1, c, count + 2);
+			DecodeHeights(down + c0, d, count);
+			NormalRow(u, c + 1, d, nx + c0, ny + c0, nz + c0, tx + c0, ty + c0, 0, count, twoDx);
+		}
+	}
+
+	// Largest |h| over count heights.
+	template<typename Height>
+	float MaxAbsHeight(const Height* h, int count)
+	{
+		float maxAbs = 0.0f;
+		float f[HeightChunk];
+		for(int c0 = 0; c0 < count; c0 += HeightChunk)
+		{
+			int n = std::min(HeightChunk, count - c0);
+			DecodeHeights(h + c0, f, n);
+			for(int j = 0; j < n; ++j)
+				maxAbs = std::max(maxAbs, fabsf(f[j]));
+		}
+		return maxAbs;
+	}
+}
+
+template<typename Height> const int BasicWaves<Height>::MaxSplatRadius;
+template<typename Height> const int BasicWaves<Height>::TileSize;
+template<typename Height> const int BasicWaves<Height>::MaxBatchSteps;
+
+template<typename Height>
+BasicWaves<Height>::BasicWaves(int m, int n, float dx, float dt, float speed, float damping)
 {
     mNumRows = m;
     mNumCols = n;
@@ -27,134 +307,360 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    // The grid starts flat: zero height, normals pointing up and tangents
+    // along +x.  Positions are not stored; see Position().
+    mPrevSolution.assign(m*n, Height(0));
+    mCurrSolution.assign(m*n, Height(0));
 
-    // Generate grid vertices in system memory.
+    // Everything starts at rest.  Tiles are stamped with the current version so a
+    // fresh vertex buffer (version 0) receives the whole grid once.
+    mTileRows = (m + TileSize - 1) / TileSize;
+    mTileCols = (n + TileSize - 1) / TileSize;
+    mTileActive.assign(mTileRows*mTileCols, 0);
+    mTileVersion.assign(mTileRows*mTileCols, mVersion);
 
-    float halfWidth = (n - 1)*dx*0.5f;
-    float halfDepth = (m - 1)*dx*0.5f;
-    for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
+    // Row bands for the batched step: one per tile row, with a short last
+    // tile row merged into the band above it.
+    for(int i = 0; i + 2*TileSize <= m; i += TileSize)
+        mBands.push_back(i);
+    if(mBands.empty() || mBands.back() + TileSize < m)
+        mBands.push_back(mBands.empty() ? 0 : mBands.back() + TileSize);
+    mBands.push_back(m);
 
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+    SetScheduler(TaskScheduler::GetInstance());
 }
 
-Waves::~Waves()
+template<typename Height>
+BasicWaves<Height>::~BasicWaves()
 {
 }
 
-int Waves::RowCount()const
+template<typename Height>
+int BasicWaves<Height>::RowCount()const
 {
 	return mNumRows;
 }
 
-int Waves::ColumnCount()const
+template<typename Height>
+int BasicWaves<Height>::ColumnCount()const
 {
 	return mNumCols;
 }
 
-int Waves::VertexCount()const
+template<typename Height>
+int BasicWaves<Height>::VertexCount()const
 {
 	return mVertexCount;
 }
 
-int Waves::TriangleCount()const
+template<typename Height>
+int BasicWaves<Height>::TriangleCount()const
 {
 	return mTriangleCount;
 }
 
-float Waves::Width()const
+template<typename Height>
+float BasicWaves<Height>::Width()const
 {
 	return mNumCols*mSpatialStep;
 }
 
-float Waves::Depth()const
+template<typename Height>
+float BasicWaves<Height>::Depth()const
 {
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Update(float dt)
+template<typename Height>
+XMFLOAT3 BasicWaves<Height>::Position(int i)const
 {
-	static float t = 0;
+	int row = i / mNumCols;
+	int col = i - row*mNumCols;
+
+	float halfWidth = (mNumCols - 1)*mSpatialStep*0.5f;
+	float halfDepth = (mNumRows - 1)*mSpatialStep*0.5f;
+
+	return XMFLOAT3(-halfWidth + col*mSpatialStep, DecodeHeight(mCurrSolution[i]), halfDepth - row*mSpatialStep);
+}
 
+template<typename Height>
+void BasicWaves<Height>::Slopes(int i, float& dx, float& dz)const
+{
+	int row = i / mNumCols;
+	int col = i - row*mNumCols;
+
+	// The boundary is held flat.
+	dx = dz = 0.0f;
+	if(row == 0 || row == mNumRows - 1 || col == 0 || col == mNumCols - 1)
+		return;
+
+	dx = DecodeHeight(mCurrSolution[i - 1]) - DecodeHeight(mCurrSolution[i + 1]);
+	dz = DecodeHeight(mCurrSolution[i + mNumCols]) - DecodeHeight(mCurrSolution[i - mNumCols]);
+}
+
+template<typename Height>
+XMFLOAT3 BasicWaves<Height>::Normal(int i)const
+{
+	// Same finite differences as NormalRow.
+	float dx, dz;
+	Slopes(i, dx, dz);
+
+	float twoDx = 2.0f*mSpatialStep;
+	float invN = 1.0f / sqrtf(dx*dx + twoDx*twoDx + dz*dz);
+	return XMFLOAT3(dx*invN, twoDx*invN, dz*invN);
+}
+
+template<typename Height>
+XMFLOAT3 BasicWaves<Height>::TangentX(int i)const
+{
+	float dx, dz;
+	Slopes(i, dx, dz);
+
+	float twoDx = 2.0f*mSpatialStep;
+	float invT = 1.0f / sqrtf(dx*dx + twoDx*twoDx);
+	return XMFLOAT3(twoDx*invT, -dx*invT, 0.0f);
+}
+
+template<typename Height>
+void BasicWaves<Height>::SetScheduler(TaskScheduler* scheduler, int rowGrain)
+{
+	mScheduler = scheduler;
+
+	// Default to roughly 16K cells per task so small grids are not split
+	// into more tasks than they are worth.
+	if(rowGrain <= 0)
+		rowGrain = std::max(1, 16384 / std::max(1, mNumCols));
+	mRowGrain = rowGrain;
+
+	// Tile loops hand out about as many cells per task as the row loops.
+	mTileGrain = std::max(1, rowGrain*mNumCols / (TileSize*TileSize));
+}
+
+template<typename Height>
+void BasicWaves<Height>::SetRestThreshold(float threshold)
+{
+	mRestThreshold = threshold;
+}
+
+template<typename Height>
+void BasicWaves<Height>::TileBounds(int tile, int& i0, int& i1, int& j0, int& j1)const
+{
+	int tr = tile / mTileCols;
+	int tc = tile - tr*mTileCols;
+
+	i0 = tr*TileSize;
+	i1 = std::min(i0 + TileSize, mNumRows);
+	j0 = tc*TileSize;
+	j1 = std::min(j0 + TileSize, mNumCols);
+}
+
+template<typename Height>
+void BasicWaves<Height>::MarkActive(int i, int j)
+{
+	int tile = (i / TileSize)*mTileCols + j / TileSize;
+	mTileActive[tile] = 1;
+	mTileVersion[tile] = mVersion;
+}
+
+template<typename Height>
+void BasicWaves<Height>::SetMaxSubsteps(int maxSubsteps)
+{
+	mMaxSubsteps = maxSubsteps;
+}
+
+template<typename Height>
+float BasicWaves<Height>::InterpolationAlpha()const
+{
+	return mAccumulator / mTimeStep;
+}
+
+template<typename Height>
+void BasicWaves<Height>::Update(float dt)
+{
 	// Accumulate time.
-	t += dt;
+	mAccumulator += dt;
+
+	// Only update the simulation at the specified time step, as many times
+	// as the elapsed time covers.
+	int steps = (int)(mAccumulator / mTimeStep);
+	if(steps == 0)
+		return;
+
+	mAccumulator -= steps*mTimeStep;
+	if(mMaxSubsteps > 0 && steps > mMaxSubsteps)
+	{
+		// Too far behind (a hitch or a breakpoint): drop the backlog rather
+		// than making the next frames even longer.
+		steps = mMaxSubsteps;
+	}
+
+	Simulate(steps);
+}
+
+template<typename Height>
+void BasicWaves<Height>::Simulate(int steps)
+{
+	while(steps > 0)
+	{
+		int batch = std::min(steps, MaxBatchSteps);
+		Step(batch);
+		steps -= batch;
+	}
+}
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+template<typename Height>
+void BasicWaves<Height>::StepRows(int k, int i0, int i1)
+{
+	// Step k of a batch overwrites the buffer holding step k - 2 in place, so
+	// the two solution buffers simply take turns.
+	Height* next = (k & 1) ? mCurrSolution.data() : mPrevSolution.data();
+	const Height* curr = (k & 1) ? mPrevSolution.data() : mCurrSolution.data();
+
+	for(int i = i0; i < i1; ++i)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		int tr = i / TileSize;
+		const Height* row = curr + i*mNumCols;
+		for(int s = mSpanOffsets[tr]; s < mSpanOffsets[tr + 1]; ++s)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			StepRowT(next + i*mNumCols, row - mNumCols, row, row + mNumCols,
+				mSpans[2*s], mSpans[2*s + 1], mK1, mK2, mK3);
+		}
+	}
+}
+
+template<typename Height>
+void BasicWaves<Height>::Step(int steps)
+{
+	assert(steps > 0 && steps <= MaxBatchSteps);
+
+	++mVersion;
+
+	// A wave moves at most one cell per step, so within a batch of at most
+	// TileSize steps only the active tiles and their neighbours can change.
+	// Everything else is flat in both buffers and stays that way.
+	auto nearActive = [this](int tr, int tc)
+	{
+		for(int r = std::max(tr - 1, 0); r <= std::min(tr + 1, mTileRows - 1); ++r)
+		{
+			for(int c = std::max(tc - 1, 0); c <= std::min(tc + 1, mTileCols - 1); ++c)
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				if(mTileActive[r*mTileCols + c])
+					return true;
 			}
-		});
+		}
+		return false;
+	};
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
+	// The tiles to step, and per tile row the column spans they cover.
+	mStepTiles.clear();
+	mSpans.clear();
+	mSpanOffsets.assign(1, 0);
+	for(int tr = 0; tr < mTileRows; ++tr)
+	{
+		int spanStart = -1;
+		for(int tc = 0; tc <= mTileCols; ++tc)
+		{
+			if(tc < mTileCols && nearActive(tr, tc))
+			{
+				mStepTiles.push_back(tr*mTileCols + tc);
+				if(spanStart < 0)
+					spanStart = tc;
+			}
+			else if(spanStart >= 0)
+			{
+				// Only update interior points; we use zero boundary conditions.
+				mSpans.push_back(std::max(spanStart*TileSize, 1));
+				mSpans.push_back(std::min(tc*TileSize, mNumCols - 1));
+				spanStart = -1;
+			}
+		}
+		mSpanOffsets.push_back((int)mSpans.size() / 2);
+	}
+
+	if(mStepTiles.empty())
+		return;
+
+	// Temporal blocking: instead of sweeping the whole grid once per step, each
+	// band of rows runs all steps of the batch while its rows are still in
+	// cache.  Step k of a band needs step k - 1 one row beyond it, so at every
+	// edge shared with another band it computes one row less per step (a
+	// trapezoid) and bands never touch each other's rows.
+	//
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to
+	// keep consistent with our row indices going down.
+	int bandCount = (int)mBands.size() - 1;
+	mScheduler->ParallelFor(0, bandCount, 1, [this, steps, bandCount](int b)
+	{
+		for(int k = 0; k < steps; ++k)
+		{
+			int i0 = b == 0 ? 1 : mBands[b] + k;
+			int i1 = b == bandCount - 1 ? mNumRows - 1 : mBands[b + 1] - k;
+			StepRows(k, i0, i1);
+		}
+	});
+
+	// Then fill the triangles left around every shared edge.  The rows they
+	// read were finished above, and bands are at least 2*MaxBatchSteps rows high,
+	// so the triangles are disjoint.
+	mScheduler->ParallelFor(1, bandCount, 1, [this, steps](int b)
+	{
+		int edge = mBands[b];
+		for(int k = 1; k < steps; ++k)
+			StepRows(k, edge - k, edge + k);
+	});
+
+	// The last step went to the previous buffer when steps is odd, so it needs
+	// to become the current solution and the old current solution becomes the
+	// new previous solution.
+	if(steps & 1)
 		std::swap(mPrevSolution, mCurrSolution);
 
-		t = 0.0f; // reset time
+	int stepTileCount = (int)mStepTiles.size();
+
+	//
+	// Measure the activity of every stepped tile.  Normals are not kept, they
+	// are computed from the heights when a tile is emitted.
+	//
+	mScheduler->ParallelFor(0, stepTileCount, mTileGrain, [this](int k)
+	{
+		int tile = mStepTiles[k];
+		int i0, i1, j0, j1;
+		TileBounds(tile, i0, i1, j0, j1);
+
+		float energy = 0.0f;
+		for(int i = i0; i < i1; ++i)
+		{
+			energy = std::max(energy, MaxAbsHeight(&mCurrSolution[i*mNumCols + j0], j1 - j0));
+			energy = std::max(energy, MaxAbsHeight(&mPrevSolution[i*mNumCols + j0], j1 - j0));
+		}
+
+		bool wasActive = mTileActive[tile] != 0;
+		if(energy >= mRestThreshold)
+		{
+			mTileActive[tile] = 1;
+			mTileVersion[tile] = mVersion;
+			return;
+		}
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+		// Came to rest (or never moved).  No other task reads this tile here,
+		// so it can be flattened right away.
+		mTileActive[tile] = 0;
+		if(wasActive || energy > 0.0f)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			for(int i = i0; i < i1; ++i)
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				int row = i*mNumCols;
+				std::fill(&mPrevSolution[row + j0], &mPrevSolution[row + j1], Height(0));
+				std::fill(&mCurrSolution[row + j0], &mCurrSolution[row + j1], Height(0));
 			}
-		});
-	}
+			mTileVersion[tile] = mVersion;
+		}
+	});
 }
 
-void Waves::Disturb(int i, int j, float magnitude)
+template<typename Height>
+void BasicWaves<Height>::Disturb(int i, int j, float magnitude)
 {
 	// Don't disturb boundaries.
 	assert(i > 1 && i < mNumRows-2);
@@ -163,10 +669,281 @@ void Waves::Disturb(int i, int j, float magnitude)
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	AddHeight(mCurrSolution[i*mNumCols+j],     magnitude);
+	AddHeight(mCurrSolution[i*mNumCols+j+1],   halfMag);
+	AddHeight(mCurrSolution[i*mNumCols+j-1],   halfMag);
+	AddHeight(mCurrSolution[(i+1)*mNumCols+j], halfMag);
+	AddHeight(mCurrSolution[(i-1)*mNumCols+j], halfMag);
+
+	// Wake up every tile the splat touched.
+	++mVersion;
+	MarkActive(i, j);
+	MarkActive(i, j+1);
+	MarkActive(i, j-1);
+	MarkActive(i+1, j);
+	MarkActive(i-1, j);
 }
-	
+
+template<typename Height>
+void BasicWaves<Height>::SplatBounds(const Impulse& impulse, int& ci, int& cj, int& reach)const
+{
+	ci = std::min(std::max(impulse.Row, 1), mNumRows - 2);
+	cj = std::min(std::max(impulse.Col, 1), mNumCols - 2);
+	reach = std::min(std::max((int)ceilf(impulse.Radius), 0), MaxSplatRadius);
+}
+
+template<typename Height>
+void BasicWaves<Height>::DisturbBatch(const Impulse* impulses, int count)
+{
+	// Nothing but boundary.
+	if(count <= 0 || mNumRows < 3 || mNumCols < 3)
+		return;
+
+	++mVersion;
+
+	// Bucket the impulses by every tile their footprint overlaps.  This is a
+	// counting sort, so each tile still applies its impulses in the given order.
+	int tileCount = mTileRows*mTileCols;
+	mSplatOffsets.assign(tileCount + 1, 0);
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		for(int k = 0; k < count; ++k)
+		{
+			int ci, cj, reach;
+			SplatBounds(impulses[k], ci, cj, reach);
+
+			int tr0 = std::max(ci - reach, 1) / TileSize;
+			int tr1 = std::min(ci + reach, mNumRows - 2) / TileSize;
+			int tc0 = std::max(cj - reach, 1) / TileSize;
+			int tc1 = std::min(cj + reach, mNumCols - 2) / TileSize;
+			for(int tr = tr0; tr <= tr1; ++tr)
+			{
+				for(int tc = tc0; tc <= tc1; ++tc)
+				{
+					int tile = tr*mTileCols + tc;
+					if(pass == 0)
+						++mSplatOffsets[tile + 1];
+					else
+						mSplatItems[mSplatCursor[tile]++] = k;
+				}
+			}
+		}
+
+		if(pass == 0)
+		{
+			mSplatTiles.clear();
+			for(int tile = 0; tile < tileCount; ++tile)
+			{
+				if(mSplatOffsets[tile + 1] > 0)
+					mSplatTiles.push_back(tile);
+				mSplatOffsets[tile + 1] += mSplatOffsets[tile];
+			}
+			mSplatItems.resize(mSplatOffsets[tileCount]);
+			mSplatCursor.assign(mSplatOffsets.begin(), mSplatOffsets.end() - 1);
+		}
+	}
+
+	mScheduler->ParallelFor(0, (int)mSplatTiles.size(), 1, [this, impulses](int k)
+	{
+		int tile = mSplatTiles[k];
+		int ti0, ti1, tj0, tj1;
+		TileBounds(tile, ti0, ti1, tj0, tj1);
+
+		for(int s = mSplatOffsets[tile]; s < mSplatOffsets[tile + 1]; ++s)
+		{
+			const Impulse& impulse = impulses[mSplatItems[s]];
+			int ci, cj, reach;
+			SplatBounds(impulse, ci, cj, reach);
+
+			// The part of the footprint inside this tile and off the boundary.
+			int i0 = std::max(std::max(ci - reach, 1), ti0);
+			int i1 = std::min(std::min(ci + reach + 1, mNumRows - 1), ti1);
+			int j0 = std::max(std::max(cj - reach, 1), tj0);
+			int j1 = std::min(std::min(cj + reach + 1, mNumCols - 1), tj1);
+
+			// exp(-d^2 / (2 sigma^2)) with sigma = radius/3, from the capped radius
+			// so the bump fades out within the footprint.  The Gaussian is
+			// separable, so one weight per column and one per row.
+			float radius = std::min(impulse.Radius, (float)MaxSplatRadius);
+			float falloff = radius > 0.0f ? 4.5f / (radius*radius) : 0.0f;
+			float colWeight[2*MaxSplatRadius + 1];
+			for(int j = j0; j < j1; ++j)
+				colWeight[j - j0] = expf(-falloff*float((j - cj)*(j - cj)));
+
+			for(int i = i0; i < i1; ++i)
+			{
+				float rowWeight = impulse.Magnitude*expf(-falloff*float((i - ci)*(i - ci)));
+				float h[2*MaxSplatRadius + 1];
+				DecodeHeights(&mCurrSolution[i*mNumCols + j0], h, j1 - j0);
+				for(int j = j0; j < j1; ++j)
+					h[j - j0] += rowWeight*colWeight[j - j0];
+				EncodeHeights(h, &mCurrSolution[i*mNumCols + j0], j1 - j0);
+			}
+		}
+
+		mTileActive[tile] = 1;
+		mTileVersion[tile] = mVersion;
+	});
+}
+
+template<typename Height>
+void BasicWaves<Height>::SetOutputBuffers(Vertex* const* buffers, int bufferCount)
+{
+	mOutputs.clear();
+	for(int b = 0; b < bufferCount; ++b)
+	{
+		// Version 0 is older than every tile, so the first EmitVertices into a
+		// new buffer writes the whole grid.
+		OutputBuffer output = { buffers[b], 0 };
+		mOutputs.push_back(output);
+
+		EmitTexCoords(buffers[b]);
+	}
+}
+
+template<typename Height>
+void BasicWaves<Height>::EmitVertices(int buffer)
+{
+	assert(buffer >= 0 && buffer < (int)mOutputs.size());
+
+	OutputBuffer& output = mOutputs[buffer];
+	Vertex* dst = output.Data;
+
+	// A tile's border normals depend on the heights of its neighbours, so a
+	// change also makes the tiles around it stale.
+	mEmitTiles.clear();
+	for(int tr = 0; tr < mTileRows; ++tr)
+	{
+		for(int tc = 0; tc < mTileCols; ++tc)
+		{
+			bool stale = false;
+			for(int r = std::max(tr - 1, 0); r <= std::min(tr + 1, mTileRows - 1) && !stale; ++r)
+			{
+				for(int c = std::max(tc - 1, 0); c <= std::min(tc + 1, mTileCols - 1); ++c)
+					stale = stale || mTileVersion[r*mTileCols + c] > output.Version;
+			}
+
+			if(stale)
+				mEmitTiles.push_back(tr*mTileCols + tc);
+		}
+	}
+
+	float halfWidth = (mNumCols - 1)*mSpatialStep*0.5f;
+	float halfDepth = (mNumRows - 1)*mSpatialStep*0.5f;
+	float twoDx = 2.0f*mSpatialStep;
+
+	// One pass over the heights of each stale tile, straight into dst; normals
+	// and tangents are only ever computed here.  The upload heap is
+	// write-combined, it is only ever written, never read back.
+	mScheduler->ParallelFor(0, (int)mEmitTiles.size(), mTileGrain, [&](int k)
+	{
+		int i0, i1, j0, j1;
+		TileBounds(mEmitTiles[k], i0, i1, j0, j1);
+
+		for(int i = i0; i < i1; ++i)
+		{
+			int row = i*mNumCols;
+			float z = halfDepth - i*mSpatialStep;
+
+			float h[TileSize];
+			DecodeHeights(&mCurrSolution[row + j0], h, j1 - j0);
+
+			// The boundary is held flat: up normals, +x tangents.
+			float nx[TileSize] = {}, ny[TileSize], nz[TileSize] = {};
+			float tx[TileSize], ty[TileSize] = {};
+			std::fill(ny, ny + TileSize, 1.0f);
+			std::fill(tx, tx + TileSize, 1.0f);
+
+			// Finite difference scheme for the interior points.
+			int a = std::max(j0, 1);
+			int b = std::min(j1, mNumCols - 1);
+			if(i > 0 && i < mNumRows - 1 && a < b)
+			{
+				const Height* curr = &mCurrSolution[row + a];
+				int o = a - j0;
+				NormalRowT(curr - mNumCols, curr, curr + mNumCols,
+					nx + o, ny + o, nz + o, tx + o, ty + o, 0, b - a, twoDx);
+			}
+
+			Vertex* v = dst + row + j0;
+			for(int j = 0; j < j1 - j0; ++j)
+			{
+				v[j].Pos.x = -halfWidth + (j0 + j)*mSpatialStep;
+				v[j].Pos.y = h[j];
+				v[j].Pos.z = z;
+				v[j].Normal.x = nx[j];
+				v[j].Normal.y = ny[j];
+				v[j].Normal.z = nz[j];
+				v[j].TangentU.x = tx[j];
+				v[j].TangentU.y = ty[j];
+				v[j].TangentU.z = 0.0f;
+			}
+		}
+	});
+
+	// Turn the stale tiles into byte ranges.  Runs of neighbouring tiles in a
+	// tile row become one span per grid row, and spans that touch are merged, so
+	// a fully stale band collapses into a single range.
+	mDirtyRanges.clear();
+	for(size_t k = 0; k < mEmitTiles.size(); )
+	{
+		int tr = mEmitTiles[k] / mTileCols;
+		size_t first = k;
+		while(k < mEmitTiles.size() && mEmitTiles[k] / mTileCols == tr)
+			++k;
+
+		int i0 = tr*TileSize;
+		int i1 = std::min(i0 + TileSize, mNumRows);
+		for(int i = i0; i < i1; ++i)
+		{
+			for(size_t s = first; s < k; )
+			{
+				int c0 = mEmitTiles[s] - tr*mTileCols;
+				int c1 = c0 + 1;
+				for(++s; s < k && mEmitTiles[s] - tr*mTileCols == c1; ++s)
+					++c1;
+
+				int j0 = c0*TileSize;
+				int j1 = std::min(c1*TileSize, mNumCols);
+				DirtyRange range = { (size_t(i)*mNumCols + j0)*sizeof(Vertex), size_t(j1 - j0)*sizeof(Vertex) };
+
+				if(!mDirtyRanges.empty() && mDirtyRanges.back().Offset + mDirtyRanges.back().Size == range.Offset)
+					mDirtyRanges.back().Size += range.Size;
+				else
+					mDirtyRanges.push_back(range);
+			}
+		}
+	}
+
+	output.Version = mVersion;
+}
+
+template<typename Height>
+const std::vector<typename BasicWaves<Height>::DirtyRange>& BasicWaves<Height>::DirtyRanges()const
+{
+	return mDirtyRanges;
+}
+
+template<typename Height>
+void BasicWaves<Height>::EmitTexCoords(Vertex* dst)const
+{
+	float halfWidth = (mNumCols - 1)*mSpatialStep*0.5f;
+	float halfDepth = (mNumRows - 1)*mSpatialStep*0.5f;
+	float width = Width();
+	float depth = Depth();
+
+	for(int i = 0; i < mNumRows; ++i)
+	{
+		float z = halfDepth - i*mSpatialStep;
+		for(int j = 0; j < mNumCols; ++j)
+		{
+			float x = -halfWidth + j*mSpatialStep;
+			dst[i*mNumCols + j].TexC.x = 0.5f + x / width;
+			dst[i*mNumCols + j].TexC.y = 0.5f - z / depth;
+		}
+	}
+}
+
+template class BasicWaves<float>;
+template class BasicWaves<HALF>;
+template class BasicWaves<std::int16_t>;
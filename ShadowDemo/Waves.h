@@ -10,15 +10,28 @@
 #define WAVES_H
 
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 #include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include "Vertex.h"
 
-class Waves
+class TaskScheduler;
+
+// Height is the storage type of the two solution buffers:
+//   float                           full precision
+//   DirectX::PackedVector::HALF     16-bit float
+//   std::int16_t                    Q3.12 fixed point, heights within +-8 with a 1/4096 step
+// All arithmetic is done in float; the 16-bit formats halve the memory the
+// stencil streams through at the cost of precision.
+template<typename Height>
+class BasicWaves
 {
 public:
-    Waves(int m, int n, float dx, float dt, float speed, float damping);
-    Waves(const Waves& rhs) = delete;
-    Waves& operator=(const Waves& rhs) = delete;
-    ~Waves();
+    BasicWaves(int m, int n, float dx, float dt, float speed, float damping);
+    BasicWaves(const BasicWaves& rhs) = delete;
+    BasicWaves& operator=(const BasicWaves& rhs) = delete;
+    ~BasicWaves();
 
 	int RowCount()const;
 	int ColumnCount()const;
@@ -27,18 +40,82 @@ public:
 	float Width()const;
 	float Depth()const;
 
-	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+	// Returns the solution at the ith grid point.  Only the height is simulated;
+	// x and z are reconstructed from the grid index.
+    DirectX::XMFLOAT3 Position(int i)const;
 
-	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+	// Returns the solution normal at the ith grid point, computed from the heights.
+    DirectX::XMFLOAT3 Normal(int i)const;
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+    DirectX::XMFLOAT3 TangentX(int i)const;
+
+	// Runs the row loops on scheduler (the shared pool by default), handing out
+	// at least rowGrain rows per task.  rowGrain <= 0 picks a grain from the grid width.
+	void SetScheduler(TaskScheduler* scheduler, int rowGrain = 0);
+
+	// Tiles whose heights stay below this magnitude are put to rest: they are
+	// flattened and skipped by the update and EmitVertices until a wave or a
+	// Disturb reaches them.
+	void SetRestThreshold(float threshold);
 
+	// An Update that falls more than maxSubsteps steps behind drops the excess
+	// time instead of catching up.  maxSubsteps <= 0 removes the cap.
+	void SetMaxSubsteps(int maxSubsteps);
+
+	// Fraction of a time step accumulated but not simulated yet, in [0, 1).
+	// The simulated surface lags real time by this much.
+	float InterpolationAlpha()const;
+
+	// Advances the simulation by whole time steps covering dt plus the time left
+	// over from previous calls.
 	void Update(float dt);
+
+	// Runs exactly steps time steps, ignoring the accumulated time.
+	void Simulate(int steps);
+
 	void Disturb(int i, int j, float magnitude);
 
+	// A Gaussian bump centred on grid point (Row, Col).  Radius is in cells and
+	// is where the bump has fallen to about 1% of Magnitude; it is capped at
+	// MaxSplatRadius.  A radius of 0 raises the centre point alone.
+	struct Impulse
+	{
+		int Row;
+		int Col;
+		float Magnitude;
+		float Radius;
+	};
+
+	static const int MaxSplatRadius = 32;
+
+	// Applies count impulses in one pass, bucketed by tile so every tile is
+	// visited once.  Centres outside the grid are clamped onto it and splats are
+	// clipped at the boundary, which stays at zero.
+	void DisturbBatch(const Impulse* impulses, int count);
+
+	// Bytes [Offset, Offset + Size) of a vertex buffer written by EmitVertices.
+	struct DirtyRange
+	{
+		std::size_t Offset;
+		std::size_t Size;
+	};
+
+	// The vertex buffers the surface is written into, typically one mapped upload
+	// buffer per frame in flight.  They are owned by the caller, hold VertexCount()
+	// vertices each and must stay valid until replaced or the Waves is destroyed.
+	// Their static texture coordinates, mapping [-w/2,w/2] --> [0,1], are written
+	// here.
+	void SetOutputBuffers(Vertex* const* buffers, int bufferCount);
+
+	// Brings output buffer up to date with the current solution: Pos, Normal and
+	// TangentU of the tiles that changed since it was last written.  Normals are
+	// not stored; they are computed from the heights on the way out.
+	void EmitVertices(int buffer);
+
+	// Byte ranges written by the last EmitVertices call, merged and in order.
+	const std::vector<DirtyRange>& DirtyRanges()const;
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -54,10 +131,64 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    float mAccumulator = 0.0f;
+    int mMaxSubsteps = 8;
+
+    TaskScheduler* mScheduler = nullptr;
+    int mRowGrain = 1;
+    int mTileGrain = 1;
+
+    // Only the heights are kept.  x and z follow from the grid index, normals
+    // and tangents are written straight into the output buffers.
+    std::vector<Height> mPrevSolution;
+    std::vector<Height> mCurrSolution;
+
+    // Activity tracking.  The grid is split into TileSize x TileSize tiles; a tile
+    // at rest is exactly flat in both solution buffers.
+    static const int TileSize = 32;
+    int mTileRows = 0;
+    int mTileCols = 0;
+    float mRestThreshold = 1e-4f;
+    std::vector<unsigned char> mTileActive;
+    std::vector<std::uint64_t> mTileVersion;	// surface version of the tile's last change
+    std::vector<int> mStepTiles;				// scratch: tiles simulated by the current step
+    std::uint64_t mVersion = 1;
+
+    // Output buffers and the surface version each of them holds.
+    struct OutputBuffer
+    {
+        Vertex* Data;
+        std::uint64_t Version;
+    };
+    std::vector<OutputBuffer> mOutputs;
+
+    std::vector<int> mEmitTiles;
+    std::vector<DirtyRange> mDirtyRanges;
+
+    // Batched stepping.  Rows are split into bands at least 2*MaxBatchSteps high,
+    // and a batch only steps the column spans of the tiles in mStepTiles.
+    static const int MaxBatchSteps = TileSize / 2;
+    std::vector<int> mBands;			// first row of every band, then mNumRows
+    std::vector<int> mSpans;			// [j0, j1) pairs
+    std::vector<int> mSpanOffsets;		// first span of every tile row, then the span count
+
+    // DisturbBatch scratch: impulse indices bucketed by tile.
+    std::vector<int> mSplatOffsets;		// first item of every tile, then the item count
+    std::vector<int> mSplatCursor;
+    std::vector<int> mSplatItems;
+    std::vector<int> mSplatTiles;		// tiles hit by the current batch
+
+    void Step(int steps);
+    void SplatBounds(const Impulse& impulse, int& ci, int& cj, int& reach)const;
+    void StepRows(int k, int i0, int i1);
+    void MarkActive(int i, int j);
+    void Slopes(int i, float& dx, float& dz)const;
+    void EmitTexCoords(Vertex* dst)const;
+    void TileBounds(int tile, int& i0, int& i1, int& j0, int& j1)const;
 };
 
+typedef BasicWaves<float> Waves;
+typedef BasicWaves<DirectX::PackedVector::HALF> HalfWaves;
+typedef BasicWaves<std::int16_t> FixedWaves;
+
 #endif // WAVES_H
\ No newline at end of file